@@ -205,6 +205,7 @@ void btrack_dsp(t_btrack *x, t_signal **sp, short *count)
     
     // initialise the beat tracker
     x->b->updateHopAndFrameSize(hopSize, frameSize);
+    x->b->updateSampleRate((int) sp[0]->s_sr);
     
     // set up dsp
 	dsp_add(btrack_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
@@ -222,6 +223,7 @@ void btrack_dsp64(t_btrack *x, t_object *dsp64, short *count, double samplerate,
     
     // initialise the beat tracker
     x->b->updateHopAndFrameSize(hopSize, frameSize);
+    x->b->updateSampleRate((int) samplerate);
 		
     // set up dsp
 	object_method(dsp64, gensym("dsp_add64"), x, btrack_perform64, 0, NULL);
@@ -9,8 +9,9 @@ static PyObject * btrack_trackBeats(PyObject *dummy, PyObject *args)
 {
     PyObject *arg1=NULL;
     PyObject *arr1=NULL;
+    int sampleRate = 44100;
     
-    if (!PyArg_ParseTuple(args, "O", &arg1))
+    if (!PyArg_ParseTuple(args, "O|i", &arg1, &sampleRate))
     {
         return NULL;
     }
@@ -36,55 +37,24 @@ static PyObject * btrack_trackBeats(PyObject *dummy, PyObject *args)
     int hopSize = 512;
     int frameSize = 1024;
     
-    int numframes;
-    double buffer[hopSize];	// buffer to hold one hopsize worth of audio samples
-    
-    
-    // get number of audio frames, given the hop size and signal length
-	numframes = (int) floor(((double) signal_length) / ((double) hopSize));
-    
+    BTrack b(hopSize,frameSize,sampleRate);
     
-    BTrack b(hopSize,frameSize);
+    std::vector<long> beatFrames;
+    std::vector<double> tempi;
     
+    // track the whole signal at once, reading each hop straight from the array
+    b.trackBeats(data,signal_length,beatFrames,tempi);
     
-    double beats[5000];
-    int beatnum = 0;
-    
-    ///////////////////////////////////////////
-	//////// Begin Processing Loop ////////////
-	
-	for (int i=0;i < numframes;i++)
-	{
-		// add new samples to frame
-		for (int n = 0;n < hopSize;n++)
-		{
-			buffer[n] = data[(i*hopSize)+n];
-		}
-		
-        // process the current audio frame
-        b.processAudioFrame(buffer);
-        
-        // if a beat is currently scheduled
-		if (b.beatDueInCurrentFrame())
-		{
-			beats[beatnum] = BTrack::getBeatTimeInSeconds(i,hopSize,44100);
-            beatnum = beatnum + 1;
-		}
-		
-	}
-	
-	///////// End Processing Loop /////////////
-	///////////////////////////////////////////
-    
+    int beatnum = (int) beatFrames.size();
     
     ////////// END PROCESS ///////////////////
     
-    double beats_out[beatnum];          // create output array
+    std::vector<double> beats_out(beatnum);          // create output array
     
-    // copy beats into output array
+    // convert the beat frames to times
     for (int i = 0;i < beatnum;i++)
     {
-        beats_out[i] = beats[i];
+        beats_out[i] = BTrack::getBeatTimeInSeconds(beatFrames[i],hopSize,sampleRate);
     }
     
     
@@ -98,7 +68,10 @@ static PyObject * btrack_trackBeats(PyObject *dummy, PyObject *args)
     
     void *arr_data = PyArray_DATA((PyArrayObject*)c);
     
-    memcpy(arr_data, beats_out, PyArray_ITEMSIZE((PyArrayObject*) c) * m);
+    if (beatnum > 0)
+    {
+        memcpy(arr_data, &beats_out[0], PyArray_ITEMSIZE((PyArrayObject*) c) * m);
+    }
     
     
     Py_DECREF(arr1);
@@ -199,8 +172,9 @@ static PyObject * btrack_trackBeatsFromOnsetDF(PyObject *dummy, PyObject *args)
 {
     PyObject *arg1=NULL;
     PyObject *arr1=NULL;
+    int sampleRate = 44100;
     
-    if (!PyArg_ParseTuple(args, "O", &arg1)) 
+    if (!PyArg_ParseTuple(args, "O|i", &arg1, &sampleRate)) 
     {
         return NULL;
     }
@@ -225,45 +199,36 @@ static PyObject * btrack_trackBeatsFromOnsetDF(PyObject *dummy, PyObject *args)
     int hopSize = 512;
     int frameSize = 2*hopSize;
 
-    BTrack b(hopSize,frameSize);
+    BTrack b(hopSize,frameSize,sampleRate);
     
-    double beats[5000];
-    int beatnum = 0;
-    double df_val;
+    // the detection function is offset slightly, as it always has been, so that it is never exactly zero
+    std::vector<double> df(numframes);
     
-    ///////////////////////////////////////////
-	//////// Begin Processing Loop ////////////
-	
-	for (long i=0;i < numframes;i++)
-	{		
-        df_val = data[i] + 0.0001;
-        
-		b.processOnsetDetectionFunctionSample(df_val);				// process df sample in beat tracker
-		
-		if (b.beatDueInCurrentFrame())
-		{
-            beats[beatnum] = BTrack::getBeatTimeInSeconds(i,hopSize,44100);
-			beatnum = beatnum + 1;	
-		}
-		
-	}
-	
-	///////// End Processing Loop /////////////
-	///////////////////////////////////////////
+    for (long i = 0;i < numframes;i++)
+    {
+        df[i] = data[i] + 0.0001;
+    }
     
+    std::vector<long> beatFrames;
+    std::vector<double> tempi;
     
-    ////////// END PROCESS ///////////////////
+    // track the whole detection function at once
+    b.trackBeatsInOnsetDetectionFunction(df.data(),numframes,beatFrames,tempi);
     
-    double beats_out[beatnum];          // create output array
+    int beatnum = (int) beatFrames.size();
     
+    ////////// END PROCESS ///////////////////
+    
+    std::vector<double> beats_out(beatnum);          // create output array
     
-    // copy beats into output array
-    for (int i = 0;i < beatnum;i++)     
+    // convert the beat frames to times
+    for (int i = 0;i < beatnum;i++)
     {
-        beats_out[i] = beats[i];
+        beats_out[i] = BTrack::getBeatTimeInSeconds(beatFrames[i],hopSize,sampleRate);
     }
     
     
+    
     ////////// CREATE ARRAY AND RETURN IT ///////////////////
     int nd=1;
     npy_intp m= beatnum;
@@ -273,7 +238,10 @@ static PyObject * btrack_trackBeatsFromOnsetDF(PyObject *dummy, PyObject *args)
     
     void *arr_data = PyArray_DATA((PyArrayObject*)c);
     
-    memcpy(arr_data, beats_out, PyArray_ITEMSIZE((PyArrayObject*) c) * m); 
+    if (beatnum > 0)
+    {
+        memcpy(arr_data, &beats_out[0], PyArray_ITEMSIZE((PyArrayObject*) c) * m);
+    }
     
     
     Py_DECREF(arr1);  
@@ -286,8 +254,8 @@ static PyObject * btrack_trackBeatsFromOnsetDF(PyObject *dummy, PyObject *args)
 //=======================================================================
 static PyMethodDef btrack_methods[] = {
     { "calculateOnsetDF",btrack_calculateOnsetDF,METH_VARARGS,"Calculate the onset detection function"},
-    { "trackBeats",btrack_trackBeats,METH_VARARGS,"Track beats from audio"},
-    { "trackBeatsFromOnsetDF",btrack_trackBeatsFromOnsetDF,METH_VARARGS,"Track beats from an onset detection function"},
+    { "trackBeats",btrack_trackBeats,METH_VARARGS,"Track beats from audio, with an optional sampling frequency (default 44100)"},
+    { "trackBeatsFromOnsetDF",btrack_trackBeatsFromOnsetDF,METH_VARARGS,"Track beats from an onset detection function, with an optional sampling frequency (default 44100)"},
     {NULL, NULL, 0, NULL} /* Sentinel */
 };
 
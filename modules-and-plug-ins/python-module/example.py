@@ -16,8 +16,8 @@ if (audioData[0].size == 2):
     data = np.average(data,axis=1)
 
 # ==========================================    
-# Usage A: track beats from audio            
-beats = btrack.trackBeats(audioData)    
+# Usage A: track beats from audio, at its own sampling frequency
+beats = btrack.trackBeats(audioData, fs)    
 
 # ==========================================
 # Usage B: extract the onset detection function
@@ -25,4 +25,4 @@ onsetDF = btrack.calculateOnsetDF(audioData)
 
 # ==========================================
 # Usage C: track beats from the onset detection function (calculated in Usage B)
-ODFbeats = btrack.trackBeatsFromOnsetDF(onsetDF)
+ODFbeats = btrack.trackBeatsFromOnsetDF(onsetDF, fs)
@@ -4,9 +4,10 @@ from numpy.distutils.core import setup, Extension
 import os, numpy
 
 name = 'btrack'
-sources = ['btrack_python_module.cpp','../../src/OnsetDetectionFunction.cpp','../../src/BTrack.cpp']
+sources = ['btrack_python_module.cpp','../../src/OnsetDetectionFunction.cpp','../../src/SpectralKernels.cpp','../../src/FFTCache.cpp','../../src/BTrack.cpp']
 
 sources.append ('../../libs/kiss_fft130/kiss_fft.c')
+sources.append ('../../libs/kiss_fft130/kiss_fftr.c')
 
 include_dirs = [
                 numpy.get_include(),'/usr/local/include'
@@ -16,6 +17,6 @@ include_dirs.append ('../../libs/kiss_fft130')
 
 setup( name = 'BTrack',
       include_dirs = include_dirs,
-      ext_modules = [Extension(name, sources,libraries = ['fftw3','samplerate'],library_dirs = ['/usr/local/lib'],define_macros=[
+      ext_modules = [Extension(name, sources,libraries = ['fftw3'],library_dirs = ['/usr/local/lib'],define_macros=[
                          ('USE_FFTW', None)])]
       )
\ No newline at end of file
@@ -199,6 +199,7 @@ BTrackVamp::initialise(size_t channels, size_t stepSize, size_t blockSize)
     m_blockSize = blockSize;
     
     b.updateHopAndFrameSize(m_stepSize,m_blockSize);
+    b.updateSampleRate(int(m_inputSampleRate + 0.5));
     
 
     return true;
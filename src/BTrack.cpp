@@ -21,45 +21,238 @@
 
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include "BTrack.h"
-#include "samplerate.h"
 #include <iostream>
 
+#if defined (__APPLE__)
+#include <dispatch/dispatch.h>
+#elif defined (__unix__)
+#include <errno.h>
+#include <semaphore.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+//=======================================================================
+/** A counting semaphore that wakes the tempo worker. Posting to it never waits for the worker,
+ * and a post made just before the worker starts to wait is never lost, so the worker can sleep
+ * until it is needed. Where there is no semaphore from the system, a post takes a lock, which is
+ * only ever held briefly by the worker
+ */
+class TempoWorkerSemaphore
+{
+public:
+    TempoWorkerSemaphore()
+    {
+#if defined (__APPLE__)
+        semaphore = dispatch_semaphore_create (0);
+#elif defined (__unix__)
+        sem_init (&semaphore, 0, 0);
+#else
+        count = 0;
+#endif
+    }
+
+    ~TempoWorkerSemaphore()
+    {
+#if defined (__APPLE__)
+        dispatch_release (semaphore);
+#elif defined (__unix__)
+        sem_destroy (&semaphore);
+#endif
+    }
+
+    /** Wake the worker, or stop its next wait from blocking */
+    void post()
+    {
+#if defined (__APPLE__)
+        dispatch_semaphore_signal (semaphore);
+#elif defined (__unix__)
+        sem_post (&semaphore);
+#else
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            count++;
+        }
+
+        condition.notify_one();
+#endif
+    }
+
+    /** Block until the semaphore has been posted to */
+    void wait()
+    {
+#if defined (__APPLE__)
+        dispatch_semaphore_wait (semaphore, DISPATCH_TIME_FOREVER);
+#elif defined (__unix__)
+        while (sem_wait (&semaphore) != 0 && errno == EINTR)
+        {
+        }
+#else
+        std::unique_lock<std::mutex> lock (mutex);
+        condition.wait (lock, [this] { return count > 0; });
+        count--;
+#endif
+    }
+
+private:
+#if defined (__APPLE__)
+    dispatch_semaphore_t semaphore;
+#elif defined (__unix__)
+    sem_t semaphore;
+#else
+    std::mutex mutex;
+    std::condition_variable condition;
+    int count;
+#endif
+};
+
+//=======================================================================
+/** The thread, and the state shared with it, used to estimate the tempo asynchronously.
+ * The audio thread and the worker hand the tempo estimation buffers and the tempo
+ * probabilities back and forth through the state: the worker only touches them while a
+ * request is in progress
+ */
+struct TempoWorker
+{
+    enum State
+    {
+        Idle,                   /**< the buffers belong to the audio thread, and no estimate is in progress */
+        Requested,              /**< the buffers belong to the worker, which is calculating an estimate */
+        Done                    /**< the buffers belong to the audio thread, and tempoIndex holds a finished estimate */
+    };
+    
+    std::thread thread;
+    TempoWorkerSemaphore wakeUp;
+    std::atomic<int> state;
+    std::atomic<bool> shouldExit;
+    
+    /** Set by the audio thread if the estimate in progress is out of date, e.g. after setTempo() */
+    bool discardResult;
+    
+    /** The most likely tempo state found by the worker, or -1 if no tempo was possible */
+    int tempoIndex;
+    
+    /** The tempo state passed to setTempo() while the worker was busy, or -1 if none */
+    int pendingTempoIndex;
+    
+    /** The tempo state passed to fixTempo() while the worker was busy, or -1 if none */
+    int pendingFixedTempoIndex;
+    
+    /** True if fixTempo() or doNotFixTempo() was called while the worker was busy */
+    bool hasPendingTempoFix;
+    
+    /** The tempo fix flag from the last of those calls */
+    bool pendingTempoFixed;
+};
+
+//=======================================================================
+/** The comb filter bank as a sparse matrix, one row for each beat period from 2 to 127, with one
+ * entry for each of the 16 comb elements. Each coefficient folds together the rayleigh weighting
+ * of the row and the normalisation of its comb element. The matrix is the same for every instance,
+ * so is calculated once, the first time it is needed.
+ */
+struct CombFilterBankMatrix
+{
+    enum
+    {
+        NumRows = 126,
+        NumEntriesPerRow = 16
+    };
+    
+    CombFilterBankMatrix()
+    {
+        double rayparam = 43;
+        
+        for (int i = 2; i <= 127; i++) // max beat period
+        {
+            int row = i - 2;
+            int entry = 0;
+            double weighting = ((double) (i-1) / pow(rayparam,2)) * exp((-1*pow((double)-(i-1),2)) / (2*pow(rayparam,2)));
+            
+            for (int a = 1; a <= 4; a++) // number of comb elements
+            {
+                for (int b = 1-a; b <= a-1; b++) // general state using normalisation of comb elements
+                {
+                    indices[entry * NumRows + row] = (a*i+b)-1;
+                    coefficients[entry * NumRows + row] = weighting / (2*a-1);
+                    entry++;
+                }
+            }
+        }
+    }
+    
+    static const CombFilterBankMatrix& get()
+    {
+        static const CombFilterBankMatrix matrix;
+        return matrix;
+    }
+    
+    int indices[NumRows * NumEntriesPerRow];
+    double coefficients[NumRows * NumEntriesPerRow];
+};
+
 //=======================================================================
 BTrack::BTrack()
  :  odf (512, 1024, ComplexSpectralDifferenceHWR, HanningWindow)
 {
-    initialise (512, 1024);
+    initialise (512, 1024, 44100, 80, 160, 2);
 }
 
 //=======================================================================
 BTrack::BTrack (int hopSize_)
  :  odf(hopSize_, 2*hopSize_, ComplexSpectralDifferenceHWR, HanningWindow)
 {	
-    initialise (hopSize_, 2*hopSize_);
+    initialise (hopSize_, 2*hopSize_, 44100, 80, 160, 2);
 }
 
 //=======================================================================
 BTrack::BTrack (int hopSize_, int frameSize_)
  : odf (hopSize_, frameSize_, ComplexSpectralDifferenceHWR, HanningWindow)
 {
-    initialise (hopSize_, frameSize_);
+    initialise (hopSize_, frameSize_, 44100, 80, 160, 2);
+}
+
+//=======================================================================
+BTrack::BTrack (int hopSize_, int frameSize_, int sampleRate_)
+ : odf (hopSize_, frameSize_, ComplexSpectralDifferenceHWR, HanningWindow)
+{
+    initialise (hopSize_, frameSize_, sampleRate_, 80, 160, 2);
+}
+
+//=======================================================================
+BTrack::BTrack (int hopSize_, int frameSize_, double minTempo_, double maxTempo_, double tempoResolution_)
+ : odf (hopSize_, frameSize_, ComplexSpectralDifferenceHWR, HanningWindow)
+{
+    initialise (hopSize_, frameSize_, 44100, minTempo_, maxTempo_, tempoResolution_);
+}
+
+//=======================================================================
+BTrack::BTrack (int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_)
+ : odf (hopSize_, frameSize_, ComplexSpectralDifferenceHWR, HanningWindow)
+{
+    initialise (hopSize_, frameSize_, sampleRate_, minTempo_, maxTempo_, tempoResolution_);
 }
 
 //=======================================================================
 BTrack::~BTrack()
 {
+    // stop the tempo worker before freeing anything it uses
+    setAsynchronousTempoEstimation (false);
+    
+    // release the shared fft plans
+    FFTCache::releasePlan (acfForwardFFT);
+    FFTCache::releasePlan (acfBackwardFFT);
+    
 #ifdef USE_FFTW
-    // destroy fft plan
-    fftw_destroy_plan (acfForwardFFT);
-    fftw_destroy_plan (acfBackwardFFT);
     fftw_free (complexIn);
     fftw_free (complexOut);
 #endif
     
 #ifdef USE_KISS_FFT
-    free (cfgForwards);
-    free (cfgBackwards);
     delete [] fftIn;
     delete [] fftOut;
 #endif
@@ -86,54 +279,57 @@ double BTrack::getBeatTimeInSeconds (int frameNumber, int hopSize, int fs)
 
 
 //=======================================================================
-void BTrack::initialise (int hopSize_, int frameSize_)
+void BTrack::initialise (int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_)
 {
-    double rayparam = 43;
-	double pi = 3.14159265;
 	
+	// use the fastest kernels the processor supports for the cumulative score and comb filter bank
+	kernels = &SpectralKernels::get (SpectralKernels::getFastestSupportedType());
 	
 	// initialise parameters
 	tightness = 5;
 	alpha = 0.9;
-	tempo = 120;
-	estimatedTempo = 120.0;
+	sampleRate = sampleRate_;
+	
+	// the resampled onset detection function always has one sample per 512 samples at 44.1kHz (see setHopSize())
 	tempoToLagFactor = 60.*44100./512.;
 	
+	// the tempo states must map to beat periods (and half beat periods) that the comb filter bank covers
+	tempoResolution = tempoResolution_ > 0 ? tempoResolution_ : 2;
+	minTempo = std::max (minTempo_, tempoToLagFactor / 127.);
+	maxTempo = std::max (minTempo, std::min (maxTempo_, tempoToLagFactor / 4.));
+	numTempoStates = ((int) floor (((maxTempo - minTempo) / tempoResolution) + 1e-9)) + 1;
+	maxTempo = minTempo + (numTempoStates - 1) * tempoResolution;
+	
+	tempoObservationVector.assign (numTempoStates, 0);
+	delta.assign (numTempoStates, 0);
+	logPrevDeltaFixed.assign (numTempoStates, 0);
+	
+	// start at the tempo state nearest to 120 bpm
+	tempo = getTempoOfState (getTempoIndex (120));
+	estimatedTempo = tempo;
+	
 	m0 = 10;
 	beatCounter = -1;
 	
 	beatDueInFrame = false;
 	
 
-	// create rayleigh weighting vector
-	for (int n = 0; n < 128; n++)
-	{
-		weightingVector[n] = ((double) n / pow(rayparam,2)) * exp((-1*pow((double)-n,2)) / (2*pow(rayparam,2)));
-	}
+	// tempo is estimated in processOnsetDetectionFunctionSample() until a worker is started
+	tempoWorker = NULL;
 	
-	// initialise prev_delta
-	for (int i = 0; i < 41; i++)
-	{
-		prevDelta[i] = 1;
-	}
+	// initialise prev_delta, with every tempo equally likely
+	logPrevDelta.assign (numTempoStates, 0);
+	tempoTransitionBandwidth = 0;
 	
-	double t_mu = 41/2;
-	double m_sig;
-	double x;
-	// create tempo transition matrix
-	m_sig = 41/8;
-	for (int i = 0;i < 41;i++)
-	{
-		for (int j = 0;j < 41;j++)
-		{
-			x = j+1;
-			t_mu = i+1;
-			tempoTransitionMatrix[i][j] = (1 / (m_sig * sqrt(2*pi))) * exp( (-1*pow((x-t_mu),2)) / (2*pow(m_sig,2)) );
-		}
-	}
+	// create tempo transition kernel, out to four standard deviations (40 bpm) either side
+	setTempoTransitionBandwidth ((int) round (40. / tempoResolution));
 	
 	// tempo is not fixed
 	tempoFixed = false;
+	
+	// tempo is estimated all at once, on the beat
+	amortiseTempoEstimation = false;
+	tempoEstimationStage = NoTempoEstimationStage;
     
     // initialise latest cumulative score value
     // in case it is requested before any processing takes place
@@ -146,49 +342,198 @@ void BTrack::initialise (int hopSize_, int frameSize_)
     // Set up FFT for calculating the auto-correlation function
     FFTLengthForACFCalculation = 1024;
     
+    // the plans are shared with every other BTrack instance
+    acfForwardFFT = FFTCache::acquirePlan (FFTLengthForACFCalculation, ForwardFFT);
+    acfBackwardFFT = FFTCache::acquirePlan (FFTLengthForACFCalculation, BackwardFFT);
+    
 #ifdef USE_FFTW
     complexIn = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * FFTLengthForACFCalculation);		// complex array to hold fft data
     complexOut = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * FFTLengthForACFCalculation);	// complex array to hold fft data
-    
-    acfForwardFFT = fftw_plan_dft_1d (FFTLengthForACFCalculation, complexIn, complexOut, FFTW_FORWARD, FFTW_ESTIMATE);	// FFT plan initialisation
-    acfBackwardFFT = fftw_plan_dft_1d (FFTLengthForACFCalculation, complexOut, complexIn, FFTW_BACKWARD, FFTW_ESTIMATE);	// FFT plan initialisation
 #endif
     
 #ifdef USE_KISS_FFT
     fftIn = new kiss_fft_cpx[FFTLengthForACFCalculation];
     fftOut = new kiss_fft_cpx[FFTLengthForACFCalculation];
-    cfgForwards = kiss_fft_alloc (FFTLengthForACFCalculation, 0, 0, 0);
-    cfgBackwards = kiss_fft_alloc (FFTLengthForACFCalculation, 1, 0, 0);
 #endif
 }
 
 //=======================================================================
 void BTrack::setHopSize (int hopSize_)
 {	
+	// any tempo estimate in progress was for the old buffer sizes
+	waitForTempoWorker();
+	tempoEstimationStage = NoTempoEstimationStage;
+	
 	hopSize = hopSize_;
-	onsetDFBufferSize = (512*512)/hopSize;		// calculate df buffer size
 	
-	beatPeriod = round(60/((((double) hopSize)/44100)*tempo));
+	// calculate df buffer size, so that it always covers 512 x 512 samples at 44.1kHz (about 6 seconds)
+	onsetDFBufferSize = (int) ((512LL*512LL*sampleRate) / (44100LL*hopSize));
+	
+	beatPeriod = round ((60.0*sampleRate)/(tempo*((double) hopSize)));
 
     // set size of onset detection function buffer
     onsetDF.resize (onsetDFBufferSize);
     
     // set size of cumulative score buffer
     cumulativeScore.resize (onsetDFBufferSize);
+    
+    // calculate the cumulative score windows for every beat period the tempo can take
+    calculateTransitionWindows();
+    
+    // design the filter for resampling the onset detection function to 512 samples
+    calculateResamplingFilter();
 	
 	// initialise df_buffer to zeros
 	for (int i = 0; i < onsetDFBufferSize; i++)
 	{
-		onsetDF[i] = 0;
-		cumulativeScore[i] = 0;
-		
 		if ((i %  ((int) round(beatPeriod))) == 0)
 		{
-			onsetDF[i] = 1;
+			onsetDF.setSample (i, 1);
 		}
 	}
 }
 
+//=======================================================================
+void BTrack::calculateTransitionWindows()
+{
+    // the beat period can only take the values calculateTempo() gives for each of the tempo
+    // states, the longest being for the slowest tempo. The initial tempo is one of them
+    maxBeatPeriod = (int) round ((60.0*sampleRate)/(getTempoOfState (0)*((double) hopSize)));
+    
+    pastWindowOffsets.assign (maxBeatPeriod + 1, -1);
+    futureWindowOffsets.assign (maxBeatPeriod + 1, -1);
+    pastWindows.clear();
+    futureWindows.clear();
+    
+    for (int j = 0;j < numTempoStates;j++)
+    {
+        double period = round ((60.0*sampleRate)/(getTempoOfState (j)*((double) hopSize)));
+        int index = (int) period;
+        
+        if (pastWindowOffsets[index] >= 0)
+        {
+            continue;
+        }
+        
+        // past window, weighting the cumulative score between two and a half beat periods ago
+        int pastwinsize = (int) (round (2 * period) - round (period / 2) + 1);
+        double v = -2*period;
+        
+        pastWindowOffsets[index] = (int) pastWindows.size();
+        
+        for (int i = 0; i < pastwinsize; i++)
+        {
+            pastWindows.push_back (exp((-1 * pow (tightness * log (-v / period), 2)) / 2));
+            v = v+1;
+        }
+        
+        // future window, weighting where in the next beat period the beat is most likely to be
+        v = 1;
+        
+        futureWindowOffsets[index] = (int) futureWindows.size();
+        
+        for (int i = 0; i < index; i++)
+        {
+            futureWindows.push_back (exp((-1*pow((v - (period/2)),2))   /  (2*pow((period/2) ,2))));
+            v++;
+        }
+    }
+    
+    // two beat periods of history, followed by one of future
+    futureCumulativeScore.resize (3 * maxBeatPeriod);
+}
+
+//=======================================================================
+void BTrack::calculateResamplingFilter()
+{
+    // reduce the resampling ratio 512 / onsetDFBufferSize to its lowest terms
+    int a = 512;
+    int b = onsetDFBufferSize;
+    
+    while (b != 0)
+    {
+        int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    
+    resamplingUpFactor = 512 / a;
+    resamplingDownFactor = onsetDFBufferSize / a;
+    
+    resamplingInput.resize (onsetDFBufferSize);
+    resamplingSource = &resamplingInput[0];
+    
+    if (resamplingUpFactor == resamplingDownFactor)
+    {
+        resamplingFilterLength = 0;
+        resamplingFilter.clear();
+        return;
+    }
+    
+    // when shrinking the buffer, the cutoff drops to the new Nyquist frequency to avoid aliasing
+    double cutoff = std::min (1.0, ((double) resamplingUpFactor) / ((double) resamplingDownFactor));
+    
+    // a Kaiser windowed sinc, spanning 16 zero crossings either side of its centre
+    double halfLength = 16. / cutoff;
+    double beta = 8.;
+    double pi = 3.14159265358979;
+    
+    resamplingFilterLength = 2 * ((int) ceil (halfLength));
+    resamplingFilter.resize (resamplingUpFactor * resamplingFilterLength);
+    
+    for (int phase = 0;phase < resamplingUpFactor;phase++)
+    {
+        double* filter = &resamplingFilter[phase * resamplingFilterLength];
+        double sum = 0;
+        
+        for (int j = 0;j < resamplingFilterLength;j++)
+        {
+            // distance in input samples from the output position to this tap
+            double x = (((double) phase) / resamplingUpFactor) + (resamplingFilterLength / 2) - 1 - j;
+            double u = x / halfLength;
+            
+            if (fabs (u) >= 1)
+            {
+                filter[j] = 0;
+            }
+            else
+            {
+                double sinc = (x == 0) ? 1. : sin (pi * cutoff * x) / (pi * cutoff * x);
+                filter[j] = sinc * besselI0 (beta * sqrt (1 - u * u)) / besselI0 (beta);
+            }
+            
+            sum += filter[j];
+        }
+        
+        // normalise each phase to unity gain so that a constant input stays constant
+        for (int j = 0;j < resamplingFilterLength;j++)
+        {
+            filter[j] = filter[j] / sum;
+        }
+    }
+}
+
+//=======================================================================
+double BTrack::besselI0 (double x)
+{
+    // power series for the zeroth order modified Bessel function of the first kind
+    double sum = 1;
+    double term = 1;
+    
+    for (int k = 1;k < 50;k++)
+    {
+        term = term * (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        
+        if (term < sum * 1e-12)
+        {
+            break;
+        }
+    }
+    
+    return sum;
+}
+
 //=======================================================================
 void BTrack::updateHopAndFrameSize (int hopSize_, int frameSize_)
 {
@@ -199,6 +544,21 @@ void BTrack::updateHopAndFrameSize (int hopSize_, int frameSize_)
     setHopSize (hopSize_);
 }
 
+//=======================================================================
+void BTrack::updateSampleRate (int sampleRate_)
+{
+    sampleRate = sampleRate_;
+    
+    // the buffer sizes and beat periods all depend on the sample rate
+    setHopSize (hopSize);
+}
+
+//=======================================================================
+int BTrack::getSampleRate()
+{
+    return sampleRate;
+}
+
 //=======================================================================
 bool BTrack::beatDueInCurrentFrame()
 {
@@ -254,20 +614,368 @@ void BTrack::processOnsetDetectionFunctionSample (double newSample)
 	// update cumulative score
 	updateCumulativeScore (newSample);
 	
+	if (tempoWorker != NULL)
+	{
+		// pick up the tempo worker's estimate, if it has finished one
+		collectTempoFromWorker();
+	}
+	else if (tempoEstimationStage != NoTempoEstimationStage)
+	{
+		// continue any tempo estimate that is being spread over several hops
+		performTempoEstimationStage();
+	}
+	
 	// if we are halfway between beats
 	if (m0 == 0)
 	{
+		// the prediction needs the latest tempo, unless we cannot wait for it
+		if (tempoWorker == NULL)
+		{
+			finishTempoEstimation();
+		}
+		
 		predictBeat();
 	}
-	
-	// if we are at a beat
-	if (beatCounter == 0)
+	
+	// if we are at a beat
+	if (beatCounter == 0)
+	{
+		beatDueInFrame = true;	// indicate a beat should be output
+		
+		if (tempoWorker != NULL)
+		{
+			// hand the onset detection function to the tempo worker
+			requestTempoFromWorker();
+		}
+		else
+		{
+			// recalculate the tempo from the onset detection function as it is now, finishing any
+			// previous estimate first, and unless amortised over the following hops, do it all now
+			finishTempoEstimation();
+			captureOnsetDetectionFunction (amortiseTempoEstimation);
+			tempoEstimationStage = ResamplingStage;
+			
+			if (!amortiseTempoEstimation)
+			{
+				finishTempoEstimation();
+			}
+		}
+	}
+}
+
+//=======================================================================
+long BTrack::trackBeats (const double* signal, long numSamples, long* beatFrames, long maxNumBeats, double* tempi)
+{
+    return trackHops (signal, numSamples, beatFrames, maxNumBeats, tempi);
+}
+
+//=======================================================================
+long BTrack::trackBeats (const float* signal, long numSamples, long* beatFrames, long maxNumBeats, double* tempi)
+{
+    return trackHops (signal, numSamples, beatFrames, maxNumBeats, tempi);
+}
+
+//=======================================================================
+template <typename SampleType>
+long BTrack::trackHops (const SampleType* signal, long numSamples, long* beatFrames, long maxNumBeats, double* tempi)
+{
+    long numHops = numSamples / hopSize;
+    long numBeats = 0;
+    
+    // the onset detection function reads each hop straight from the signal, converting
+    // the samples as it writes them into its frame
+    for (long i = 0; i < numHops; i++)
+    {
+        double sample = odf.calculateOnsetDetectionFunctionSample (signal + (i * hopSize));
+        
+        trackBeatInSignal (sample, i, beatFrames, maxNumBeats, numBeats, tempi);
+    }
+    
+    return numBeats;
+}
+
+//=======================================================================
+void BTrack::trackBeats (const double* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    long numHops = std::max (numSamples / hopSize, 0L);
+    
+    // there can be at most one beat per hop
+    beatFrames.resize (numHops);
+    tempi.resize (numHops);
+    
+    long numBeats = trackBeats (signal, numSamples, beatFrames.data(), numHops, tempi.data());
+    
+    beatFrames.resize (numBeats);
+}
+
+//=======================================================================
+void BTrack::trackBeats (const float* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    long numHops = std::max (numSamples / hopSize, 0L);
+    
+    // there can be at most one beat per hop
+    beatFrames.resize (numHops);
+    tempi.resize (numHops);
+    
+    long numBeats = trackBeats (signal, numSamples, beatFrames.data(), numHops, tempi.data());
+    
+    beatFrames.resize (numBeats);
+}
+
+//=======================================================================
+long BTrack::trackBeatsInOnsetDetectionFunction (const double* onsetDetectionFunction, long numSamples, long* beatFrames, long maxNumBeats, double* tempi)
+{
+    long numBeats = 0;
+    
+    for (long i = 0; i < numSamples; i++)
+    {
+        trackBeatInSignal (onsetDetectionFunction[i], i, beatFrames, maxNumBeats, numBeats, tempi);
+    }
+    
+    return numBeats;
+}
+
+//=======================================================================
+void BTrack::trackBeatsInOnsetDetectionFunction (const double* onsetDetectionFunction, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    long numHops = std::max (numSamples, 0L);
+    
+    // there can be at most one beat per hop
+    beatFrames.resize (numHops);
+    tempi.resize (numHops);
+    
+    long numBeats = trackBeatsInOnsetDetectionFunction (onsetDetectionFunction, numSamples, beatFrames.data(), numHops, tempi.data());
+    
+    beatFrames.resize (numBeats);
+}
+
+//=======================================================================
+void BTrack::trackBeatInSignal (double sample, long hop, long* beatFrames, long maxNumBeats, long& numBeats, double* tempi)
+{
+    processOnsetDetectionFunctionSample (sample);
+    
+    if (beatDueInFrame)
+    {
+        if (beatFrames != NULL && numBeats < maxNumBeats)
+        {
+            beatFrames[numBeats] = hop;
+        }
+        
+        numBeats++;
+    }
+    
+    if (tempi != NULL)
+    {
+        tempi[hop] = estimatedTempo;
+    }
+}
+
+//=======================================================================
+void BTrack::setAsynchronousTempoEstimation (bool shouldBeAsynchronous)
+{
+	if (shouldBeAsynchronous && tempoWorker == NULL)
+	{
+		// the worker takes over tempo estimation from here
+		finishTempoEstimation();
+		
+		tempoWorker = new TempoWorker();
+		tempoWorker->state = TempoWorker::Idle;
+		tempoWorker->shouldExit = false;
+		tempoWorker->discardResult = false;
+		tempoWorker->tempoIndex = -1;
+		tempoWorker->pendingTempoIndex = -1;
+		tempoWorker->pendingFixedTempoIndex = -1;
+		tempoWorker->hasPendingTempoFix = false;
+		tempoWorker->pendingTempoFixed = false;
+		tempoWorker->thread = std::thread (&BTrack::runTempoWorker, this);
+	}
+	else if (!shouldBeAsynchronous && tempoWorker != NULL)
+	{
+		tempoWorker->shouldExit = true;
+		tempoWorker->wakeUp.post();
+		tempoWorker->thread.join();
+		
+		// take over any estimate the worker finished, and abandon any it did not start
+		if (tempoWorker->state == TempoWorker::Requested)
+		{
+			tempoWorker->discardResult = true;
+			tempoWorker->state = TempoWorker::Done;
+		}
+		
+		collectTempoFromWorker();
+		tempoEstimationStage = NoTempoEstimationStage;
+		
+		delete tempoWorker;
+		tempoWorker = NULL;
+	}
+}
+
+//=======================================================================
+bool BTrack::isTempoEstimationAsynchronous()
+{
+	return tempoWorker != NULL;
+}
+
+//=======================================================================
+void BTrack::requestTempoFromWorker()
+{
+	// if the worker is still busy with the last estimate, skip this one rather than wait
+	if (tempoWorker->state.load (std::memory_order_acquire) != TempoWorker::Idle)
+	{
+		return;
+	}
+	
+	captureOnsetDetectionFunction (true);
+	tempoEstimationStage = ResamplingStage;
+	tempoWorker->discardResult = false;
+	tempoWorker->state.store (TempoWorker::Requested, std::memory_order_release);
+	
+	// posting never waits for the worker, so the audio thread is never held up
+	tempoWorker->wakeUp.post();
+}
+
+//=======================================================================
+void BTrack::collectTempoFromWorker()
+{
+	if (tempoWorker->state.load (std::memory_order_acquire) != TempoWorker::Done)
+	{
+		return;
+	}
+	
+	if (!tempoWorker->discardResult)
+	{
+		updateBeatPeriod (tempoWorker->tempoIndex);
+	}
+	
+	// the tempo probabilities are back with the audio thread, so apply any changes
+	// made to them while the worker had them
+	if (tempoWorker->pendingTempoIndex >= 0)
+	{
+		resetTempoProbabilities (tempoWorker->pendingTempoIndex);
+		tempoWorker->pendingTempoIndex = -1;
+	}
+	
+	if (tempoWorker->pendingFixedTempoIndex >= 0)
+	{
+		setFixedTempoProbabilities (tempoWorker->pendingFixedTempoIndex);
+		tempoWorker->pendingFixedTempoIndex = -1;
+	}
+	
+	if (tempoWorker->hasPendingTempoFix)
+	{
+		tempoFixed = tempoWorker->pendingTempoFixed;
+		tempoWorker->hasPendingTempoFix = false;
+	}
+	
+	tempoWorker->state.store (TempoWorker::Idle, std::memory_order_release);
+}
+
+//=======================================================================
+bool BTrack::isTempoWorkerBusy()
+{
+	return tempoWorker != NULL && tempoWorker->state.load (std::memory_order_acquire) == TempoWorker::Requested;
+}
+
+//=======================================================================
+void BTrack::waitForTempoWorker()
+{
+	if (tempoWorker == NULL)
+	{
+		return;
+	}
+	
+	while (tempoWorker->state.load (std::memory_order_acquire) == TempoWorker::Requested)
+	{
+		std::this_thread::yield();
+	}
+	
+	collectTempoFromWorker();
+}
+
+//=======================================================================
+void BTrack::runTempoWorker()
+{
+	while (true)
+	{
+		// sleep until there is a request, or it is time to exit
+		tempoWorker->wakeUp.wait();
+		
+		if (tempoWorker->shouldExit)
+		{
+			return;
+		}
+		
+		if (tempoWorker->state.load (std::memory_order_acquire) == TempoWorker::Requested)
+		{
+			// calculate everything up to and including the Viterbi update, leaving the
+			// audio thread to set the beat period from it
+			while (tempoEstimationStage != TempoStage)
+			{
+				performTempoEstimationStage();
+			}
+			
+			tempoWorker->tempoIndex = calculateTempo();
+			tempoEstimationStage = NoTempoEstimationStage;
+			tempoWorker->state.store (TempoWorker::Done, std::memory_order_release);
+		}
+	}
+}
+
+//=======================================================================
+void BTrack::setAmortisedTempoEstimation (bool shouldAmortise)
+{
+	amortiseTempoEstimation = shouldAmortise;
+}
+
+//=======================================================================
+bool BTrack::isTempoEstimationAmortised()
+{
+	return amortiseTempoEstimation;
+}
+
+//=======================================================================
+void BTrack::performTempoEstimationStage()
+{
+	switch (tempoEstimationStage)
+	{
+		case ResamplingStage:
+			// resample and apply an adaptive threshold to the onset detection function
+			resampleOnsetDetectionFunction();
+			adaptiveThreshold (resampledOnsetDF,512);
+			tempoEstimationStage = PowerSpectrumStage;
+			break;
+			
+		case PowerSpectrumStage:
+			calculatePowerSpectrumForACF (resampledOnsetDF);
+			tempoEstimationStage = AutocorrelationStage;
+			break;
+			
+		case AutocorrelationStage:
+			calculateBalancedACFFromPowerSpectrum();
+			tempoEstimationStage = CombFilterBankStage;
+			break;
+			
+		case CombFilterBankStage:
+			calculateTempoObservationVector();
+			tempoEstimationStage = TempoStage;
+			break;
+			
+		case TempoStage:
+			updateBeatPeriod (calculateTempo());
+			tempoEstimationStage = NoTempoEstimationStage;
+			break;
+			
+		default:
+			break;
+	}
+}
+
+//=======================================================================
+void BTrack::finishTempoEstimation()
+{
+	while (tempoEstimationStage != NoTempoEstimationStage)
 	{
-		beatDueInFrame = true;	// indicate a beat should be output
-		
-		// recalculate the tempo
-		resampleOnsetDetectionFunction();
-		calculateTempo();
+		performTempoEstimationStage();
 	}
 }
 
@@ -277,34 +985,37 @@ void BTrack::setTempo (double tempo)
 	
 	/////////// TEMPO INDICATION RESET //////////////////
 	
-	// firstly make sure tempo is between 80 and 160 bpm..
-	while (tempo > 160)
+	// abandon any tempo estimate in progress, as it would override the new tempo
+	if (tempoWorker != NULL)
 	{
-		tempo = tempo/2;
+		tempoWorker->discardResult = true;
 	}
-	
-	while (tempo < 80)
+	else
 	{
-		tempo = tempo * 2;
+		tempoEstimationStage = NoTempoEstimationStage;
 	}
+	
+	// firstly make sure tempo is in the range of the tempo states..
+	tempo = foldTempoIntoRange (tempo);
 		
 	// convert tempo from bpm value to integer index of tempo probability 
-	int tempo_index = (int) round((tempo - 80)/2);
+	int tempo_index = getTempoIndex (tempo);
 	
-	// now set previous tempo observations to zero
-	for (int i=0;i < 41;i++)
+	// if the tempo worker has the tempo probabilities, it hands them back before they are reset
+	if (isTempoWorkerBusy())
 	{
-		prevDelta[i] = 0;
+		tempoWorker->pendingTempoIndex = tempo_index;
+	}
+	else
+	{
+		resetTempoProbabilities (tempo_index);
 	}
-	
-	// set desired tempo index to 1
-	prevDelta[tempo_index] = 1;
 	
 	
 	/////////// CUMULATIVE SCORE ARTIFICAL TEMPO UPDATE //////////////////
 	
 	// calculate new beat period
-	int new_bperiod = (int) round(60/((((double) hopSize)/44100)*tempo));
+	int new_bperiod = (int) round(60/((((double) hopSize)/sampleRate)*tempo));
 	
 	int bcounter = 1;
 	// initialise df_buffer to zeros
@@ -312,13 +1023,13 @@ void BTrack::setTempo (double tempo)
 	{
 		if (bcounter == 1)
 		{
-			cumulativeScore[i] = 150;
-			onsetDF[i] = 150;
+			cumulativeScore.setSample (i, 150);
+			onsetDF.setSample (i, 150);
 		}
 		else
 		{
-			cumulativeScore[i] = 10;
-			onsetDF[i] = 10;
+			cumulativeScore.setSample (i, 10);
+			onsetDF.setSample (i, 10);
 		}
 		
 		bcounter++;
@@ -341,85 +1052,259 @@ void BTrack::setTempo (double tempo)
 //=======================================================================
 void BTrack::fixTempo (double tempo)
 {	
-	// firstly make sure tempo is between 80 and 160 bpm..
-	while (tempo > 160)
+	// convert tempo from bpm value to integer index of tempo probability 
+	int tempo_index = getTempoIndex (tempo);
+	
+	// if the tempo worker is using the fixed tempo probabilities, it hands them back before they change
+	if (isTempoWorkerBusy())
 	{
-		tempo = tempo/2;
+		tempoWorker->pendingFixedTempoIndex = tempo_index;
+		tempoWorker->hasPendingTempoFix = true;
+		tempoWorker->pendingTempoFixed = true;
+		return;
+	}
+	
+	setFixedTempoProbabilities (tempo_index);
+		
+	// set the tempo fix flag
+	tempoFixed = true;
+}
+
+//=======================================================================
+void BTrack::resetTempoProbabilities (int tempoIndex)
+{
+	// now set previous tempo observations to zero (in the log domain)
+	for (int i=0;i < numTempoStates;i++)
+	{
+		logPrevDelta[tempoTransitionBandwidth + i] = -INFINITY;
 	}
 	
-	while (tempo < 80)
+	// set desired tempo index to 1
+	logPrevDelta[tempoTransitionBandwidth + tempoIndex] = 0;
+}
+
+//=======================================================================
+void BTrack::setFixedTempoProbabilities (int tempoIndex)
+{
+	// now set previous fixed previous tempo observation values to zero (in the log domain)
+	for (int i=0;i < numTempoStates;i++)
 	{
-		tempo = tempo * 2;
+		logPrevDeltaFixed[i] = -INFINITY;
 	}
 	
-	// convert tempo from bpm value to integer index of tempo probability 
-	int tempo_index = (int) round((tempo - 80)/2);
+	// set desired tempo index to 1
+	logPrevDeltaFixed[tempoIndex] = 0;
+}
+
+//=======================================================================
+void BTrack::setTempoTransitionBandwidth (int bandwidth)
+{
+	// the tempo worker uses the tempo probabilities and transitions in its estimates
+	waitForTempoWorker();
+	
+	// beyond numTempoStates - 1 states every transition is already included
+	bandwidth = std::max (0, std::min (bandwidth, numTempoStates - 1));
 	
-	// now set previous fixed previous tempo observation values to zero
-	for (int i=0;i < 41;i++)
+	// the standard deviation is 10 bpm, in tempo states
+	double pi = 3.14159265;
+	double m_sig = 10. / tempoResolution;
+	
+	// the log of the gaussian tempo transition probability, for each change of tempo index from -bandwidth to +bandwidth
+	logTempoTransitions.resize (2 * bandwidth + 1);
+	
+	for (int i = -bandwidth;i <= bandwidth;i++)
 	{
-		prevDeltaFixed[i] = 0;
+		logTempoTransitions[bandwidth + i] = -log (m_sig * sqrt(2*pi)) - (pow(i,2) / (2*pow(m_sig,2)));
 	}
 	
-	// set desired tempo index to 1
-	prevDeltaFixed[tempo_index] = 1;
-		
-	// set the tempo fix flag
-	tempoFixed = true;
+	// keep the current tempo probabilities, padded with impossible states so that every
+	// state has bandwidth neighbours either side
+	std::vector<double> padded (numTempoStates + 2 * bandwidth, -INFINITY);
+	
+	for (int i = 0;i < numTempoStates;i++)
+	{
+		padded[bandwidth + i] = logPrevDelta[tempoTransitionBandwidth + i];
+	}
+	
+	logPrevDelta.swap (padded);
+	tempoTransitionBandwidth = bandwidth;
+}
+
+//=======================================================================
+int BTrack::getTempoTransitionBandwidth()
+{
+	return tempoTransitionBandwidth;
+}
+
+//=======================================================================
+double BTrack::getMinTempo()
+{
+	return minTempo;
+}
+
+//=======================================================================
+double BTrack::getMaxTempo()
+{
+	return maxTempo;
+}
+
+//=======================================================================
+double BTrack::getTempoResolution()
+{
+	return tempoResolution;
+}
+
+//=======================================================================
+int BTrack::getNumTempoStates()
+{
+	return numTempoStates;
+}
+
+//=======================================================================
+TimingStatistics BTrack::getTimingStatistics()
+{
+	TimingStatistics statistics;
+	
+	odf.getTimingStatistics (statistics);
+	
+#ifdef BTRACK_STAGE_TIMING
+	statistics.cumulativeScore = cumulativeScoreTiming.getStatistics();
+	statistics.beatPrediction = beatPredictionTiming.getStatistics();
+	statistics.resampling = resamplingTiming.getStatistics();
+	statistics.autocorrelation = autocorrelationTiming.getStatistics();
+	statistics.combFilterBank = combFilterBankTiming.getStatistics();
+	statistics.viterbi = viterbiTiming.getStatistics();
+#else
+	StageTimingStatistics none = {0, 0, 0};
+	statistics.cumulativeScore = none;
+	statistics.beatPrediction = none;
+	statistics.resampling = none;
+	statistics.autocorrelation = none;
+	statistics.combFilterBank = none;
+	statistics.viterbi = none;
+#endif
+	
+	return statistics;
+}
+
+//=======================================================================
+void BTrack::resetTimingStatistics()
+{
+	odf.resetTimingStatistics();
+	
+#ifdef BTRACK_STAGE_TIMING
+	cumulativeScoreTiming.reset();
+	beatPredictionTiming.reset();
+	resamplingTiming.reset();
+	autocorrelationTiming.reset();
+	combFilterBankTiming.reset();
+	viterbiTiming.reset();
+#endif
+}
+
+//=======================================================================
+double BTrack::getTempoOfState (int tempoIndex)
+{
+	return minTempo + tempoIndex * tempoResolution;
+}
+
+//=======================================================================
+double BTrack::foldTempoIntoRange (double tempo)
+{
+	while (tempo > maxTempo)
+	{
+		tempo = tempo/2;
+	}
+	
+	while (tempo < minTempo)
+	{
+		tempo = tempo * 2;
+	}
+	
+	// a range of less than an octave may not contain any multiple of the tempo
+	return std::min (tempo, maxTempo);
+}
+
+//=======================================================================
+int BTrack::getTempoIndex (double tempo)
+{
+	int tempoIndex = (int) round ((foldTempoIntoRange (tempo) - minTempo) / tempoResolution);
+	
+	return std::max (0, std::min (tempoIndex, numTempoStates - 1));
 }
 
 //=======================================================================
 void BTrack::doNotFixTempo()
 {	
+	// the tempo worker reads the flag, so it changes when the worker hands back the tempo probabilities
+	if (isTempoWorkerBusy())
+	{
+		tempoWorker->hasPendingTempoFix = true;
+		tempoWorker->pendingTempoFixed = false;
+		return;
+	}
+	
 	// set the tempo fix flag
 	tempoFixed = false;
 }
 
 //=======================================================================
-void BTrack::resampleOnsetDetectionFunction()
+void BTrack::captureOnsetDetectionFunction (bool mustCopy)
 {
-	float output[512];
+    // the buffer holds the samples contiguously, oldest first, so the filter can run over it directly
+    resamplingSource = onsetDF.getPointer (0);
     
-    float input[onsetDFBufferSize];
-    
-    for (int i = 0;i < onsetDFBufferSize;i++)
+    if (mustCopy)
     {
-        input[i] = (float) onsetDF[i];
+        std::copy (resamplingSource, resamplingSource + onsetDFBufferSize, resamplingInput.begin());
+        resamplingSource = &resamplingInput[0];
     }
-        
-    double src_ratio = 512.0/((double) onsetDFBufferSize);
-    int BUFFER_LEN = onsetDFBufferSize;
-    int output_len;
-    SRC_DATA	src_data ;
-    
-    //output_len = (int) floor (((double) BUFFER_LEN) * src_ratio) ;
-    output_len = 512;
-    
-    src_data.data_in = input;
-    src_data.input_frames = BUFFER_LEN;
-    
-    src_data.src_ratio = src_ratio;
+}
+
+//=======================================================================
+void BTrack::resampleOnsetDetectionFunction()
+{
+    BTRACK_TIME_STAGE (resamplingTiming);
     
-    src_data.data_out = output;
-    src_data.output_frames = output_len;
+    // the buffer is already the right length, so just copy it
+    if (resamplingUpFactor == resamplingDownFactor)
+    {
+        for (int i = 0;i < 512;i++)
+        {
+            resampledOnsetDF[i] = resamplingSource[i];
+        }
+        
+        return;
+    }
     
-    src_simple (&src_data, SRC_SINC_BEST_QUALITY, 1);
-            
-    for (int i = 0;i < output_len;i++)
+    for (int i = 0;i < 512;i++)
     {
-        resampledOnsetDF[i] = (double) src_data.data_out[i];
+        // output sample i lies (i * down / up) input samples into the buffer, and the
+        // fractional part of that position picks which phase of the filter to use
+        int position = i * resamplingDownFactor;
+        int phase = position % resamplingUpFactor;
+        int start = (position / resamplingUpFactor) - (resamplingFilterLength / 2) + 1;
+        
+        const double* filter = &resamplingFilter[phase * resamplingFilterLength];
+        
+        // samples before the start and after the end of the buffer are taken as zero
+        int firstTap = std::max (0, -start);
+        int lastTap = std::min (resamplingFilterLength, onsetDFBufferSize - start);
+        
+        double sum = 0;
+        
+        for (int j = firstTap;j < lastTap;j++)
+        {
+            sum += filter[j] * resamplingSource[start + j];
+        }
+        
+        resampledOnsetDF[i] = sum;
     }
 }
 
 //=======================================================================
-void BTrack::calculateTempo()
+void BTrack::calculateTempoObservationVector()
 {
-	// adaptive threshold on input
-	adaptiveThreshold (resampledOnsetDF,512);
-		
-	// calculate auto-correlation function of detection function
-	calculateBalancedACF (resampledOnsetDF);
-	
 	// calculate output of comb filterbank
 	calculateOutputOfCombFilterBank();
 	
@@ -430,67 +1315,87 @@ void BTrack::calculateTempo()
 	int t_index;
 	int t_index2;
 	// calculate tempo observation vector from beat period observation vector
-	for (int i = 0;i < 41;i++)
+	for (int i = 0;i < numTempoStates;i++)
 	{
-		t_index = (int) round (tempoToLagFactor / ((double) ((2*i)+80)));
-		t_index2 = (int) round (tempoToLagFactor / ((double) ((4*i)+160)));
+		t_index = (int) round (tempoToLagFactor / getTempoOfState (i));
+		t_index2 = (int) round (tempoToLagFactor / (2 * getTempoOfState (i)));
 
 		
 		tempoObservationVector[i] = combFilterBankOutput[t_index-1] + combFilterBankOutput[t_index2-1];
 	}
+}
+
+//=======================================================================
+int BTrack::calculateTempo()
+{
+	BTRACK_TIME_STAGE (viterbiTiming);
 	
-	
-	double maxval;
-	double maxind;
-	double curval;
+	double* logPrevDeltaStates = &logPrevDelta[tempoTransitionBandwidth];
 	
 	// if tempo is fixed then always use a fixed set of tempi as the previous observation probability function
 	if (tempoFixed)
 	{
-		for (int k = 0;k < 41;k++)
-		{
-			prevDelta[k] = prevDeltaFixed[k];
-		}
-	}
-		
-	for (int j=0;j < 41;j++)
-	{
-		maxval = -1;
-		for (int i = 0;i < 41;i++)
+		for (int k = 0;k < numTempoStates;k++)
 		{
-			curval = prevDelta[i] * tempoTransitionMatrix[i][j];
-			
-			if (curval > maxval)
-			{
-				maxval = curval;
-			}
+			logPrevDeltaStates[k] = logPrevDeltaFixed[k];
 		}
-		
-		delta[j] = maxval * tempoObservationVector[j];
 	}
 	
-
-	normaliseArray(delta,41);
+	// the Viterbi update, in the log domain, only considering transitions within the bandwidth
+	kernels->maxPlusCorrelation (&logPrevDelta[0], &logTempoTransitions[0], (int) logTempoTransitions.size(), &delta[0], numTempoStates);
 	
-	maxind = -1;
-	maxval = -1;
+	double maxval = -INFINITY;
+	int maxind = -1;
 	
-	for (int j=0;j < 41;j++)
+	for (int j=0;j < numTempoStates;j++)
 	{
+		delta[j] = delta[j] + log (tempoObservationVector[j]);
+		
 		if (delta[j] > maxval)
 		{
 			maxval = delta[j];
 			maxind = j;
 		}
-		
-		prevDelta[j] = delta[j];
 	}
 	
-	beatPeriod = round ((60.0*44100.0)/(((2*maxind)+80)*((double) hopSize)));
+	// if no tempo is possible (e.g. in silence) then there is nothing to update the tempo from,
+	// so keep the current beat period and tempo probabilities
+	if (maxind < 0)
+	{
+		return -1;
+	}
+	
+	// normalise, so that the probabilities sum to one
+	double sum = 0;
+	
+	for (int j=0;j < numTempoStates;j++)
+	{
+		sum = sum + exp (delta[j] - maxval);
+	}
+	
+	double logSum = maxval + log (sum);
+	
+	for (int j=0;j < numTempoStates;j++)
+	{
+		logPrevDeltaStates[j] = delta[j] - logSum;
+	}
+	
+	return maxind;
+}
+
+//=======================================================================
+void BTrack::updateBeatPeriod (int tempoIndex)
+{
+	if (tempoIndex < 0)
+	{
+		return;
+	}
+	
+	beatPeriod = round ((60.0*sampleRate)/(getTempoOfState (tempoIndex)*((double) hopSize)));
 	
 	if (beatPeriod > 0)
 	{
-		estimatedTempo = 60.0/((((double) hopSize) / 44100.0) * beatPeriod);
+		estimatedTempo = 60.0/((((double) hopSize) / sampleRate) * beatPeriod);
 	}
 }
 
@@ -499,29 +1404,37 @@ void BTrack::adaptiveThreshold (double* x, int N)
 {
 	int i = 0;
 	int k,t = 0;
-	double x_thresh[N];
+	double* x_thresh = adaptiveThresholdValues;
 	
 	int p_post = 7;
 	int p_pre = 8;
 	
+	// cumulative sums, so that the mean of any section of x can be found with one subtraction
+	adaptiveThresholdPrefixSum[0] = 0;
+	
+	for (i = 0;i < N;i++)
+	{
+		adaptiveThresholdPrefixSum[i+1] = adaptiveThresholdPrefixSum[i] + x[i];
+	}
+	
 	t = std::min(N,p_post);	// what is smaller, p_post of df size. This is to avoid accessing outside of arrays
 	
 	// find threshold for first 't' samples, where a full average cannot be computed yet 
 	for (i = 0;i <= t;i++)
 	{	
 		k = std::min ((i+p_pre),N);
-		x_thresh[i] = calculateMeanOfArray (x,1,k);
+		x_thresh[i] = calculateMeanOfPrefixSum (1,k);
 	}
 	// find threshold for bulk of samples across a moving average from [i-p_pre,i+p_post]
 	for (i = t+1;i < N-p_post;i++)
 	{
-		x_thresh[i] = calculateMeanOfArray (x,i-p_pre,i+p_post);
+		x_thresh[i] = calculateMeanOfPrefixSum (i-p_pre,i+p_post);
 	}
 	// for last few samples calculate threshold, again, not enough samples to do as above
 	for (i = N-p_post;i < N;i++)
 	{
 		k = std::max ((i-p_post),1);
-		x_thresh[i] = calculateMeanOfArray (x,k,N);
+		x_thresh[i] = calculateMeanOfPrefixSum (k,N);
 	}
 	
 	// subtract the threshold from the detection function and check that it is not less than 0
@@ -538,30 +1451,44 @@ void BTrack::adaptiveThreshold (double* x, int N)
 //=======================================================================
 void BTrack::calculateOutputOfCombFilterBank()
 {
-	int numelem;
+	BTRACK_TIME_STAGE (combFilterBankTiming);
 	
-	for (int i = 0;i < 128;i++)
-	{
-		combFilterBankOutput[i] = 0;
-	}
+	const CombFilterBankMatrix& matrix = CombFilterBankMatrix::get();
+	
+	// beat periods of 1 and 128 are outside the filter bank
+	combFilterBankOutput[0] = 0;
+	combFilterBankOutput[127] = 0;
+	
+	kernels->sparseMatrixVector (matrix.indices, matrix.coefficients, CombFilterBankMatrix::NumRows,
+	                             CombFilterBankMatrix::NumEntriesPerRow, acf, combFilterBankOutput + 1);
+}
+
+//=======================================================================
+void BTrack::calculateOutputsOfCombFilterBank (const double* acfs, int numColumns, double* outputs)
+{
+	const CombFilterBankMatrix& matrix = CombFilterBankMatrix::get();
 	
-	numelem = 4;
+	// beat periods of 1 and 128 are outside the filter bank
+	std::fill (outputs, outputs + numColumns, 0.0);
+	std::fill (outputs + (127 * numColumns), outputs + (128 * numColumns), 0.0);
 	
-	for (int i = 2; i <= 127; i++) // max beat period
+	// a single column is rounded the same either way, and the vector kernel calculates many rows at once
+	if (numColumns == 1)
 	{
-		for (int a = 1; a <= numelem; a++) // number of comb elements
-		{
-			for (int b = 1-a; b <= a-1; b++) // general state using normalisation of comb elements
-			{
-				combFilterBankOutput[i-1] = combFilterBankOutput[i-1] + (acf[(a*i+b)-1]*weightingVector[i-1])/(2*a-1);	// calculate value for comb filter row
-			}
-		}
+		kernels->sparseMatrixVector (matrix.indices, matrix.coefficients, CombFilterBankMatrix::NumRows,
+		                             CombFilterBankMatrix::NumEntriesPerRow, acfs, outputs + 1);
+		return;
 	}
+	
+	kernels->sparseMatrixMatrix (matrix.indices, matrix.coefficients, CombFilterBankMatrix::NumRows,
+	                             CombFilterBankMatrix::NumEntriesPerRow, acfs, numColumns, outputs + numColumns);
 }
 
 //=======================================================================
-void BTrack::calculateBalancedACF (double* onsetDetectionFunction)
+void BTrack::calculatePowerSpectrumForACF (double* onsetDetectionFunction)
 {
+    BTRACK_TIME_STAGE (autocorrelationTiming);
+    
     int onsetDetectionFunctionLength = 512;
     
 #ifdef USE_FFTW
@@ -581,7 +1508,7 @@ void BTrack::calculateBalancedACF (double* onsetDetectionFunction)
     }
     
     // perform the fft
-    fftw_execute (acfForwardFFT);
+    fftw_execute_dft (acfForwardFFT->plan, complexIn, complexOut);
     
     // multiply by complex conjugate
     for (int i = 0;i < FFTLengthForACFCalculation;i++)
@@ -589,10 +1516,6 @@ void BTrack::calculateBalancedACF (double* onsetDetectionFunction)
         complexOut[i][0] = complexOut[i][0]*complexOut[i][0] + complexOut[i][1]*complexOut[i][1];
         complexOut[i][1] = 0.0;
     }
-    
-    // perform the ifft
-    fftw_execute (acfBackwardFFT);
-    
 #endif
     
 #ifdef USE_KISS_FFT
@@ -612,7 +1535,7 @@ void BTrack::calculateBalancedACF (double* onsetDetectionFunction)
     }
     
     // execute kiss fft
-    kiss_fft (cfgForwards, fftIn, fftOut);
+    kiss_fft (acfForwardFFT->cfg, fftIn, fftOut);
     
     // multiply by complex conjugate
     for (int i = 0;i < FFTLengthForACFCalculation;i++)
@@ -620,10 +1543,22 @@ void BTrack::calculateBalancedACF (double* onsetDetectionFunction)
         fftOut[i].r = fftOut[i].r * fftOut[i].r + fftOut[i].i * fftOut[i].i;
         fftOut[i].i = 0.0;
     }
+#endif
+}
+
+//=======================================================================
+void BTrack::calculateBalancedACFFromPowerSpectrum()
+{
+    BTRACK_TIME_STAGE (autocorrelationTiming);
     
+#ifdef USE_FFTW
     // perform the ifft
-    kiss_fft (cfgBackwards, fftOut, fftIn);
+    fftw_execute_dft (acfBackwardFFT->plan, complexOut, complexIn);
+#endif
     
+#ifdef USE_KISS_FFT
+    // perform the ifft
+    kiss_fft (acfBackwardFFT->cfg, fftOut, fftIn);
 #endif
     
     double lag = 512;
@@ -652,22 +1587,14 @@ void BTrack::calculateBalancedACF (double* onsetDetectionFunction)
 }
 
 //=======================================================================
-double BTrack::calculateMeanOfArray (double* array, int startIndex, int endIndex)
+double BTrack::calculateMeanOfPrefixSum (int startIndex, int endIndex)
 {
-	int i;
-	double sum = 0;
-
     int length = endIndex - startIndex;
 	
-	// find sum
-	for (i = startIndex; i < endIndex; i++)
-	{
-		sum = sum + array[i];
-	}
-	
     if (length > 0)
     {
-        return sum / length;	// average and return
+        // the sum of the samples in [startIndex,endIndex) is the difference of the cumulative sums
+        return (adaptiveThresholdPrefixSum[endIndex] - adaptiveThresholdPrefixSum[startIndex]) / length;
     }
     else
     {
@@ -675,31 +1602,11 @@ double BTrack::calculateMeanOfArray (double* array, int startIndex, int endIndex
     }
 }
 
-//=======================================================================
-void BTrack::normaliseArray (double* array, int N)
-{
-	double sum = 0;
-	
-	for (int i = 0; i < N; i++)
-	{
-		if (array[i] > 0)
-		{
-			sum = sum + array[i];
-		}
-	}
-	
-	if (sum > 0)
-	{
-		for (int i = 0; i < N; i++)
-		{
-			array[i] = array[i] / sum;
-		}
-	}
-}
-
 //=======================================================================
 void BTrack::updateCumulativeScore (double odfSample)
 {	 
+	BTRACK_TIME_STAGE (cumulativeScoreTiming);
+	
 	int start, end, winsize;
 	double max;
 	
@@ -707,30 +1614,11 @@ void BTrack::updateCumulativeScore (double odfSample)
 	end = onsetDFBufferSize - round (beatPeriod / 2);
 	winsize = end-start+1;
 	
-	double w1[winsize];
-	double v = -2*beatPeriod;
-	double wcumscore;
-	
-	// create window
-	for (int i = 0; i < winsize; i++)
-	{
-		w1[i] = exp((-1 * pow (tightness * log (-v / beatPeriod), 2)) / 2);
-		v = v+1;
-	}	
+	// the window for the current beat period was calculated when the hop size was set
+	const double* w1 = &pastWindows[pastWindowOffsets[(int) beatPeriod]];
 	
 	// calculate new cumulative score value
-	max = 0;
-	int n = 0;
-	for (int i=start; i <= end; i++)
-	{
-			wcumscore = cumulativeScore[i]*w1[n];
-		
-			if (wcumscore > max)
-			{
-				max = wcumscore;
-			}
-		n++;
-	}
+	max = kernels->weightedMaximum (cumulativeScore.getPointer (start), w1, winsize);
 	
     latestCumulativeScoreValue = ((1 - alpha) * odfSample) + (alpha * max);
     
@@ -740,67 +1628,40 @@ void BTrack::updateCumulativeScore (double odfSample)
 //=======================================================================
 void BTrack::predictBeat()
 {	 
+	BTRACK_TIME_STAGE (beatPredictionTiming);
+	
 	int windowSize = (int) beatPeriod;
-	double futureCumulativeScore[onsetDFBufferSize + windowSize];
-	double w2[windowSize];
-    
-	// copy cumscore to first part of fcumscore
-	for (int i = 0;i < onsetDFBufferSize;i++)
-	{
-		futureCumulativeScore[i] = cumulativeScore[i];
-	}
 	
-	// create future window
-	double v = 1;
-	for (int i = 0; i < windowSize; i++)
-	{
-		w2[i] = exp((-1*pow((v - (beatPeriod/2)),2))   /  (2*pow((beatPeriod/2) ,2)));
-		v++;
-	}
+	// the future cumulative score only looks two beat periods back, so only that much
+	// of the cumulative score needs to be copied in front of it
+	int historySize = (int) round (2*beatPeriod);
+	const double* history = cumulativeScore.getPointer (onsetDFBufferSize - historySize);
+	std::copy (history, history + historySize, futureCumulativeScore.begin());
 	
-	// create past window
-	v = -2*beatPeriod;
-	int start = onsetDFBufferSize - round(2*beatPeriod);
-	int end = onsetDFBufferSize - round(beatPeriod/2);
+	// the future and past windows for the current beat period were calculated when the hop size was set
+	const double* w2 = &futureWindows[futureWindowOffsets[windowSize]];
+	const double* w1 = &pastWindows[pastWindowOffsets[windowSize]];
+	
+	int start = historySize - round(2*beatPeriod);
+	int end = historySize - round(beatPeriod/2);
 	int pastwinsize = end-start+1;
-	double w1[pastwinsize];
-
-	for (int i = 0;i < pastwinsize;i++)
-	{
-		w1[i] = exp((-1*pow(tightness*log(-v/beatPeriod),2))/2);
-		v = v+1;
-	}
 
 	// calculate future cumulative score
 	double max;
 	int n;
 	double wcumscore;
-	for (int i = onsetDFBufferSize; i < (onsetDFBufferSize + windowSize); i++)
+	for (int i = historySize; i < (historySize + windowSize); i++)
 	{
 		start = i - round (2*beatPeriod);
-		end = i - round (beatPeriod/2);
-		
-		max = 0;
-		n = 0;
-		for (int k=start;k <= end;k++)
-		{
-			wcumscore = futureCumulativeScore[k]*w1[n];
-			
-			if (wcumscore > max)
-			{
-				max = wcumscore;
-			}
-			n++;
-		}
 		
-		futureCumulativeScore[i] = max;
+		futureCumulativeScore[i] = kernels->weightedMaximum (&futureCumulativeScore[start], w1, pastwinsize);
 	}
 	
 	// predict beat
 	max = 0;
 	n = 0;
 	
-	for (int i = onsetDFBufferSize; i < (onsetDFBufferSize + windowSize); i++)
+	for (int i = historySize; i < (historySize + windowSize); i++)
 	{
 		wcumscore = futureCumulativeScore[i]*w2[n];
 		
@@ -26,6 +26,8 @@
 #include "CircularBuffer.h"
 #include <vector>
 
+struct TempoWorker;
+
 //=======================================================================
 /** The main beat tracking class and the interface to the BTrack
  * beat tracking algorithm. The algorithm can process either
@@ -51,6 +53,32 @@ public:
      */
     BTrack (int hopSize_, int frameSize_);
     
+    /** Constructor taking the hop size and frame size, and the range and resolution of the tempo states
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     * @param minTempo the slowest tempo, in beats per minute, which must be at least 41 bpm
+     * @param maxTempo the fastest tempo, in beats per minute, which is rounded down to a whole number of steps above minTempo
+     * @param tempoResolution the difference between neighbouring tempo states, in beats per minute
+     */
+    BTrack (int hopSize_, int frameSize_, double minTempo_, double maxTempo_, double tempoResolution_);
+    
+    /** Constructor taking the hop size, frame size and sampling frequency
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     * @param sampleRate the sampling frequency of the audio in Hz
+     */
+    BTrack (int hopSize_, int frameSize_, int sampleRate_);
+    
+    /** Constructor taking the hop size, frame size, sampling frequency and the range and resolution of the tempo states
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     * @param sampleRate the sampling frequency of the audio in Hz
+     * @param minTempo the slowest tempo, in beats per minute, which must be at least 41 bpm
+     * @param maxTempo the fastest tempo, in beats per minute, which is rounded down to a whole number of steps above minTempo
+     * @param tempoResolution the difference between neighbouring tempo states, in beats per minute
+     */
+    BTrack (int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_);
+    
     /** Destructor */
     ~BTrack();
     
@@ -61,6 +89,12 @@ public:
      */
     void updateHopAndFrameSize (int hopSize_, int frameSize_);
     
+    /** Updates the sampling frequency of the audio, or of the audio the onset detection function
+     * samples were calculated from. This resets the beat tracker's history
+     * @param sampleRate the sampling frequency in Hz
+     */
+    void updateSampleRate (int sampleRate_);
+    
     //=======================================================================
     /** Process a single audio frame 
      * @param frame a pointer to an array containing an audio frame. The number of samples should 
@@ -72,11 +106,59 @@ public:
      * @param sample an onset detection function sample
      */
     void processOnsetDetectionFunctionSample (double sample);
+    
+    //=======================================================================
+    /** Track the beats of a whole audio signal at once, a hop at a time, carrying on from the beat
+     * tracker's current state. The hops are read straight from the signal, and any samples after the
+     * last whole hop are ignored
+     * @param signal the audio samples
+     * @param numSamples the number of audio samples
+     * @param beatFrames an array that the index of each hop with a beat is written to, or NULL
+     * @param maxNumBeats the number of indices that beatFrames can hold. Any further beats are counted, but not written
+     * @param tempi an array of numSamples / hopSize values that the tempo estimate after each hop is written to, or NULL
+     * @returns the number of beats, which may be more than maxNumBeats
+     */
+    long trackBeats (const double* signal, long numSamples, long* beatFrames, long maxNumBeats, double* tempi);
+    
+    /** Track the beats of a whole single precision audio signal at once (see above) */
+    long trackBeats (const float* signal, long numSamples, long* beatFrames, long maxNumBeats, double* tempi);
+    
+    /** Track the beats of a whole audio signal at once, a hop at a time, carrying on from the beat tracker's current state
+     * @param signal the audio samples
+     * @param numSamples the number of audio samples. Any samples after the last whole hop are ignored
+     * @param beatFrames set to the index of each hop with a beat
+     * @param tempi set to the tempo estimate after each hop
+     */
+    void trackBeats (const double* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+    
+    /** Track the beats of a whole single precision audio signal at once (see above) */
+    void trackBeats (const float* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+    
+    /** Track the beats of a whole onset detection function at once, carrying on from the beat tracker's current state
+     * @param onsetDetectionFunction the onset detection function samples, one per hop
+     * @param numSamples the number of onset detection function samples
+     * @param beatFrames an array that the index of each hop with a beat is written to, or NULL
+     * @param maxNumBeats the number of indices that beatFrames can hold. Any further beats are counted, but not written
+     * @param tempi an array of numSamples values that the tempo estimate after each hop is written to, or NULL
+     * @returns the number of beats, which may be more than maxNumBeats
+     */
+    long trackBeatsInOnsetDetectionFunction (const double* onsetDetectionFunction, long numSamples, long* beatFrames, long maxNumBeats, double* tempi);
+    
+    /** Track the beats of a whole onset detection function at once, carrying on from the beat tracker's current state
+     * @param onsetDetectionFunction the onset detection function samples, one per hop
+     * @param numSamples the number of onset detection function samples
+     * @param beatFrames set to the index of each hop with a beat
+     * @param tempi set to the tempo estimate after each hop
+     */
+    void trackBeatsInOnsetDetectionFunction (const double* onsetDetectionFunction, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
    
     //=======================================================================
     /** @returns the current hop size being used by the beat tracker */
     int getHopSize();
     
+    /** @returns the sampling frequency being used by the beat tracker, in Hz */
+    int getSampleRate();
+    
     /** @returns true if a beat should occur in the current audio frame */
     bool beatDueInCurrentFrame();
 
@@ -101,6 +183,67 @@ public:
     /** Tell the algorithm to not fix the tempo anymore */
     void doNotFixTempo();
     
+    /** Spread each tempo estimate over the hops that follow a beat, rather than doing it all in
+     * the hop with the beat, so that every hop takes a similar amount of time to process. Each
+     * estimate is split into five stages, one per hop, and the new tempo takes effect once the
+     * last stage is done. An estimate is finished early if the next beat prediction needs it
+     * @param shouldAmortise true to spread tempo estimates over several hops, false to do each all at once (the default)
+     */
+    void setAmortisedTempoEstimation (bool shouldAmortise);
+    
+    /** @returns true if tempo estimates are spread over several hops */
+    bool isTempoEstimationAmortised();
+    
+    /** Estimate the tempo on a worker thread, so that processing a hop never includes more than
+     * the cumulative score update and beat prediction. On each beat the onset detection function
+     * is copied and handed to the worker, and the new tempo takes effect in the first hop after the
+     * worker finishes. If the worker is still busy at the next beat, that beat's estimate is skipped.
+     * Calls to setTempo(), fixTempo() and doNotFixTempo() while the worker is busy take effect when
+     * it finishes. This takes precedence over setAmortisedTempoEstimation()
+     * @param shouldBeAsynchronous true to start a worker thread for this instance, false to stop it
+     * and estimate the tempo in processOnsetDetectionFunctionSample() again (the default)
+     */
+    void setAsynchronousTempoEstimation (bool shouldBeAsynchronous);
+    
+    /** @returns true if tempo estimates are calculated on a worker thread */
+    bool isTempoEstimationAsynchronous();
+    
+    /** Waits for the tempo worker, if there is one, to finish the estimate it is working on, and
+     * updates the tempo from it. This is never needed in real time, but makes tracking faster than
+     * real time behave as it would have in real time */
+    void waitForTempoWorker();
+    
+    /** Set how far the tempo can move between estimates. Each estimate only considers moves to
+     * tempo states within this many states of the previous one, as larger moves are very unlikely
+     * @param bandwidth the largest move, in tempo states, from 0 to getNumTempoStates() - 1. The default
+     * is four standard deviations of the tempo transition probability, or 40 bpm
+     */
+    void setTempoTransitionBandwidth (int bandwidth);
+    
+    /** @returns the largest move between tempo states considered by each tempo estimate */
+    int getTempoTransitionBandwidth();
+    
+    /** @returns the slowest tempo the beat tracker can estimate, in beats per minute */
+    double getMinTempo();
+    
+    /** @returns the fastest tempo the beat tracker can estimate, in beats per minute */
+    double getMaxTempo();
+    
+    /** @returns the difference between neighbouring tempo states, in beats per minute */
+    double getTempoResolution();
+    
+    /** @returns the number of tempo states */
+    int getNumTempoStates();
+    
+    /** @returns the time spent so far in each stage of beat tracking, including the onset detection
+     * function. This may be called from any thread, for example to report on processing as it runs,
+     * but the values are only counted when compiled with the flag -DBTRACK_STAGE_TIMING
+     */
+    TimingStatistics getTimingStatistics();
+    
+    /** Set the time spent in each stage of beat tracking back to zero */
+    void resetTimingStatistics();
+    
     //=======================================================================
     /** Calculates a beat time in seconds, given the frame number, hop size and sampling frequency.
      * This version uses a long to represent the frame number
@@ -123,18 +266,93 @@ public:
 		
 private:
     
+    /** A BTrackBank uses one BTrack's windows, tempo states and tempo estimation buffers for all of its streams */
+    friend class BTrackBank;
+    
+    /** The stages of a tempo estimate, in the order they are performed */
+    enum TempoEstimationStage
+    {
+        NoTempoEstimationStage,             /**< no tempo estimate is in progress */
+        ResamplingStage,                    /**< resample the onset detection function and apply an adaptive threshold */
+        PowerSpectrumStage,                 /**< calculate the power spectrum of the onset detection function */
+        AutocorrelationStage,               /**< calculate the autocorrelation function from the power spectrum */
+        CombFilterBankStage,                /**< apply the comb filter bank to find the tempo observation vector */
+        TempoStage                          /**< update the tempo probabilities and the tempo */
+    };
+    
     /** Initialises the algorithm, setting internal parameters and creating weighting vectors 
      * @param hopSize_ the hop size in audio samples
      * @param frameSize_ the frame size in audio samples
+     * @param sampleRate_ the sampling frequency in Hz
+     * @param minTempo_ the slowest tempo state, in beats per minute
+     * @param maxTempo_ the fastest tempo state, in beats per minute
+     * @param tempoResolution_ the difference between neighbouring tempo states, in beats per minute
+     */
+    void initialise (int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_);
+    
+    /** Track the beats in a whole audio signal, hop by hop (see trackBeats())
+     * @param signal the audio samples, as double or float
+     * @param numSamples the number of samples in the signal
+     * @param beatFrames the array of beat hop indices, or NULL
+     * @param maxNumBeats the number of indices that beatFrames can hold
+     * @param tempi the array of tempo estimates, or NULL
+     * @returns the number of beats found
      */
-    void initialise (int hopSize_, int frameSize_);
+    template <typename SampleType>
+    long trackHops (const SampleType* signal, long numSamples, long* beatFrames, long maxNumBeats, double* tempi);
+    
+    /** Track the beats of the next onset detection function sample, as part of a whole signal
+     * @param sample the onset detection function sample
+     * @param hop the index of the hop within the signal
+     * @param beatFrames the array of beat hop indices, or NULL
+     * @param maxNumBeats the number of indices that beatFrames can hold
+     * @param numBeats the number of beats so far, which is incremented if there is a beat
+     * @param tempi the array of tempo estimates, or NULL
+     */
+    void trackBeatInSignal (double sample, long hop, long* beatFrames, long maxNumBeats, long& numBeats, double* tempi);
     
     /** Initialise with hop size and set all array sizes accordingly
      * @param hopSize_ the hop size in audio samples
      */
     void setHopSize (int hopSize_);
     
-    /** Resamples the onset detection function from an arbitrary number of samples to 512 */
+    /** Calculates the windows used to update the cumulative score and predict beats, for every
+     * beat period that the tempo can take with the current hop size */
+    void calculateTransitionWindows();
+    
+    /** Designs the polyphase filter used to resample the onset detection function to 512
+     * samples, given the onset detection function buffer size */
+    void calculateResamplingFilter();
+    
+    /** Calculates the zeroth order modified Bessel function of the first kind, for the Kaiser window
+     * @param x the value to calculate the function at
+     * @returns the function value
+     */
+    static double besselI0 (double x);
+    
+    /** @returns the tempo of a tempo state, in beats per minute
+     * @param tempoIndex the index of the tempo state
+     */
+    double getTempoOfState (int tempoIndex);
+    
+    /** @returns the tempo halved or doubled until it lies between minTempo and maxTempo, if possible,
+     * and otherwise limited to maxTempo
+     * @param tempo the tempo in beats per minute
+     */
+    double foldTempoIntoRange (double tempo);
+    
+    /** @returns the index of the tempo state nearest to a tempo, once it is folded into range
+     * @param tempo the tempo in beats per minute
+     */
+    int getTempoIndex (double tempo);
+    
+    /** Takes the onset detection function as it is now for the next tempo estimate. It is read in place,
+     * unless the estimate will continue after more samples are added, in which case it is copied
+     * @param mustCopy true if the estimate will not be finished before the next sample is added
+     */
+    void captureOnsetDetectionFunction (bool mustCopy);
+    
+    /** Resamples the captured onset detection function from an arbitrary number of samples to 512 */
     void resampleOnsetDetectionFunction();
     
     /** Updates the cumulative score function with a new onset detection function sample 
@@ -145,58 +363,125 @@ private:
     /** Predicts the next beat, based upon the internal program state */
     void predictBeat();
     
-    /** Calculates the current tempo expressed as the beat period in detection function samples */
-    void calculateTempo();
+    /** Performs the next stage of the tempo estimate in progress (see TempoEstimationStage) */
+    void performTempoEstimationStage();
+    
+    /** Performs every remaining stage of the tempo estimate in progress, if there is one */
+    void finishTempoEstimation();
+    
+    /** Hands a copy of the onset detection function to the tempo worker, if it is not busy */
+    void requestTempoFromWorker();
+    
+    /** Updates the tempo from the tempo worker's estimate, if it has finished one, and applies any
+     * changes to the tempo probabilities made while it was busy */
+    void collectTempoFromWorker();
+    
+    /** @returns true if the tempo worker has the tempo probabilities, to calculate an estimate */
+    bool isTempoWorkerBusy();
+    
+    /** The tempo worker's thread function */
+    void runTempoWorker();
+    
+    /** Calculates the tempo observation vector from the autocorrelation function of the onset detection function */
+    void calculateTempoObservationVector();
+    
+    /** Updates the tempo probabilities from the tempo observation vector
+     * @returns the index of the most likely tempo state, or -1 if no tempo is possible
+     */
+    int calculateTempo();
+    
+    /** Sets the beat period, in detection function samples, and the tempo estimate from a tempo state
+     * @param tempoIndex the index of the tempo state, or -1 to leave them as they are
+     */
+    void updateBeatPeriod (int tempoIndex);
+    
+    /** Makes a tempo state certain, and every other impossible
+     * @param tempoIndex the index of the tempo state
+     */
+    void resetTempoProbabilities (int tempoIndex);
+    
+    /** Sets the tempo probabilities used in place of the previous ones while the tempo is fixed
+     * @param tempoIndex the index of the fixed tempo state
+     */
+    void setFixedTempoProbabilities (int tempoIndex);
     
     /** Calculates an adaptive threshold which is used to remove low level energy from detection
      * function and emphasise peaks 
      * @param x a pointer to an array containing onset detection function samples
-     * @param N the length of the array, x
+     * @param N the length of the array, x, which must be no more than 512
      */
     void adaptiveThreshold (double* x, int N);
     
-    /** Calculates the mean of values in an array between index locations [startIndex,endIndex]
-     * @param array a pointer to an array that contains the values we wish to find the mean from
+    /** Calculates the mean of the values passed to adaptiveThreshold() between index locations
+     * [startIndex,endIndex), using their cumulative sums
      * @param startIndex the start index from which we would like to calculate the mean
-     * @param endIndex the final index to which we would like to calculate the mean
+     * @param endIndex the index after the last value we would like to calculate the mean of
      * @returns the mean of the sub-section of the array
      */
-    double calculateMeanOfArray (double* array, int startIndex, int endIndex);
+    double calculateMeanOfPrefixSum (int startIndex, int endIndex);
     
-    /** Normalises a given array
-     * @param array a pointer to the array we wish to normalise
-     * @param N the length of the array
-     */
-    void normaliseArray (double* array, int N);
-    
-    /** Calculates the balanced autocorrelation of the smoothed onset detection function
+    /** Calculates the power spectrum of the smoothed onset detection function, the first half
+     * of calculating its balanced autocorrelation
      * @param onsetDetectionFunction a pointer to an array containing the onset detection function
      */
-    void calculateBalancedACF (double* onsetDetectionFunction);
+    void calculatePowerSpectrumForACF (double* onsetDetectionFunction);
+    
+    /** Calculates the balanced autocorrelation of the smoothed onset detection function from its power spectrum */
+    void calculateBalancedACFFromPowerSpectrum();
     
     /** Calculates the output of the comb filter bank */
     void calculateOutputOfCombFilterBank();
+    
+    /** Calculates the output of the comb filter bank for many autocorrelation functions at once, each
+     * exactly as calculateOutputOfCombFilterBank() would
+     * @param acfs the autocorrelation functions, 512 rows with one column for each function
+     * @param numColumns the number of autocorrelation functions
+     * @param outputs the array to write the 128 rows of outputs to, with one column for each function
+     */
+    void calculateOutputsOfCombFilterBank (const double* acfs, int numColumns, double* outputs);
 	
     //=======================================================================
 
     /** An OnsetDetectionFunction instance for calculating onset detection functions */
     OnsetDetectionFunction odf;
     
+#ifdef BTRACK_STAGE_TIMING
+    StageTimingCounter cumulativeScoreTiming;   /**< the time spent in updateCumulativeScore() */
+    StageTimingCounter beatPredictionTiming;    /**< the time spent in predictBeat() */
+    StageTimingCounter resamplingTiming;        /**< the time spent in resampleOnsetDetectionFunction() */
+    StageTimingCounter autocorrelationTiming;   /**< the time spent calculating the autocorrelation function */
+    StageTimingCounter combFilterBankTiming;    /**< the time spent in calculateOutputOfCombFilterBank() */
+    StageTimingCounter viterbiTiming;           /**< the time spent in the Viterbi update of the tempo state */
+#endif
+    
+    /** The kernels used to calculate the cumulative score and the comb filter bank */
+    const SpectralKernels* kernels;
+    
     //=======================================================================
 	// buffers
     
     CircularBuffer onsetDF;                 /**< to hold onset detection function */
     CircularBuffer cumulativeScore;         /**< to hold cumulative score */
     
+    std::vector<double> futureCumulativeScore;  /**< to hold the cumulative score extended into the next beat period when predicting beats */
+    std::vector<double> pastWindows;        /**< the past window for each reachable beat period, one after another */
+    std::vector<double> futureWindows;      /**< the future window for each reachable beat period, one after another */
+    std::vector<int> pastWindowOffsets;     /**< the offset of each beat period's window in pastWindows, or -1 if it is unreachable */
+    std::vector<int> futureWindowOffsets;   /**< the offset of each beat period's window in futureWindows, or -1 if it is unreachable */
+    
     double resampledOnsetDF[512];           /**< to hold resampled detection function */
+    std::vector<double> resamplingInput;    /**< to hold a copy of the onset detection function, for estimates that last more than one hop */
+    const double* resamplingSource;         /**< the onset detection function captured for resampling, in order */
+    std::vector<double> resamplingFilter;   /**< polyphase resampling filter, resamplingFilterLength taps for each phase */
     double acf[512];                        /**<  to hold autocorrelation function */
-    double weightingVector[128];            /**<  to hold weighting vector */
+    double adaptiveThresholdPrefixSum[513]; /**<  to hold cumulative sums of the adaptive threshold input */
+    double adaptiveThresholdValues[512];    /**<  to hold the adaptive threshold */
     double combFilterBankOutput[128];       /**<  to hold comb filter output */
-    double tempoObservationVector[41];      /**<  to hold tempo version of comb filter output */
-    double delta[41];                       /**<  to hold final tempo candidate array */
-    double prevDelta[41];                   /**<  previous delta */
-    double prevDeltaFixed[41];              /**<  fixed tempo version of previous delta */
-    double tempoTransitionMatrix[41][41];   /**<  tempo transition matrix */
+    std::vector<double> tempoObservationVector; /**<  to hold tempo version of comb filter output */
+    std::vector<double> delta;              /**<  to hold final tempo candidate array, as log probabilities */
+    std::vector<double> logPrevDelta;       /**<  previous delta as log probabilities, with tempoTransitionBandwidth impossible states either side */
+    std::vector<double> logPrevDeltaFixed;  /**<  fixed tempo version of previous delta, as log probabilities */
+    std::vector<double> logTempoTransitions;    /**<  log tempo transition probability for each change of tempo index within the bandwidth */
     
 	//=======================================================================
     // parameters
@@ -208,24 +493,36 @@ private:
     double estimatedTempo;                  /**< the current tempo estimation being used by the algorithm */
     double latestCumulativeScoreValue;      /**< holds the latest value of the cumulative score function */
     double tempoToLagFactor;                /**< factor for converting between lag and tempo */
+    double minTempo;                        /**< the tempo of the slowest tempo state, in beats per minute */
+    double maxTempo;                        /**< the tempo of the fastest tempo state, in beats per minute */
+    double tempoResolution;                 /**< the difference between neighbouring tempo states, in beats per minute */
+    int numTempoStates;                     /**< the number of tempo states */
     int m0;                                 /**< indicates when the next point to predict the next beat is */
     int beatCounter;                        /**< keeps track of when the next beat is - will be zero when the beat is due, and is set elsewhere in the algorithm to be positive once a beat prediction is made */
     int hopSize;                            /**< the hop size being used by the algorithm */
+    int sampleRate;                         /**< the sampling frequency of the audio, in Hz */
     int onsetDFBufferSize;                  /**< the onset detection function buffer size */
+    int maxBeatPeriod;                      /**< the longest beat period the tempo can take, in detection function samples */
+    int resamplingUpFactor;                 /**< the onset detection function is resampled by resamplingUpFactor / resamplingDownFactor */
+    int resamplingDownFactor;               /**< the onset detection function is resampled by resamplingUpFactor / resamplingDownFactor */
+    int resamplingFilterLength;             /**< the number of taps in each phase of the resampling filter */
+    int tempoTransitionBandwidth;           /**< the largest change of tempo state considered by each tempo estimate */
     bool tempoFixed;                        /**< indicates whether the tempo should be fixed or not */
+    bool amortiseTempoEstimation;           /**< indicates whether tempo estimates are spread over several hops */
+    int tempoEstimationStage;               /**< the next stage of the tempo estimate in progress (see TempoEstimationStage) */
+    TempoWorker* tempoWorker;               /**< the worker thread estimating the tempo, or NULL if it is estimated in processOnsetDetectionFunctionSample() */
     bool beatDueInFrame;                    /**< indicates whether a beat is due in the current frame */
     int FFTLengthForACFCalculation;         /**< the FFT length for the auto-correlation function calculation */
     
+    const FFTPlan* acfForwardFFT;           /**< shared forward FFT plan for calculating auto-correlation function */
+    const FFTPlan* acfBackwardFFT;          /**< shared inverse FFT plan for calculating auto-correlation function */
+    
 #ifdef USE_FFTW
-    fftw_plan acfForwardFFT;                /**< forward fftw plan for calculating auto-correlation function */
-    fftw_plan acfBackwardFFT;               /**< inverse fftw plan for calculating auto-correlation function */
     fftw_complex* complexIn;                /**< to hold complex fft values for input */
     fftw_complex* complexOut;               /**< to hold complex fft values for output */
 #endif
     
 #ifdef USE_KISS_FFT
-    kiss_fft_cfg cfgForwards;               /**< Kiss FFT configuration */
-    kiss_fft_cfg cfgBackwards;              /**< Kiss FFT configuration */
     kiss_fft_cpx* fftIn;                    /**< FFT input samples, in complex form */
     kiss_fft_cpx* fftOut;                   /**< FFT output samples, in complex form */
 #endif
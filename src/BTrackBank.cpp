@@ -0,0 +1,835 @@
+//=======================================================================
+/** @file BTrackBank.cpp
+ *  @brief A bank of beat trackers that advance together
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#include <cmath>
+#include <algorithm>
+#include "BTrackBank.h"
+
+/** The fewest streams for which the cumulative scores are updated, beats are predicted and the Viterbi update
+ * is made side by side. Below this, making each stream's own vectorised calculation, as BTrack does, is faster */
+static const int minStreamsToVectoriseAcross = 16;
+
+//=======================================================================
+BTrackBank::BTrackBank (int numStreams_, int hopSize_, int frameSize_)
+ :  numStreams (std::max (numStreams_, 1)),
+    tracker (hopSize_, frameSize_),
+    onsetDetectionFunctions (numStreams, hopSize_, frameSize_, ComplexSpectralDifferenceHWR, HanningWindow)
+{
+    initialise();
+}
+
+//=======================================================================
+BTrackBank::BTrackBank (int numStreams_, int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_)
+ :  numStreams (std::max (numStreams_, 1)),
+    tracker (hopSize_, frameSize_, sampleRate_, minTempo_, maxTempo_, tempoResolution_),
+    onsetDetectionFunctions (numStreams, hopSize_, frameSize_, ComplexSpectralDifferenceHWR, HanningWindow)
+{
+    initialise();
+}
+
+//=======================================================================
+BTrackBank::~BTrackBank()
+{
+    delete [] beatDueInFrame;
+}
+
+//=======================================================================
+void BTrackBank::initialise()
+{
+    kernels = tracker.kernels;
+
+    int onsetDFBufferSize = tracker.onsetDFBufferSize;
+    int numTempoStates = tracker.numTempoStates;
+    int bandwidth = tracker.tempoTransitionBandwidth;
+
+    // every stream starts in the state a new BTrack starts in, with the onset
+    // detection function holding one pulse per beat period and a zero cumulative score
+    onsetDFSamples.assign (numStreams, 0);
+    onsetDF.assign (2 * onsetDFBufferSize * numStreams, 0);
+    onsetDFWriteIndex = 0;
+
+    int initialBeatPeriod = (int) round (tracker.beatPeriod);
+
+    for (int i = 0; i < onsetDFBufferSize; i++)
+    {
+        if ((i % initialBeatPeriod) == 0)
+        {
+            std::fill (onsetDF.begin() + (i * numStreams), onsetDF.begin() + ((i + 1) * numStreams), 1.0);
+            std::fill (onsetDF.begin() + ((i + onsetDFBufferSize) * numStreams), onsetDF.begin() + ((i + onsetDFBufferSize + 1) * numStreams), 1.0);
+        }
+    }
+
+    // the cumulative score is never looked at more than two beat periods back
+    historySize = 2 * tracker.maxBeatPeriod;
+    cumulativeScore.assign (2 * historySize * numStreams, 0);
+    cumulativeScoreWriteIndex = 0;
+    pastWeights.assign (historySize * numStreams, 0);
+    firstLaneOfLag.assign (historySize, 0);
+    endLaneOfLag.assign (historySize, 0);
+    streamOfLane.resize (numStreams);
+    laneOfStream.resize (numStreams);
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        streamOfLane[s] = s;
+        laneOfStream[s] = s;
+    }
+
+    beatPeriod.assign (numStreams, tracker.beatPeriod);
+    estimatedTempo.assign (numStreams, tracker.estimatedTempo);
+    m0.assign (numStreams, tracker.m0);
+    beatCounter.assign (numStreams, tracker.beatCounter);
+    beatDueInFrame = new bool[numStreams];
+    logPrevDelta.assign (numTempoStates * numStreams, 0);
+    observationLags.resize (2 * numTempoStates);
+
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        observationLags[2 * j] = (int) round (tracker.tempoToLagFactor / tracker.getTempoOfState (j));
+        observationLags[2 * j + 1] = (int) round (tracker.tempoToLagFactor / (2 * tracker.getTempoOfState (j)));
+    }
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        beatDueInFrame[s] = false;
+        setBeatPeriod (s, tracker.beatPeriod);
+    }
+
+    calculatePastLagRanges();
+
+    // the batches are allocated for every stream, so that processing never allocates memory
+    batch.reserve (numStreams);
+    batchFirstLaneOfLag.assign (historySize, 0);
+    batchEndLaneOfLag.assign (historySize, 0);
+    batchScore.assign ((historySize + tracker.maxBeatPeriod) * numStreams, 0);
+    batchPastWeights.assign (historySize * numStreams, 0);
+    batchFutureWeights.assign (tracker.maxBeatPeriod * numStreams, 0);
+    batchMaxima.assign (numStreams, 0);
+
+    // the tempo of a batch is estimated with its lanes padded to a whole number of vectors
+    int maxLanes = ((numStreams + kernels->numFloatLanes - 1) / kernels->numFloatLanes) * kernels->numFloatLanes;
+
+    batchResampledOnsetDF.assign (512 * maxLanes, 0);
+    batchFFTIn.assign (2 * tracker.FFTLengthForACFCalculation * maxLanes, 0);
+    batchFFTOut.assign (2 * tracker.FFTLengthForACFCalculation * maxLanes, 0);
+    batchACF.assign (512 * maxLanes, 0);
+    batchCombFilterBankOutput.assign (128 * maxLanes, 0);
+    batchLogObservation.assign (numTempoStates * numStreams, 0);
+    batchLogPrevDelta.assign ((numTempoStates + 2 * bandwidth) * numStreams, 0);
+    batchDelta.assign (numTempoStates * numStreams, 0);
+    batchLogSum.assign (numStreams, 0);
+    batchMaxIndex.assign (numStreams, 0);
+}
+
+//=======================================================================
+void BTrackBank::processAudioFrames (double* const* hops)
+{
+    onsetDetectionFunctions.calculateOnsetDetectionFunctionSamples (hops, &onsetDFSamples[0]);
+
+    // each sample is read before it is overwritten, so the samples can be processed in place
+    processOnsetDetectionFunctionSamples (&onsetDFSamples[0]);
+}
+
+//=======================================================================
+void BTrackBank::processOnsetDetectionFunctionSamples (const double* samples)
+{
+    int onsetDFBufferSize = tracker.onsetDFBufferSize;
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        // as for BTrack, the samples are made positive and kept away from zero
+        onsetDFSamples[s] = fabs (samples[s]) + 0.0001;
+
+        m0[s]--;
+        beatCounter[s]--;
+        beatDueInFrame[s] = false;
+    }
+
+    // add the new samples at the end of the onset detection functions, and their mirror image
+    std::copy (onsetDFSamples.begin(), onsetDFSamples.end(), onsetDF.begin() + (onsetDFWriteIndex * numStreams));
+    std::copy (onsetDFSamples.begin(), onsetDFSamples.end(), onsetDF.begin() + ((onsetDFWriteIndex + onsetDFBufferSize) * numStreams));
+
+    onsetDFWriteIndex++;
+
+    if (onsetDFWriteIndex == onsetDFBufferSize)
+    {
+        onsetDFWriteIndex = 0;
+    }
+
+    updateCumulativeScores();
+
+    // predict the next beat of every stream that is halfway between beats. The batch is
+    // gathered in lane order, so that it is in order of beat period too
+    batch.clear();
+
+    for (int lane = 0; lane < numStreams; lane++)
+    {
+        if (m0[streamOfLane[lane]] == 0)
+        {
+            batch.push_back (streamOfLane[lane]);
+        }
+    }
+
+    if (!batch.empty())
+    {
+        predictBeats();
+    }
+
+    // update the tempo of every stream that is at a beat
+    batch.clear();
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        if (beatCounter[s] == 0)
+        {
+            beatDueInFrame[s] = true;
+            batch.push_back (s);
+        }
+    }
+
+    if (!batch.empty())
+    {
+        calculateTempi();
+    }
+}
+
+//=======================================================================
+int BTrackBank::getNumStreams()
+{
+    return numStreams;
+}
+
+//=======================================================================
+int BTrackBank::getHopSize()
+{
+    return tracker.hopSize;
+}
+
+//=======================================================================
+const bool* BTrackBank::getBeatsDueInCurrentFrame()
+{
+    return beatDueInFrame;
+}
+
+//=======================================================================
+const double* BTrackBank::getCurrentTempoEstimates()
+{
+    return &estimatedTempo[0];
+}
+
+//=======================================================================
+void BTrackBank::setBeatPeriod (int stream, double period)
+{
+    beatPeriod[stream] = period;
+
+    moveToLaneInOrder (stream);
+
+    // BTrack weights the cumulative score between two and a half beat periods ago. Here the weights
+    // are indexed by lag, and are zero outside the window
+    int lane = laneOfStream[stream];
+    int longestLag = (int) round (2 * period);
+    int shortestLag = (int) round (period / 2);
+    const double* window = &tracker.pastWindows[tracker.pastWindowOffsets[(int) period]];
+
+    for (int lag = 1; lag <= historySize; lag++)
+    {
+        double weight = 0;
+
+        if ((lag >= shortestLag) && (lag <= longestLag))
+        {
+            weight = window[longestLag - lag];
+        }
+
+        pastWeights[(lag - 1) * numStreams + lane] = weight;
+    }
+}
+
+//=======================================================================
+void BTrackBank::moveToLaneInOrder (int stream)
+{
+    int lane = laneOfStream[stream];
+    double period = beatPeriod[stream];
+
+    // step over each run of streams with the same, shorter or longer, beat period by swapping
+    // with the far end of the run, which keeps the run together with one swap
+    while ((lane > 0) && (beatPeriod[streamOfLane[lane - 1]] > period))
+    {
+        double runPeriod = beatPeriod[streamOfLane[lane - 1]];
+        int runStart = lane - 1;
+
+        while ((runStart > 0) && (beatPeriod[streamOfLane[runStart - 1]] == runPeriod))
+        {
+            runStart--;
+        }
+
+        swapLanes (lane, runStart);
+        lane = runStart;
+    }
+
+    while ((lane < numStreams - 1) && (beatPeriod[streamOfLane[lane + 1]] < period))
+    {
+        double runPeriod = beatPeriod[streamOfLane[lane + 1]];
+        int runEnd = lane + 1;
+
+        while ((runEnd < numStreams - 1) && (beatPeriod[streamOfLane[runEnd + 1]] == runPeriod))
+        {
+            runEnd++;
+        }
+
+        swapLanes (lane, runEnd);
+        lane = runEnd;
+    }
+}
+
+//=======================================================================
+void BTrackBank::swapLanes (int lane1, int lane2)
+{
+    for (int t = 0; t < 2 * historySize; t++)
+    {
+        std::swap (cumulativeScore[t * numStreams + lane1], cumulativeScore[t * numStreams + lane2]);
+    }
+
+    for (int t = 0; t < historySize; t++)
+    {
+        std::swap (pastWeights[t * numStreams + lane1], pastWeights[t * numStreams + lane2]);
+    }
+
+    std::swap (streamOfLane[lane1], streamOfLane[lane2]);
+    laneOfStream[streamOfLane[lane1]] = lane1;
+    laneOfStream[streamOfLane[lane2]] = lane2;
+}
+
+//=======================================================================
+void BTrackBank::calculatePastLagRanges()
+{
+    // the lanes are in order of beat period, so the first has the shortest lags and the last the longest
+    shortestPastLag = std::max ((int) round (beatPeriod[streamOfLane[0]] / 2), 1);
+    longestPastLag = (int) round (2 * beatPeriod[streamOfLane[numStreams - 1]]);
+
+    calculateLaneRanges (&streamOfLane[0], numStreams, &firstLaneOfLag[0], &endLaneOfLag[0]);
+}
+
+//=======================================================================
+void BTrackBank::calculateLaneRanges (const int* streams, int count, int* firstLane, int* endLane)
+{
+    int first = 0;
+    int end = 0;
+
+    // the shortest and longest lags of a window both grow with the beat period, so as the
+    // lag grows, the streams that give it a weight are a range of lanes that moves forwards
+    for (int lag = 1; lag <= historySize; lag++)
+    {
+        while ((first < count) && (round (2 * beatPeriod[streams[first]]) < lag))
+        {
+            first++;
+        }
+
+        while ((end < count) && (round (beatPeriod[streams[end]] / 2) <= lag))
+        {
+            end++;
+        }
+
+        firstLane[lag - 1] = first;
+        endLane[lag - 1] = end;
+    }
+}
+
+//=======================================================================
+void BTrackBank::updateCumulativeScores()
+{
+    double alpha = tracker.alpha;
+
+    if (numStreams < minStreamsToVectoriseAcross)
+    {
+        // the weighted maximum of each stream's past cumulative score on its own, as BTrack::updateCumulativeScore() does
+        for (int lane = 0; lane < numStreams; lane++)
+        {
+            double period = beatPeriod[streamOfLane[lane]];
+            int longestLag = (int) round (2 * period);
+            int windowSize = longestLag - (int) round (period / 2) + 1;
+            double* score = &batchScore[0];
+
+            for (int t = 0; t < windowSize; t++)
+            {
+                score[t] = getCumulativeScoreRow (historySize - longestLag + t)[lane];
+            }
+
+            batchMaxima[lane] = kernels->weightedMaximum (score, &tracker.pastWindows[tracker.pastWindowOffsets[(int) period]], windowSize);
+        }
+    }
+    else
+    {
+        // the weighted maximum of the past cumulative score of every stream, a lag at a time,
+        // over only the lanes whose streams give that lag a weight
+        std::fill (batchMaxima.begin(), batchMaxima.end(), 0.0);
+
+        for (int lag = shortestPastLag; lag <= longestPastLag; lag++)
+        {
+            int first = firstLaneOfLag[lag - 1];
+            int count = endLaneOfLag[lag - 1] - first;
+
+            if (count > 0)
+            {
+                kernels->accumulateWeightedMaximum (getCumulativeScoreRow (historySize - lag) + first, &pastWeights[(lag - 1) * numStreams + first], &batchMaxima[first], count);
+            }
+        }
+    }
+
+    double* row = &cumulativeScore[cumulativeScoreWriteIndex * numStreams];
+    double* mirrorRow = &cumulativeScore[(cumulativeScoreWriteIndex + historySize) * numStreams];
+
+    for (int lane = 0; lane < numStreams; lane++)
+    {
+        row[lane] = ((1 - alpha) * onsetDFSamples[streamOfLane[lane]]) + (alpha * batchMaxima[lane]);
+        mirrorRow[lane] = row[lane];
+    }
+
+    cumulativeScoreWriteIndex++;
+
+    if (cumulativeScoreWriteIndex == historySize)
+    {
+        cumulativeScoreWriteIndex = 0;
+    }
+}
+
+//=======================================================================
+void BTrackBank::predictBeats()
+{
+    int batchSize = (int) batch.size();
+    int longestWindow = 0;
+
+    if (batchSize < minStreamsToVectoriseAcross)
+    {
+        for (int b = 0; b < batchSize; b++)
+        {
+            predictBeat (batch[b]);
+        }
+
+        return;
+    }
+
+    // gather the cumulative scores and windows of the streams in the batch
+    for (int t = 0; t < historySize; t++)
+    {
+        const double* row = getCumulativeScoreRow (t);
+        const double* weights = &pastWeights[t * numStreams];
+
+        for (int b = 0; b < batchSize; b++)
+        {
+            int lane = laneOfStream[batch[b]];
+            batchScore[t * batchSize + b] = row[lane];
+            batchPastWeights[t * batchSize + b] = weights[lane];
+        }
+    }
+
+    for (int b = 0; b < batchSize; b++)
+    {
+        longestWindow = std::max (longestWindow, (int) beatPeriod[batch[b]]);
+    }
+
+    // the batch is in order of beat period, so the streams that give each lag a weight are a range of it
+    int shortestLag = std::max ((int) round (beatPeriod[batch[0]] / 2), 1);
+    int longestLag = (int) round (2 * beatPeriod[batch[batchSize - 1]]);
+
+    calculateLaneRanges (&batch[0], batchSize, &batchFirstLaneOfLag[0], &batchEndLaneOfLag[0]);
+
+    for (int b = 0; b < batchSize; b++)
+    {
+        int windowSize = (int) beatPeriod[batch[b]];
+        const double* window = &tracker.futureWindows[tracker.futureWindowOffsets[windowSize]];
+
+        for (int n = 0; n < longestWindow; n++)
+        {
+            batchFutureWeights[n * batchSize + b] = (n < windowSize) ? window[n] : 0;
+        }
+    }
+
+    // extend the cumulative scores one beat period into the future, as BTrack::predictBeat() does.
+    // Streams with shorter beat periods calculate a little further than they need to
+    for (int i = 0; i < longestWindow; i++)
+    {
+        double* future = &batchScore[(historySize + i) * batchSize];
+
+        std::fill (future, future + batchSize, 0.0);
+
+        for (int lag = shortestLag; lag <= longestLag; lag++)
+        {
+            int first = batchFirstLaneOfLag[lag - 1];
+            int count = batchEndLaneOfLag[lag - 1] - first;
+
+            if (count > 0)
+            {
+                kernels->accumulateWeightedMaximum (&batchScore[(historySize + i - lag) * batchSize + first], &batchPastWeights[(lag - 1) * batchSize + first], future + first, count);
+            }
+        }
+    }
+
+    // predict the beat where the weighted future cumulative score is largest
+    for (int b = 0; b < batchSize; b++)
+    {
+        int s = batch[b];
+        int windowSize = (int) beatPeriod[s];
+        double max = 0;
+
+        for (int n = 0; n < windowSize; n++)
+        {
+            double wcumscore = batchScore[(historySize + n) * batchSize + b] * batchFutureWeights[n * batchSize + b];
+
+            if (wcumscore > max)
+            {
+                max = wcumscore;
+                beatCounter[s] = n;
+            }
+        }
+
+        // set next prediction time
+        m0[s] = beatCounter[s] + round (beatPeriod[s] / 2);
+    }
+}
+
+//=======================================================================
+void BTrackBank::predictBeat (int stream)
+{
+    int lane = laneOfStream[stream];
+    double period = beatPeriod[stream];
+    int windowSize = (int) period;
+    int historyLength = (int) round (2 * period);
+    int pastWindowSize = historyLength - (int) round (period / 2) + 1;
+    double* score = &batchScore[0];
+
+    const double* futureWindow = &tracker.futureWindows[tracker.futureWindowOffsets[windowSize]];
+    const double* pastWindow = &tracker.pastWindows[tracker.pastWindowOffsets[windowSize]];
+
+    // gather the stream's last two beat periods of cumulative score, and extend it as BTrack::predictBeat() does
+    for (int t = 0; t < historyLength; t++)
+    {
+        score[t] = getCumulativeScoreRow (historySize - historyLength + t)[lane];
+    }
+
+    for (int i = historyLength; i < historyLength + windowSize; i++)
+    {
+        score[i] = kernels->weightedMaximum (&score[i - historyLength], pastWindow, pastWindowSize);
+    }
+
+    double max = 0;
+
+    for (int n = 0; n < windowSize; n++)
+    {
+        double wcumscore = score[historyLength + n] * futureWindow[n];
+
+        if (wcumscore > max)
+        {
+            max = wcumscore;
+            beatCounter[stream] = n;
+        }
+    }
+
+    // set next prediction time
+    m0[stream] = beatCounter[stream] + round (period / 2);
+}
+
+//=======================================================================
+void BTrackBank::calculateTempi()
+{
+    int batchSize = (int) batch.size();
+    int onsetDFBufferSize = tracker.onsetDFBufferSize;
+    int numTempoStates = tracker.numTempoStates;
+    int bandwidth = tracker.tempoTransitionBandwidth;
+    int kernelLength = (int) tracker.logTempoTransitions.size();
+
+    // the streams are laid out side by side, and when there is more than one, padded to a whole number of vectors for the FFTs
+    int numLanes = batchSize;
+
+    if (batchSize > 1)
+    {
+        numLanes = ((batchSize + kernels->numFloatLanes - 1) / kernels->numFloatLanes) * kernels->numFloatLanes;
+    }
+
+    // resample and apply an adaptive threshold to each stream's onset detection function with the shared tracker
+    for (int b = 0; b < batchSize; b++)
+    {
+        for (int t = 0; t < onsetDFBufferSize; t++)
+        {
+            tracker.resamplingInput[t] = getOnsetDFRow (t)[batch[b]];
+        }
+
+        tracker.resamplingSource = &tracker.resamplingInput[0];
+        tracker.resampleOnsetDetectionFunction();
+        tracker.adaptiveThreshold (tracker.resampledOnsetDF, 512);
+
+        for (int i = 0; i < 512; i++)
+        {
+            batchResampledOnsetDF[i * numLanes + b] = tracker.resampledOnsetDF[i];
+        }
+    }
+
+    // then calculate the autocorrelation functions and comb filter bank outputs of every stream at once
+    calculateBalancedACFs (numLanes);
+    tracker.calculateOutputsOfCombFilterBank (&batchACF[0], numLanes, &batchCombFilterBankOutput[0]);
+
+    // and observe the tempo states of each stream, as BTrack::calculateTempoObservationVector() does
+    for (int b = 0; b < batchSize; b++)
+    {
+        for (int i = 0; i < 128; i++)
+        {
+            tracker.combFilterBankOutput[i] = batchCombFilterBankOutput[i * numLanes + b];
+        }
+
+        tracker.adaptiveThreshold (tracker.combFilterBankOutput, 128);
+
+        if (batchSize < minStreamsToVectoriseAcross)
+        {
+            calculateTempo (batch[b]);
+            continue;
+        }
+
+        for (int j = 0; j < numTempoStates; j++)
+        {
+            batchLogObservation[j * batchSize + b] = log (tracker.combFilterBankOutput[observationLags[2 * j] - 1] + tracker.combFilterBankOutput[observationLags[2 * j + 1] - 1]);
+        }
+    }
+
+    if (batchSize < minStreamsToVectoriseAcross)
+    {
+        calculatePastLagRanges();
+        return;
+    }
+
+    // gather the previous tempo state probabilities, with impossible states either side
+    std::fill (batchLogPrevDelta.begin(), batchLogPrevDelta.begin() + ((numTempoStates + 2 * bandwidth) * batchSize), -INFINITY);
+
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        for (int b = 0; b < batchSize; b++)
+        {
+            batchLogPrevDelta[(j + bandwidth) * batchSize + b] = logPrevDelta[j * numStreams + batch[b]];
+        }
+    }
+
+    // the Viterbi update, in the log domain, for every stream in the batch at once
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        double* delta = &batchDelta[j * batchSize];
+
+        std::fill (delta, delta + batchSize, -INFINITY);
+
+        for (int k = 0; k < kernelLength; k++)
+        {
+            kernels->accumulateMaxPlus (&batchLogPrevDelta[(j + k) * batchSize], tracker.logTempoTransitions[k], delta, batchSize);
+        }
+    }
+
+    for (int b = 0; b < batchSize; b++)
+    {
+        batchMaxima[b] = -INFINITY;
+        batchMaxIndex[b] = -1;
+        batchLogSum[b] = 0;
+    }
+
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        for (int b = 0; b < batchSize; b++)
+        {
+            double& delta = batchDelta[j * batchSize + b];
+
+            delta = delta + batchLogObservation[j * batchSize + b];
+
+            if (delta > batchMaxima[b])
+            {
+                batchMaxima[b] = delta;
+                batchMaxIndex[b] = j;
+            }
+        }
+    }
+
+    // normalise, so that the probabilities sum to one
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        for (int b = 0; b < batchSize; b++)
+        {
+            batchLogSum[b] = batchLogSum[b] + exp (batchDelta[j * batchSize + b] - batchMaxima[b]);
+        }
+    }
+
+    for (int b = 0; b < batchSize; b++)
+    {
+        int s = batch[b];
+
+        // if no tempo is possible then there is nothing to update the tempo from
+        if (batchMaxIndex[b] < 0)
+        {
+            continue;
+        }
+
+        double logSum = batchMaxima[b] + log (batchLogSum[b]);
+
+        for (int j = 0; j < numTempoStates; j++)
+        {
+            logPrevDelta[j * numStreams + s] = batchDelta[j * batchSize + b] - logSum;
+        }
+
+        updateBeatPeriod (s, batchMaxIndex[b]);
+    }
+
+    calculatePastLagRanges();
+}
+
+//=======================================================================
+void BTrackBank::calculateTempo (int stream)
+{
+    int numTempoStates = tracker.numTempoStates;
+    double* logPrevDeltaStates = &tracker.logPrevDelta[tracker.tempoTransitionBandwidth];
+
+    // observe the tempo states from the thresholded comb filter bank output, as
+    // BTrack::calculateTempoObservationVector() does, and give the tracker the stream's probabilities
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        tracker.tempoObservationVector[j] = tracker.combFilterBankOutput[observationLags[2 * j] - 1] + tracker.combFilterBankOutput[observationLags[2 * j + 1] - 1];
+        logPrevDeltaStates[j] = logPrevDelta[j * numStreams + stream];
+    }
+
+    int tempoIndex = tracker.calculateTempo();
+
+    // if no tempo is possible then there is nothing to update the tempo from
+    if (tempoIndex < 0)
+    {
+        return;
+    }
+
+    for (int j = 0; j < numTempoStates; j++)
+    {
+        logPrevDelta[j * numStreams + stream] = logPrevDeltaStates[j];
+    }
+
+    updateBeatPeriod (stream, tempoIndex);
+}
+
+//=======================================================================
+void BTrackBank::updateBeatPeriod (int stream, int tempoIndex)
+{
+    setBeatPeriod (stream, round ((60.0*tracker.sampleRate)/(tracker.getTempoOfState (tempoIndex)*((double) tracker.hopSize))));
+
+    if (beatPeriod[stream] > 0)
+    {
+        estimatedTempo[stream] = 60.0/((((double) tracker.hopSize) / tracker.sampleRate) * beatPeriod[stream]);
+    }
+}
+
+//=======================================================================
+void BTrackBank::calculateBalancedACFs (int numLanes)
+{
+    int batchSize = (int) batch.size();
+
+#ifdef USE_KISS_FFT
+    // the streams are transformed side by side when there are enough of them to fill the vectors better than one stream alone
+    if ((batchSize > 1) && (kernels->numFloatLanes > 1))
+    {
+        int fftLength = tracker.FFTLengthForACFCalculation;
+        int rowSize = 2 * numLanes;
+        float* in = &batchFFTIn[0];
+        float* out = &batchFFTOut[0];
+
+        // copy into the complex rows and zero pad, with silence in the padding lanes
+        std::fill (in, in + (fftLength * rowSize), 0.0f);
+
+        for (int i = 0; i < 512; i++)
+        {
+            for (int b = 0; b < batchSize; b++)
+            {
+                in[i * rowSize + b] = batchResampledOnsetDF[i * numLanes + b];
+            }
+        }
+
+        // transform, multiply by the complex conjugate and transform back
+        FFTCache::performInterleavedFFT (tracker.acfForwardFFT, *kernels, in, out, numLanes, numLanes);
+
+        for (int i = 0; i < fftLength; i++)
+        {
+            float* row = out + (i * rowSize);
+
+            for (int b = 0; b < batchSize; b++)
+            {
+                row[b] = row[b] * row[b] + row[numLanes + b] * row[numLanes + b];
+                row[numLanes + b] = 0.0;
+            }
+        }
+
+        FFTCache::performInterleavedFFT (tracker.acfBackwardFFT, *kernels, out, in, numLanes, numLanes);
+
+        double lag = 512;
+
+        for (int i = 0; i < 512; i++)
+        {
+            const float* row = in + (i * rowSize);
+            double* acf = &batchACF[i * numLanes];
+
+            for (int b = 0; b < batchSize; b++)
+            {
+                double absValue = sqrt (row[b] * row[b] + row[numLanes + b] * row[numLanes + b]);
+
+                // balanced and scaled as BTrack::calculateBalancedACFFromPowerSpectrum() does
+                acf[b] = absValue / lag;
+                acf[b] = acf[b] / 1024.;
+            }
+
+            std::fill (acf + batchSize, acf + numLanes, 0.0);
+
+            lag = lag - 1.;
+        }
+
+        return;
+    }
+#endif
+
+    // otherwise each stream is transformed in turn with the shared tracker's buffers
+    for (int b = 0; b < batchSize; b++)
+    {
+        for (int i = 0; i < 512; i++)
+        {
+            tracker.resampledOnsetDF[i] = batchResampledOnsetDF[i * numLanes + b];
+        }
+
+        tracker.calculatePowerSpectrumForACF (tracker.resampledOnsetDF);
+        tracker.calculateBalancedACFFromPowerSpectrum();
+
+        for (int i = 0; i < 512; i++)
+        {
+            batchACF[i * numLanes + b] = tracker.acf[i];
+        }
+    }
+
+    for (int i = 0; i < 512; i++)
+    {
+        std::fill (batchACF.begin() + (i * numLanes + batchSize), batchACF.begin() + ((i + 1) * numLanes), 0.0);
+    }
+}
+
+//=======================================================================
+const double* BTrackBank::getOnsetDFRow (int hop)
+{
+    return &onsetDF[(onsetDFWriteIndex + hop) * numStreams];
+}
+
+//=======================================================================
+const double* BTrackBank::getCumulativeScoreRow (int hop)
+{
+    return &cumulativeScore[(cumulativeScoreWriteIndex + hop) * numStreams];
+}
@@ -0,0 +1,225 @@
+//=======================================================================
+/** @file BTrackBank.h
+ *  @brief A bank of beat trackers that advance together
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#ifndef __BTRACKBANK_H
+#define __BTRACKBANK_H
+
+#include "BTrack.h"
+#include "OnsetDetectionFunctionBank.h"
+#include <vector>
+
+//=======================================================================
+/** Tracks the beats of many independent streams at once, one hop of every stream per call.
+ * Each stream gives exactly the same beats and tempi as its own BTrack would, with the same settings
+ * (when built with fftw, the batched FFT of the audio can differ from a single FFT by rounding error).
+ *
+ * The state of all of the streams is held together, with the values for each stream side by side
+ * (e.g. the cumulative score of every stream for one hop, then for the next hop) so that the cumulative
+ * score update, beat prediction and Viterbi update are calculated for many streams at once with the
+ * vectorised kernels. The cumulative scores are kept in lanes in order of beat period, so that the streams
+ * that look back a given number of hops are next to each other, and each stream's update only covers its
+ * own window, as it would in its own BTrack. Each hop, the beats are predicted for all of the streams that
+ * are halfway between beats together, and the tempo is updated for all of the streams that are on a beat together.
+ * With fewer streams than fill a few vectors, these steps are instead made one stream at a time, each with
+ * the vectorised calculation that BTrack uses, which is then faster.
+ *
+ * The tempo observations of the streams that are on a beat are always calculated as a batch: with Kiss FFT,
+ * the autocorrelation FFTs of the batch are interleaved, one stream per lane, and the comb filter bank is
+ * applied to every stream's autocorrelation function as one matrix-matrix product.
+ * Everything that does not depend on the stream, such as the windows, the tempo states and the
+ * buffers used to estimate the tempo, is shared.
+ */
+class BTrackBank
+{
+public:
+
+    //=======================================================================
+    /** Constructor taking the number of streams, the hop size and the frame size
+     * @param numStreams the number of streams to track, at least one
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     */
+    BTrackBank (int numStreams_, int hopSize_, int frameSize_);
+
+    /** Constructor taking the number of streams, the hop size, frame size, sampling frequency and the range and
+     * resolution of the tempo states. These are the same for every stream and have the same meaning as for BTrack
+     * @param numStreams the number of streams to track, at least one
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     * @param sampleRate the sampling frequency of the audio in Hz
+     * @param minTempo the slowest tempo, in beats per minute
+     * @param maxTempo the fastest tempo, in beats per minute
+     * @param tempoResolution the difference between neighbouring tempo states, in beats per minute
+     */
+    BTrackBank (int numStreams_, int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_);
+
+    /** Destructor */
+    ~BTrackBank();
+
+    //=======================================================================
+    /** Process the next hop of audio of every stream
+     * @param hops an array of numStreams pointers, each to the next hopSize audio samples of one stream
+     */
+    void processAudioFrames (double* const* hops);
+
+    /** Process the next onset detection function sample of every stream
+     * @param samples an array of numStreams onset detection function samples, one for each stream
+     */
+    void processOnsetDetectionFunctionSamples (const double* samples);
+
+    //=======================================================================
+    /** @returns the number of streams */
+    int getNumStreams();
+
+    /** @returns the hop size being used by the beat trackers */
+    int getHopSize();
+
+    /** @returns an array of numStreams flags, each true if a beat should occur in the current audio frame of that stream */
+    const bool* getBeatsDueInCurrentFrame();
+
+    /** @returns an array of numStreams tempo estimates, in beats per minute, one for each stream */
+    const double* getCurrentTempoEstimates();
+
+private:
+
+    /** Initialise the state of every stream, given the settings of the shared beat tracker */
+    void initialise();
+
+    /** Set the beat period of a stream, and the weights it uses to update its cumulative score
+     * @param stream the stream
+     * @param period the beat period in detection function samples
+     */
+    void setBeatPeriod (int stream, double period);
+
+    /** Move a stream to a new lane, if needed, so that the lanes stay in order of beat period
+     * @param stream the stream, whose beat period has just been set
+     */
+    void moveToLaneInOrder (int stream);
+
+    /** Swap the cumulative scores and past weights of two lanes, and the streams they hold
+     * @param lane1 the first lane
+     * @param lane2 the second lane
+     */
+    void swapLanes (int lane1, int lane2);
+
+    /** Find the shortest and longest lags that any stream's cumulative score update looks at, and the lanes that look at each lag */
+    void calculatePastLagRanges();
+
+    /** Find the range of a list of streams, in order of beat period, that give a weight to each lag from 1 to historySize
+     * @param streams the streams, in order of beat period
+     * @param count the number of streams
+     * @param firstLane an array of historySize values to write the first stream in the list that gives each lag a weight to
+     * @param endLane an array of historySize values to write the stream after the last one in the list that gives each lag a weight to
+     */
+    void calculateLaneRanges (const int* streams, int count, int* firstLane, int* endLane);
+
+    /** Update the cumulative score of every stream with the latest onset detection function samples */
+    void updateCumulativeScores();
+
+    /** Predict the next beat of each of the streams in the batch */
+    void predictBeats();
+
+    /** Predict the next beat of one stream on its own, as BTrack::predictBeat() does
+     * @param stream the stream
+     */
+    void predictBeat (int stream);
+
+    /** Update the tempo of each of the streams in the batch */
+    void calculateTempi();
+
+    /** Make the Viterbi update of one stream on its own with the shared tracker, from the thresholded comb filter bank output in its buffer
+     * @param stream the stream
+     */
+    void calculateTempo (int stream);
+
+    /** Set the beat period and tempo of a stream from its most likely tempo state, as BTrack::updateBeatPeriod() does
+     * @param stream the stream
+     * @param tempoIndex the index of the tempo state
+     */
+    void updateBeatPeriod (int stream, int tempoIndex);
+
+    /** Calculate the balanced autocorrelation function of the resampled onset detection function of each of the streams
+     * in the batch, as BTrack::calculatePowerSpectrumForACF() and BTrack::calculateBalancedACFFromPowerSpectrum() do
+     * @param numLanes the number of lanes of the batch, including the padding after the last stream
+     */
+    void calculateBalancedACFs (int numLanes);
+
+    /** @returns a pointer to the onset detection function samples of every stream for one hop, where hop 0 is the oldest */
+    const double* getOnsetDFRow (int hop);
+
+    /** @returns a pointer to the cumulative score of every stream for one hop, where hop 0 is the oldest */
+    const double* getCumulativeScoreRow (int hop);
+
+    //=======================================================================
+    int numStreams;                         /**< the number of streams */
+    BTrack tracker;                         /**< the beat tracker whose windows, tempo states and tempo estimation buffers are shared by every stream */
+    const SpectralKernels* kernels;         /**< the kernels used to calculate every stream at once */
+    OnsetDetectionFunctionBank onsetDetectionFunctions;    /**< the onset detection function of each stream, calculated with one batch of FFTs */
+
+    //=======================================================================
+    // the state of every stream, with the values for each stream side by side
+
+    std::vector<double> onsetDFSamples;     /**< the latest onset detection function sample of each stream */
+    std::vector<double> onsetDF;            /**< the onset detection function of each stream, one row per hop, as a circular buffer followed by its mirror image */
+    int onsetDFWriteIndex;                  /**< the row of the oldest hop of the onset detection functions */
+
+    int historySize;                        /**< the number of hops of cumulative score kept, enough for two of the longest beat periods */
+    std::vector<double> cumulativeScore;    /**< the cumulative score of each lane, one row per hop, as a circular buffer followed by its mirror image */
+    int cumulativeScoreWriteIndex;          /**< the row of the oldest hop of the cumulative scores */
+    std::vector<double> pastWeights;        /**< the weight each lane gives its cumulative score at each lag, from 1 to historySize hops, when updating it */
+    std::vector<int> streamOfLane;          /**< the stream in each lane of the cumulative scores and past weights, in order of beat period */
+    std::vector<int> laneOfStream;          /**< the lane of each stream */
+    int shortestPastLag;                    /**< the shortest lag any stream gives a weight to */
+    int longestPastLag;                     /**< the longest lag any stream gives a weight to */
+    std::vector<int> firstLaneOfLag;        /**< the first lane that gives each lag, from 1 to historySize, a weight */
+    std::vector<int> endLaneOfLag;          /**< the lane after the last one that gives each lag a weight */
+
+    std::vector<double> beatPeriod;         /**< the beat period of each stream, in detection function samples */
+    std::vector<double> estimatedTempo;     /**< the tempo estimate of each stream, in beats per minute */
+    std::vector<int> m0;                    /**< the number of hops until each stream is halfway between beats */
+    std::vector<int> beatCounter;           /**< the number of hops until each stream's next beat */
+    bool* beatDueInFrame;                   /**< whether each stream has a beat due in the current frame */
+    std::vector<double> logPrevDelta;       /**< the previous tempo state log probabilities of each stream, one row per tempo state */
+    std::vector<int> observationLags;       /**< the lags of the two comb filter bank outputs that are summed to observe each tempo state */
+
+    //=======================================================================
+    // buffers for the batch of streams being predicted or updated, with the values for each stream side by side
+
+    std::vector<int> batch;                 /**< the streams in the batch */
+    std::vector<int> batchFirstLaneOfLag;   /**< the first stream in the batch that gives each lag a weight, when predicting beats */
+    std::vector<int> batchEndLaneOfLag;     /**< the stream after the last one in the batch that gives each lag a weight, when predicting beats */
+    std::vector<double> batchScore;         /**< the cumulative score of each stream, extended by one beat period into the future */
+    std::vector<double> batchPastWeights;   /**< the past weights of each stream */
+    std::vector<double> batchFutureWeights; /**< the future window of each stream, padded with zeros to the longest beat period */
+    std::vector<double> batchMaxima;        /**< the running maximum for each stream */
+    std::vector<double> batchResampledOnsetDF;  /**< the resampled and thresholded onset detection function of each stream */
+    std::vector<float> batchFFTIn;          /**< the complex rows the autocorrelation FFTs transform from, the real part of each stream then the imaginary parts */
+    std::vector<float> batchFFTOut;         /**< the complex rows the autocorrelation FFTs transform to */
+    std::vector<double> batchACF;           /**< the balanced autocorrelation function of each stream */
+    std::vector<double> batchCombFilterBankOutput;  /**< the output of the comb filter bank for each stream */
+    std::vector<double> batchLogPrevDelta;  /**< the previous tempo state log probabilities, with tempoTransitionBandwidth impossible states either side */
+    std::vector<double> batchLogObservation;    /**< the log of the tempo observation vector of each stream */
+    std::vector<double> batchDelta;         /**< the new tempo state log probabilities */
+    std::vector<double> batchLogSum;        /**< the log of the sum of the probabilities of each stream */
+    std::vector<int> batchMaxIndex;         /**< the most likely tempo state of each stream */
+};
+
+#endif
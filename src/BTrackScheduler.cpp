@@ -0,0 +1,584 @@
+//=======================================================================
+/** @file BTrackScheduler.cpp
+ *  @brief A pool of worker threads that track the beats of many streams
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "BTrackScheduler.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+/** The most hops of one stream that a worker processes before it puts the stream back in the queue */
+static const int maxHopsPerTurn = 4;
+
+//=======================================================================
+/** @returns the time on the steady clock, in nanoseconds */
+static long long getNanoseconds()
+{
+    return (long long) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//=======================================================================
+/** One stream: its beat tracker, and the queues of hops and results that it shares with the thread
+ * feeding it. Each queue is a ring buffer with a single producer and a single consumer, which count
+ * the items they have added and removed. The worker processing the stream is the consumer of its
+ * hops and the producer of its results, and as only one worker can hold the stream at a time, its
+ * state hands the stream over from one worker to the next.
+ */
+struct SchedulerStream
+{
+    enum State
+    {
+        Idle,                   /**< not in any queue, with no hops waiting when it became idle */
+        Scheduled,              /**< in one worker's run queue */
+        Running                 /**< being processed by a worker */
+    };
+
+    SchedulerStream (int hopSize_, int frameSize_, int queueLength_)
+     :  tracker (hopSize_, frameSize_),
+        hopSize (hopSize_),
+        queueLength (queueLength_),
+        hops (hopSize_ * queueLength_),
+        results (queueLength_)
+    {
+        numHopsPushed = 0;
+        numHopsProcessed = 0;
+        numResultsWritten = 0;
+        numResultsRead = 0;
+        state = Idle;
+    }
+
+    BTrack tracker;
+    int hopSize;
+    int queueLength;
+
+    std::vector<double> hops;
+    std::atomic<long> numHopsPushed;
+    std::atomic<long> numHopsProcessed;
+
+    std::vector<StreamResult> results;
+    std::atomic<long> numResultsWritten;
+    std::atomic<long> numResultsRead;
+
+    std::atomic<int> state;
+    std::atomic<int> priority;
+    std::atomic<int> preferredWorker;   /**< the worker the stream is always queued with, or -1 */
+    std::atomic<bool> exclusive;        /**< true if only the preferred worker may process the stream */
+    std::atomic<int> lastWorker;        /**< the worker that processed the stream last */
+};
+
+//=======================================================================
+/** A double ended queue of streams, as a ring buffer large enough for every stream */
+struct StreamQueue
+{
+    void initialise (int capacity)
+    {
+        entries.assign (capacity, NULL);
+        front = 0;
+        size = 0;
+    }
+
+    void pushBack (SchedulerStream* stream)
+    {
+        entries[(front + size) % entries.size()] = stream;
+        size++;
+    }
+
+    SchedulerStream* popFront()
+    {
+        if (size == 0)
+        {
+            return NULL;
+        }
+
+        SchedulerStream* stream = entries[front];
+        front = (front + 1) % entries.size();
+        size--;
+        return stream;
+    }
+
+    SchedulerStream* popBack()
+    {
+        if (size == 0)
+        {
+            return NULL;
+        }
+
+        size--;
+        return entries[(front + size) % entries.size()];
+    }
+
+    std::vector<SchedulerStream*> entries;
+    int front;
+    int size;
+};
+
+//=======================================================================
+/** One worker: its thread, its run queues, one of each priority for the streams any worker may take
+ * and one of each priority for the streams only it may process, and the statistics of its work
+ */
+struct SchedulerWorker
+{
+    std::thread thread;
+    std::mutex mutex;                   /**< protects the run queues */
+    StreamQueue queues[NumStreamPriorities];
+    StreamQueue exclusiveQueues[NumStreamPriorities];
+    std::atomic<int> numExclusiveStreams;
+
+    std::atomic<unsigned long long> numHopsProcessed;
+    std::atomic<unsigned long long> numStreamsStolen;
+    std::atomic<unsigned long long> busyNanoseconds;
+    std::atomic<long long> statisticsStartTime;
+};
+
+//=======================================================================
+BTrackScheduler::BTrackScheduler (int numWorkers_, int maxNumStreams_)
+ :  maxNumStreams (std::max (maxNumStreams_, 1)),
+    streams (maxNumStreams, NULL)
+{
+    numStreams = 0;
+    nextWorker = 0;
+    numStealableStreams = 0;
+    numSleepingWorkers = 0;
+    shouldExit = false;
+
+    int numWorkers = numWorkers_;
+
+    if (numWorkers <= 0)
+    {
+        numWorkers = std::max ((int) std::thread::hardware_concurrency(), 1);
+    }
+
+    // every worker is set up before any of them start, as they look at each other's queues
+    for (int w = 0; w < numWorkers; w++)
+    {
+        SchedulerWorker* worker = new SchedulerWorker();
+
+        for (int p = 0; p < NumStreamPriorities; p++)
+        {
+            worker->queues[p].initialise (maxNumStreams);
+            worker->exclusiveQueues[p].initialise (maxNumStreams);
+        }
+
+        worker->numExclusiveStreams = 0;
+        workers.push_back (worker);
+    }
+
+    resetWorkerStatistics();
+
+    for (int w = 0; w < numWorkers; w++)
+    {
+        workers[w]->thread = std::thread (&BTrackScheduler::runWorker, this, w);
+    }
+}
+
+//=======================================================================
+BTrackScheduler::~BTrackScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock (sleepMutex);
+        shouldExit = true;
+    }
+
+    sleepCondition.notify_all();
+
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        workers[w]->thread.join();
+        delete workers[w];
+    }
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        delete streams[s];
+    }
+}
+
+//=======================================================================
+int BTrackScheduler::addStream (int hopSize, int frameSize)
+{
+    return addStream (hopSize, frameSize, NormalPriority, 16);
+}
+
+//=======================================================================
+int BTrackScheduler::addStream (int hopSize, int frameSize, int priority, int queueLength)
+{
+    // streams are added one at a time, so that no two are given the same index
+    std::lock_guard<std::mutex> lock (addStreamMutex);
+
+    int index = numStreams.load();
+
+    if (index >= maxNumStreams)
+    {
+        return -1;
+    }
+
+    SchedulerStream* stream = new SchedulerStream (hopSize, frameSize, std::max (queueLength, 1));
+    stream->priority = std::min (std::max (priority, (int) LowPriority), (int) HighPriority);
+    stream->preferredWorker = -1;
+    stream->exclusive = false;
+    stream->lastWorker = nextWorker.fetch_add (1) % getNumWorkers();
+
+    streams[index] = stream;
+
+    // the stream can be used by other threads once it is counted
+    numStreams.store (index + 1);
+
+    return index;
+}
+
+//=======================================================================
+int BTrackScheduler::getNumStreams()
+{
+    return numStreams;
+}
+
+//=======================================================================
+int BTrackScheduler::getNumWorkers()
+{
+    return (int) workers.size();
+}
+
+//=======================================================================
+bool BTrackScheduler::pushHop (int streamIndex, const double* hop)
+{
+    SchedulerStream* stream = streams[streamIndex];
+
+    long numPushed = stream->numHopsPushed.load (std::memory_order_relaxed);
+
+    if (numPushed - stream->numHopsProcessed.load (std::memory_order_acquire) >= stream->queueLength)
+    {
+        return false;
+    }
+
+    std::copy (hop, hop + stream->hopSize, stream->hops.begin() + ((numPushed % stream->queueLength) * stream->hopSize));
+
+    stream->numHopsPushed.store (numPushed + 1);
+
+    scheduleStreamIfIdle (stream);
+
+    return true;
+}
+
+//=======================================================================
+bool BTrackScheduler::popResult (int streamIndex, StreamResult& result)
+{
+    SchedulerStream* stream = streams[streamIndex];
+
+    long numRead = stream->numResultsRead.load (std::memory_order_relaxed);
+
+    if (numRead == stream->numResultsWritten.load (std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    result = stream->results[numRead % stream->queueLength];
+    stream->numResultsRead.store (numRead + 1);
+
+    // the stream may have been waiting for room for its results
+    scheduleStreamIfIdle (stream);
+
+    return true;
+}
+
+//=======================================================================
+void BTrackScheduler::setStreamPriority (int streamIndex, int priority)
+{
+    streams[streamIndex]->priority = std::min (std::max (priority, (int) LowPriority), (int) HighPriority);
+}
+
+//=======================================================================
+int BTrackScheduler::getStreamPriority (int streamIndex)
+{
+    return streams[streamIndex]->priority;
+}
+
+//=======================================================================
+void BTrackScheduler::setStreamAffinity (int streamIndex, int worker, bool exclusive)
+{
+    SchedulerStream* stream = streams[streamIndex];
+
+    if (worker < 0 || worker >= getNumWorkers())
+    {
+        stream->preferredWorker = -1;
+        stream->exclusive = false;
+    }
+    else
+    {
+        stream->preferredWorker = worker;
+        stream->exclusive = exclusive;
+    }
+}
+
+//=======================================================================
+bool BTrackScheduler::setWorkerCore (int worker, int core)
+{
+#ifdef __linux__
+    cpu_set_t cores;
+    CPU_ZERO (&cores);
+    CPU_SET (core, &cores);
+
+    return pthread_setaffinity_np (workers[worker]->thread.native_handle(), sizeof (cpu_set_t), &cores) == 0;
+#else
+    return false;
+#endif
+}
+
+//=======================================================================
+WorkerStatistics BTrackScheduler::getWorkerStatistics (int worker)
+{
+    SchedulerWorker* w = workers[worker];
+    WorkerStatistics statistics;
+
+    statistics.numHopsProcessed = w->numHopsProcessed.load (std::memory_order_relaxed);
+    statistics.numStreamsStolen = w->numStreamsStolen.load (std::memory_order_relaxed);
+    statistics.busyNanoseconds = w->busyNanoseconds.load (std::memory_order_relaxed);
+    statistics.elapsedNanoseconds = (unsigned long long) std::max (getNanoseconds() - w->statisticsStartTime.load (std::memory_order_relaxed), 0LL);
+    statistics.utilisation = 0;
+
+    if (statistics.elapsedNanoseconds > 0)
+    {
+        statistics.utilisation = std::min ((double) statistics.busyNanoseconds / (double) statistics.elapsedNanoseconds, 1.0);
+    }
+
+    return statistics;
+}
+
+//=======================================================================
+void BTrackScheduler::resetWorkerStatistics()
+{
+    long long now = getNanoseconds();
+
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        workers[w]->numHopsProcessed.store (0, std::memory_order_relaxed);
+        workers[w]->numStreamsStolen.store (0, std::memory_order_relaxed);
+        workers[w]->busyNanoseconds.store (0, std::memory_order_relaxed);
+        workers[w]->statisticsStartTime.store (now, std::memory_order_relaxed);
+    }
+}
+
+//=======================================================================
+void BTrackScheduler::scheduleStreamIfIdle (SchedulerStream* stream)
+{
+    // a stream can be processed if it has hops waiting and room for their results
+    long numProcessed = stream->numHopsProcessed.load();
+    bool hasHops = stream->numHopsPushed.load() > numProcessed;
+    bool hasRoom = numProcessed - stream->numResultsRead.load() < stream->queueLength;
+
+    if (!hasHops || !hasRoom)
+    {
+        return;
+    }
+
+    // if the stream is idle, it is up to us to queue it. If not, whoever has it
+    // will see the change once they are done with it, and queue it if they need to
+    int expected = SchedulerStream::Idle;
+
+    if (stream->state.compare_exchange_strong (expected, SchedulerStream::Scheduled))
+    {
+        scheduleStream (stream);
+    }
+}
+
+//=======================================================================
+void BTrackScheduler::scheduleStream (SchedulerStream* stream)
+{
+    int priority = stream->priority;
+    int worker = stream->preferredWorker;
+    bool exclusive = stream->exclusive && worker >= 0;
+
+    // by default a stream goes back to the worker that last had it, whose cache still holds it
+    if (worker < 0)
+    {
+        worker = stream->lastWorker;
+    }
+
+    SchedulerWorker* w = workers[worker];
+
+    {
+        std::lock_guard<std::mutex> lock (w->mutex);
+
+        if (exclusive)
+        {
+            w->exclusiveQueues[priority].pushBack (stream);
+            w->numExclusiveStreams++;
+        }
+        else
+        {
+            w->queues[priority].pushBack (stream);
+            numStealableStreams++;
+        }
+    }
+
+    // a worker counts itself as sleeping before it checks for work, so if none are counted here,
+    // any that goes to sleep will see the stream first. Taking the lock means that a worker that
+    // has counted itself cannot miss the notification
+    if (numSleepingWorkers > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock (sleepMutex);
+        }
+
+        // an exclusive stream can only be taken by its own worker, which could be any of them
+        if (exclusive)
+        {
+            sleepCondition.notify_all();
+        }
+        else
+        {
+            sleepCondition.notify_one();
+        }
+    }
+}
+
+//=======================================================================
+SchedulerStream* BTrackScheduler::findStream (int worker)
+{
+    SchedulerWorker* w = workers[worker];
+    int numWorkers = getNumWorkers();
+
+    for (int p = HighPriority; p >= LowPriority; p--)
+    {
+        {
+            std::lock_guard<std::mutex> lock (w->mutex);
+
+            SchedulerStream* stream = w->exclusiveQueues[p].popFront();
+
+            if (stream != NULL)
+            {
+                w->numExclusiveStreams--;
+                return stream;
+            }
+
+            stream = w->queues[p].popFront();
+
+            if (stream != NULL)
+            {
+                numStealableStreams--;
+                return stream;
+            }
+        }
+
+        // steal the stream that has waited least, from the back of another worker's queue,
+        // leaving the front, which that worker will take next, alone
+        for (int i = 1; i < numWorkers && numStealableStreams > 0; i++)
+        {
+            SchedulerWorker* victim = workers[(worker + i) % numWorkers];
+            std::lock_guard<std::mutex> lock (victim->mutex);
+
+            SchedulerStream* stream = victim->queues[p].popBack();
+
+            if (stream != NULL)
+            {
+                numStealableStreams--;
+                w->numStreamsStolen.fetch_add (1, std::memory_order_relaxed);
+                return stream;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+//=======================================================================
+void BTrackScheduler::processStream (int worker, SchedulerStream* stream)
+{
+    SchedulerWorker* w = workers[worker];
+    long long startTime = getNanoseconds();
+
+    stream->state = SchedulerStream::Running;
+    stream->lastWorker = worker;
+
+    // this worker is the only one processing the stream, so is the only one changing these counts.
+    // The number of results written is always the number of hops processed
+    long numProcessed = stream->numHopsProcessed.load (std::memory_order_relaxed);
+    long numWaiting = stream->numHopsPushed.load (std::memory_order_acquire) - numProcessed;
+    long numFreeResults = stream->queueLength - (numProcessed - stream->numResultsRead.load (std::memory_order_acquire));
+    int numHops = (int) std::min (std::min (numWaiting, numFreeResults), (long) maxHopsPerTurn);
+
+    for (int i = 0; i < numHops; i++)
+    {
+        double* hop = &stream->hops[(numProcessed % stream->queueLength) * stream->hopSize];
+
+        stream->tracker.processAudioFrame (hop);
+
+        StreamResult& result = stream->results[numProcessed % stream->queueLength];
+        result.hopIndex = numProcessed;
+        result.beatDue = stream->tracker.beatDueInCurrentFrame();
+        result.tempo = stream->tracker.getCurrentTempoEstimate();
+
+        // the hop is counted before its result is published, so that anyone who has read
+        // the result also sees it in the worker's statistics
+        w->numHopsProcessed.fetch_add (1, std::memory_order_relaxed);
+
+        // the result can now be read, and the hop's place in the input queue reused
+        numProcessed++;
+        stream->numResultsWritten.store (numProcessed, std::memory_order_release);
+        stream->numHopsProcessed.store (numProcessed, std::memory_order_release);
+    }
+
+    w->busyNanoseconds.fetch_add ((unsigned long long) (getNanoseconds() - startTime), std::memory_order_relaxed);
+
+    // give up the stream, and queue it again if it can carry on. Anything that changes after
+    // this is seen by pushHop() or popResult(), which then queue the stream themselves
+    stream->state = SchedulerStream::Idle;
+
+    scheduleStreamIfIdle (stream);
+}
+
+//=======================================================================
+bool BTrackScheduler::waitForWork (int worker)
+{
+    SchedulerWorker* w = workers[worker];
+    std::unique_lock<std::mutex> lock (sleepMutex);
+
+    numSleepingWorkers++;
+
+    sleepCondition.wait (lock, [this, w] {
+        return shouldExit || numStealableStreams > 0 || w->numExclusiveStreams > 0;
+    });
+
+    numSleepingWorkers--;
+
+    return !shouldExit;
+}
+
+//=======================================================================
+void BTrackScheduler::runWorker (int worker)
+{
+    while (!shouldExit)
+    {
+        SchedulerStream* stream = findStream (worker);
+
+        if (stream != NULL)
+        {
+            processStream (worker, stream);
+        }
+        else if (!waitForWork (worker))
+        {
+            return;
+        }
+    }
+}
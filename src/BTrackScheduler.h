@@ -0,0 +1,222 @@
+//=======================================================================
+/** @file BTrackScheduler.h
+ *  @brief A pool of worker threads that track the beats of many streams
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+
+#ifndef __BTRACKSCHEDULER_H
+#define __BTRACKSCHEDULER_H
+
+#include "BTrack.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+struct SchedulerStream;
+struct SchedulerWorker;
+
+//=======================================================================
+/** The priority with which a stream's hops are processed, when there is more work than workers */
+enum StreamPriority
+{
+    LowPriority,
+    NormalPriority,
+    HighPriority,
+    NumStreamPriorities
+};
+
+//=======================================================================
+/** The result of processing one hop of a stream */
+struct StreamResult
+{
+    long hopIndex;                          /**< the index of the hop, counting from zero for the first hop pushed */
+    bool beatDue;                           /**< true if a beat is due in the hop */
+    double tempo;                           /**< the tempo estimate after the hop, in beats per minute */
+};
+
+//=======================================================================
+/** How much work one worker thread has done since the scheduler started, or the statistics were reset */
+struct WorkerStatistics
+{
+    unsigned long long numHopsProcessed;    /**< the number of hops processed */
+    unsigned long long numStreamsStolen;    /**< the number of times the worker took a stream from another worker's queue */
+    unsigned long long busyNanoseconds;     /**< the time spent processing hops */
+    unsigned long long elapsedNanoseconds;  /**< the time since the statistics were started */
+    double utilisation;                     /**< the fraction of the elapsed time spent processing hops */
+};
+
+//=======================================================================
+/** Runs a pool of worker threads that track the beats of many streams, each with its own BTrack.
+ *
+ * Audio is pushed into each stream's input queue a hop at a time, from any thread, and the results
+ * are popped from its output queue. Each stream has a single producer and a single consumer: the
+ * hops of one stream must be pushed from one thread at a time, and its results popped from one
+ * thread at a time. A stream is only processed while its output queue has room, so if its results
+ * are not popped, its input queue fills up and pushHop() refuses any more hops.
+ *
+ * A stream with hops waiting is placed in the run queue of one worker. Workers take streams from
+ * the front of their own queues and, when these are empty, steal from the back of other workers'
+ * queues. A stream is only ever in one queue, or being processed by one worker, so its hops are
+ * always processed in order. After a few hops a stream goes back to the end of the queue, so that
+ * one stream with many hops waiting does not hold up the others. Higher priority streams are always
+ * taken, or stolen, before lower priority ones.
+ *
+ * Pushing hops, processing them and popping results never allocates memory.
+ */
+class BTrackScheduler
+{
+public:
+
+    //=======================================================================
+    /** Constructor, which starts the worker threads
+     * @param numWorkers_ the number of worker threads, or zero for one per processor core
+     * @param maxNumStreams_ the largest number of streams that can be added
+     */
+    BTrackScheduler (int numWorkers_, int maxNumStreams_);
+
+    /** Destructor, which stops the worker threads. Any hops that have not been processed are abandoned */
+    ~BTrackScheduler();
+
+    //=======================================================================
+    /** Add a stream with normal priority, which is processed by whichever worker is free
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     * @returns the index of the new stream, or -1 if maxNumStreams have already been added
+     */
+    int addStream (int hopSize, int frameSize);
+
+    /** Add a stream. Streams may be added from any thread, including while the workers run
+     * @param hopSize the hop size in audio samples
+     * @param frameSize the frame size in audio samples
+     * @param priority the priority of the stream (see StreamPriority)
+     * @param queueLength the number of hops, and of results, that the stream's queues can hold
+     * @returns the index of the new stream, or -1 if maxNumStreams have already been added
+     */
+    int addStream (int hopSize, int frameSize, int priority, int queueLength);
+
+    /** @returns the number of streams that have been added */
+    int getNumStreams();
+
+    /** @returns the number of worker threads */
+    int getNumWorkers();
+
+    //=======================================================================
+    /** Add the next hop of audio to a stream's input queue
+     * @param stream the index of the stream
+     * @param hop the next hopSize audio samples of the stream, which are copied
+     * @returns true if the hop was queued, false if the queue was full
+     */
+    bool pushHop (int stream, const double* hop);
+
+    /** Take the oldest result from a stream's output queue
+     * @param stream the index of the stream
+     * @param result the result to fill in
+     * @returns true if there was a result, false if the queue was empty
+     */
+    bool popResult (int stream, StreamResult& result);
+
+    //=======================================================================
+    /** Set the priority of a stream. This takes effect the next time the stream is queued
+     * @param stream the index of the stream
+     * @param priority the priority of the stream (see StreamPriority)
+     */
+    void setStreamPriority (int stream, int priority);
+
+    /** @returns the priority of a stream (see StreamPriority)
+     * @param stream the index of the stream
+     */
+    int getStreamPriority (int stream);
+
+    /** Set which worker processes a stream. This takes effect the next time the stream is queued
+     * @param stream the index of the stream
+     * @param worker the worker whose queue the stream is placed in, or -1 for the worker that processed it last (the default)
+     * @param exclusive if true, no other worker may steal the stream, so it is only processed by the given worker
+     */
+    void setStreamAffinity (int stream, int worker, bool exclusive);
+
+    /** Pin a worker thread to one processor core. This is only supported on Linux
+     * @param worker the index of the worker
+     * @param core the index of the core
+     * @returns true if the worker was pinned, false otherwise
+     */
+    bool setWorkerCore (int worker, int core);
+
+    //=======================================================================
+    /** @returns how much work a worker has done. This may be called from any thread
+     * @param worker the index of the worker
+     */
+    WorkerStatistics getWorkerStatistics (int worker);
+
+    /** Set every worker's statistics back to zero */
+    void resetWorkerStatistics();
+
+private:
+
+    /** Queue a stream if it is idle, and has hops waiting and room in its output queue for their results
+     * @param stream the stream
+     */
+    void scheduleStreamIfIdle (SchedulerStream* stream);
+
+    /** Place a stream in the run queue of the worker that should process it, and wake a worker to process it
+     * @param stream the stream, which must be in the Scheduled state
+     */
+    void scheduleStream (SchedulerStream* stream);
+
+    /** @returns the next stream for a worker to process, from its own queues or stolen from another
+     * worker's, or NULL if there are none
+     * @param worker the index of the worker
+     */
+    SchedulerStream* findStream (int worker);
+
+    /** Process the hops waiting in a stream's input queue, up to a limit, then queue the stream again if there are more
+     * @param worker the index of the worker
+     * @param stream the stream
+     */
+    void processStream (int worker, SchedulerStream* stream);
+
+    /** Wait until there might be a stream for a worker to process
+     * @param worker the index of the worker
+     * @returns false if the worker should exit
+     */
+    bool waitForWork (int worker);
+
+    /** The worker threads' thread function
+     * @param worker the index of the worker
+     */
+    void runWorker (int worker);
+
+    //=======================================================================
+    int maxNumStreams;                          /**< the largest number of streams that can be added */
+    std::vector<SchedulerStream*> streams;      /**< the streams, allocated up front so that they can be added while the workers run */
+    std::atomic<int> numStreams;                /**< the number of streams that have been added */
+    std::mutex addStreamMutex;                  /**< held while a stream is added, so that streams can be added from several threads at once */
+
+    std::vector<SchedulerWorker*> workers;      /**< the workers */
+    std::atomic<int> nextWorker;                /**< the worker new streams are first placed with, so that they are spread between the workers */
+
+    std::atomic<int> numStealableStreams;       /**< the number of streams in any worker's queues that any worker may take */
+
+    std::mutex sleepMutex;                      /**< protects the workers' sleep */
+    std::condition_variable sleepCondition;     /**< signalled when a stream is queued, or the workers should exit */
+    std::atomic<int> numSleepingWorkers;        /**< the number of workers waiting for work */
+    std::atomic<bool> shouldExit;               /**< set when the workers should exit */
+};
+
+#endif
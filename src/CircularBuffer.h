@@ -1,6 +1,6 @@
 //=======================================================================
 /** @file CircularBuffer.h
- *  @brief A class for calculating onset detection functions
+ *  @brief A circular buffer that can be read contiguously
  *  @author Adam Stark
  *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
  *
@@ -27,7 +27,11 @@
 //=======================================================================
 /** A circular buffer that allows you to add new samples to the end
  * whilst removing them from the beginning. This is implemented in an
- * efficient way which doesn't involve any memory allocation
+ * efficient way which doesn't involve any memory allocation.
+ *
+ * Every sample is written twice, to its place in the buffer and to the same
+ * place in a mirror image of the buffer that follows it in memory. The samples,
+ * from the oldest to the newest, can therefore always be read contiguously.
  */
 class CircularBuffer
 {
@@ -35,36 +39,72 @@ public:
     
     /** Constructor */
     CircularBuffer()
-     :  writeIndex (0)
+     :  bufferSize (0),
+        writeIndex (0)
     {
         
     }
     
-    /** Access the ith element in the buffer */
-    double &operator[] (int i)
+    /** @returns the ith element in the buffer, where element 0 is the oldest */
+    double operator[] (int i) const
+    {
+        return buffer[writeIndex + i];
+    }
+    
+    /** @returns a pointer to the ith element in the buffer. All of the elements from the
+     * ith to the newest are stored after it in memory, in order */
+    const double* getPointer (int i) const
+    {
+        return &buffer[writeIndex + i];
+    }
+    
+    /** Set the ith element in the buffer, where element 0 is the oldest */
+    void setSample (int i, double v)
     {
-        int index = (i + writeIndex) % buffer.size();
-        return buffer[index];
+        int index = writeIndex + i;
+        
+        if (index >= bufferSize)
+        {
+            index -= bufferSize;
+        }
+        
+        buffer[index] = v;
+        buffer[index + bufferSize] = v;
     }
     
     /** Add a new sample to the end of the buffer */
     void addSampleToEnd (double v)
     {
         buffer[writeIndex] = v;
-        writeIndex = (writeIndex + 1) % buffer.size();
+        buffer[writeIndex + bufferSize] = v;
+        
+        writeIndex++;
+        
+        if (writeIndex == bufferSize)
+        {
+            writeIndex = 0;
+        }
     }
     
-    /** Resize the buffer */
+    /** Resize the buffer, setting every element to zero */
     void resize (int size)
     {
-        buffer.resize (size);
+        bufferSize = size;
+        buffer.assign (2 * size, 0.0);
         writeIndex = 0;
     }
     
+    /** @returns the number of elements in the buffer */
+    int size() const
+    {
+        return bufferSize;
+    }
+    
 private:
     
-    std::vector<double> buffer;
-    int writeIndex;
+    std::vector<double> buffer;     /**< the buffer, followed by its mirror image */
+    int bufferSize;                 /**< the number of elements in the buffer */
+    int writeIndex;                 /**< the position of the oldest element, which is the next to be overwritten */
 };
 
 #endif /* CircularBuffer_hpp */
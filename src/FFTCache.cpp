@@ -0,0 +1,829 @@
+//=======================================================================
+/** @file FFTCache.cpp
+ *  @brief A process-wide cache of FFT plans and window tables
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <utility>
+#include "FFTCache.h"
+#include "SpectralKernels.h"
+
+#ifdef USE_KISS_FFT
+#include "_kiss_fft_guts.h"
+#endif
+
+//=======================================================================
+/** A cached plan and the number of users it has */
+struct PlanEntry
+{
+    FFTPlan plan;
+    int referenceCount;
+};
+
+//=======================================================================
+/** A cached window and the number of users it has */
+struct WindowEntry
+{
+    std::vector<double> window;
+    int referenceCount;
+};
+
+typedef std::map<std::tuple<int, int, int>, PlanEntry> PlanMap;
+typedef std::map<std::pair<int, int>, WindowEntry> WindowMap;
+
+//=======================================================================
+// the cache is created on first use, so that it exists before any
+// statically constructed instances use it
+static std::mutex& getCacheMutex()
+{
+    static std::mutex cacheMutex;
+    return cacheMutex;
+}
+
+//=======================================================================
+static PlanMap& getPlans()
+{
+    static PlanMap plans;
+    return plans;
+}
+
+//=======================================================================
+static WindowMap& getWindows()
+{
+    static WindowMap windows;
+    return windows;
+}
+
+//=======================================================================
+static int& getPlanningModeSetting()
+{
+    static int planningMode = EstimatePlanning;
+    return planningMode;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////// Plans ///////////////////////////////////////////////////
+
+#ifdef USE_KISS_FFT
+//=======================================================================
+/** @returns true if n has no prime factors other than 2, 3 and 5, the sizes Kiss FFT can transform without allocating */
+static bool hasOnlySmallPrimeFactors (int n)
+{
+    int factors[] = {2, 3, 5};
+
+    for (int i = 0; i < 3; i++)
+    {
+        while (n > 1 && n % factors[i] == 0)
+        {
+            n /= factors[i];
+        }
+    }
+
+    return n <= 1;
+}
+
+//=======================================================================
+/** Find the input sample that kf_work() copies to each output position before its butterflies, by following its recursion
+ * @param factors the remaining (radix, size / radix) pairs of the configuration
+ * @param fstride the distance between the input samples of each of the sub-FFTs at this depth
+ * @param inputIndex the first input sample of the sub-FFT at this depth
+ * @param order the output positions of the sub-FFT, to write the input samples to
+ */
+static void findInterleavedInputOrder (const int* factors, int fstride, int inputIndex, int* order)
+{
+    int p = factors[0];
+    int m = factors[1];
+
+    for (int q = 0; q < p; q++)
+    {
+        if (m == 1)
+        {
+            order[q] = inputIndex + (q * fstride);
+        }
+        else
+        {
+            findInterleavedInputOrder (factors + 2, fstride * p, inputIndex + (q * fstride), order + (q * m));
+        }
+    }
+}
+
+//=======================================================================
+/** Find the stages and twiddle factors that kiss_fft uses with a configuration, if they are all radix 2 or 4
+ * @param plan the plan to store them in
+ * @param cfg the configuration
+ */
+static void findInterleavedStages (FFTPlan& plan, kiss_fft_cfg cfg)
+{
+    int size = cfg->nfft;
+    int numStages = 0;
+
+    do
+    {
+        if ((cfg->factors[2 * numStages] != 2) && (cfg->factors[2 * numStages] != 4))
+        {
+            return;
+        }
+
+        numStages++;
+    }
+    while (cfg->factors[2 * numStages - 1] > 1);
+
+    plan.interleavedInputOrder.resize (size);
+    findInterleavedInputOrder (cfg->factors, 1, 0, &plan.interleavedInputOrder[0]);
+
+    // kf_work() performs the butterflies of the last factor first, as its recursion unwinds
+    for (int stage = numStages - 1; stage >= 0; stage--)
+    {
+        int p = cfg->factors[2 * stage];
+        int m = cfg->factors[2 * stage + 1];
+        int fstride = size / (p * m);
+
+        plan.interleavedStages.push_back (p);
+        plan.interleavedStages.push_back (m);
+        plan.interleavedStages.push_back (fstride);
+
+        for (int k = 0; k < m; k++)
+        {
+            for (int q = 1; q < p; q++)
+            {
+                plan.interleavedTwiddles.push_back (cfg->twiddles[q * k * fstride].r);
+                plan.interleavedTwiddles.push_back (cfg->twiddles[q * k * fstride].i);
+            }
+        }
+    }
+}
+#endif
+
+//=======================================================================
+static void createPlan (FFTPlan& plan, int size, int fftType, int batchSize)
+{
+    plan.size = size;
+    plan.fftType = fftType;
+    plan.batchSize = batchSize;
+    
+#ifdef USE_FFTW
+    unsigned flags;
+    
+    switch (getPlanningModeSetting())
+    {
+        case MeasurePlanning:
+            flags = FFTW_MEASURE;
+            break;
+        case PatientPlanning:
+            flags = FFTW_PATIENT;
+            break;
+        default:
+            flags = FFTW_ESTIMATE;
+    }
+    
+    // the arrays are only needed to plan with, as the plan is always run on new arrays,
+    // and measuring overwrites them. fftw's planner is not thread-safe, which the cache
+    // mutex takes care of
+    if (fftType == RealForwardFFT)
+    {
+        int numBins = (size / 2) + 1;
+        double* realIn = (double*) fftw_malloc (sizeof(double) * size * batchSize);
+        fftw_complex* complexOut = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * numBins * batchSize);
+
+        if (batchSize == 1)
+        {
+            plan.plan = fftw_plan_dft_r2c_1d (size, realIn, complexOut, flags);
+        }
+        else
+        {
+            // one plan for the whole batch, so that fftw can share its twiddle factors and work across the batch
+            plan.plan = fftw_plan_many_dft_r2c (1, &size, batchSize, realIn, NULL, 1, size, complexOut, NULL, 1, numBins, flags);
+        }
+
+        fftw_free (realIn);
+        fftw_free (complexOut);
+    }
+    else
+    {
+        fftw_complex* complexIn = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * size);
+        fftw_complex* complexOut = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * size);
+
+        plan.plan = fftw_plan_dft_1d (size, complexIn, complexOut, (fftType == BackwardFFT) ? FFTW_BACKWARD : FFTW_FORWARD, flags);
+
+        fftw_free (complexIn);
+        fftw_free (complexOut);
+    }
+#endif
+
+#ifdef USE_KISS_FFT
+    plan.bluesteinSize = 0;
+    plan.inverseCfg = NULL;
+
+    if (fftType == RealForwardFFT)
+    {
+        // the real FFT is a complex FFT of the even and odd samples, split apart
+        // afterwards using the same twiddle factors as kiss_fftr
+        int halfSize = size / 2;
+
+        if (hasOnlySmallPrimeFactors (halfSize))
+        {
+            plan.cfg = kiss_fft_alloc (halfSize, 0, 0, 0);
+        }
+        else
+        {
+            // Bluestein's algorithm writes the FFT as a convolution with a chirp, done
+            // with FFTs of a power of two size at least twice as long
+            plan.bluesteinSize = 1;
+
+            while (plan.bluesteinSize < 2 * halfSize - 1)
+            {
+                plan.bluesteinSize *= 2;
+            }
+
+            plan.cfg = kiss_fft_alloc (plan.bluesteinSize, 0, 0, 0);
+            plan.inverseCfg = kiss_fft_alloc (plan.bluesteinSize, 1, 0, 0);
+            plan.chirp.resize (halfSize);
+
+            std::vector<kiss_fft_cpx> filter (plan.bluesteinSize);
+
+            for (int n = 0; n < plan.bluesteinSize; n++)
+            {
+                filter[n].r = 0;
+                filter[n].i = 0;
+            }
+
+            for (int n = 0; n < halfSize; n++)
+            {
+                // n^2 is reduced first, so that the phase stays accurate for large n
+                double phase = -3.14159265358979323846264338327 * ((double) (((long long) n * n) % (2 * halfSize)) / halfSize);
+
+                plan.chirp[n].r = (kiss_fft_scalar) cos (phase);
+                plan.chirp[n].i = (kiss_fft_scalar) sin (phase);
+
+                // the filter is the conjugate chirp, at both positive and negative offsets
+                filter[n].r = plan.chirp[n].r;
+                filter[n].i = -plan.chirp[n].i;
+                filter[(plan.bluesteinSize - n) % plan.bluesteinSize] = filter[n];
+            }
+
+            plan.chirpSpectrum.resize (plan.bluesteinSize);
+            kiss_fft (plan.cfg, &filter[0], &plan.chirpSpectrum[0]);
+
+            for (int k = 0; k < plan.bluesteinSize; k++)
+            {
+                plan.chirpSpectrum[k].r /= plan.bluesteinSize;
+                plan.chirpSpectrum[k].i /= plan.bluesteinSize;
+            }
+        }
+
+        plan.superTwiddles.resize (halfSize / 2);
+
+        for (int i = 0; i < halfSize / 2; i++)
+        {
+            double phase = -3.14159265358979323846264338327 * ((double) (i + 1) / halfSize + .5);
+
+            plan.superTwiddles[i].r = (kiss_fft_scalar) cos (phase);
+            plan.superTwiddles[i].i = (kiss_fft_scalar) sin (phase);
+        }
+    }
+    else
+    {
+        plan.cfg = kiss_fft_alloc (size, (fftType == BackwardFFT) ? 1 : 0, 0, 0);
+    }
+
+    if (plan.bluesteinSize == 0)
+    {
+        findInterleavedStages (plan, plan.cfg);
+    }
+#endif
+}
+
+//=======================================================================
+static void destroyPlan (FFTPlan& plan)
+{
+#ifdef USE_FFTW
+    fftw_destroy_plan (plan.plan);
+#endif
+
+#ifdef USE_KISS_FFT
+    free (plan.cfg);
+    free (plan.inverseCfg);
+#endif
+}
+
+//=======================================================================
+const FFTPlan* FFTCache::acquirePlan (int size, int fftType)
+{
+    return acquirePlan (size, fftType, 1);
+}
+
+//=======================================================================
+const FFTPlan* FFTCache::acquireRealBatchPlan (int size, int batchSize)
+{
+    return acquirePlan (size, RealForwardFFT, batchSize);
+}
+
+//=======================================================================
+const FFTPlan* FFTCache::acquirePlan (int size, int fftType, int batchSize)
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+
+    PlanMap& plans = getPlans();
+    std::tuple<int, int, int> key (size, fftType, batchSize);
+    PlanMap::iterator entry = plans.find (key);
+
+    if (entry == plans.end())
+    {
+        entry = plans.insert (std::make_pair (key, PlanEntry())).first;
+        entry->second.referenceCount = 0;
+
+        createPlan (entry->second.plan, size, fftType, batchSize);
+    }
+
+    entry->second.referenceCount++;
+
+    // map entries never move, so the plan stays where it is until it is erased
+    return &entry->second.plan;
+}
+
+//=======================================================================
+void FFTCache::releasePlan (const FFTPlan* plan)
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+
+    PlanMap& plans = getPlans();
+
+    for (PlanMap::iterator entry = plans.begin(); entry != plans.end(); ++entry)
+    {
+        if (&entry->second.plan == plan)
+        {
+            entry->second.referenceCount--;
+
+            if (entry->second.referenceCount == 0)
+            {
+                destroyPlan (entry->second.plan);
+                plans.erase (entry);
+            }
+
+            return;
+        }
+    }
+}
+
+//=======================================================================
+void FFTCache::setPlanningMode (int planningMode)
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+    
+    getPlanningModeSetting() = planningMode;
+}
+
+//=======================================================================
+int FFTCache::getPlanningMode()
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+    
+    return getPlanningModeSetting();
+}
+
+//=======================================================================
+bool FFTCache::importWisdom (const char* filename)
+{
+#ifdef USE_FFTW
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+    
+    return fftw_import_wisdom_from_filename (filename) != 0;
+#else
+    (void) filename;
+    return false;
+#endif
+}
+
+//=======================================================================
+bool FFTCache::exportWisdom (const char* filename)
+{
+#ifdef USE_FFTW
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+    
+    return fftw_export_wisdom_to_filename (filename) != 0;
+#else
+    (void) filename;
+    return false;
+#endif
+}
+
+//=======================================================================
+int FFTCache::getNumPlans()
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+
+    return (int) getPlans().size();
+}
+
+#ifdef USE_KISS_FFT
+//=======================================================================
+int FFTCache::getWorkingMemorySize (const FFTPlan* plan)
+{
+    // the input to and output from the convolution's FFTs
+    return 2 * plan->bluesteinSize;
+}
+
+//=======================================================================
+void FFTCache::performRealFFT (const FFTPlan* plan, const kiss_fft_scalar* in, kiss_fft_cpx* out, kiss_fft_cpx* workingMemory)
+{
+    // the FFTs of a batch share one configuration, so its twiddle factors stay in the cache from one FFT to the next
+    for (int b = 0; b < plan->batchSize; b++)
+    {
+        performSingleRealFFT (plan, in + (b * plan->size), out + (b * ((plan->size / 2) + 1)), workingMemory);
+    }
+}
+
+//=======================================================================
+bool FFTCache::canInterleave (const FFTPlan* plan)
+{
+    return !plan->interleavedInputOrder.empty();
+}
+
+//=======================================================================
+void FFTCache::performInterleavedFFT (const FFTPlan* plan, const SpectralKernels& kernels, const float* in, float* out, int numLanes, int laneStride)
+{
+    int rowSize = 2 * laneStride;
+    int numRows = (int) plan->interleavedInputOrder.size();
+    bool inverse = (plan->fftType == BackwardFFT);
+
+    // start each output row from the input row that kiss_fft starts it from
+    for (int i = 0; i < numRows; i++)
+    {
+        const float* source = in + (plan->interleavedInputOrder[i] * rowSize);
+        float* destination = out + (i * rowSize);
+
+        std::copy (source, source + numLanes, destination);
+        std::copy (source + laneStride, source + laneStride + numLanes, destination + laneStride);
+    }
+
+    // then perform its stages of butterflies, in the same order
+    const float* twiddles = &plan->interleavedTwiddles[0];
+
+    for (size_t stage = 0; stage < plan->interleavedStages.size(); stage += 3)
+    {
+        int radix = plan->interleavedStages[stage];
+        int m = plan->interleavedStages[stage + 1];
+        int numBlocks = plan->interleavedStages[stage + 2];
+
+        if (radix == 2)
+        {
+            kernels.radix2Butterflies (out, laneStride, numLanes, numBlocks, m, twiddles);
+        }
+        else
+        {
+            kernels.radix4Butterflies (out, laneStride, numLanes, numBlocks, m, twiddles, inverse);
+        }
+
+        twiddles += 2 * (radix - 1) * m;
+    }
+}
+
+//=======================================================================
+void FFTCache::performInterleavedRealFFT (const FFTPlan* plan, const SpectralKernels& kernels, const float* in, float* out, int numLanes, int laneStride)
+{
+    int halfSize = plan->size / 2;
+    int rowSize = 2 * laneStride;
+
+    // each pair of input rows already holds the even and odd samples of every lane side by side,
+    // as the real and imaginary parts of a row of the half size FFT
+    performInterleavedFFT (plan, kernels, in, out, numLanes, laneStride);
+
+    // then split them apart, exactly as performSingleRealFFT() does
+    float* dc = out;
+    float* nyquist = out + (halfSize * rowSize);
+
+    for (int re = 0; re < numLanes; re++)
+    {
+        int im = re + laneStride;
+        float dcr = dc[re];
+        float dci = dc[im];
+
+        dc[re] = dcr + dci;
+        dc[im] = 0;
+        nyquist[re] = dcr - dci;
+        nyquist[im] = 0;
+    }
+
+    for (int k = 1; k <= halfSize / 2; k++)
+    {
+        float* fk = out + (k * rowSize);
+        float* fnk = out + ((halfSize - k) * rowSize);
+        float twr = plan->superTwiddles[k - 1].r;
+        float twi = plan->superTwiddles[k - 1].i;
+
+        for (int re = 0; re < numLanes; re++)
+        {
+            int im = re + laneStride;
+
+            float fpkr = fk[re];
+            float fpki = fk[im];
+            float fpnkr = fnk[re];
+            float fpnki = -fnk[im];
+
+            float f1kr = fpkr + fpnkr;
+            float f1ki = fpki + fpnki;
+            float f2kr = fpkr - fpnkr;
+            float f2ki = fpki - fpnki;
+
+            float tr = f2kr * twr - f2ki * twi;
+            float ti = f2kr * twi + f2ki * twr;
+
+            fk[re] = (f1kr + tr) * .5;
+            fk[im] = (f1ki + ti) * .5;
+            fnk[re] = (f1kr - tr) * .5;
+            fnk[im] = (ti - f1ki) * .5;
+        }
+    }
+}
+
+//=======================================================================
+void FFTCache::performSingleRealFFT (const FFTPlan* plan, const kiss_fft_scalar* in, kiss_fft_cpx* out, kiss_fft_cpx* workingMemory)
+{
+    int halfSize = plan->size / 2;
+    kiss_fft_cpx fpk, fpnk, f1k, f2k, tw;
+
+    // transform the even and odd samples as the real and imaginary parts of a half size
+    // FFT, into the output array, then split them apart in place as kiss_fftr does
+    if (plan->bluesteinSize > 0)
+    {
+        performBluesteinFFT (plan, (const kiss_fft_cpx*) in, out, workingMemory);
+    }
+    else
+    {
+        kiss_fft (plan->cfg, (const kiss_fft_cpx*) in, out);
+    }
+
+    kiss_fft_cpx dc = out[0];
+
+    out[0].r = dc.r + dc.i;
+    out[0].i = 0;
+    out[halfSize].r = dc.r - dc.i;
+    out[halfSize].i = 0;
+
+    for (int k = 1; k <= halfSize / 2; k++)
+    {
+        fpk = out[k];
+        fpnk.r = out[halfSize - k].r;
+        fpnk.i = -out[halfSize - k].i;
+
+        f1k.r = fpk.r + fpnk.r;
+        f1k.i = fpk.i + fpnk.i;
+        f2k.r = fpk.r - fpnk.r;
+        f2k.i = fpk.i - fpnk.i;
+
+        tw.r = f2k.r * plan->superTwiddles[k - 1].r - f2k.i * plan->superTwiddles[k - 1].i;
+        tw.i = f2k.r * plan->superTwiddles[k - 1].i + f2k.i * plan->superTwiddles[k - 1].r;
+
+        out[k].r = (f1k.r + tw.r) * .5;
+        out[k].i = (f1k.i + tw.i) * .5;
+        out[halfSize - k].r = (f1k.r - tw.r) * .5;
+        out[halfSize - k].i = (tw.i - f1k.i) * .5;
+    }
+}
+
+//=======================================================================
+void FFTCache::performBluesteinFFT (const FFTPlan* plan, const kiss_fft_cpx* in, kiss_fft_cpx* out, kiss_fft_cpx* workingMemory)
+{
+    int halfSize = plan->size / 2;
+    int convolutionSize = plan->bluesteinSize;
+    kiss_fft_cpx* signal = workingMemory;
+    kiss_fft_cpx* spectrum = workingMemory + convolutionSize;
+
+    // multiply by the chirp, and pad with zeros to the convolution size
+    for (int n = 0; n < halfSize; n++)
+    {
+        signal[n].r = in[n].r * plan->chirp[n].r - in[n].i * plan->chirp[n].i;
+        signal[n].i = in[n].r * plan->chirp[n].i + in[n].i * plan->chirp[n].r;
+    }
+
+    for (int n = halfSize; n < convolutionSize; n++)
+    {
+        signal[n].r = 0;
+        signal[n].i = 0;
+    }
+
+    // convolve with the conjugate chirp
+    kiss_fft (plan->cfg, signal, spectrum);
+
+    for (int k = 0; k < convolutionSize; k++)
+    {
+        kiss_fft_scalar r = spectrum[k].r * plan->chirpSpectrum[k].r - spectrum[k].i * plan->chirpSpectrum[k].i;
+        spectrum[k].i = spectrum[k].r * plan->chirpSpectrum[k].i + spectrum[k].i * plan->chirpSpectrum[k].r;
+        spectrum[k].r = r;
+    }
+
+    kiss_fft (plan->inverseCfg, spectrum, signal);
+
+    // and multiply by the chirp again
+    for (int k = 0; k < halfSize; k++)
+    {
+        out[k].r = signal[k].r * plan->chirp[k].r - signal[k].i * plan->chirp[k].i;
+        out[k].i = signal[k].r * plan->chirp[k].i + signal[k].i * plan->chirp[k].r;
+    }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////// Windows /////////////////////////////////////////////////
+
+//=======================================================================
+static void calculateHanningWindow (std::vector<double>& window)
+{
+	double pi = 3.14159265358979;
+	int frameSize = (int) window.size();
+	double N;		// variable to store framesize minus 1
+
+	N = (double) (frameSize-1);	// framesize minus 1
+
+	// Hanning window calculation
+	for (int n = 0; n < frameSize; n++)
+	{
+		window[n] = 0.5 * (1 - cos (2 * pi * (n / N)));
+	}
+}
+
+//=======================================================================
+static void calculateHammingWindow (std::vector<double>& window)
+{
+	double pi = 3.14159265358979;
+	int frameSize = (int) window.size();
+	double N;		// variable to store framesize minus 1
+	double n_val;	// double version of index 'n'
+
+	N = (double) (frameSize-1);	// framesize minus 1
+	n_val = 0;
+
+	// Hamming window calculation
+	for (int n = 0;n < frameSize;n++)
+	{
+		window[n] = 0.54 - (0.46 * cos (2 * pi * (n_val/N)));
+		n_val = n_val+1;
+	}
+}
+
+//=======================================================================
+static void calculateBlackmanWindow (std::vector<double>& window)
+{
+	double pi = 3.14159265358979;
+	int frameSize = (int) window.size();
+	double N;		// variable to store framesize minus 1
+	double n_val;	// double version of index 'n'
+
+	N = (double) (frameSize-1);	// framesize minus 1
+	n_val = 0;
+
+	// Blackman window calculation
+	for (int n = 0;n < frameSize;n++)
+	{
+		window[n] = 0.42 - (0.5*cos(2*pi*(n_val/N))) + (0.08*cos(4*pi*(n_val/N)));
+		n_val = n_val+1;
+	}
+}
+
+//=======================================================================
+static void calculateTukeyWindow (std::vector<double>& window)
+{
+	double pi = 3.14159265358979;
+	int frameSize = (int) window.size();
+	double N;		// variable to store framesize minus 1
+	double n_val;	// double version of index 'n'
+	double alpha;	// alpha [default value = 0.5];
+
+	alpha = 0.5;
+
+	N = (double) (frameSize-1);	// framesize minus 1
+
+	// Tukey window calculation
+
+	n_val = (double) (-1*((frameSize/2)))+1;
+
+	for (int n = 0;n < frameSize;n++)	// left taper
+	{
+		if ((n_val >= 0) && (n_val <= (alpha*(N/2))))
+		{
+			window[n] = 1.0;
+		}
+		else if ((n_val <= 0) && (n_val >= (-1*alpha*(N/2))))
+		{
+			window[n] = 1.0;
+		}
+		else
+		{
+			window[n] = 0.5*(1+cos(pi*(((2*n_val)/(alpha*N))-1)));
+		}
+
+		n_val = n_val+1;
+	}
+
+}
+
+//=======================================================================
+static void calculateRectangularWindow (std::vector<double>& window)
+{
+	// Rectangular window calculation
+	for (int n = 0;n < (int) window.size();n++)
+	{
+		window[n] = 1.0;
+	}
+}
+
+//=======================================================================
+const double* FFTCache::acquireWindow (int windowType, int size)
+{
+    // unknown window types fall back to a Hanning window, so share it
+    if ((windowType < RectangularWindow) || (windowType > TukeyWindow))
+    {
+        windowType = HanningWindow;
+    }
+
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+
+    WindowMap& windows = getWindows();
+    std::pair<int, int> key (windowType, size);
+    WindowMap::iterator entry = windows.find (key);
+
+    if (entry == windows.end())
+    {
+        entry = windows.insert (std::make_pair (key, WindowEntry())).first;
+        entry->second.referenceCount = 0;
+
+        std::vector<double>& window = entry->second.window;
+        window.resize (size);
+
+        // set the window to the specified type
+        switch (windowType)
+        {
+            case RectangularWindow:
+                calculateRectangularWindow (window);		// Rectangular window
+                break;
+            case HammingWindow:
+                calculateHammingWindow (window);			// Hamming Window
+                break;
+            case BlackmanWindow:
+                calculateBlackmanWindow (window);			// Blackman Window
+                break;
+            case TukeyWindow:
+                calculateTukeyWindow (window);				// Tukey Window
+                break;
+            default:
+                calculateHanningWindow (window);			// Hanning Window
+        }
+    }
+
+    entry->second.referenceCount++;
+
+    return &entry->second.window[0];
+}
+
+//=======================================================================
+void FFTCache::releaseWindow (const double* window)
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+
+    WindowMap& windows = getWindows();
+
+    for (WindowMap::iterator entry = windows.begin(); entry != windows.end(); ++entry)
+    {
+        if (&entry->second.window[0] == window)
+        {
+            entry->second.referenceCount--;
+
+            if (entry->second.referenceCount == 0)
+            {
+                windows.erase (entry);
+            }
+
+            return;
+        }
+    }
+}
+
+//=======================================================================
+int FFTCache::getNumWindows()
+{
+    std::lock_guard<std::mutex> lock (getCacheMutex());
+
+    return (int) getWindows().size();
+}
@@ -0,0 +1,268 @@
+//=======================================================================
+/** @file FFTCache.h
+ *  @brief A process-wide cache of FFT plans and window tables
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#ifndef __FFTCACHE_H
+#define __FFTCACHE_H
+
+#ifdef USE_FFTW
+#include "fftw3.h"
+#endif
+
+#ifdef USE_KISS_FFT
+#include "kiss_fftr.h"
+#endif
+
+#include <vector>
+
+struct SpectralKernels;
+
+//=======================================================================
+/** The type of window to use when calculating onset detection function samples */
+enum WindowType
+{
+    RectangularWindow,
+    HanningWindow,
+    HammingWindow,
+    BlackmanWindow,
+    TukeyWindow
+};
+
+//=======================================================================
+/** The type of FFT that a plan performs */
+enum FFTType
+{
+    ForwardFFT,             /**< complex to complex, forwards */
+    BackwardFFT,            /**< complex to complex, backwards (unnormalised) */
+    RealForwardFFT          /**< real to complex, forwards, producing the first (size/2)+1 bins */
+};
+
+//=======================================================================
+/** How much effort fftw puts into finding a fast plan. Anything above EstimatePlanning times
+ * real FFTs when each plan is created, which can take a long time, so is best done once per
+ * host with the result saved using FFTCache::exportWisdom(). The setting is ignored when using Kiss FFT.
+ */
+enum FFTPlanningMode
+{
+    EstimatePlanning,       /**< FFTW_ESTIMATE, the default - guess a plan without timing anything */
+    MeasurePlanning,        /**< FFTW_MEASURE - time a number of candidate plans */
+    PatientPlanning         /**< FFTW_PATIENT - time a wider range of candidate plans */
+};
+
+//=======================================================================
+/** An FFT plan shared between all users of an FFT of one size and type. Plans are
+ * read-only once created, so any number of threads may use one at the same time.
+ */
+struct FFTPlan
+{
+    int size;               /**< the FFT size */
+    int fftType;            /**< the type of FFT (see FFTType) */
+    int batchSize;          /**< the number of FFTs performed at once, each on the input after the last */
+
+#ifdef USE_FFTW
+    /** The fftw plan. As it is shared, it must be run with the new-array execute
+     * functions (fftw_execute_dft, fftw_execute_dft_r2c) on arrays allocated with
+     * fftw_malloc, out of place. */
+    fftw_plan plan;
+#endif
+
+#ifdef USE_KISS_FFT
+    /** The Kiss FFT configuration. For RealForwardFFT this is a complex FFT of half the size,
+     * run by FFTCache::performRealFFT(), as kiss_fftr keeps its working memory in its
+     * configuration and so cannot be shared between threads. */
+    kiss_fft_cfg cfg;
+
+    /** For RealForwardFFT, the twiddle factors that split the half size FFT into the real FFT */
+    std::vector<kiss_fft_cpx> superTwiddles;
+
+    /** Kiss FFT allocates working memory on every FFT whose size has a prime factor other than 2, 3
+     * or 5. For a RealForwardFFT whose half size has one, the half size FFT is instead done with
+     * Bluestein's algorithm, as a convolution using FFTs of this power of two size, which cfg and
+     * inverseCfg perform. Zero if the half size FFT is done directly */
+    int bluesteinSize;
+
+    /** The inverse FFT of Bluestein's algorithm, or NULL if it is not used */
+    kiss_fft_cfg inverseCfg;
+
+    /** The chirp exp(-i pi n^2 / halfSize) that Bluestein's algorithm multiplies by before and after the convolution */
+    std::vector<kiss_fft_cpx> chirp;
+
+    /** The spectrum of the conjugate chirp that Bluestein's algorithm convolves with, divided by bluesteinSize */
+    std::vector<kiss_fft_cpx> chirpSpectrum;
+
+    /** When cfg's stages are all radix 2 or 4, as they are for powers of two, the input sample that kiss_fft
+     * starts each output position from, so that FFTCache::performInterleavedFFT() can do the same. Empty otherwise */
+    std::vector<int> interleavedInputOrder;
+
+    /** The radix, number of butterflies per block and number of blocks of each of cfg's stages, in the order kiss_fft performs them */
+    std::vector<int> interleavedStages;
+
+    /** The twiddle factors of each stage's butterflies, one stage after another, as (real, imaginary) pairs */
+    std::vector<float> interleavedTwiddles;
+#endif
+};
+
+//=======================================================================
+/** A thread-safe, reference counted cache of FFT plans, keyed by size and FFT type, and of window
+ * tables, keyed by window type and size. Every instance that needs an FFT or window of the same
+ * size shares one copy, which is freed when the last instance releases it.
+ */
+class FFTCache
+{
+public:
+
+    /** @returns the shared plan for an FFT of the given size and type, creating it if needed.
+     * With Kiss FFT, complex FFTs must have sizes with no prime factors other than 2, 3 and 5,
+     * so that they never allocate. Every call must be matched by a call to releasePlan()
+     * @param size the FFT size
+     * @param fftType the type of FFT (see FFTType)
+     */
+    static const FFTPlan* acquirePlan (int size, int fftType);
+
+    /** @returns the shared plan for a batch of real-input FFTs of the given size, creating it if needed.
+     * Each run of the plan transforms batchSize frames, held one after another in the input, to
+     * batchSize spectra of (size/2)+1 bins, held one after another in the output. Every call must
+     * be matched by a call to releasePlan()
+     * @param size the FFT size
+     * @param batchSize the number of FFTs performed at once
+     */
+    static const FFTPlan* acquireRealBatchPlan (int size, int batchSize);
+
+    /** Release a plan returned by acquirePlan(), freeing it if nothing else is using it
+     * @param plan the plan to release
+     */
+    static void releasePlan (const FFTPlan* plan);
+
+    /** @returns the shared window table of the given type and size, calculating it if needed.
+     * Every call must be matched by a call to releaseWindow()
+     * @param windowType the type of window (see WindowType). Unknown types give a Hanning window
+     * @param size the number of samples in the window
+     */
+    static const double* acquireWindow (int windowType, int size);
+
+    /** Release a window returned by acquireWindow(), freeing it if nothing else is using it
+     * @param window the window to release
+     */
+    static void releaseWindow (const double* window);
+
+    /** Set how much effort fftw puts into finding fast plans (see FFTPlanningMode). This only
+     * affects plans created afterwards, so should be called before any instances are constructed
+     * @param planningMode the planning mode to use
+     */
+    static void setPlanningMode (int planningMode);
+
+    /** @returns the planning mode in use (see FFTPlanningMode) */
+    static int getPlanningMode();
+
+    /** Load fftw wisdom (previously found plans) from a file, so that plans that were found with
+     * the current planning mode are created without having to time them again. Call this before
+     * any instances are constructed
+     * @param filename the wisdom file
+     * @returns true if the wisdom was loaded, false if the file could not be read or fftw is not in use
+     */
+    static bool importWisdom (const char* filename);
+
+    /** Save fftw's accumulated wisdom, including that found for every plan created so far, to a file
+     * @param filename the wisdom file
+     * @returns true if the wisdom was saved, false if the file could not be written or fftw is not in use
+     */
+    static bool exportWisdom (const char* filename);
+
+    /** @returns the number of plans currently in the cache */
+    static int getNumPlans();
+
+    /** @returns the number of window tables currently in the cache */
+    static int getNumWindows();
+
+#ifdef USE_KISS_FFT
+    /** @returns the number of complex values of working memory that performRealFFT() needs for a plan.
+     * This is zero unless half the FFT size has a prime factor other than 2, 3 or 5
+     * @param plan the plan
+     */
+    static int getWorkingMemorySize (const FFTPlan* plan);
+
+    /** Perform a real-input FFT with a RealForwardFFT plan, or every FFT of a batch plan
+     * @param plan the plan
+     * @param in the size real input samples, for each FFT of the batch
+     * @param out an array of (size/2)+1 bins to write the output to, for each FFT of the batch
+     * @param workingMemory an array of getWorkingMemorySize() values, which the caller owns so that
+     * any number of threads can share the plan
+     */
+    static void performRealFFT (const FFTPlan* plan, const kiss_fft_scalar* in, kiss_fft_cpx* out, kiss_fft_cpx* workingMemory);
+
+    /** @returns true if performInterleavedFFT() or performInterleavedRealFFT() can be used with a plan, which
+     * is when its size (for RealForwardFFT plans, half its size) is a power of two
+     * @param plan the plan
+     */
+    static bool canInterleave (const FFTPlan* plan);
+
+    /** Perform one complex FFT for each of a number of lanes at once, with a ForwardFFT or BackwardFFT plan, giving exactly the
+     * same result for each lane as kiss_fft would. Row r of the input and output holds the real part of sample r of every
+     * lane, then, laneStride values later, the imaginary parts (see SpectralKernels)
+     * @param plan a plan for which canInterleave() is true
+     * @param kernels the kernels to perform the butterflies with
+     * @param in the size rows of input, 2 * laneStride values each
+     * @param out the size rows to write the output to, which must not overlap the input
+     * @param numLanes the number of lanes
+     * @param laneStride the number of values from the real parts of a row to its imaginary parts
+     */
+    static void performInterleavedFFT (const FFTPlan* plan, const SpectralKernels& kernels, const float* in, float* out, int numLanes, int laneStride);
+
+    /** Perform one real-input FFT for each of a number of lanes at once, with a RealForwardFFT plan, giving exactly
+     * the same result for each lane as performRealFFT() would
+     * @param plan a plan for which canInterleave() is true
+     * @param kernels the kernels to perform the butterflies with
+     * @param in the size rows of input, each holding the sample of every lane, laneStride values long
+     * @param out the (size/2)+1 rows to write the output bins to, as for performInterleavedFFT(), which must not overlap the input
+     * @param numLanes the number of lanes
+     * @param laneStride the number of values in each input row, and from the real parts of an output row to its imaginary parts
+     */
+    static void performInterleavedRealFFT (const FFTPlan* plan, const SpectralKernels& kernels, const float* in, float* out, int numLanes, int laneStride);
+#endif
+
+private:
+
+    /** @returns the shared plan for a batch of FFTs of the given size and type, creating it if needed
+     * @param size the FFT size
+     * @param fftType the type of FFT (see FFTType)
+     * @param batchSize the number of FFTs performed at once
+     */
+    static const FFTPlan* acquirePlan (int size, int fftType, int batchSize);
+
+#ifdef USE_KISS_FFT
+    /** Perform one real-input FFT with a RealForwardFFT plan
+     * @param plan the plan
+     * @param in the size real input samples
+     * @param out an array of (size/2)+1 bins to write the output to
+     * @param workingMemory an array of getWorkingMemorySize() values
+     */
+    static void performSingleRealFFT (const FFTPlan* plan, const kiss_fft_scalar* in, kiss_fft_cpx* out, kiss_fft_cpx* workingMemory);
+
+    /** Perform the half size complex FFT of a RealForwardFFT plan with Bluestein's algorithm
+     * @param plan the plan
+     * @param in the size/2 complex input samples
+     * @param out an array of size/2 bins to write the output to
+     * @param workingMemory an array of getWorkingMemorySize() values
+     */
+    static void performBluesteinFFT (const FFTPlan* plan, const kiss_fft_cpx* in, kiss_fft_cpx* out, kiss_fft_cpx* workingMemory);
+#endif
+};
+
+#endif
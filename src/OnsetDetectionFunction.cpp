@@ -24,8 +24,11 @@
 
 //=======================================================================
 OnsetDetectionFunction::OnsetDetectionFunction (int hopSize_,int frameSize_)
- :  onsetDetectionFunctionType (ComplexSpectralDifferenceHWR), windowType (HanningWindow)
+ :  onsetDetectionFunctionType (ComplexSpectralDifferenceHWR), windowType (HanningWindow), phaseCalculationMethod (PolarPhase), sharedWeights (NULL)
 {
+    // use the fastest spectral kernels that the processor supports
+    setSpectralKernelType (SpectralKernels::getFastestSupportedType());
+    
     // indicate that we have not initialised yet
 	initialised = false;
 	
@@ -38,8 +41,11 @@ OnsetDetectionFunction::OnsetDetectionFunction (int hopSize_,int frameSize_)
 
 //=======================================================================
 OnsetDetectionFunction::OnsetDetectionFunction(int hopSize_,int frameSize_,int onsetDetectionFunctionType_,int windowType_)
- :  onsetDetectionFunctionType (ComplexSpectralDifferenceHWR), windowType (HanningWindow)
+ :  onsetDetectionFunctionType (ComplexSpectralDifferenceHWR), windowType (HanningWindow), phaseCalculationMethod (PolarPhase), sharedWeights (NULL)
 {	
+    // use the fastest spectral kernels that the processor supports
+    setSpectralKernelType (SpectralKernels::getFastestSupportedType());
+    
 	// indicate that we have not initialised yet
 	initialised = false;
 	
@@ -50,6 +56,17 @@ OnsetDetectionFunction::OnsetDetectionFunction(int hopSize_,int frameSize_,int o
 	initialise (hopSize_, frameSize_, onsetDetectionFunctionType_, windowType_);
 }
 
+//=======================================================================
+OnsetDetectionFunction::OnsetDetectionFunction (int hopSize_, int frameSize_, int onsetDetectionFunctionType_, int windowType_, const double* sharedWeights_)
+ :  onsetDetectionFunctionType (ComplexSpectralDifferenceHWR), windowType (HanningWindow), phaseCalculationMethod (PolarPhase), sharedWeights (sharedWeights_)
+{
+    setSpectralKernelType (SpectralKernels::getFastestSupportedType());
+    
+    initialised = false;
+    pi = 3.14159265358979;
+    
+    initialise (hopSize_, frameSize_, onsetDetectionFunctionType_, windowType_);
+}
 
 //=======================================================================
 OnsetDetectionFunction::~OnsetDetectionFunction()
@@ -73,56 +90,91 @@ void OnsetDetectionFunction::initialise(int hopSize_,int frameSize_,int onsetDet
 {
 	hopSize = hopSize_; // set hopsize
 	frameSize = frameSize_; // set framesize
+	numBins = (frameSize / 2) + 1; // the spectrum of a real frame is symmetric above this
 	
 	onsetDetectionFunctionType = onsetDetectionFunctionType_; // set detection function type
     windowType = windowType_; // set window type
 		
 	// initialise buffers
-    frame.resize (frameSize);
-    window.resize (frameSize);
-    magSpec.resize (frameSize);
-    prevMagSpec.resize (frameSize);
-    phase.resize (frameSize);
-    prevPhase.resize (frameSize);
-    prevPhase2.resize (frameSize);
+    frame.resize (frameSize * 2);
+    magSpec.resize (numBins);
+    prevMagSpec.resize (numBins);
+    phase.resize (numBins);
+    prevPhase.resize (numBins);
+    prevPhase2.resize (numBins);
+    phasorReal.resize (numBins);
+    phasorImag.resize (numBins);
+    prevPhasorReal.resize (numBins);
+    prevPhasorImag.resize (numBins);
+    prevPhasor2Real.resize (numBins);
+    prevPhasor2Imag.resize (numBins);
 	
 	
-	// set the window to the specified type
-	switch (windowType)
-    {
-		case RectangularWindow:
-			calculateRectangularWindow();		// Rectangular window
-			break;	
-		case HanningWindow:
-			calculateHanningWindow();			// Hanning Window
-			break;
-		case HammingWindow:
-			calclulateHammingWindow();			// Hamming Window
-			break;
-		case BlackmanWindow:
-			calculateBlackmanWindow();			// Blackman Window
-			break;
-		case TukeyWindow:
-			calculateTukeyWindow();             // Tukey Window
-			break;
-		default:
-			calculateHanningWindow();			// DEFAULT: Hanning Window
-	}
-	
 	// initialise previous magnitude spectrum to zero
-	for (int i = 0; i < frameSize; i++)
+	for (int i = 0; i < numBins; i++)
 	{
 		prevMagSpec[i] = 0.0;
 		prevPhase[i] = 0.0;
 		prevPhase2[i] = 0.0;
+		prevPhasorReal[i] = 1.0;
+		prevPhasorImag[i] = 0.0;
+		prevPhasor2Real[i] = 1.0;
+		prevPhasor2Imag[i] = 0.0;
+	}
+	
+	for (int i = 0; i < frameSize * 2; i++)
+	{
 		frame[i] = 0.0;
 	}
 	
+	framePosition = 0;
+	
+	// the streams of a bank share its weights rather than each holding a copy
+	if (sharedWeights != NULL)
+	{
+		binWeights = sharedWeights;
+	}
+	else
+	{
+		weights.resize (2 * numBins);
+		calculateBinWeights (frameSize, &weights[0]);
+		binWeights = &weights[0];
+	}
+	
+	highFrequencyWeights = binWeights + numBins;
+	
+	energySum = 0.0;		// initialise energy sum value to zero
+	samplesSinceEnergySum = 0;
 	prevEnergySum = 0.0;	// initialise previous energy sum value to zero
 	
     initialiseFFT();
 }
 
+//=======================================================================
+void OnsetDetectionFunction::calculateBinWeights (int frameSize_, double* weights)
+{
+	int numBins_ = (frameSize_ / 2) + 1;
+	double* binWeights_ = weights;
+	double* highFrequencyWeights_ = weights + numBins_;
+	
+	// bins 1 to (N/2)-1 each stand in for themselves and their mirror image at N-i,
+	// so weight them such that summing over the half spectrum gives the same result
+	// as summing over the full spectrum
+	for (int i = 0; i < numBins_; i++)
+	{
+		if ((i == 0) || (i == frameSize_ - i))
+		{
+			binWeights_[i] = 1.0;
+			highFrequencyWeights_[i] = (double) (i + 1);
+		}
+		else
+		{
+			binWeights_[i] = 2.0;
+			highFrequencyWeights_[i] = (double) ((i + 1) + (frameSize_ - i + 1));
+		}
+	}
+}
+
 //=======================================================================
 void OnsetDetectionFunction::initialiseFFT()
 {
@@ -131,24 +183,30 @@ void OnsetDetectionFunction::initialiseFFT()
         freeFFT();
     }
     
-#ifdef USE_FFTW
-    complexIn = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * frameSize);		// complex array to hold fft data
-    complexOut = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * frameSize);	// complex array to hold fft data
-    p = fftw_plan_dft_1d (frameSize, complexIn, complexOut, FFTW_FORWARD, FFTW_ESTIMATE);	// FFT plan initialisation
-#endif
-    
-#ifdef USE_KISS_FFT
-    complexOut.resize (frameSize);
+    // the window and FFT plan are shared with every other instance of the same size
+    window = FFTCache::acquireWindow (windowType, frameSize);
     
-    for (int i = 0; i < frameSize;i++)
+    // the stream of a bank only needs the window, as the bank performs the FFT
+    if (sharedWeights != NULL)
     {
-        complexOut[i].resize(2);
+        plan = NULL;
     }
-    
-    fftIn = new kiss_fft_cpx[frameSize];
-    fftOut = new kiss_fft_cpx[frameSize];
-    cfg = kiss_fft_alloc (frameSize, 0, 0, 0);
+    else
+    {
+        plan = FFTCache::acquirePlan (frameSize, RealForwardFFT);
+        
+#ifdef USE_FFTW
+        realIn = (double*) fftw_malloc (sizeof(double) * frameSize);					// real array to hold input data
+        complexOut = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * numBins);	// complex array to hold fft data
 #endif
+        
+#ifdef USE_KISS_FFT
+        complexOut = new double[numBins][2];
+        fftIn = new kiss_fft_scalar[frameSize];
+        fftOut = new kiss_fft_cpx[numBins];
+        fftWorkingMemory = new kiss_fft_cpx[FFTCache::getWorkingMemorySize (plan)];
+#endif
+    }
 
     initialised = true;
 }
@@ -156,16 +214,25 @@ void OnsetDetectionFunction::initialiseFFT()
 //=======================================================================
 void OnsetDetectionFunction::freeFFT()
 {
+    FFTCache::releaseWindow (window);
+    
+    if (plan == NULL)
+    {
+        return;
+    }
+    
+    FFTCache::releasePlan (plan);
+    
 #ifdef USE_FFTW
-    fftw_destroy_plan (p);
-    fftw_free (complexIn);
+    fftw_free (realIn);
     fftw_free (complexOut);
 #endif
     
 #ifdef USE_KISS_FFT
-    free (cfg);
     delete [] fftIn;
     delete [] fftOut;
+    delete [] fftWorkingMemory;
+    delete [] complexOut;
 #endif
 }
 
@@ -176,129 +243,359 @@ void OnsetDetectionFunction::setOnsetDetectionFunctionType (int onsetDetectionFu
 }
 
 //=======================================================================
-double OnsetDetectionFunction::calculateOnsetDetectionFunctionSample (double* buffer)
+void OnsetDetectionFunction::setPhaseCalculationMethod (int phaseCalculationMethod_)
+{
+    if (phaseCalculationMethod_ == phaseCalculationMethod)
+    {
+        return;
+    }
+    
+    // carry the phase history over to the new representation so that
+    // switching method does not produce a spurious detection function peak
+    for (int i = 0; i < numBins; i++)
+    {
+        if (phaseCalculationMethod_ == ComplexDomainPhase)
+        {
+            prevPhasorReal[i] = cos (prevPhase[i]);
+            prevPhasorImag[i] = sin (prevPhase[i]);
+            prevPhasor2Real[i] = cos (prevPhase2[i]);
+            prevPhasor2Imag[i] = sin (prevPhase2[i]);
+        }
+        else
+        {
+            prevPhase[i] = atan2 (prevPhasorImag[i], prevPhasorReal[i]);
+            prevPhase2[i] = atan2 (prevPhasor2Imag[i], prevPhasor2Real[i]);
+        }
+    }
+    
+    phaseCalculationMethod = phaseCalculationMethod_;
+}
+
+//=======================================================================
+void OnsetDetectionFunction::setSpectralKernelType (int spectralKernelType_)
+{
+    spectralKernelType = SpectralKernels::getNearestSupportedType (spectralKernelType_);
+    kernels = &SpectralKernels::get (spectralKernelType);
+}
+
+//=======================================================================
+int OnsetDetectionFunction::getSpectralKernelType()
+{
+    return spectralKernelType;
+}
+
+//=======================================================================
+void OnsetDetectionFunction::getTimingStatistics (TimingStatistics& statistics)
+{
+#ifdef BTRACK_STAGE_TIMING
+    statistics.onsetDetectionFunctionFFT = fftTiming.getStatistics();
+    statistics.onsetDetectionFunctionReduction = reductionTiming.getStatistics();
+#else
+    StageTimingStatistics none = {0, 0, 0};
+    statistics.onsetDetectionFunctionFFT = none;
+    statistics.onsetDetectionFunctionReduction = none;
+#endif
+}
+
+//=======================================================================
+void OnsetDetectionFunction::resetTimingStatistics()
+{
+#ifdef BTRACK_STAGE_TIMING
+    fftTiming.reset();
+    reductionTiming.reset();
+#endif
+}
+
+//=======================================================================
+template <typename SampleType>
+double OnsetDetectionFunction::calculateOnsetDetectionFunctionSample (const SampleType* buffer)
 {	
 	double odfSample;
+	
+	calculateOnsetDetectionFunctionSamples (buffer, &onsetDetectionFunctionType, 1, &odfSample);
 		
-	// shift audio samples back in frame by hop size
-	for (int i = 0; i < (frameSize-hopSize);i++)
+	return odfSample;
+}
+
+//=======================================================================
+template <typename SampleType>
+void OnsetDetectionFunction::calculateOnsetDetectionFunctionSamples (const SampleType* buffer, const int* onsetDetectionFunctionTypes, int numTypes, double* odfSamples)
+{
+	bool needsEnergy, needsSpectrum, needsPhase;
+	
+	findSharedCalculations (onsetDetectionFunctionTypes, numTypes, needsEnergy, needsSpectrum, needsPhase);
+	
+	addHopToFrame (buffer);
+	
+	if (needsSpectrum)
 	{
-		frame[i] = frame[i+hopSize];
+		// perform the FFT
+		performFFT();
 	}
 	
-	// add new samples to frame from input buffer
-	int j = 0;
-	for (int i = (frameSize-hopSize);i < frameSize;i++)
+	reduceSpectrum (&complexOut[0][0], onsetDetectionFunctionTypes, numTypes, odfSamples);
+}
+
+//=======================================================================
+void OnsetDetectionFunction::findSharedCalculations (const int* onsetDetectionFunctionTypes, int numTypes, bool& needsEnergy, bool& needsSpectrum, bool& needsPhase)
+{
+	needsEnergy = false;
+	needsSpectrum = false;
+	needsPhase = false;
+	
+	// work out which of the shared calculations the requested detection functions need
+	for (int k = 0; k < numTypes; k++)
 	{
-		frame[i] = buffer[j];
-		j++;
+		switch (onsetDetectionFunctionTypes[k])
+		{
+			case EnergyEnvelope:
+			case EnergyDifference:
+				needsEnergy = true;
+				break;
+			case PhaseDeviation:
+			case ComplexSpectralDifference:
+			case ComplexSpectralDifferenceHWR:
+				needsSpectrum = true;
+				needsPhase = true;
+				break;
+			case SpectralDifference:
+			case SpectralDifferenceHWR:
+			case HighFrequencyContent:
+			case HighFrequencySpectralDifference:
+			case HighFrequencySpectralDifferenceHWR:
+				needsSpectrum = true;
+				break;
+			default:
+				break;
+		}
 	}
+}
+
+//=======================================================================
+template <typename SampleType>
+void OnsetDetectionFunction::addHopToFrame (const SampleType* buffer)
+{
+	// write the new samples over the oldest ones in the frame ring buffer and its mirror
+	// image, so that the frame always reads contiguously from the oldest sample, and
+	// update the frame energy with the samples entering and leaving the frame
+	for (int j = 0; j < hopSize; j++)
+	{
+		double sample = buffer[j];
 		
-	switch (onsetDetectionFunctionType)
-    {
-		case EnergyEnvelope:
-        {
-            // calculate energy envelope detection function sample
-			odfSample = energyEnvelope();
-			break;
-        }
-		case EnergyDifference:
-        {
-            // calculate half-wave rectified energy difference detection function sample
-			odfSample = energyDifference();
-			break;
-        }
-		case SpectralDifference:
-        {
-            // calculate spectral difference detection function sample
-			odfSample = spectralDifference();
-			break;
-        }
-		case SpectralDifferenceHWR:
-        {
-            // calculate spectral difference detection function sample (half wave rectified)
-			odfSample = spectralDifferenceHWR();
-			break;
-        }
-		case PhaseDeviation:
-        {
-            // calculate phase deviation detection function sample (half wave rectified)
-			odfSample = phaseDeviation();
-			break;
-        }
-		case ComplexSpectralDifference:
-        {
-            // calcualte complex spectral difference detection function sample
-			odfSample = complexSpectralDifference();
-			break;
-        }
-		case ComplexSpectralDifferenceHWR:
-        {
-            // calcualte complex spectral difference detection function sample (half-wave rectified)
-			odfSample = complexSpectralDifferenceHWR();
-			break;
-        }
-		case HighFrequencyContent:
-        {
-            // calculate high frequency content detection function sample
-			odfSample = highFrequencyContent();
-			break;
-        }
-		case HighFrequencySpectralDifference:
-        {
-            // calculate high frequency spectral difference detection function sample
-			odfSample = highFrequencySpectralDifference();
-			break;
-        }
-		case HighFrequencySpectralDifferenceHWR:
-        {
-            // calculate high frequency spectral difference detection function (half-wave rectified)
-			odfSample = highFrequencySpectralDifferenceHWR();
-			break;
-        }
-		default:
-        {
-			odfSample = 1.0;
-        }
-	}
+		energySum = energySum + (sample * sample) - (frame[framePosition] * frame[framePosition]);
 		
-	return odfSample;
+		frame[framePosition] = sample;
+		frame[framePosition + frameSize] = sample;
+		
+		framePosition++;
+		
+		if (framePosition == frameSize)
+		{
+			framePosition = 0;
+		}
+	}
+	
+	samplesSinceEnergySum += hopSize;
+	
+	// re-sum the energy from time to time to stop rounding errors accumulating
+	if (samplesSinceEnergySum >= frameSize * 64)
+	{
+		calculateEnergy();
+	}
+	
+	// the running sum can drift slightly below zero in silence
+	if (energySum < 0)
+	{
+		energySum = 0;
+	}
+}
+
+//=======================================================================
+// the sample types that audio can be passed in
+template double OnsetDetectionFunction::calculateOnsetDetectionFunctionSample<double> (const double*);
+template double OnsetDetectionFunction::calculateOnsetDetectionFunctionSample<float> (const float*);
+template void OnsetDetectionFunction::calculateOnsetDetectionFunctionSamples<double> (const double*, const int*, int, double*);
+template void OnsetDetectionFunction::calculateOnsetDetectionFunctionSamples<float> (const float*, const int*, int, double*);
+template void OnsetDetectionFunction::addHopToFrame<double> (const double*);
+template void OnsetDetectionFunction::addHopToFrame<float> (const float*);
+
+//=======================================================================
+void OnsetDetectionFunction::reduceSpectrum (const double* spectrum_, const int* onsetDetectionFunctionTypes, int numTypes, double* odfSamples)
+{
+	BTRACK_TIME_STAGE (reductionTiming);
+	
+	bool needsEnergy, needsSpectrum, needsPhase;
+	
+	findSharedCalculations (onsetDetectionFunctionTypes, numTypes, needsEnergy, needsSpectrum, needsPhase);
+	
+	spectrum = spectrum_;
+	
+	if (needsSpectrum)
+	{
+		// mag spec symmetric above (N/2)+1 so only visit the first (N/2)+1 bins
+		kernels->magnitudeSpectrum (spectrum, &magSpec[0], numBins);
+	}
+	
+	if (needsPhase)
+	{
+		calculatePhase();
+	}
+	
+	for (int k = 0; k < numTypes; k++)
+	{
+		switch (onsetDetectionFunctionTypes[k])
+		{
+			case EnergyEnvelope:
+			{
+				// calculate energy envelope detection function sample
+				odfSamples[k] = energyEnvelope();
+				break;
+			}
+			case EnergyDifference:
+			{
+				// calculate half-wave rectified energy difference detection function sample
+				odfSamples[k] = energyDifference();
+				break;
+			}
+			case SpectralDifference:
+			{
+				// calculate spectral difference detection function sample
+				odfSamples[k] = spectralDifference();
+				break;
+			}
+			case SpectralDifferenceHWR:
+			{
+				// calculate spectral difference detection function sample (half wave rectified)
+				odfSamples[k] = spectralDifferenceHWR();
+				break;
+			}
+			case PhaseDeviation:
+			{
+				// calculate phase deviation detection function sample (half wave rectified)
+				odfSamples[k] = phaseDeviation();
+				break;
+			}
+			case ComplexSpectralDifference:
+			{
+				// calcualte complex spectral difference detection function sample
+				odfSamples[k] = complexSpectralDifference();
+				break;
+			}
+			case ComplexSpectralDifferenceHWR:
+			{
+				// calcualte complex spectral difference detection function sample (half-wave rectified)
+				odfSamples[k] = complexSpectralDifferenceHWR();
+				break;
+			}
+			case HighFrequencyContent:
+			{
+				// calculate high frequency content detection function sample
+				odfSamples[k] = highFrequencyContent();
+				break;
+			}
+			case HighFrequencySpectralDifference:
+			{
+				// calculate high frequency spectral difference detection function sample
+				odfSamples[k] = highFrequencySpectralDifference();
+				break;
+			}
+			case HighFrequencySpectralDifferenceHWR:
+			{
+				// calculate high frequency spectral difference detection function (half-wave rectified)
+				odfSamples[k] = highFrequencySpectralDifferenceHWR();
+				break;
+			}
+			default:
+			{
+				odfSamples[k] = 1.0;
+			}
+		}
+	}
+	
+	// store values for the next calculation, only after every requested
+	// detection function has seen the values from the previous frame
+	if (needsEnergy)
+	{
+		prevEnergySum = energySum;
+	}
+	
+	if (needsSpectrum)
+	{
+		magSpec.swap (prevMagSpec);
+	}
+	
+	if (needsPhase)
+	{
+		if (phaseCalculationMethod == ComplexDomainPhase)
+		{
+			prevPhasor2Real.swap (prevPhasorReal);
+			prevPhasor2Imag.swap (prevPhasorImag);
+			prevPhasorReal.swap (phasorReal);
+			prevPhasorImag.swap (phasorImag);
+		}
+		else
+		{
+			prevPhase2.swap (prevPhase);
+			prevPhase.swap (phase);
+		}
+	}
+}
+
+//=======================================================================
+void OnsetDetectionFunction::calculateEnergy()
+{
+	const double* currentFrame = &frame[framePosition];
+	
+	energySum = 0;	// initialise sum
+	
+	// sum the squares of the samples
+	for (int i = 0; i < frameSize; i++)
+	{
+		energySum = energySum + (currentFrame[i] * currentFrame[i]);
+	}
+	
+	samplesSinceEnergySum = 0;
+}
+
+//=======================================================================
+void OnsetDetectionFunction::calculatePhase()
+{
+	if (phaseCalculationMethod == ComplexDomainPhase)
+	{
+		// the unit phasor of each bin stands in for its phase
+		kernels->unitPhasors (spectrum, &magSpec[0], &phasorReal[0], &phasorImag[0], numBins);
+	}
+	else
+	{
+		// calculate phase values from fft output
+		for (int i = 0; i < numBins; i++)
+		{
+			phase[i] = atan2 (spectrum[2 * i + 1], spectrum[2 * i]);
+		}
+	}
 }
 
 
 //=======================================================================
 void OnsetDetectionFunction::performFFT()
 {
-    int fsize2 = (frameSize/2);
+    BTRACK_TIME_STAGE (fftTiming);
     
 #ifdef USE_FFTW
-	// window frame and copy to complex array, swapping the first and second half of the signal
-	for (int i = 0;i < fsize2;i++)
-	{
-		complexIn[i][0] = frame[i + fsize2] * window[i + fsize2];
-		complexIn[i][1] = 0.0;
-		complexIn[i+fsize2][0] = frame[i] * window[i];
-		complexIn[i+fsize2][1] = 0.0;
-	}
+	windowFrame (realIn);
 	
 	// perform the fft
-	fftw_execute (p);
+	fftw_execute_dft_r2c (plan->plan, realIn, complexOut);
 #endif
     
 #ifdef USE_KISS_FFT
-    for (int i = 0; i < fsize2; i++)
-    {
-        fftIn[i].r = frame[i + fsize2] * window[i + fsize2];
-        fftIn[i].i = 0.0;
-        fftIn[i + fsize2].r = frame[i] * window[i];
-        fftIn[i + fsize2].i = 0.0;
-    }
+    windowFrame (fftIn);
     
     // execute kiss fft
-    kiss_fft (cfg, fftIn, fftOut);
+    FFTCache::performRealFFT (plan, fftIn, fftOut, fftWorkingMemory);
     
     // store real and imaginary parts of FFT
-    for (int i = 0; i < frameSize; i++)
+    for (int i = 0; i < numBins; i++)
     {
         complexOut[i][0] = fftOut[i].r;
         complexOut[i][1] = fftOut[i].i;
@@ -306,6 +603,37 @@ void OnsetDetectionFunction::performFFT()
 #endif
 }
 
+#ifdef USE_FFTW
+//=======================================================================
+void OnsetDetectionFunction::windowFrame (double* output)
+{
+    int fsize2 = (frameSize/2);
+    const double* currentFrame = &frame[framePosition];
+    
+	// window frame and copy to real array, swapping the first and second half of the signal
+	for (int i = 0;i < fsize2;i++)
+	{
+		output[i] = currentFrame[i + fsize2] * window[i + fsize2];
+		output[i+fsize2] = currentFrame[i] * window[i];
+	}
+}
+#endif
+
+#ifdef USE_KISS_FFT
+//=======================================================================
+void OnsetDetectionFunction::windowFrame (kiss_fft_scalar* output)
+{
+    int fsize2 = (frameSize/2);
+    const double* currentFrame = &frame[framePosition];
+    
+    for (int i = 0; i < fsize2; i++)
+    {
+        output[i] = currentFrame[i + fsize2] * window[i + fsize2];
+        output[i + fsize2] = currentFrame[i] * window[i];
+    }
+}
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////// Methods for Detection Functions /////////////////////////////////
@@ -313,36 +641,15 @@ void OnsetDetectionFunction::performFFT()
 //=======================================================================
 double OnsetDetectionFunction::energyEnvelope()
 {
-	double sum;
-	
-	sum = 0;	// initialise sum
-	
-	// sum the squares of the samples
-	for (int i = 0;i < frameSize;i++)
-	{
-		sum = sum + (frame[i] * frame[i]);
-	}
-	
-	return sum;		// return sum
+	return energySum;
 }
 
 //=======================================================================
 double OnsetDetectionFunction::energyDifference()
 {
-	double sum;
 	double sample;
 	
-	sum = 0;	// initialise sum
-	
-	// sum the squares of the samples
-	for (int i = 0; i < frameSize; i++)
-	{
-		sum = sum + (frame[i] * frame[i]);
-	}
-	
-	sample = sum - prevEnergySum;	// sample is first order difference in energy
-	
-	prevEnergySum = sum;	// store energy value for next calculation
+	sample = energySum - prevEnergySum;	// sample is first order difference in energy
 	
 	if (sample > 0)
 	{
@@ -357,85 +664,15 @@ double OnsetDetectionFunction::energyDifference()
 //=======================================================================
 double OnsetDetectionFunction::spectralDifference()
 {
-	double diff;
-	double sum;
-	
-	// perform the FFT
-	performFFT();
-	
-	// compute first (N/2)+1 mag values
-	for (int i = 0;i < (frameSize/2)+1;i++)
-	{
-		magSpec[i] = sqrt (pow (complexOut[i][0], 2) + pow (complexOut[i][1], 2));
-	}
-	// mag spec symmetric above (N/2)+1 so copy previous values
-	for (int i = (frameSize/2)+1; i < frameSize; i++)
-	{
-		magSpec[i] = magSpec[frameSize-i];
-	}
-	
-	sum = 0;	// initialise sum to zero
-
-	for (int i = 0; i < frameSize; i++)
-	{
-		// calculate difference
-		diff = magSpec[i] - prevMagSpec[i];
-		
-		// ensure all difference values are positive
-		if (diff < 0)
-		{
-			diff = diff*-1;
-		}
-		
-		// add difference to sum
-		sum = sum + diff;
-		
-		// store magnitude spectrum bin for next detection function sample calculation
-		prevMagSpec[i] = magSpec[i];
-	}
-	
-	return sum;		
+	// sum the absolute differences with the previous magnitude spectrum, including their mirror images
+	return kernels->spectralDifference (&magSpec[0], &prevMagSpec[0], &binWeights[0], numBins);
 }
 
 //=======================================================================
 double OnsetDetectionFunction::spectralDifferenceHWR()
 {
-	double diff;
-	double sum;
-	
-	// perform the FFT
-	performFFT();
-	
-	// compute first (N/2)+1 mag values
-	for (int i = 0;i < (frameSize/2) + 1; i++)
-	{
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow (complexOut[i][1],2));
-	}
-	// mag spec symmetric above (N/2)+1 so copy previous values
-	for (int i = (frameSize/2)+1;i < frameSize;i++)
-	{
-		magSpec[i] = magSpec[frameSize-i];
-	}
-	
-	sum = 0;	// initialise sum to zero
-	
-	for (int i = 0;i < frameSize;i++)
-	{
-		// calculate difference
-		diff = magSpec[i] - prevMagSpec[i];
-		
-		// only add up positive differences
-		if (diff > 0)
-		{
-			// add difference to sum
-			sum = sum+diff;
-		}
-		
-		// store magnitude spectrum bin for next detection function sample calculation
-		prevMagSpec[i] = magSpec[i];
-	}
-	
-	return sum;		
+	// sum only the positive differences with the previous magnitude spectrum, including their mirror images
+	return kernels->spectralDifferenceHWR (&magSpec[0], &prevMagSpec[0], &binWeights[0], numBins);
 }
 
 
@@ -445,21 +682,16 @@ double OnsetDetectionFunction::phaseDeviation()
 	double dev,pdev;
 	double sum;
 	
-	// perform the FFT
-	performFFT();
+	if (phaseCalculationMethod == ComplexDomainPhase)
+	{
+		return complexDomainPhaseDeviation();
+	}
 	
 	sum = 0; // initialise sum to zero
 	
-	// compute phase values from fft output and sum deviations
-	for (int i = 0;i < frameSize;i++)
+	// sum phase deviations
+	for (int i = 0;i < numBins;i++)
 	{
-		// calculate phase value
-		phase[i] = atan2 (complexOut[i][1], complexOut[i][0]);
-		
-		// calculate magnitude value
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow (complexOut[i][1],2));
-		
-		
 		// if bin is not just a low energy bin then examine phase deviation
 		if (magSpec[i] > 0.1)
 		{
@@ -472,13 +704,9 @@ double OnsetDetectionFunction::phaseDeviation()
 				pdev = pdev*-1;
 			}
 						
-			// add to sum
-			sum = sum + pdev;
+			// add to sum, including its mirror image
+			sum = sum + (pdev * binWeights[i]);
 		}
-				
-		// store values for next calculation
-		prevPhase2[i] = prevPhase[i];
-		prevPhase[i] = phase[i];
 	}
 	
 	return sum;		
@@ -491,33 +719,24 @@ double OnsetDetectionFunction::complexSpectralDifference()
 	double sum;
 	double csd;
 	
-	// perform the FFT
-	performFFT();
+	if (phaseCalculationMethod == ComplexDomainPhase)
+	{
+		return complexDomainSpectralDifference (false);
+	}
 	
 	sum = 0; // initialise sum to zero
 	
-	// compute phase values from fft output and sum deviations
-	for (int i = 0;i < frameSize;i++)
+	// sum complex spectral differences
+	for (int i = 0;i < numBins;i++)
 	{
-		// calculate phase value
-		phase[i] = atan2 (complexOut[i][1], complexOut[i][0]);
-		
-		// calculate magnitude value
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow(complexOut[i][1],2));
-		
 		// phase deviation
 		phaseDeviation = phase[i] - (2 * prevPhase[i]) + prevPhase2[i];
 		
         // calculate complex spectral difference for the current spectral bin
 		csd = sqrt (pow (magSpec[i], 2) + pow (prevMagSpec[i], 2) - 2 * magSpec[i] * prevMagSpec[i] * cos (phaseDeviation));
 			
-		// add to sum
-		sum = sum + csd;
-		
-		// store values for next calculation
-		prevPhase2[i] = prevPhase[i];
-		prevPhase[i] = phase[i];
-		prevMagSpec[i] = magSpec[i];
+		// add to sum, including its mirror image
+		sum = sum + (csd * binWeights[i]);
 	}
 	
 	return sum;		
@@ -531,40 +750,31 @@ double OnsetDetectionFunction::complexSpectralDifferenceHWR()
 	double magnitudeDifference;
 	double csd;
 	
-	// perform the FFT
-	performFFT();
+	if (phaseCalculationMethod == ComplexDomainPhase)
+	{
+		return complexDomainSpectralDifference (true);
+	}
 	
 	sum = 0; // initialise sum to zero
 	
-	// compute phase values from fft output and sum deviations
-	for (int i = 0;i < frameSize;i++)
+	// sum complex spectral differences
+	for (int i = 0;i < numBins;i++)
 	{
-		// calculate phase value
-		phase[i] = atan2 (complexOut[i][1], complexOut[i][0]);
-		
-		// calculate magnitude value
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow(complexOut[i][1],2));
-		
-        // phase deviation
-        phaseDeviation = phase[i] - (2 * prevPhase[i]) + prevPhase2[i];
-        
         // calculate magnitude difference (real part of Euclidean distance between complex frames)
         magnitudeDifference = magSpec[i] - prevMagSpec[i];
         
         // if we have a positive change in magnitude, then include in sum, otherwise ignore (half-wave rectification)
         if (magnitudeDifference > 0)
         {
+            // phase deviation
+            phaseDeviation = phase[i] - (2 * prevPhase[i]) + prevPhase2[i];
+            
             // calculate complex spectral difference for the current spectral bin
             csd = sqrt (pow (magSpec[i], 2) + pow (prevMagSpec[i], 2) - 2 * magSpec[i] * prevMagSpec[i] * cos (phaseDeviation));
         
-            // add to sum
-            sum = sum + csd;
+            // add to sum, including its mirror image
+            sum = sum + (csd * binWeights[i]);
         }
-        
-		// store values for next calculation
-		prevPhase2[i] = prevPhase[i];
-		prevPhase[i] = phase[i];
-		prevMagSpec[i] = magSpec[i];
 	}
 	
 	return sum;		
@@ -574,192 +784,67 @@ double OnsetDetectionFunction::complexSpectralDifferenceHWR()
 //=======================================================================
 double OnsetDetectionFunction::highFrequencyContent()
 {
-	double sum;
-	
-	// perform the FFT
-	performFFT();
-	
-	sum = 0; // initialise sum to zero
-	
-	// compute phase values from fft output and sum deviations
-	for (int i = 0; i < frameSize; i++)
-	{		
-		// calculate magnitude value
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow (complexOut[i][1],2));
-		
-		
-		sum = sum + (magSpec[i] * ((double) (i+1)));
-		
-		// store values for next calculation
-		prevMagSpec[i] = magSpec[i];
-	}
-	
-	return sum;		
+	// weight each bin by its frequency
+	return kernels->weightedSum (&magSpec[0], &highFrequencyWeights[0], numBins);
 }
 
 //=======================================================================
 double OnsetDetectionFunction::highFrequencySpectralDifference()
 {
-	double sum;
-	double mag_diff;
-	
-	// perform the FFT
-	performFFT();
-	
-	sum = 0; // initialise sum to zero
-	
-	// compute phase values from fft output and sum deviations
-	for (int i = 0;i < frameSize;i++)
-	{		
-		// calculate magnitude value
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow (complexOut[i][1],2));
-		
-		// calculate difference
-		mag_diff = magSpec[i] - prevMagSpec[i];
-		
-		if (mag_diff < 0)
-		{
-			mag_diff = -mag_diff;
-		}
-		
-		sum = sum + (mag_diff * ((double) (i+1)));
-		
-		// store values for next calculation
-		prevMagSpec[i] = magSpec[i];
-	}
-	
-	return sum;		
+	// sum the absolute differences, weighting each bin by its frequency
+	return kernels->spectralDifference (&magSpec[0], &prevMagSpec[0], &highFrequencyWeights[0], numBins);
 }
 
 //=======================================================================
 double OnsetDetectionFunction::highFrequencySpectralDifferenceHWR()
 {
-	double sum;
-	double mag_diff;
-	
-	// perform the FFT
-	performFFT();
-	
-	sum = 0; // initialise sum to zero
-	
-	// compute phase values from fft output and sum deviations
-	for (int i = 0;i < frameSize;i++)
-	{		
-		// calculate magnitude value
-		magSpec[i] = sqrt (pow (complexOut[i][0],2) + pow (complexOut[i][1],2));
-		
-		// calculate difference
-		mag_diff = magSpec[i] - prevMagSpec[i];
-		
-		if (mag_diff > 0)
-		{
-			sum = sum + (mag_diff * ((double) (i+1)));
-		}
-
-		// store values for next calculation
-		prevMagSpec[i] = magSpec[i];
-	}
-	
-	return sum;		
-}
-
-
-////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////
-////////////////////////////// Methods to Calculate Windows ////////////////////////////////////
-
-//=======================================================================
-void OnsetDetectionFunction::calculateHanningWindow()
-{
-	double N;		// variable to store framesize minus 1
-	
-	N = (double) (frameSize-1);	// framesize minus 1
-	
-	// Hanning window calculation
-	for (int n = 0; n < frameSize; n++)
-	{
-		window[n] = 0.5 * (1 - cos (2 * pi * (n / N)));
-	}
+	// sum the positive differences, weighting each bin by its frequency
+	return kernels->spectralDifferenceHWR (&magSpec[0], &prevMagSpec[0], &highFrequencyWeights[0], numBins);
 }
 
-//=======================================================================
-void OnsetDetectionFunction::calclulateHammingWindow()
-{
-	double N;		// variable to store framesize minus 1
-	double n_val;	// double version of index 'n'
-	
-	N = (double) (frameSize-1);	// framesize minus 1
-	n_val = 0;
-	
-	// Hamming window calculation
-	for (int n = 0;n < frameSize;n++)
-	{
-		window[n] = 0.54 - (0.46 * cos (2 * pi * (n_val/N)));
-		n_val = n_val+1;
-	}
-}
 
 //=======================================================================
-void OnsetDetectionFunction::calculateBlackmanWindow()
+double OnsetDetectionFunction::complexDomainSpectralDifference (bool halfWaveRectify)
 {
-	double N;		// variable to store framesize minus 1
-	double n_val;	// double version of index 'n'
-	
-	N = (double) (frameSize-1);	// framesize minus 1
-	n_val = 0;
-	
-	// Blackman window calculation
-	for (int n = 0;n < frameSize;n++)
-	{
-		window[n] = 0.42 - (0.5*cos(2*pi*(n_val/N))) + (0.08*cos(4*pi*(n_val/N)));
-		n_val = n_val+1;
-	}
+	// predict each bin from the previous two spectra and sum the distances to the predictions
+	return kernels->complexSpectralDifference (spectrum, &magSpec[0], &prevMagSpec[0],
+	                                           &prevPhasorReal[0], &prevPhasorImag[0], &prevPhasor2Real[0], &prevPhasor2Imag[0],
+	                                           &binWeights[0], numBins, halfWaveRectify);
 }
 
 //=======================================================================
-void OnsetDetectionFunction::calculateTukeyWindow()
+double OnsetDetectionFunction::complexDomainPhaseDeviation()
 {
-	double N;		// variable to store framesize minus 1
-	double n_val;	// double version of index 'n'
-	double alpha;	// alpha [default value = 0.5];
-	
-	alpha = 0.5;
+	double sum;
+	double rotationReal, rotationImag;
+	double deviationReal, deviationImag;
 	
-	N = (double) (frameSize-1);	// framesize minus 1
-		
-	// Tukey window calculation
+	sum = 0; // initialise sum to zero
 	
-	n_val = (double) (-1*((frameSize/2)))+1;
-
-	for (int n = 0;n < frameSize;n++)	// left taper
+	for (int i = 0; i < numBins; i++)
 	{
-		if ((n_val >= 0) && (n_val <= (alpha*(N/2))))
-		{
-			window[n] = 1.0;
-		}
-		else if ((n_val <= 0) && (n_val >= (-1*alpha*(N/2))))
-		{
-			window[n] = 1.0;
-		}
-		else
+		// if bin is not just a low energy bin then examine phase deviation
+		if (magSpec[i] > 0.1)
 		{
-			window[n] = 0.5*(1+cos(pi*(((2*n_val)/(alpha*N))-1)));
+			// rotate the current phasor by the conjugate of the squared previous phasor
+			// and by the second previous phasor, giving phase - 2*prevPhase + prevPhase2
+			rotationReal = prevPhasorReal[i] * prevPhasorReal[i] - prevPhasorImag[i] * prevPhasorImag[i];
+			rotationImag = -2 * prevPhasorReal[i] * prevPhasorImag[i];
+			
+			deviationReal = phasorReal[i] * rotationReal - phasorImag[i] * rotationImag;
+			deviationImag = phasorReal[i] * rotationImag + phasorImag[i] * rotationReal;
+			
+			rotationReal = deviationReal * prevPhasor2Real[i] - deviationImag * prevPhasor2Imag[i];
+			rotationImag = deviationReal * prevPhasor2Imag[i] + deviationImag * prevPhasor2Real[i];
+			
+			// the angle of the rotated phasor is already wrapped into [-pi,pi]
+			sum = sum + (absoluteAngle (rotationReal, rotationImag) * binWeights[i]);
 		}
-
-		n_val = n_val+1;			 
 	}
-
+	
+	return sum;
 }
 
-//=======================================================================
-void OnsetDetectionFunction::calculateRectangularWindow()
-{
-	// Rectangular window calculation
-	for (int n = 0;n < frameSize;n++)
-	{
-		window[n] = 1.0;
-	}
-}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -782,3 +867,37 @@ double OnsetDetectionFunction::princarg(double phaseVal)
 			
 	return phaseVal;
 }
+
+//=======================================================================
+double OnsetDetectionFunction::absoluteAngle (double real, double imag)
+{
+	double x = fabs (real);
+	double y = fabs (imag);
+	double z;
+	double z2;
+	double angle;
+	
+	if ((x == 0) && (y == 0))
+	{
+		return 0;
+	}
+	
+	// reduce to an argument in [0,1] for the polynomial
+	z = (y > x) ? (x / y) : (y / x);
+	z2 = z * z;
+	
+	// minimax polynomial approximation of atan(z) on [0,1]
+	angle = z * (0.9998660 + z2 * (-0.3302995 + z2 * (0.1801410 + z2 * (-0.0851330 + z2 * 0.0208351))));
+	
+	if (y > x)
+	{
+		angle = (pi / 2) - angle;
+	}
+	
+	if (real < 0)
+	{
+		angle = pi - angle;
+	}
+	
+	return angle;
+}
@@ -22,15 +22,10 @@
 #ifndef __ONSETDETECTIONFUNCTION_H
 #define __ONSETDETECTIONFUNCTION_H
 
-#ifdef USE_FFTW
-#include "fftw3.h"
-#endif
-
-#ifdef USE_KISS_FFT
-#include "kiss_fft.h"
-#endif
-
 #include <vector>
+#include "FFTCache.h"
+#include "SpectralKernels.h"
+#include "StageTiming.h"
 
 //=======================================================================
 /** The type of onset detection function to calculate */
@@ -49,14 +44,12 @@ enum OnsetDetectionFunctionType
 };
 
 //=======================================================================
-/** The type of window to use when calculating onset detection function samples */
-enum WindowType
+/** The method used to calculate the phase based detection functions
+ * (PhaseDeviation, ComplexSpectralDifference and ComplexSpectralDifferenceHWR) */
+enum PhaseCalculationMethod
 {
-    RectangularWindow,
-    HanningWindow,
-    HammingWindow,
-    BlackmanWindow,
-    TukeyWindow
+    PolarPhase,
+    ComplexDomainPhase
 };
 
 //=======================================================================
@@ -100,20 +93,126 @@ public:
 	void initialise (int hopSize_, int frameSize_, int onsetDetectionFunctionType_, int windowType_);
 	
     /** Process input frame and calculate detection function sample 
-     * @param buffer a pointer to an array containing the audio samples to be processed
+     * @param buffer a pointer to an array containing the audio samples to be processed, as double or float
      * @returns the onset detection function sample
      */
-	double calculateOnsetDetectionFunctionSample (double* buffer);
+    template <typename SampleType>
+	double calculateOnsetDetectionFunctionSample (const SampleType* buffer);
+    
+    /** Process input frame and calculate several detection function samples at once. The frame is
+     * windowed and transformed once, and the magnitude and phase of the spectrum are calculated once,
+     * then shared between all of the requested detection functions. The detection function type set
+     * with setOnsetDetectionFunctionType() is not used. The same list of types should be passed for
+     * every frame, as only the values the requested detection functions need are kept for the next frame.
+     * @param buffer a pointer to an array containing the audio samples to be processed, as double or float
+     * @param onsetDetectionFunctionTypes the types of onset detection function to calculate - (see OnsetDetectionFunctionType)
+     * @param numTypes the number of detection function types
+     * @param odfSamples an array of size numTypes that the detection function samples are written to, in the same order as the types
+     */
+    template <typename SampleType>
+    void calculateOnsetDetectionFunctionSamples (const SampleType* buffer, const int* onsetDetectionFunctionTypes, int numTypes, double* odfSamples);
     
     /** Set the detection function type 
      * @param onsetDetectionFunctionType_ the type of onset detection function to use - (see OnsetDetectionFunctionType)
      */
 	void setOnsetDetectionFunctionType (int onsetDetectionFunctionType_);
+    
+    /** Set the method used to calculate the phase based detection functions. PolarPhase
+     * converts every bin to magnitude and phase, whereas ComplexDomainPhase predicts each bin
+     * from the previous two spectra using only multiplications. The two agree to within rounding
+     * error for the complex spectral difference, and to within around 0.1% for phase deviation.
+     * @param phaseCalculationMethod_ the method to use - (see PhaseCalculationMethod)
+     */
+    void setPhaseCalculationMethod (int phaseCalculationMethod_);
+    
+    /** Set the instruction set used to reduce spectra to detection function samples. By default the
+     * fastest one supported by the processor is used. If the processor does not support the requested
+     * type, the fastest supported type below it is used instead.
+     * @param spectralKernelType_ the kernel type to use - (see SpectralKernelType)
+     */
+    void setSpectralKernelType (int spectralKernelType_);
+    
+    /** @returns the instruction set being used to reduce spectra to detection function samples */
+    int getSpectralKernelType();
+    
+    /** Fill in the time spent so far in the FFT and in reducing spectra to detection function
+     * samples. The other stages are left as they are. This may be called from any thread, but
+     * the values are only counted when compiled with the flag -DBTRACK_STAGE_TIMING
+     * @param statistics the statistics to fill in
+     */
+    void getTimingStatistics (TimingStatistics& statistics);
+    
+    /** Set the time spent in each stage back to zero */
+    void resetTimingStatistics();
 	
 private:
 	
-    /** Perform the FFT on the data in 'frame' */
+    friend class OnsetDetectionFunctionBank;
+    
+    /** Constructor for one stream of an OnsetDetectionFunctionBank. The bank performs the FFT of every
+     * stream and holds the bin weights, so no FFT plan or buffers are created, and the weights are not copied
+     * @param hopSize_ the hop size in audio samples
+     * @param frameSize_ the frame size in audio samples
+     * @param onsetDetectionFunctionType_ the type of onset detection function to use - (see OnsetDetectionFunctionType)
+     * @param windowType_ the type of window to use (see WindowType)
+     * @param sharedWeights_ the bin weights followed by the high frequency weights (see calculateBinWeights())
+     */
+    OnsetDetectionFunction (int hopSize_, int frameSize_, int onsetDetectionFunctionType_, int windowType_, const double* sharedWeights_);
+    
+    /** Calculate the weights that account for the mirrored upper half of the spectrum
+     * @param frameSize_ the frame size in audio samples
+     * @param weights an array of 2 * ((frameSize_ / 2) + 1) values, set to the bin weights followed by the high frequency weights
+     */
+    static void calculateBinWeights (int frameSize_, double* weights);
+    
+    /** Work out which of the shared calculations a list of detection functions needs
+     * @param onsetDetectionFunctionTypes the types of onset detection function - (see OnsetDetectionFunctionType)
+     * @param numTypes the number of detection function types
+     * @param needsEnergy set to true if the frame energy is needed
+     * @param needsSpectrum set to true if the magnitude spectrum is needed
+     * @param needsPhase set to true if the phase of the spectrum is needed
+     */
+    static void findSharedCalculations (const int* onsetDetectionFunctionTypes, int numTypes, bool& needsEnergy, bool& needsSpectrum, bool& needsPhase);
+    
+    /** Add a hop of audio samples to the frame, updating its energy. The samples are converted
+     * to double as they are written to the frame
+     * @param buffer a pointer to an array containing hopSize audio samples, as double or float
+     */
+    template <typename SampleType>
+    void addHopToFrame (const SampleType* buffer);
+    
+    /** Perform the real-input FFT on the current frame, producing the first (frameSize/2)+1 bins */
 	void performFFT();
+    
+#ifdef USE_FFTW
+    /** Window the current frame, with its two halves swapped, ready for the FFT
+     * @param output an array of frameSize samples to write the windowed frame to
+     */
+    void windowFrame (double* output);
+#endif
+    
+#ifdef USE_KISS_FFT
+    /** Window the current frame, with its two halves swapped, ready for the FFT
+     * @param output an array of frameSize samples to write the windowed frame to
+     */
+    void windowFrame (kiss_fft_scalar* output);
+#endif
+    
+    /** Reduce the spectrum of the current frame to detection function samples, and keep the
+     * values that the next frame's detection functions need
+     * @param spectrum_ the first (frameSize/2)+1 bins of the spectrum of the current frame, with the real and imaginary parts interleaved
+     * @param onsetDetectionFunctionTypes the types of onset detection function to calculate - (see OnsetDetectionFunctionType)
+     * @param numTypes the number of detection function types
+     * @param odfSamples an array of size numTypes that the detection function samples are written to
+     */
+    void reduceSpectrum (const double* spectrum_, const int* onsetDetectionFunctionTypes, int numTypes, double* odfSamples);
+    
+    /** Calculate the energy of the samples in the current frame from scratch. Between calls
+     * the energy is kept up to date from the samples entering and leaving the frame */
+    void calculateEnergy();
+    
+    /** Calculate the phase of each bin of the spectrum, using the phase calculation method in use */
+    void calculatePhase();
 
     //=======================================================================
     /** Calculate energy envelope detection function sample */
@@ -145,22 +244,14 @@ private:
     
     /** Calculate high frequency spectral difference detection function sample (half-wave rectified) */
 	double highFrequencySpectralDifferenceHWR();
-
-    //=======================================================================
-    /** Calculate a Rectangular window */
-	void calculateRectangularWindow();
-    
-    /** Calculate a Hanning window */
-	void calculateHanningWindow();
-    
-    /** Calculate a Hamming window */
-	void calclulateHammingWindow();
     
-    /** Calculate a Blackman window */
-	void calculateBlackmanWindow();
+    /** Calculate complex spectral difference detection function sample in the complex domain
+     * @param halfWaveRectify if true, only bins with a rise in magnitude contribute to the sum
+     */
+    double complexDomainSpectralDifference (bool halfWaveRectify);
     
-    /** Calculate a Tukey window */
-	void calculateTukeyWindow();
+    /** Calculate phase deviation detection function sample in the complex domain */
+    double complexDomainPhaseDeviation();
 
     //=======================================================================
 	/** Set phase values between [-pi, pi] 
@@ -168,6 +259,14 @@ private:
      * @returns the wrapped phase value
      */
 	double princarg(double phaseVal);
+    
+    /** Calculate the absolute angle of a complex number, using a polynomial approximation
+     * that is accurate to around 1e-5 radians
+     * @param real the real part of the complex number
+     * @param imag the imaginary part of the complex number
+     * @returns the absolute value of the angle, in the range [0, pi]
+     */
+    double absoluteAngle (double real, double imag);
 	
     void initialiseFFT();
     void freeFFT();
@@ -176,29 +275,49 @@ private:
 	
 	int frameSize;						/**< audio framesize */
 	int hopSize;						/**< audio hopsize */
+	int numBins;						/**< number of unique spectral bins for a real frame, (frameSize/2)+1 */
 	int onsetDetectionFunctionType;		/**< type of detection function */
     int windowType;                     /**< type of window used in calculations */
+    int phaseCalculationMethod;         /**< method used to calculate phase based detection functions */
+    int spectralKernelType;             /**< instruction set used to reduce spectra to detection function samples */
+    const SpectralKernels* kernels;     /**< the spectral kernels for the instruction set in use */
 
     //=======================================================================
+    const FFTPlan* plan;                /**< the shared FFT plan */
+    
 #ifdef USE_FFTW
-	fftw_plan p;						/**< fftw plan */
-	fftw_complex* complexIn;			/**< to hold complex fft values for input */
+	double* realIn;						/**< to hold real fft values for input */
 	fftw_complex* complexOut;			/**< to hold complex fft values for output */
 #endif
     
 #ifdef USE_KISS_FFT
-    kiss_fft_cfg cfg;                   /**< Kiss FFT configuration */
-    kiss_fft_cpx* fftIn;                /**< FFT input samples, in complex form */
+    kiss_fft_scalar* fftIn;             /**< FFT input samples, in real form */
     kiss_fft_cpx* fftOut;               /**< FFT output samples, in complex form */
-    std::vector<std::vector<double> > complexOut;
+    kiss_fft_cpx* fftWorkingMemory;     /**< working memory for the FFT, so that it never allocates */
+    double (*complexOut)[2];            /**< to hold complex fft values for output, interleaved as for fftw */
+#endif
+    
+    const double* spectrum;             /**< the spectrum being reduced to detection function samples, interleaved as for fftw */
+	
+#ifdef BTRACK_STAGE_TIMING
+    StageTimingCounter fftTiming;       /**< the time spent in the FFT */
+    StageTimingCounter reductionTiming; /**< the time spent reducing spectra to detection function samples */
 #endif
 	
     //=======================================================================
-	bool initialised;					/**< flag indicating whether buffers and FFT plans are initialised */
+	bool initialised;					/**< flag indicating whether buffers, FFT plans and the window are initialised */
 
-    std::vector<double> frame;          /**< audio frame */
-    std::vector<double> window;         /**< window */
+    std::vector<double> frame;          /**< audio frame, as a ring buffer of frameSize samples followed by a mirror image of it */
+    int framePosition;                  /**< the position of the oldest sample in the frame ring buffer */
+    const double* window;               /**< the shared window table */
+    
+    std::vector<double> weights;                /**< the bin weights followed by the high frequency weights, unless they are shared */
+    const double* sharedWeights;                /**< the weights of the OnsetDetectionFunctionBank this is a stream of, or NULL */
+    const double* binWeights;                   /**< weights that account for the mirrored upper half of the spectrum */
+    const double* highFrequencyWeights;         /**< bin weights for the high frequency content functions, including the mirrored upper half */
 	
+	double energySum;					/**< to hold the energy sum value, updated as samples enter and leave the frame */
+	int samplesSinceEnergySum;			/**< number of samples since the energy sum was last calculated from scratch */
 	double prevEnergySum;				/**< to hold the previous energy sum value */
 	
     std::vector<double> magSpec;        /**< magnitude spectrum */
@@ -207,6 +326,13 @@ private:
     std::vector<double> phase;          /**< FFT phase values */
     std::vector<double> prevPhase;      /**< previous phase values */
     std::vector<double> prevPhase2;     /**< second order previous phase values */
+    
+    std::vector<double> phasorReal;         /**< unit phasors (real part) */
+    std::vector<double> phasorImag;         /**< unit phasors (imaginary part) */
+    std::vector<double> prevPhasorReal;     /**< previous unit phasors (real part) */
+    std::vector<double> prevPhasorImag;     /**< previous unit phasors (imaginary part) */
+    std::vector<double> prevPhasor2Real;    /**< second order previous unit phasors (real part) */
+    std::vector<double> prevPhasor2Imag;    /**< second order previous unit phasors (imaginary part) */
 
 };
 
@@ -0,0 +1,194 @@
+//=======================================================================
+/** @file OnsetDetectionFunctionBank.cpp
+ *  @brief Onset detection functions for many streams, sharing one batch of FFTs
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+
+#include <algorithm>
+#include "OnsetDetectionFunctionBank.h"
+
+//=======================================================================
+OnsetDetectionFunctionBank::OnsetDetectionFunctionBank (int numStreams_, int hopSize_, int frameSize_)
+ :  numStreams (std::max (numStreams_, 1)),
+    onsetDetectionFunctionType (ComplexSpectralDifferenceHWR)
+{
+    initialise (hopSize_, frameSize_, HanningWindow);
+}
+
+//=======================================================================
+OnsetDetectionFunctionBank::OnsetDetectionFunctionBank (int numStreams_, int hopSize_, int frameSize_, int onsetDetectionFunctionType_, int windowType_)
+ :  numStreams (std::max (numStreams_, 1)),
+    onsetDetectionFunctionType (onsetDetectionFunctionType_)
+{
+    initialise (hopSize_, frameSize_, windowType_);
+}
+
+//=======================================================================
+OnsetDetectionFunctionBank::~OnsetDetectionFunctionBank()
+{
+    for (int s = 0; s < numStreams; s++)
+    {
+        delete onsetDetectionFunctions[s];
+    }
+
+    FFTCache::releasePlan (plan);
+
+#ifdef USE_FFTW
+    fftw_free (realIn);
+    fftw_free (complexOut);
+#endif
+
+#ifdef USE_KISS_FFT
+    delete [] fftIn;
+    delete [] fftOut;
+    delete [] fftWorkingMemory;
+#endif
+}
+
+//=======================================================================
+void OnsetDetectionFunctionBank::initialise (int hopSize, int frameSize_, int windowType)
+{
+    frameSize = frameSize_;
+    numBins = (frameSize / 2) + 1;
+
+    bool needsEnergy, needsPhase;
+    OnsetDetectionFunction::findSharedCalculations (&onsetDetectionFunctionType, 1, needsEnergy, needsSpectrum, needsPhase);
+
+    weights.resize (2 * numBins);
+    OnsetDetectionFunction::calculateBinWeights (frameSize, &weights[0]);
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        onsetDetectionFunctions.push_back (new OnsetDetectionFunction (hopSize, frameSize, onsetDetectionFunctionType, windowType, &weights[0]));
+    }
+
+    plan = FFTCache::acquireRealBatchPlan (frameSize, numStreams);
+
+#ifdef USE_FFTW
+    realIn = (double*) fftw_malloc (sizeof(double) * frameSize * numStreams);
+    complexOut = (fftw_complex*) fftw_malloc (sizeof(fftw_complex) * numBins * numStreams);
+#endif
+
+#ifdef USE_KISS_FFT
+    fftIn = new kiss_fft_scalar[frameSize * numStreams];
+    fftOut = new kiss_fft_cpx[numBins * numStreams];
+    fftWorkingMemory = new kiss_fft_cpx[FFTCache::getWorkingMemorySize (plan)];
+    complexOut.assign (2 * numBins * numStreams, 0);
+
+    kernels = &SpectralKernels::get (SpectralKernels::getFastestSupportedType());
+    numLanes = 0;
+
+    // a single stream is faster through the plain FFT than in a batch padded out to a whole vector of lanes
+    if (needsSpectrum && (numStreams > 1) && (kernels->numFloatLanes > 1) && FFTCache::canInterleave (plan))
+    {
+        numLanes = ((numStreams + kernels->numFloatLanes - 1) / kernels->numFloatLanes) * kernels->numFloatLanes;
+        interleavedIn.assign (frameSize * numLanes, 0);
+        interleavedOut.assign (numBins * 2 * numLanes, 0);
+    }
+#endif
+}
+
+//=======================================================================
+void OnsetDetectionFunctionBank::calculateOnsetDetectionFunctionSamples (double* const* buffers, double* odfSamples)
+{
+    for (int s = 0; s < numStreams; s++)
+    {
+        onsetDetectionFunctions[s]->addHopToFrame (buffers[s]);
+    }
+
+    if (needsSpectrum)
+    {
+#ifdef USE_FFTW
+        for (int s = 0; s < numStreams; s++)
+        {
+            onsetDetectionFunctions[s]->windowFrame (realIn + (s * frameSize));
+        }
+
+        // transform every stream's frame at once
+        fftw_execute_dft_r2c (plan->plan, realIn, complexOut);
+#endif
+
+#ifdef USE_KISS_FFT
+        for (int s = 0; s < numStreams; s++)
+        {
+            onsetDetectionFunctions[s]->windowFrame (fftIn + (s * frameSize));
+        }
+
+        if (numLanes > 0)
+        {
+            // lay the frames side by side, one stream per lane, leaving the padding lanes at zero
+            for (int i = 0; i < frameSize; i++)
+            {
+                float* row = &interleavedIn[i * numLanes];
+
+                for (int s = 0; s < numStreams; s++)
+                {
+                    row[s] = fftIn[s * frameSize + i];
+                }
+            }
+
+            // transform every stream's frame at once
+            FFTCache::performInterleavedRealFFT (plan, *kernels, &interleavedIn[0], &interleavedOut[0], numLanes, numLanes);
+
+            // store real and imaginary parts of FFT
+            for (int k = 0; k < numBins; k++)
+            {
+                const float* row = &interleavedOut[k * 2 * numLanes];
+
+                for (int s = 0; s < numStreams; s++)
+                {
+                    complexOut[2 * (s * numBins + k)] = row[s];
+                    complexOut[2 * (s * numBins + k) + 1] = row[numLanes + s];
+                }
+            }
+        }
+        else
+        {
+            // transform every stream's frame at once
+            FFTCache::performRealFFT (plan, fftIn, fftOut, fftWorkingMemory);
+
+            // store real and imaginary parts of FFT
+            for (int i = 0; i < numBins * numStreams; i++)
+            {
+                complexOut[2 * i] = fftOut[i].r;
+                complexOut[2 * i + 1] = fftOut[i].i;
+            }
+        }
+#endif
+    }
+
+#ifdef USE_FFTW
+    const double* spectra = &complexOut[0][0];
+#endif
+
+#ifdef USE_KISS_FFT
+    const double* spectra = &complexOut[0];
+#endif
+
+    for (int s = 0; s < numStreams; s++)
+    {
+        onsetDetectionFunctions[s]->reduceSpectrum (spectra + (2 * s * numBins), &onsetDetectionFunctionType, 1, &odfSamples[s]);
+    }
+}
+
+//=======================================================================
+int OnsetDetectionFunctionBank::getNumStreams()
+{
+    return numStreams;
+}
@@ -0,0 +1,112 @@
+//=======================================================================
+/** @file OnsetDetectionFunctionBank.h
+ *  @brief Onset detection functions for many streams, sharing one batch of FFTs
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+
+#ifndef __ONSETDETECTIONFUNCTIONBANK_H
+#define __ONSETDETECTIONFUNCTIONBANK_H
+
+#include <vector>
+#include "OnsetDetectionFunction.h"
+
+//=======================================================================
+/** Calculates the same onset detection function for many independent streams, one hop of every stream per call.
+ * Each stream gives the same detection function samples as its own OnsetDetectionFunction would: exactly
+ * with Kiss FFT, and to within rounding error with fftw, which may order the arithmetic of a batch differently.
+ *
+ * The frames of every stream are windowed into one buffer, one after another, and transformed together with
+ * a single batched FFT, so that the FFT's twiddle factors are loaded once per hop rather than once per stream.
+ * With Kiss FFT, when the frame size allows it, the frames are instead laid side by side, one stream per lane,
+ * and transformed with interleaved FFTs that take every stream through each butterfly at once.
+ * Each stream's spectrum is then reduced to its detection function sample with the same code as a single stream.
+ */
+class OnsetDetectionFunctionBank
+{
+public:
+
+    /** Constructor that defaults the onset detection function type to ComplexSpectralDifferenceHWR
+     * and the window type to HanningWindow
+     * @param numStreams_ the number of streams, at least one
+     * @param hopSize_ the hop size in audio samples
+     * @param frameSize_ the frame size in audio samples
+     */
+    OnsetDetectionFunctionBank (int numStreams_, int hopSize_, int frameSize_);
+
+    /** Constructor
+     * @param numStreams_ the number of streams, at least one
+     * @param hopSize_ the hop size in audio samples
+     * @param frameSize_ the frame size in audio samples
+     * @param onsetDetectionFunctionType_ the type of onset detection function to use - (see OnsetDetectionFunctionType)
+     * @param windowType_ the type of window to use (see WindowType)
+     */
+    OnsetDetectionFunctionBank (int numStreams_, int hopSize_, int frameSize_, int onsetDetectionFunctionType_, int windowType_);
+
+    /** Destructor */
+    ~OnsetDetectionFunctionBank();
+
+    /** Process the next hop of audio of every stream and calculate each stream's detection function sample
+     * @param buffers an array of numStreams pointers, each to the next hopSize audio samples of one stream
+     * @param odfSamples an array of numStreams values that the detection function samples are written to
+     */
+    void calculateOnsetDetectionFunctionSamples (double* const* buffers, double* odfSamples);
+
+    /** @returns the number of streams */
+    int getNumStreams();
+
+private:
+
+    /** Create the detection function of each stream and the buffers for the batch of FFTs
+     * @param hopSize the hop size in audio samples
+     * @param frameSize_ the frame size in audio samples
+     * @param windowType the type of window to use (see WindowType)
+     */
+    void initialise (int hopSize, int frameSize_, int windowType);
+
+    int numStreams;                     /**< the number of streams */
+    int frameSize;                      /**< audio framesize */
+    int numBins;                        /**< number of unique spectral bins for a real frame, (frameSize/2)+1 */
+    int onsetDetectionFunctionType;     /**< type of detection function */
+    bool needsSpectrum;                 /**< whether the detection function uses the spectrum */
+
+    std::vector<double> weights;        /**< the bin weights followed by the high frequency weights, shared by every stream */
+    std::vector<OnsetDetectionFunction*> onsetDetectionFunctions;  /**< the frame and previous spectra of each stream, without FFT buffers of their own */
+
+    //=======================================================================
+    const FFTPlan* plan;                /**< the shared plan for a batch of numStreams FFTs */
+
+#ifdef USE_FFTW
+    double* realIn;                     /**< the windowed frame of each stream, one after another */
+    fftw_complex* complexOut;           /**< the spectrum of each stream, one after another */
+#endif
+
+#ifdef USE_KISS_FFT
+    kiss_fft_scalar* fftIn;             /**< the windowed frame of each stream, one after another */
+    kiss_fft_cpx* fftOut;               /**< the spectrum of each stream, one after another */
+    kiss_fft_cpx* fftWorkingMemory;     /**< working memory for the FFTs, so that they never allocate */
+    std::vector<double> complexOut;     /**< the spectrum of each stream, one after another, interleaved as for fftw */
+
+    const SpectralKernels* kernels;     /**< the spectral kernels that perform the interleaved FFTs */
+    int numLanes;                       /**< the number of lanes of the interleaved FFTs, or zero if they are not used */
+    std::vector<float> interleavedIn;   /**< the windowed frames, one stream per lane (see FFTCache::performInterleavedRealFFT()) */
+    std::vector<float> interleavedOut;  /**< the spectra, one stream per lane */
+#endif
+};
+
+#endif
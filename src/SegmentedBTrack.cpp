@@ -0,0 +1,402 @@
+//=======================================================================
+/** @file SegmentedBTrack.cpp
+ *  @brief Offline beat tracking of long signals, a segment per thread
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include "SegmentedBTrack.h"
+
+/** How far apart, in seconds, two beats can be and still line up. This is the usual tolerance for
+ * scoring beat trackers, and is used both to stitch segments and to measure agreement */
+static const double beatToleranceInSeconds = 0.07;
+
+//=======================================================================
+SegmentedBTrack::SegmentedBTrack (int hopSize_, int frameSize_)
+ :  hopSize (hopSize_),
+    frameSize (frameSize_),
+    sampleRate (44100),
+    minTempo (80),
+    maxTempo (160),
+    tempoResolution (2)
+{
+    numThreads = 0;
+    segmentLength = 60;
+    preRollLength = 10;
+}
+
+//=======================================================================
+SegmentedBTrack::SegmentedBTrack (int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_)
+ :  hopSize (hopSize_),
+    frameSize (frameSize_),
+    sampleRate (sampleRate_),
+    minTempo (minTempo_),
+    maxTempo (maxTempo_),
+    tempoResolution (tempoResolution_)
+{
+    numThreads = 0;
+    segmentLength = 60;
+    preRollLength = 10;
+}
+
+//=======================================================================
+void SegmentedBTrack::setNumThreads (int numThreads_)
+{
+    numThreads = std::max (numThreads_, 0);
+}
+
+//=======================================================================
+void SegmentedBTrack::setSegmentLength (double seconds)
+{
+    segmentLength = seconds;
+}
+
+//=======================================================================
+void SegmentedBTrack::setPreRollLength (double seconds)
+{
+    preRollLength = seconds;
+}
+
+//=======================================================================
+long SegmentedBTrack::getSegmentLengthInHops()
+{
+    return std::max (secondsToHops (segmentLength), 1L);
+}
+
+//=======================================================================
+long SegmentedBTrack::getPreRollLengthInHops()
+{
+    return std::max (secondsToHops (preRollLength), 0L);
+}
+
+//=======================================================================
+void SegmentedBTrack::trackBeats (const double* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    trackSegments (signal, NULL, NULL, std::max (numSamples / hopSize, 0L), beatFrames, tempi, NULL);
+}
+
+//=======================================================================
+void SegmentedBTrack::trackBeats (const float* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    trackSegments (NULL, signal, NULL, std::max (numSamples / hopSize, 0L), beatFrames, tempi, NULL);
+}
+
+//=======================================================================
+void SegmentedBTrack::trackBeatsInOnsetDetectionFunction (const double* onsetDetectionFunction, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    trackSegments (NULL, NULL, onsetDetectionFunction, std::max (numSamples, 0L), beatFrames, tempi, NULL);
+}
+
+//=======================================================================
+BeatAgreement SegmentedBTrack::trackBeatsAndMeasureAgreement (const double* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    BeatAgreement agreement;
+    trackSegments (signal, NULL, NULL, std::max (numSamples / hopSize, 0L), beatFrames, tempi, &agreement);
+    return agreement;
+}
+
+//=======================================================================
+BeatAgreement SegmentedBTrack::trackBeatsInOnsetDetectionFunctionAndMeasureAgreement (const double* onsetDetectionFunction, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    BeatAgreement agreement;
+    trackSegments (NULL, NULL, onsetDetectionFunction, std::max (numSamples, 0L), beatFrames, tempi, &agreement);
+    return agreement;
+}
+
+//=======================================================================
+BeatAgreement SegmentedBTrack::measureAgreement (const std::vector<long>& beatFrames, const std::vector<double>& tempi,
+                                                 const std::vector<long>& referenceBeatFrames, const std::vector<double>& referenceTempi,
+                                                 long toleranceInHops)
+{
+    BeatAgreement agreement;
+    agreement.numBeats = (long) beatFrames.size();
+    agreement.numReferenceBeats = (long) referenceBeatFrames.size();
+    agreement.numMatchedBeats = 0;
+
+    // both sequences are in order, so each beat is matched to the earliest reference beat in reach
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < beatFrames.size() && j < referenceBeatFrames.size())
+    {
+        if (std::abs (beatFrames[i] - referenceBeatFrames[j]) <= toleranceInHops)
+        {
+            agreement.numMatchedBeats++;
+            i++;
+            j++;
+        }
+        else if (beatFrames[i] < referenceBeatFrames[j])
+        {
+            i++;
+        }
+        else
+        {
+            j++;
+        }
+    }
+
+    if (agreement.numBeats == 0 && agreement.numReferenceBeats == 0)
+    {
+        agreement.precision = 1;
+        agreement.recall = 1;
+    }
+    else
+    {
+        agreement.precision = agreement.numBeats > 0 ? ((double) agreement.numMatchedBeats) / agreement.numBeats : 0;
+        agreement.recall = agreement.numReferenceBeats > 0 ? ((double) agreement.numMatchedBeats) / agreement.numReferenceBeats : 0;
+    }
+
+    if (agreement.precision + agreement.recall > 0)
+    {
+        agreement.fMeasure = 2 * agreement.precision * agreement.recall / (agreement.precision + agreement.recall);
+    }
+    else
+    {
+        agreement.fMeasure = 0;
+    }
+
+    size_t numTempi = std::min (tempi.size(), referenceTempi.size());
+    double sumTempoDifference = 0;
+
+    for (size_t n = 0; n < numTempi; n++)
+    {
+        sumTempoDifference += std::abs (tempi[n] - referenceTempi[n]);
+    }
+
+    agreement.meanTempoDifference = numTempi > 0 ? sumTempoDifference / numTempi : 0;
+
+    return agreement;
+}
+
+//=======================================================================
+void SegmentedBTrack::trackSegments (const double* signal, const float* floatSignal, const double* onsetDetectionFunction, long numHops,
+                                     std::vector<long>& beatFrames, std::vector<double>& tempi, BeatAgreement* agreement)
+{
+    long segmentHops = getSegmentLengthInHops();
+    long preRollHops = getPreRollLengthInHops();
+
+    // the last segment takes any part segment left over at the end
+    long numSegments = std::max (numHops / segmentHops, 1L);
+
+    std::vector<SegmentResult> segments (numSegments);
+
+    for (long k = 0; k < numSegments; k++)
+    {
+        segments[k].startHop = k * segmentHops;
+        segments[k].endHop = (k == numSegments - 1) ? numHops : (k + 1) * segmentHops;
+    }
+
+    // the sequential pass, if there is one, takes longest, so it is the first job to be picked up
+    SegmentResult sequential;
+    int numSequentialJobs = agreement != NULL ? 1 : 0;
+    int numJobs = numSequentialJobs + (int) numSegments;
+    std::atomic<int> nextJob (0);
+
+    auto runJobs = [&]()
+    {
+        int job;
+
+        while ((job = nextJob.fetch_add (1)) < numJobs)
+        {
+            if (job < numSequentialJobs)
+            {
+                trackRange (signal, floatSignal, onsetDetectionFunction, 0, numHops, sequential);
+            }
+            else
+            {
+                SegmentResult& segment = segments[job - numSequentialJobs];
+                long firstHop = std::max (segment.startHop - preRollHops, 0L);
+                long lastHop = std::min (segment.endHop + preRollHops, numHops);
+
+                trackRange (signal, floatSignal, onsetDetectionFunction, firstHop, lastHop - firstHop, segment);
+            }
+        }
+    };
+
+    int numThreadsToUse = numThreads;
+
+    if (numThreadsToUse <= 0)
+    {
+        numThreadsToUse = std::max ((int) std::thread::hardware_concurrency(), 1);
+    }
+
+    numThreadsToUse = std::min (numThreadsToUse, numJobs);
+
+    // the calling thread is one of the threads
+    std::vector<std::thread> threads;
+
+    for (int t = 1; t < numThreadsToUse; t++)
+    {
+        threads.push_back (std::thread (runJobs));
+    }
+
+    runJobs();
+
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+
+    stitchSegments (segments, numHops, beatFrames, tempi);
+
+    if (agreement != NULL)
+    {
+        *agreement = measureAgreement (beatFrames, tempi, sequential.beatFrames, sequential.tempi, getToleranceInHops());
+    }
+}
+
+//=======================================================================
+void SegmentedBTrack::trackRange (const double* signal, const float* floatSignal, const double* onsetDetectionFunction, long firstHop, long numHops, SegmentResult& result)
+{
+    BTrack tracker (hopSize, frameSize, sampleRate, minTempo, maxTempo, tempoResolution);
+
+    result.firstHop = firstHop;
+
+    if (signal != NULL)
+    {
+        tracker.trackBeats (signal + firstHop * hopSize, numHops * hopSize, result.beatFrames, result.tempi);
+    }
+    else if (floatSignal != NULL)
+    {
+        tracker.trackBeats (floatSignal + firstHop * hopSize, numHops * hopSize, result.beatFrames, result.tempi);
+    }
+    else
+    {
+        tracker.trackBeatsInOnsetDetectionFunction (onsetDetectionFunction + firstHop, numHops, result.beatFrames, result.tempi);
+    }
+
+    for (size_t n = 0; n < result.beatFrames.size(); n++)
+    {
+        result.beatFrames[n] += firstHop;
+    }
+}
+
+//=======================================================================
+void SegmentedBTrack::stitchSegments (const std::vector<SegmentResult>& segments, long numHops, std::vector<long>& beatFrames, std::vector<double>& tempi)
+{
+    beatFrames.clear();
+    tempi.resize (numHops);
+
+    // the first hop taken from the current segment
+    long stitchHop = 0;
+
+    for (size_t k = 0; k < segments.size(); k++)
+    {
+        const SegmentResult& segment = segments[k];
+        long nextStitchHop = (k + 1 < segments.size()) ? findStitchHop (segment, segments[k + 1]) : numHops;
+
+        for (long h = stitchHop; h < nextStitchHop; h++)
+        {
+            tempi[h] = segment.tempi[h - segment.firstHop];
+        }
+
+        // the first beat after a stitch is left out if it comes too soon after the last one
+        bool checkingSpacing = k > 0 && !beatFrames.empty();
+
+        for (size_t n = 0; n < segment.beatFrames.size(); n++)
+        {
+            long beat = segment.beatFrames[n];
+
+            if (beat < stitchHop || beat >= nextStitchHop)
+            {
+                continue;
+            }
+
+            if (checkingSpacing)
+            {
+                if (beat - beatFrames.back() < getHalfBeatPeriod (segment.tempi[beat - segment.firstHop]))
+                {
+                    continue;
+                }
+
+                checkingSpacing = false;
+            }
+
+            beatFrames.push_back (beat);
+        }
+
+        stitchHop = nextStitchHop;
+    }
+}
+
+//=======================================================================
+long SegmentedBTrack::findStitchHop (const SegmentResult& segment, const SegmentResult& nextSegment)
+{
+    // both beat trackers have warmed up from the start of the next segment until the end of the
+    // pre-roll after this one, as long as that is still within the next segment
+    long regionStart = nextSegment.startHop;
+    long regionEnd = segment.firstHop + (long) segment.tempi.size();
+    regionEnd = std::min (regionEnd, nextSegment.endHop);
+    regionEnd = std::max (regionEnd, regionStart);
+
+    long tolerance = getToleranceInHops();
+
+    // stitch just after the first beat of this segment that the next segment has a beat in line with
+    size_t j = 0;
+
+    for (size_t i = 0; i < segment.beatFrames.size(); i++)
+    {
+        long beat = segment.beatFrames[i];
+
+        if (beat < regionStart)
+        {
+            continue;
+        }
+
+        if (beat >= regionEnd)
+        {
+            break;
+        }
+
+        while (j < nextSegment.beatFrames.size() && nextSegment.beatFrames[j] < beat - tolerance)
+        {
+            j++;
+        }
+
+        if (j < nextSegment.beatFrames.size() && nextSegment.beatFrames[j] <= beat + tolerance)
+        {
+            return beat + 1;
+        }
+    }
+
+    // the beats never line up, so stitch at the end of the region
+    return regionEnd;
+}
+
+//=======================================================================
+long SegmentedBTrack::secondsToHops (double seconds)
+{
+    return (long) round (seconds * sampleRate / hopSize);
+}
+
+//=======================================================================
+long SegmentedBTrack::getToleranceInHops()
+{
+    return std::max (secondsToHops (beatToleranceInSeconds), 1L);
+}
+
+//=======================================================================
+double SegmentedBTrack::getHalfBeatPeriod (double tempo)
+{
+    return 0.5 * (60. * sampleRate) / (hopSize * tempo);
+}
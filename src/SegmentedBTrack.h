@@ -0,0 +1,212 @@
+//=======================================================================
+/** @file SegmentedBTrack.h
+ *  @brief Offline beat tracking of long signals, a segment per thread
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#ifndef __SEGMENTEDBTRACK_H
+#define __SEGMENTEDBTRACK_H
+
+#include "BTrack.h"
+#include <vector>
+
+//=======================================================================
+/** How closely one sequence of beats agrees with another, taken as the reference */
+struct BeatAgreement
+{
+    long numBeats;                  /**< the number of beats */
+    long numReferenceBeats;         /**< the number of reference beats */
+    long numMatchedBeats;           /**< the number of beats within the tolerance of a reference beat, each matched at most once */
+    double precision;               /**< the fraction of the beats that are matched */
+    double recall;                  /**< the fraction of the reference beats that are matched */
+    double fMeasure;                /**< the harmonic mean of the precision and recall */
+    double meanTempoDifference;     /**< the mean absolute difference between the tempo tracks, in beats per minute */
+};
+
+//=======================================================================
+/** Tracks the beats of a whole signal offline, split into segments that are tracked at the same time
+ * on a pool of threads, each with its own BTrack.
+ *
+ * Each segment's beat tracker starts a pre-roll before the segment, to warm up, and carries on for a
+ * pre-roll after it, so that at each boundary there is a stretch in which both neighbouring trackers
+ * are warmed up. The two beat sequences are stitched together at the first pair of beats in that
+ * stretch that line up. If none do, they are stitched at the end of the stretch, leaving out any beat
+ * less than half a beat period after the last one. The longer the pre-roll, the more closely the
+ * result agrees with tracking the whole signal in one go, which trackBeatsAndMeasureAgreement() reports.
+ */
+class SegmentedBTrack
+{
+public:
+
+    //=======================================================================
+    /** Constructor taking the hop size and frame size of every segment's beat tracker
+     * @param hopSize_ the hop size in audio samples
+     * @param frameSize_ the frame size in audio samples
+     */
+    SegmentedBTrack (int hopSize_, int frameSize_);
+
+    /** Constructor taking the settings of every segment's beat tracker, which have the same meaning as for BTrack
+     * @param hopSize_ the hop size in audio samples
+     * @param frameSize_ the frame size in audio samples
+     * @param sampleRate_ the sampling frequency in Hz
+     * @param minTempo_ the slowest tempo, in beats per minute
+     * @param maxTempo_ the fastest tempo, in beats per minute
+     * @param tempoResolution_ the difference between neighbouring tempo states, in beats per minute
+     */
+    SegmentedBTrack (int hopSize_, int frameSize_, int sampleRate_, double minTempo_, double maxTempo_, double tempoResolution_);
+
+    //=======================================================================
+    /** Set the number of threads that track segments
+     * @param numThreads_ the number of threads, or zero for one per processor core (the default)
+     */
+    void setNumThreads (int numThreads_);
+
+    /** Set the length of each segment. The last segment also takes any part segment left over at the end
+     * @param seconds the segment length in seconds (60 by default)
+     */
+    void setSegmentLength (double seconds);
+
+    /** Set how long each segment's beat tracker runs for before, and after, the segment
+     * @param seconds the pre-roll length in seconds (10 by default)
+     */
+    void setPreRollLength (double seconds);
+
+    /** @returns the number of hops in each segment */
+    long getSegmentLengthInHops();
+
+    /** @returns the number of hops of pre-roll */
+    long getPreRollLengthInHops();
+
+    //=======================================================================
+    /** Track the beats of a whole audio signal. Any samples after the last whole hop are ignored
+     * @param signal the audio samples
+     * @param numSamples the number of audio samples
+     * @param beatFrames set to the index of each hop with a beat
+     * @param tempi set to the tempo estimate after each hop
+     */
+    void trackBeats (const double* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+
+    /** Track the beats of a whole single precision audio signal (see above) */
+    void trackBeats (const float* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+
+    /** Track the beats of a whole onset detection function
+     * @param onsetDetectionFunction the onset detection function samples, one per hop
+     * @param numSamples the number of onset detection function samples
+     * @param beatFrames set to the index of each hop with a beat
+     * @param tempi set to the tempo estimate after each hop
+     */
+    void trackBeatsInOnsetDetectionFunction (const double* onsetDetectionFunction, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+
+    /** Track the beats of a whole audio signal, and also track it in one go, on one more thread, to
+     * measure how closely the segmented result agrees with it
+     * @param signal the audio samples
+     * @param numSamples the number of audio samples
+     * @param beatFrames set to the index of each hop with a beat
+     * @param tempi set to the tempo estimate after each hop
+     * @returns the agreement of the segmented result with the sequential one
+     */
+    BeatAgreement trackBeatsAndMeasureAgreement (const double* signal, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+
+    /** Track the beats of a whole onset detection function, and measure agreement with tracking it in one go (see above) */
+    BeatAgreement trackBeatsInOnsetDetectionFunctionAndMeasureAgreement (const double* onsetDetectionFunction, long numSamples, std::vector<long>& beatFrames, std::vector<double>& tempi);
+
+    //=======================================================================
+    /** Measure how closely one sequence of beats agrees with a reference sequence
+     * @param beatFrames the hop index of each beat, in order
+     * @param tempi the tempo estimate after each hop
+     * @param referenceBeatFrames the hop index of each reference beat, in order
+     * @param referenceTempi the reference tempo estimate after each hop
+     * @param toleranceInHops how far apart, in hops, a beat and a reference beat can be to match
+     * @returns the agreement of the beats with the reference beats
+     */
+    static BeatAgreement measureAgreement (const std::vector<long>& beatFrames, const std::vector<double>& tempi,
+                                           const std::vector<long>& referenceBeatFrames, const std::vector<double>& referenceTempi,
+                                           long toleranceInHops);
+
+private:
+
+    /** The beats and tempi found by one job */
+    struct SegmentResult
+    {
+        long startHop;                  /**< the first hop of the segment */
+        long endHop;                    /**< the hop after the end of the segment */
+        long firstHop;                  /**< the first hop tracked, including the pre-roll */
+        std::vector<long> beatFrames;   /**< the hop index of each beat, from the start of the signal */
+        std::vector<double> tempi;      /**< the tempo estimate after each hop tracked */
+    };
+
+    /** Track the beats of a whole signal in segments, given as exactly one of the three arrays
+     * @param signal the audio samples, or NULL
+     * @param floatSignal the single precision audio samples, or NULL
+     * @param onsetDetectionFunction the onset detection function samples, or NULL
+     * @param numHops the number of hops in the signal
+     * @param beatFrames set to the index of each hop with a beat
+     * @param tempi set to the tempo estimate after each hop
+     * @param agreement if not NULL, the signal is also tracked in one go, and this is set to the agreement with it
+     */
+    void trackSegments (const double* signal, const float* floatSignal, const double* onsetDetectionFunction, long numHops,
+                        std::vector<long>& beatFrames, std::vector<double>& tempi, BeatAgreement* agreement);
+
+    /** Track a range of hops of a signal with a new beat tracker
+     * @param signal the audio samples, or NULL
+     * @param floatSignal the single precision audio samples, or NULL
+     * @param onsetDetectionFunction the onset detection function samples, or NULL
+     * @param firstHop the first hop to track
+     * @param numHops the number of hops to track
+     * @param result set to the beats and tempi found
+     */
+    void trackRange (const double* signal, const float* floatSignal, const double* onsetDetectionFunction, long firstHop, long numHops, SegmentResult& result);
+
+    /** Find where to stitch one segment's beats to the next segment's
+     * @param segment the results of the segment
+     * @param nextSegment the results of the next segment
+     * @returns the first hop to take from the next segment
+     */
+    long findStitchHop (const SegmentResult& segment, const SegmentResult& nextSegment);
+
+    /** Stitch the beats and tempi of each segment together
+     * @param segments the results of each segment, in order
+     * @param numHops the number of hops in the signal
+     * @param beatFrames set to the stitched beats
+     * @param tempi set to the stitched tempi
+     */
+    void stitchSegments (const std::vector<SegmentResult>& segments, long numHops, std::vector<long>& beatFrames, std::vector<double>& tempi);
+
+    /** @returns the number of hops in the given time */
+    long secondsToHops (double seconds);
+
+    /** @returns how far apart, in hops, two beats can be and still line up */
+    long getToleranceInHops();
+
+    /** @returns half of the beat period, in hops, at the given tempo */
+    double getHalfBeatPeriod (double tempo);
+
+    //=======================================================================
+    int hopSize;                        /**< the hop size in audio samples */
+    int frameSize;                      /**< the frame size in audio samples */
+    int sampleRate;                     /**< the sampling frequency in Hz */
+    double minTempo;                    /**< the slowest tempo, in beats per minute */
+    double maxTempo;                    /**< the fastest tempo, in beats per minute */
+    double tempoResolution;             /**< the difference between neighbouring tempo states, in beats per minute */
+
+    int numThreads;                     /**< the number of threads, or zero for one per processor core */
+    double segmentLength;               /**< the length of each segment, in seconds */
+    double preRollLength;               /**< the length of the pre-roll, in seconds */
+};
+
+#endif
@@ -0,0 +1,1673 @@
+//=======================================================================
+/** @file SpectralKernels.cpp
+ *  @brief Vectorised functions for reducing spectra to onset detection function samples
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#include <math.h>
+#include <algorithm>
+#include "SpectralKernels.h"
+
+// the vectorised kernels are compiled with per-function target attributes, so that
+// they can be built into the same binary as the scalar kernels and picked at runtime
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SPECTRAL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////// Scalar Kernels //////////////////////////////////////////
+
+//=======================================================================
+static void scalarMagnitudeSpectrum (const double* complexSpectrum, double* magnitudeSpectrum, int numBins)
+{
+    for (int i = 0; i < numBins; i++)
+    {
+        double real = complexSpectrum[2 * i];
+        double imag = complexSpectrum[2 * i + 1];
+
+        magnitudeSpectrum[i] = sqrt (real * real + imag * imag);
+    }
+}
+
+//=======================================================================
+static double scalarSpectralDifference (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    double sum = 0;
+
+    for (int i = 0; i < numBins; i++)
+    {
+        sum = sum + (fabs (magnitudeSpectrum[i] - prevMagnitudeSpectrum[i]) * weights[i]);
+    }
+
+    return sum;
+}
+
+//=======================================================================
+static double scalarSpectralDifferenceHWR (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    double sum = 0;
+    double diff;
+
+    for (int i = 0; i < numBins; i++)
+    {
+        diff = magnitudeSpectrum[i] - prevMagnitudeSpectrum[i];
+
+        // only add up positive differences
+        sum = sum + ((diff > 0 ? diff : 0) * weights[i]);
+    }
+
+    return sum;
+}
+
+//=======================================================================
+static double scalarWeightedSum (const double* values, const double* weights, int numBins)
+{
+    double sum = 0;
+
+    for (int i = 0; i < numBins; i++)
+    {
+        sum = sum + (values[i] * weights[i]);
+    }
+
+    return sum;
+}
+
+//=======================================================================
+static double scalarWeightedMaximum (const double* values, const double* weights, int numValues)
+{
+    double maximum = 0;
+
+    for (int i = 0; i < numValues; i++)
+    {
+        double weightedValue = values[i] * weights[i];
+
+        if (weightedValue > maximum)
+        {
+            maximum = weightedValue;
+        }
+    }
+
+    return maximum;
+}
+
+//=======================================================================
+// calculates rows startRow onwards, so that the vectorised versions can use it for their remaining rows
+static void scalarSparseMatrixVectorRows (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                          const double* input, double* output, int startRow)
+{
+    for (int row = startRow; row < numRows; row++)
+    {
+        double sum = 0;
+
+        for (int j = 0; j < numEntriesPerRow; j++)
+        {
+            sum = sum + (coefficients[j * numRows + row] * input[indices[j * numRows + row]]);
+        }
+
+        output[row] = sum;
+    }
+}
+
+//=======================================================================
+static void scalarSparseMatrixVector (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                      const double* input, double* output)
+{
+    scalarSparseMatrixVectorRows (indices, coefficients, numRows, numEntriesPerRow, input, output, 0);
+}
+
+//=======================================================================
+static void scalarMaxPlusCorrelation (const double* input, const double* kernel, int kernelLength, double* output, int numOutputs)
+{
+    for (int i = 0; i < numOutputs; i++)
+    {
+        double maximum = input[i] + kernel[0];
+
+        for (int k = 1; k < kernelLength; k++)
+        {
+            double value = input[i + k] + kernel[k];
+
+            if (value > maximum)
+            {
+                maximum = value;
+            }
+        }
+
+        output[i] = maximum;
+    }
+}
+
+//=======================================================================
+static void scalarAccumulateWeightedMaximum (const double* values, const double* weights, double* maxima, int numValues)
+{
+    for (int i = 0; i < numValues; i++)
+    {
+        double weightedValue = values[i] * weights[i];
+
+        if (weightedValue > maxima[i])
+        {
+            maxima[i] = weightedValue;
+        }
+    }
+}
+
+//=======================================================================
+static void scalarAccumulateMaxPlus (const double* values, double offset, double* maxima, int numValues)
+{
+    for (int i = 0; i < numValues; i++)
+    {
+        double value = values[i] + offset;
+
+        if (value > maxima[i])
+        {
+            maxima[i] = value;
+        }
+    }
+}
+
+//=======================================================================
+static void scalarUnitPhasors (const double* complexSpectrum, const double* magnitudeSpectrum, double* phasorReal, double* phasorImag, int numBins)
+{
+    for (int i = 0; i < numBins; i++)
+    {
+        // a zero bin has phase 0, as atan2 gives
+        if (magnitudeSpectrum[i] > 0)
+        {
+            phasorReal[i] = complexSpectrum[2 * i] / magnitudeSpectrum[i];
+            phasorImag[i] = complexSpectrum[2 * i + 1] / magnitudeSpectrum[i];
+        }
+        else
+        {
+            phasorReal[i] = 1.0;
+            phasorImag[i] = 0.0;
+        }
+    }
+}
+
+//=======================================================================
+static double scalarComplexSpectralDifference (const double* complexSpectrum, const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum,
+                                               const double* prevPhasorReal, const double* prevPhasorImag, const double* prevPhasor2Real, const double* prevPhasor2Imag,
+                                               const double* weights, int numBins, bool halfWaveRectify)
+{
+    double sum = 0;
+
+    for (int i = 0; i < numBins; i++)
+    {
+        // the target phase is 2*prevPhase - prevPhase2, i.e. the previous phasor
+        // squared and rotated back by the conjugate of the second previous phasor
+        double rotationReal = prevPhasorReal[i] * prevPhasorReal[i] - prevPhasorImag[i] * prevPhasorImag[i];
+        double rotationImag = 2 * prevPhasorReal[i] * prevPhasorImag[i];
+
+        double targetReal = prevMagnitudeSpectrum[i] * (rotationReal * prevPhasor2Real[i] + rotationImag * prevPhasor2Imag[i]);
+        double targetImag = prevMagnitudeSpectrum[i] * (rotationImag * prevPhasor2Real[i] - rotationReal * prevPhasor2Imag[i]);
+
+        // if half-wave rectifying, only include bins with a positive change in magnitude
+        if (!halfWaveRectify || (magnitudeSpectrum[i] - prevMagnitudeSpectrum[i] > 0))
+        {
+            // the complex spectral difference is the distance between the bin and its target
+            double diffReal = complexSpectrum[2 * i] - targetReal;
+            double diffImag = complexSpectrum[2 * i + 1] - targetImag;
+
+            sum = sum + (sqrt (diffReal * diffReal + diffImag * diffImag) * weights[i]);
+        }
+    }
+
+    return sum;
+}
+
+//=======================================================================
+// calculates columns startColumn onwards, so that the vectorised versions can use it for their remaining columns
+static void scalarSparseMatrixMatrixColumns (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                             const double* input, int numColumns, double* output, int startColumn)
+{
+    for (int row = 0; row < numRows; row++)
+    {
+        for (int column = startColumn; column < numColumns; column++)
+        {
+            double sum = 0;
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                sum = sum + (coefficients[j * numRows + row] * input[indices[j * numRows + row] * numColumns + column]);
+            }
+
+            output[row * numColumns + column] = sum;
+        }
+    }
+}
+
+//=======================================================================
+static void scalarSparseMatrixMatrix (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                      const double* input, int numColumns, double* output)
+{
+    scalarSparseMatrixMatrixColumns (indices, coefficients, numRows, numEntriesPerRow, input, numColumns, output, 0);
+}
+
+//=======================================================================
+// calculates lanes startLane onwards, so that the vectorised versions can use it for their remaining
+// lanes. The arithmetic is kf_bfly2's, in the same order, so that each lane is rounded as Kiss FFT rounds it
+static void scalarRadix2ButterfliesLanes (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles, int startLane)
+{
+    int rowSize = 2 * laneStride;
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            float* f0 = values + ((block * 2 * m) + k) * rowSize;
+            float* f1 = f0 + m * rowSize;
+            float twr = twiddles[2 * k];
+            float twi = twiddles[2 * k + 1];
+
+            for (int re = startLane; re < numLanes; re++)
+            {
+                int im = re + laneStride;
+
+                float tr = f1[re] * twr - f1[im] * twi;
+                float ti = f1[re] * twi + f1[im] * twr;
+
+                f1[re] = f0[re] - tr;
+                f1[im] = f0[im] - ti;
+                f0[re] = f0[re] + tr;
+                f0[im] = f0[im] + ti;
+            }
+        }
+    }
+}
+
+//=======================================================================
+static void scalarRadix2Butterflies (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles)
+{
+    scalarRadix2ButterfliesLanes (values, laneStride, numLanes, numBlocks, m, twiddles, 0);
+}
+
+//=======================================================================
+// calculates lanes startLane onwards, as kf_bfly4 does
+static void scalarRadix4ButterfliesLanes (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles, bool inverse, int startLane)
+{
+    int rowSize = 2 * laneStride;
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            float* f0 = values + ((block * 4 * m) + k) * rowSize;
+            float* f1 = f0 + m * rowSize;
+            float* f2 = f1 + m * rowSize;
+            float* f3 = f2 + m * rowSize;
+            const float* tw = twiddles + 6 * k;
+
+            for (int re = startLane; re < numLanes; re++)
+            {
+                int im = re + laneStride;
+
+                float s0r = f1[re] * tw[0] - f1[im] * tw[1];
+                float s0i = f1[re] * tw[1] + f1[im] * tw[0];
+                float s1r = f2[re] * tw[2] - f2[im] * tw[3];
+                float s1i = f2[re] * tw[3] + f2[im] * tw[2];
+                float s2r = f3[re] * tw[4] - f3[im] * tw[5];
+                float s2i = f3[re] * tw[5] + f3[im] * tw[4];
+
+                float s5r = f0[re] - s1r;
+                float s5i = f0[im] - s1i;
+                float f0r = f0[re] + s1r;
+                float f0i = f0[im] + s1i;
+                float s3r = s0r + s2r;
+                float s3i = s0i + s2i;
+                float s4r = s0r - s2r;
+                float s4i = s0i - s2i;
+
+                f2[re] = f0r - s3r;
+                f2[im] = f0i - s3i;
+                f0[re] = f0r + s3r;
+                f0[im] = f0i + s3i;
+
+                if (inverse)
+                {
+                    f1[re] = s5r - s4i;
+                    f1[im] = s5i + s4r;
+                    f3[re] = s5r + s4i;
+                    f3[im] = s5i - s4r;
+                }
+                else
+                {
+                    f1[re] = s5r + s4i;
+                    f1[im] = s5i - s4r;
+                    f3[re] = s5r - s4i;
+                    f3[im] = s5i + s4r;
+                }
+            }
+        }
+    }
+}
+
+//=======================================================================
+static void scalarRadix4Butterflies (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles, bool inverse)
+{
+    scalarRadix4ButterfliesLanes (values, laneStride, numLanes, numBlocks, m, twiddles, inverse, 0);
+}
+
+#ifdef SPECTRAL_KERNELS_X86
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// SSE2 Kernels ///////////////////////////////////////////
+
+//=======================================================================
+__attribute__((target("sse2")))
+static double sse2HorizontalSum (__m128d x)
+{
+    return _mm_cvtsd_f64 (_mm_add_sd (x, _mm_unpackhi_pd (x, x)));
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2MagnitudeSpectrum (const double* complexSpectrum, double* magnitudeSpectrum, int numBins)
+{
+    int i = 0;
+
+    for (; i + 2 <= numBins; i += 2)
+    {
+        __m128d a = _mm_loadu_pd (complexSpectrum + 2 * i);
+        __m128d b = _mm_loadu_pd (complexSpectrum + 2 * i + 2);
+        __m128d real = _mm_unpacklo_pd (a, b);
+        __m128d imag = _mm_unpackhi_pd (a, b);
+
+        _mm_storeu_pd (magnitudeSpectrum + i, _mm_sqrt_pd (_mm_add_pd (_mm_mul_pd (real, real), _mm_mul_pd (imag, imag))));
+    }
+
+    scalarMagnitudeSpectrum (complexSpectrum + 2 * i, magnitudeSpectrum + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static double sse2SpectralDifference (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    __m128d sum = _mm_setzero_pd();
+    __m128d signMask = _mm_set1_pd (-0.0);
+    int i = 0;
+
+    for (; i + 2 <= numBins; i += 2)
+    {
+        __m128d magnitude = _mm_loadu_pd (magnitudeSpectrum + i);
+        __m128d diff = _mm_sub_pd (magnitude, _mm_loadu_pd (prevMagnitudeSpectrum + i));
+
+        sum = _mm_add_pd (sum, _mm_mul_pd (_mm_andnot_pd (signMask, diff), _mm_loadu_pd (weights + i)));
+    }
+
+    return sse2HorizontalSum (sum) + scalarSpectralDifference (magnitudeSpectrum + i, prevMagnitudeSpectrum + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static double sse2SpectralDifferenceHWR (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    __m128d sum = _mm_setzero_pd();
+    __m128d zero = _mm_setzero_pd();
+    int i = 0;
+
+    for (; i + 2 <= numBins; i += 2)
+    {
+        __m128d magnitude = _mm_loadu_pd (magnitudeSpectrum + i);
+        __m128d diff = _mm_sub_pd (magnitude, _mm_loadu_pd (prevMagnitudeSpectrum + i));
+
+        sum = _mm_add_pd (sum, _mm_mul_pd (_mm_max_pd (diff, zero), _mm_loadu_pd (weights + i)));
+    }
+
+    return sse2HorizontalSum (sum) + scalarSpectralDifferenceHWR (magnitudeSpectrum + i, prevMagnitudeSpectrum + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static double sse2WeightedSum (const double* values, const double* weights, int numBins)
+{
+    __m128d sum = _mm_setzero_pd();
+    int i = 0;
+
+    for (; i + 2 <= numBins; i += 2)
+    {
+        sum = _mm_add_pd (sum, _mm_mul_pd (_mm_loadu_pd (values + i), _mm_loadu_pd (weights + i)));
+    }
+
+    return sse2HorizontalSum (sum) + scalarWeightedSum (values + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static double sse2WeightedMaximum (const double* values, const double* weights, int numValues)
+{
+    // maxpd returns its second operand if the first is NaN, so NaNs are skipped as in the scalar version
+    __m128d maximum = _mm_setzero_pd();
+    int i = 0;
+
+    for (; i + 2 <= numValues; i += 2)
+    {
+        maximum = _mm_max_pd (_mm_mul_pd (_mm_loadu_pd (values + i), _mm_loadu_pd (weights + i)), maximum);
+    }
+
+    maximum = _mm_max_pd (maximum, _mm_unpackhi_pd (maximum, maximum));
+
+    return std::max (_mm_cvtsd_f64 (maximum), scalarWeightedMaximum (values + i, weights + i, numValues - i));
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2SparseMatrixVector (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                    const double* input, double* output)
+{
+    int row = 0;
+
+    // SSE2 has no gather, so load each pair of inputs separately and do the arithmetic two rows at a time
+    for (; row + 2 <= numRows; row += 2)
+    {
+        __m128d sum = _mm_setzero_pd();
+
+        for (int j = 0; j < numEntriesPerRow; j++)
+        {
+            const int* rowIndices = indices + j * numRows + row;
+            __m128d values = _mm_set_pd (input[rowIndices[1]], input[rowIndices[0]]);
+
+            sum = _mm_add_pd (sum, _mm_mul_pd (_mm_loadu_pd (coefficients + j * numRows + row), values));
+        }
+
+        _mm_storeu_pd (output + row, sum);
+    }
+
+    scalarSparseMatrixVectorRows (indices, coefficients, numRows, numEntriesPerRow, input, output, row);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2MaxPlusCorrelation (const double* input, const double* kernel, int kernelLength, double* output, int numOutputs)
+{
+    int i = 0;
+
+    // calculate neighbouring outputs together, as they use the same kernel value at each offset
+    for (; i + 2 <= numOutputs; i += 2)
+    {
+        __m128d maximum = _mm_add_pd (_mm_loadu_pd (input + i), _mm_set1_pd (kernel[0]));
+
+        for (int k = 1; k < kernelLength; k++)
+        {
+            maximum = _mm_max_pd (maximum, _mm_add_pd (_mm_loadu_pd (input + i + k), _mm_set1_pd (kernel[k])));
+        }
+
+        _mm_storeu_pd (output + i, maximum);
+    }
+
+    scalarMaxPlusCorrelation (input + i, kernel, kernelLength, output + i, numOutputs - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2AccumulateWeightedMaximum (const double* values, const double* weights, double* maxima, int numValues)
+{
+    int i = 0;
+
+    // the running maximum is the second operand, so that it is kept if the product is NaN, as in the scalar version
+    for (; i + 2 <= numValues; i += 2)
+    {
+        _mm_storeu_pd (maxima + i, _mm_max_pd (_mm_mul_pd (_mm_loadu_pd (values + i), _mm_loadu_pd (weights + i)), _mm_loadu_pd (maxima + i)));
+    }
+
+    scalarAccumulateWeightedMaximum (values + i, weights + i, maxima + i, numValues - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2AccumulateMaxPlus (const double* values, double offset, double* maxima, int numValues)
+{
+    __m128d offsets = _mm_set1_pd (offset);
+    int i = 0;
+
+    for (; i + 2 <= numValues; i += 2)
+    {
+        _mm_storeu_pd (maxima + i, _mm_max_pd (_mm_add_pd (_mm_loadu_pd (values + i), offsets), _mm_loadu_pd (maxima + i)));
+    }
+
+    scalarAccumulateMaxPlus (values + i, offset, maxima + i, numValues - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2UnitPhasors (const double* complexSpectrum, const double* magnitudeSpectrum, double* phasorReal, double* phasorImag, int numBins)
+{
+    __m128d zero = _mm_setzero_pd();
+    __m128d one = _mm_set1_pd (1.0);
+    int i = 0;
+
+    for (; i + 2 <= numBins; i += 2)
+    {
+        __m128d a = _mm_loadu_pd (complexSpectrum + 2 * i);
+        __m128d b = _mm_loadu_pd (complexSpectrum + 2 * i + 2);
+        __m128d magnitude = _mm_loadu_pd (magnitudeSpectrum + i);
+
+        // unit phasor, or phase 0 for zero bins
+        __m128d nonZero = _mm_cmpgt_pd (magnitude, zero);
+        __m128d real = _mm_div_pd (_mm_unpacklo_pd (a, b), magnitude);
+        __m128d imag = _mm_div_pd (_mm_unpackhi_pd (a, b), magnitude);
+
+        _mm_storeu_pd (phasorReal + i, _mm_or_pd (_mm_and_pd (nonZero, real), _mm_andnot_pd (nonZero, one)));
+        _mm_storeu_pd (phasorImag + i, _mm_and_pd (nonZero, imag));
+    }
+
+    scalarUnitPhasors (complexSpectrum + 2 * i, magnitudeSpectrum + i, phasorReal + i, phasorImag + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static double sse2ComplexSpectralDifference (const double* complexSpectrum, const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum,
+                                             const double* prevPhasorReal, const double* prevPhasorImag, const double* prevPhasor2Real, const double* prevPhasor2Imag,
+                                             const double* weights, int numBins, bool halfWaveRectify)
+{
+    __m128d sum = _mm_setzero_pd();
+    __m128d zero = _mm_setzero_pd();
+    __m128d two = _mm_set1_pd (2.0);
+    int i = 0;
+
+    for (; i + 2 <= numBins; i += 2)
+    {
+        __m128d a = _mm_loadu_pd (complexSpectrum + 2 * i);
+        __m128d b = _mm_loadu_pd (complexSpectrum + 2 * i + 2);
+        __m128d real = _mm_unpacklo_pd (a, b);
+        __m128d imag = _mm_unpackhi_pd (a, b);
+
+        __m128d pr = _mm_loadu_pd (prevPhasorReal + i);
+        __m128d pi = _mm_loadu_pd (prevPhasorImag + i);
+        __m128d p2r = _mm_loadu_pd (prevPhasor2Real + i);
+        __m128d p2i = _mm_loadu_pd (prevPhasor2Imag + i);
+        __m128d prevMagnitude = _mm_loadu_pd (prevMagnitudeSpectrum + i);
+
+        __m128d rotationReal = _mm_sub_pd (_mm_mul_pd (pr, pr), _mm_mul_pd (pi, pi));
+        __m128d rotationImag = _mm_mul_pd (two, _mm_mul_pd (pr, pi));
+        __m128d targetReal = _mm_mul_pd (prevMagnitude, _mm_add_pd (_mm_mul_pd (rotationReal, p2r), _mm_mul_pd (rotationImag, p2i)));
+        __m128d targetImag = _mm_mul_pd (prevMagnitude, _mm_sub_pd (_mm_mul_pd (rotationImag, p2r), _mm_mul_pd (rotationReal, p2i)));
+
+        __m128d diffReal = _mm_sub_pd (real, targetReal);
+        __m128d diffImag = _mm_sub_pd (imag, targetImag);
+        __m128d csd = _mm_mul_pd (_mm_sqrt_pd (_mm_add_pd (_mm_mul_pd (diffReal, diffReal), _mm_mul_pd (diffImag, diffImag))), _mm_loadu_pd (weights + i));
+
+        if (halfWaveRectify)
+        {
+            csd = _mm_and_pd (csd, _mm_cmpgt_pd (_mm_sub_pd (_mm_loadu_pd (magnitudeSpectrum + i), prevMagnitude), zero));
+        }
+
+        sum = _mm_add_pd (sum, csd);
+    }
+
+    return sse2HorizontalSum (sum) + scalarComplexSpectralDifference (complexSpectrum + 2 * i, magnitudeSpectrum + i, prevMagnitudeSpectrum + i,
+                                                                       prevPhasorReal + i, prevPhasorImag + i, prevPhasor2Real + i, prevPhasor2Imag + i,
+                                                                       weights + i, numBins - i, halfWaveRectify);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2SparseMatrixMatrix (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                    const double* input, int numColumns, double* output)
+{
+    int vectorColumns = numColumns - (numColumns % 2);
+
+    // two columns at a time, which use the same entries of the sparse matrix, for four rows at a time,
+    // so that their sums are calculated in parallel
+    for (int column = 0; column < vectorColumns; column += 2)
+    {
+        int row = 0;
+
+        for (; row + 4 <= numRows; row += 4)
+        {
+            __m128d sum0 = _mm_setzero_pd();
+            __m128d sum1 = _mm_setzero_pd();
+            __m128d sum2 = _mm_setzero_pd();
+            __m128d sum3 = _mm_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                const int* index = indices + j * numRows + row;
+                const double* coefficient = coefficients + j * numRows + row;
+
+                sum0 = _mm_add_pd (sum0, _mm_mul_pd (_mm_set1_pd (coefficient[0]), _mm_loadu_pd (input + index[0] * numColumns + column)));
+                sum1 = _mm_add_pd (sum1, _mm_mul_pd (_mm_set1_pd (coefficient[1]), _mm_loadu_pd (input + index[1] * numColumns + column)));
+                sum2 = _mm_add_pd (sum2, _mm_mul_pd (_mm_set1_pd (coefficient[2]), _mm_loadu_pd (input + index[2] * numColumns + column)));
+                sum3 = _mm_add_pd (sum3, _mm_mul_pd (_mm_set1_pd (coefficient[3]), _mm_loadu_pd (input + index[3] * numColumns + column)));
+            }
+
+            _mm_storeu_pd (output + row * numColumns + column, sum0);
+            _mm_storeu_pd (output + (row + 1) * numColumns + column, sum1);
+            _mm_storeu_pd (output + (row + 2) * numColumns + column, sum2);
+            _mm_storeu_pd (output + (row + 3) * numColumns + column, sum3);
+        }
+
+        for (; row < numRows; row++)
+        {
+            __m128d sum = _mm_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                const double* values = input + indices[j * numRows + row] * numColumns + column;
+
+                sum = _mm_add_pd (sum, _mm_mul_pd (_mm_set1_pd (coefficients[j * numRows + row]), _mm_loadu_pd (values)));
+            }
+
+            _mm_storeu_pd (output + row * numColumns + column, sum);
+        }
+    }
+
+    scalarSparseMatrixMatrixColumns (indices, coefficients, numRows, numEntriesPerRow, input, numColumns, output, vectorColumns);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2Radix2Butterflies (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles)
+{
+    int rowSize = 2 * laneStride;
+    int vectorLanes = numLanes - (numLanes % 4);
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            float* f0 = values + ((block * 2 * m) + k) * rowSize;
+            float* f1 = f0 + m * rowSize;
+            __m128 twr = _mm_set1_ps (twiddles[2 * k]);
+            __m128 twi = _mm_set1_ps (twiddles[2 * k + 1]);
+
+            for (int re = 0; re < vectorLanes; re += 4)
+            {
+                int im = re + laneStride;
+
+                __m128 f0r = _mm_loadu_ps (f0 + re);
+                __m128 f0i = _mm_loadu_ps (f0 + im);
+                __m128 f1r = _mm_loadu_ps (f1 + re);
+                __m128 f1i = _mm_loadu_ps (f1 + im);
+
+                __m128 tr = _mm_sub_ps (_mm_mul_ps (f1r, twr), _mm_mul_ps (f1i, twi));
+                __m128 ti = _mm_add_ps (_mm_mul_ps (f1r, twi), _mm_mul_ps (f1i, twr));
+
+                _mm_storeu_ps (f1 + re, _mm_sub_ps (f0r, tr));
+                _mm_storeu_ps (f1 + im, _mm_sub_ps (f0i, ti));
+                _mm_storeu_ps (f0 + re, _mm_add_ps (f0r, tr));
+                _mm_storeu_ps (f0 + im, _mm_add_ps (f0i, ti));
+            }
+        }
+    }
+
+    scalarRadix2ButterfliesLanes (values, laneStride, numLanes, numBlocks, m, twiddles, vectorLanes);
+}
+
+//=======================================================================
+__attribute__((target("sse2")))
+static void sse2Radix4Butterflies (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles, bool inverse)
+{
+    int rowSize = 2 * laneStride;
+    int vectorLanes = numLanes - (numLanes % 4);
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            float* f0 = values + ((block * 4 * m) + k) * rowSize;
+            float* f1 = f0 + m * rowSize;
+            float* f2 = f1 + m * rowSize;
+            float* f3 = f2 + m * rowSize;
+            const float* tw = twiddles + 6 * k;
+
+            __m128 tw1r = _mm_set1_ps (tw[0]);
+            __m128 tw1i = _mm_set1_ps (tw[1]);
+            __m128 tw2r = _mm_set1_ps (tw[2]);
+            __m128 tw2i = _mm_set1_ps (tw[3]);
+            __m128 tw3r = _mm_set1_ps (tw[4]);
+            __m128 tw3i = _mm_set1_ps (tw[5]);
+
+            for (int re = 0; re < vectorLanes; re += 4)
+            {
+                int im = re + laneStride;
+
+                __m128 f1r = _mm_loadu_ps (f1 + re);
+                __m128 f1i = _mm_loadu_ps (f1 + im);
+                __m128 f2r = _mm_loadu_ps (f2 + re);
+                __m128 f2i = _mm_loadu_ps (f2 + im);
+                __m128 f3r = _mm_loadu_ps (f3 + re);
+                __m128 f3i = _mm_loadu_ps (f3 + im);
+
+                __m128 s0r = _mm_sub_ps (_mm_mul_ps (f1r, tw1r), _mm_mul_ps (f1i, tw1i));
+                __m128 s0i = _mm_add_ps (_mm_mul_ps (f1r, tw1i), _mm_mul_ps (f1i, tw1r));
+                __m128 s1r = _mm_sub_ps (_mm_mul_ps (f2r, tw2r), _mm_mul_ps (f2i, tw2i));
+                __m128 s1i = _mm_add_ps (_mm_mul_ps (f2r, tw2i), _mm_mul_ps (f2i, tw2r));
+                __m128 s2r = _mm_sub_ps (_mm_mul_ps (f3r, tw3r), _mm_mul_ps (f3i, tw3i));
+                __m128 s2i = _mm_add_ps (_mm_mul_ps (f3r, tw3i), _mm_mul_ps (f3i, tw3r));
+
+                __m128 f0r = _mm_loadu_ps (f0 + re);
+                __m128 f0i = _mm_loadu_ps (f0 + im);
+                __m128 s5r = _mm_sub_ps (f0r, s1r);
+                __m128 s5i = _mm_sub_ps (f0i, s1i);
+                f0r = _mm_add_ps (f0r, s1r);
+                f0i = _mm_add_ps (f0i, s1i);
+                __m128 s3r = _mm_add_ps (s0r, s2r);
+                __m128 s3i = _mm_add_ps (s0i, s2i);
+                __m128 s4r = _mm_sub_ps (s0r, s2r);
+                __m128 s4i = _mm_sub_ps (s0i, s2i);
+
+                _mm_storeu_ps (f2 + re, _mm_sub_ps (f0r, s3r));
+                _mm_storeu_ps (f2 + im, _mm_sub_ps (f0i, s3i));
+                _mm_storeu_ps (f0 + re, _mm_add_ps (f0r, s3r));
+                _mm_storeu_ps (f0 + im, _mm_add_ps (f0i, s3i));
+
+                if (inverse)
+                {
+                    _mm_storeu_ps (f1 + re, _mm_sub_ps (s5r, s4i));
+                    _mm_storeu_ps (f1 + im, _mm_add_ps (s5i, s4r));
+                    _mm_storeu_ps (f3 + re, _mm_add_ps (s5r, s4i));
+                    _mm_storeu_ps (f3 + im, _mm_sub_ps (s5i, s4r));
+                }
+                else
+                {
+                    _mm_storeu_ps (f1 + re, _mm_add_ps (s5r, s4i));
+                    _mm_storeu_ps (f1 + im, _mm_sub_ps (s5i, s4r));
+                    _mm_storeu_ps (f3 + re, _mm_sub_ps (s5r, s4i));
+                    _mm_storeu_ps (f3 + im, _mm_add_ps (s5i, s4r));
+                }
+            }
+        }
+    }
+
+    scalarRadix4ButterfliesLanes (values, laneStride, numLanes, numBlocks, m, twiddles, inverse, vectorLanes);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////// AVX2 Kernels ///////////////////////////////////////////
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static double avx2HorizontalSum (__m256d x)
+{
+    __m128d sum = _mm_add_pd (_mm256_castpd256_pd128 (x), _mm256_extractf128_pd (x, 1));
+    return _mm_cvtsd_f64 (_mm_add_sd (sum, _mm_unpackhi_pd (sum, sum)));
+}
+
+//=======================================================================
+/** Load four interleaved complex values and split them into real and imaginary parts */
+__attribute__((target("avx2,fma")))
+static inline void avx2LoadComplex (const double* complexSpectrum, __m256d& real, __m256d& imag)
+{
+    __m256d a = _mm256_loadu_pd (complexSpectrum);
+    __m256d b = _mm256_loadu_pd (complexSpectrum + 4);
+
+    // unpacking gives the order [0 2 1 3], so swap the middle two elements back
+    real = _mm256_permute4x64_pd (_mm256_unpacklo_pd (a, b), _MM_SHUFFLE (3, 1, 2, 0));
+    imag = _mm256_permute4x64_pd (_mm256_unpackhi_pd (a, b), _MM_SHUFFLE (3, 1, 2, 0));
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2MagnitudeSpectrum (const double* complexSpectrum, double* magnitudeSpectrum, int numBins)
+{
+    __m256d real, imag;
+    int i = 0;
+
+    for (; i + 4 <= numBins; i += 4)
+    {
+        avx2LoadComplex (complexSpectrum + 2 * i, real, imag);
+        _mm256_storeu_pd (magnitudeSpectrum + i, _mm256_sqrt_pd (_mm256_fmadd_pd (real, real, _mm256_mul_pd (imag, imag))));
+    }
+
+    scalarMagnitudeSpectrum (complexSpectrum + 2 * i, magnitudeSpectrum + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static double avx2SpectralDifference (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    __m256d sum = _mm256_setzero_pd();
+    __m256d signMask = _mm256_set1_pd (-0.0);
+    int i = 0;
+
+    for (; i + 4 <= numBins; i += 4)
+    {
+        __m256d magnitude = _mm256_loadu_pd (magnitudeSpectrum + i);
+        __m256d diff = _mm256_sub_pd (magnitude, _mm256_loadu_pd (prevMagnitudeSpectrum + i));
+
+        sum = _mm256_fmadd_pd (_mm256_andnot_pd (signMask, diff), _mm256_loadu_pd (weights + i), sum);
+    }
+
+    return avx2HorizontalSum (sum) + scalarSpectralDifference (magnitudeSpectrum + i, prevMagnitudeSpectrum + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static double avx2SpectralDifferenceHWR (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    __m256d sum = _mm256_setzero_pd();
+    __m256d zero = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= numBins; i += 4)
+    {
+        __m256d magnitude = _mm256_loadu_pd (magnitudeSpectrum + i);
+        __m256d diff = _mm256_sub_pd (magnitude, _mm256_loadu_pd (prevMagnitudeSpectrum + i));
+
+        sum = _mm256_fmadd_pd (_mm256_max_pd (diff, zero), _mm256_loadu_pd (weights + i), sum);
+    }
+
+    return avx2HorizontalSum (sum) + scalarSpectralDifferenceHWR (magnitudeSpectrum + i, prevMagnitudeSpectrum + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static double avx2WeightedSum (const double* values, const double* weights, int numBins)
+{
+    __m256d sum = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= numBins; i += 4)
+    {
+        sum = _mm256_fmadd_pd (_mm256_loadu_pd (values + i), _mm256_loadu_pd (weights + i), sum);
+    }
+
+    return avx2HorizontalSum (sum) + scalarWeightedSum (values + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static double avx2WeightedMaximum (const double* values, const double* weights, int numValues)
+{
+    __m256d maximum = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= numValues; i += 4)
+    {
+        maximum = _mm256_max_pd (_mm256_mul_pd (_mm256_loadu_pd (values + i), _mm256_loadu_pd (weights + i)), maximum);
+    }
+
+    __m128d half = _mm_max_pd (_mm256_castpd256_pd128 (maximum), _mm256_extractf128_pd (maximum, 1));
+    half = _mm_max_pd (half, _mm_unpackhi_pd (half, half));
+
+    return std::max (_mm_cvtsd_f64 (half), scalarWeightedMaximum (values + i, weights + i, numValues - i));
+}
+
+//=======================================================================
+// calculates rows startRow onwards, one at a time, with the fused multiply-adds that the vectorised
+// rows use, so that every row is rounded the same way, wherever it falls
+__attribute__((target("avx2,fma")))
+static void fmaSparseMatrixVectorRows (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                       const double* input, double* output, int startRow)
+{
+    for (int row = startRow; row < numRows; row++)
+    {
+        __m128d sum = _mm_setzero_pd();
+
+        for (int j = 0; j < numEntriesPerRow; j++)
+        {
+            sum = _mm_fmadd_sd (_mm_set_sd (coefficients[j * numRows + row]), _mm_set_sd (input[indices[j * numRows + row]]), sum);
+        }
+
+        output[row] = _mm_cvtsd_f64 (sum);
+    }
+}
+
+//=======================================================================
+// calculates columns startColumn onwards, one at a time, with fused multiply-adds
+__attribute__((target("avx2,fma")))
+static void fmaSparseMatrixMatrixColumns (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                          const double* input, int numColumns, double* output, int startColumn)
+{
+    for (int row = 0; row < numRows; row++)
+    {
+        for (int column = startColumn; column < numColumns; column++)
+        {
+            __m128d sum = _mm_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                __m128d value = _mm_set_sd (input[indices[j * numRows + row] * numColumns + column]);
+
+                sum = _mm_fmadd_sd (_mm_set_sd (coefficients[j * numRows + row]), value, sum);
+            }
+
+            output[row * numColumns + column] = _mm_cvtsd_f64 (sum);
+        }
+    }
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2SparseMatrixVector (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                    const double* input, double* output)
+{
+    int row = 0;
+
+    // the masked gather is used, with every lane enabled, as it takes an explicit source to merge into
+    __m256d allLanes = _mm256_castsi256_pd (_mm256_set1_epi64x (-1));
+
+    for (; row + 4 <= numRows; row += 4)
+    {
+        __m256d sum = _mm256_setzero_pd();
+
+        for (int j = 0; j < numEntriesPerRow; j++)
+        {
+            __m128i rowIndices = _mm_loadu_si128 ((const __m128i*) (indices + j * numRows + row));
+            __m256d values = _mm256_mask_i32gather_pd (_mm256_setzero_pd(), input, rowIndices, allLanes, 8);
+
+            sum = _mm256_fmadd_pd (_mm256_loadu_pd (coefficients + j * numRows + row), values, sum);
+        }
+
+        _mm256_storeu_pd (output + row, sum);
+    }
+
+    fmaSparseMatrixVectorRows (indices, coefficients, numRows, numEntriesPerRow, input, output, row);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2MaxPlusCorrelation (const double* input, const double* kernel, int kernelLength, double* output, int numOutputs)
+{
+    int i = 0;
+
+    for (; i + 4 <= numOutputs; i += 4)
+    {
+        __m256d maximum = _mm256_add_pd (_mm256_loadu_pd (input + i), _mm256_set1_pd (kernel[0]));
+
+        for (int k = 1; k < kernelLength; k++)
+        {
+            maximum = _mm256_max_pd (maximum, _mm256_add_pd (_mm256_loadu_pd (input + i + k), _mm256_set1_pd (kernel[k])));
+        }
+
+        _mm256_storeu_pd (output + i, maximum);
+    }
+
+    scalarMaxPlusCorrelation (input + i, kernel, kernelLength, output + i, numOutputs - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2AccumulateWeightedMaximum (const double* values, const double* weights, double* maxima, int numValues)
+{
+    int i = 0;
+
+    for (; i + 4 <= numValues; i += 4)
+    {
+        _mm256_storeu_pd (maxima + i, _mm256_max_pd (_mm256_mul_pd (_mm256_loadu_pd (values + i), _mm256_loadu_pd (weights + i)), _mm256_loadu_pd (maxima + i)));
+    }
+
+    scalarAccumulateWeightedMaximum (values + i, weights + i, maxima + i, numValues - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2AccumulateMaxPlus (const double* values, double offset, double* maxima, int numValues)
+{
+    __m256d offsets = _mm256_set1_pd (offset);
+    int i = 0;
+
+    for (; i + 4 <= numValues; i += 4)
+    {
+        _mm256_storeu_pd (maxima + i, _mm256_max_pd (_mm256_add_pd (_mm256_loadu_pd (values + i), offsets), _mm256_loadu_pd (maxima + i)));
+    }
+
+    scalarAccumulateMaxPlus (values + i, offset, maxima + i, numValues - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2UnitPhasors (const double* complexSpectrum, const double* magnitudeSpectrum, double* phasorReal, double* phasorImag, int numBins)
+{
+    __m256d zero = _mm256_setzero_pd();
+    __m256d one = _mm256_set1_pd (1.0);
+    __m256d real, imag;
+    int i = 0;
+
+    for (; i + 4 <= numBins; i += 4)
+    {
+        avx2LoadComplex (complexSpectrum + 2 * i, real, imag);
+        __m256d magnitude = _mm256_loadu_pd (magnitudeSpectrum + i);
+
+        // unit phasor, or phase 0 for zero bins
+        __m256d nonZero = _mm256_cmp_pd (magnitude, zero, _CMP_GT_OQ);
+
+        _mm256_storeu_pd (phasorReal + i, _mm256_blendv_pd (one, _mm256_div_pd (real, magnitude), nonZero));
+        _mm256_storeu_pd (phasorImag + i, _mm256_and_pd (nonZero, _mm256_div_pd (imag, magnitude)));
+    }
+
+    scalarUnitPhasors (complexSpectrum + 2 * i, magnitudeSpectrum + i, phasorReal + i, phasorImag + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static double avx2ComplexSpectralDifference (const double* complexSpectrum, const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum,
+                                             const double* prevPhasorReal, const double* prevPhasorImag, const double* prevPhasor2Real, const double* prevPhasor2Imag,
+                                             const double* weights, int numBins, bool halfWaveRectify)
+{
+    __m256d sum = _mm256_setzero_pd();
+    __m256d zero = _mm256_setzero_pd();
+    __m256d two = _mm256_set1_pd (2.0);
+    __m256d real, imag;
+    int i = 0;
+
+    for (; i + 4 <= numBins; i += 4)
+    {
+        avx2LoadComplex (complexSpectrum + 2 * i, real, imag);
+
+        __m256d pr = _mm256_loadu_pd (prevPhasorReal + i);
+        __m256d pi = _mm256_loadu_pd (prevPhasorImag + i);
+        __m256d p2r = _mm256_loadu_pd (prevPhasor2Real + i);
+        __m256d p2i = _mm256_loadu_pd (prevPhasor2Imag + i);
+        __m256d prevMagnitude = _mm256_loadu_pd (prevMagnitudeSpectrum + i);
+
+        __m256d rotationReal = _mm256_fmsub_pd (pr, pr, _mm256_mul_pd (pi, pi));
+        __m256d rotationImag = _mm256_mul_pd (two, _mm256_mul_pd (pr, pi));
+        __m256d targetReal = _mm256_mul_pd (prevMagnitude, _mm256_fmadd_pd (rotationReal, p2r, _mm256_mul_pd (rotationImag, p2i)));
+        __m256d targetImag = _mm256_mul_pd (prevMagnitude, _mm256_fmsub_pd (rotationImag, p2r, _mm256_mul_pd (rotationReal, p2i)));
+
+        __m256d diffReal = _mm256_sub_pd (real, targetReal);
+        __m256d diffImag = _mm256_sub_pd (imag, targetImag);
+        __m256d csd = _mm256_mul_pd (_mm256_sqrt_pd (_mm256_fmadd_pd (diffReal, diffReal, _mm256_mul_pd (diffImag, diffImag))), _mm256_loadu_pd (weights + i));
+
+        if (halfWaveRectify)
+        {
+            csd = _mm256_and_pd (csd, _mm256_cmp_pd (_mm256_sub_pd (_mm256_loadu_pd (magnitudeSpectrum + i), prevMagnitude), zero, _CMP_GT_OQ));
+        }
+
+        sum = _mm256_add_pd (sum, csd);
+    }
+
+    return avx2HorizontalSum (sum) + scalarComplexSpectralDifference (complexSpectrum + 2 * i, magnitudeSpectrum + i, prevMagnitudeSpectrum + i,
+                                                                       prevPhasorReal + i, prevPhasorImag + i, prevPhasor2Real + i, prevPhasor2Imag + i,
+                                                                       weights + i, numBins - i, halfWaveRectify);
+}
+
+//=======================================================================
+__attribute__((target("avx2,fma")))
+static void avx2SparseMatrixMatrix (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                    const double* input, int numColumns, double* output)
+{
+    int vectorColumns = numColumns - (numColumns % 4);
+
+    // four columns at a time, for four rows at a time, so that their sums are calculated in parallel
+    for (int column = 0; column < vectorColumns; column += 4)
+    {
+        int row = 0;
+
+        for (; row + 4 <= numRows; row += 4)
+        {
+            __m256d sum0 = _mm256_setzero_pd();
+            __m256d sum1 = _mm256_setzero_pd();
+            __m256d sum2 = _mm256_setzero_pd();
+            __m256d sum3 = _mm256_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                const int* index = indices + j * numRows + row;
+                const double* coefficient = coefficients + j * numRows + row;
+
+                sum0 = _mm256_fmadd_pd (_mm256_set1_pd (coefficient[0]), _mm256_loadu_pd (input + index[0] * numColumns + column), sum0);
+                sum1 = _mm256_fmadd_pd (_mm256_set1_pd (coefficient[1]), _mm256_loadu_pd (input + index[1] * numColumns + column), sum1);
+                sum2 = _mm256_fmadd_pd (_mm256_set1_pd (coefficient[2]), _mm256_loadu_pd (input + index[2] * numColumns + column), sum2);
+                sum3 = _mm256_fmadd_pd (_mm256_set1_pd (coefficient[3]), _mm256_loadu_pd (input + index[3] * numColumns + column), sum3);
+            }
+
+            _mm256_storeu_pd (output + row * numColumns + column, sum0);
+            _mm256_storeu_pd (output + (row + 1) * numColumns + column, sum1);
+            _mm256_storeu_pd (output + (row + 2) * numColumns + column, sum2);
+            _mm256_storeu_pd (output + (row + 3) * numColumns + column, sum3);
+        }
+
+        for (; row < numRows; row++)
+        {
+            __m256d sum = _mm256_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                const double* values = input + indices[j * numRows + row] * numColumns + column;
+
+                sum = _mm256_fmadd_pd (_mm256_set1_pd (coefficients[j * numRows + row]), _mm256_loadu_pd (values), sum);
+            }
+
+            _mm256_storeu_pd (output + row * numColumns + column, sum);
+        }
+    }
+
+    fmaSparseMatrixMatrixColumns (indices, coefficients, numRows, numEntriesPerRow, input, numColumns, output, vectorColumns);
+}
+
+//=======================================================================
+// the butterflies are compiled without FMA, as the compiler would otherwise fuse their multiplies and
+// adds, which Kiss FFT does not do, and that would change the rounding. The remaining lanes are done by SSE2
+__attribute__((target("avx2")))
+static void avx2Radix2Butterflies (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles)
+{
+    int rowSize = 2 * laneStride;
+    int vectorLanes = numLanes - (numLanes % 8);
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            float* f0 = values + ((block * 2 * m) + k) * rowSize;
+            float* f1 = f0 + m * rowSize;
+            __m256 twr = _mm256_set1_ps (twiddles[2 * k]);
+            __m256 twi = _mm256_set1_ps (twiddles[2 * k + 1]);
+
+            for (int re = 0; re < vectorLanes; re += 8)
+            {
+                int im = re + laneStride;
+
+                __m256 f0r = _mm256_loadu_ps (f0 + re);
+                __m256 f0i = _mm256_loadu_ps (f0 + im);
+                __m256 f1r = _mm256_loadu_ps (f1 + re);
+                __m256 f1i = _mm256_loadu_ps (f1 + im);
+
+                __m256 tr = _mm256_sub_ps (_mm256_mul_ps (f1r, twr), _mm256_mul_ps (f1i, twi));
+                __m256 ti = _mm256_add_ps (_mm256_mul_ps (f1r, twi), _mm256_mul_ps (f1i, twr));
+
+                _mm256_storeu_ps (f1 + re, _mm256_sub_ps (f0r, tr));
+                _mm256_storeu_ps (f1 + im, _mm256_sub_ps (f0i, ti));
+                _mm256_storeu_ps (f0 + re, _mm256_add_ps (f0r, tr));
+                _mm256_storeu_ps (f0 + im, _mm256_add_ps (f0i, ti));
+            }
+        }
+    }
+
+    if (vectorLanes < numLanes)
+    {
+        sse2Radix2Butterflies (values + vectorLanes, laneStride, numLanes - vectorLanes, numBlocks, m, twiddles);
+    }
+}
+
+//=======================================================================
+__attribute__((target("avx2")))
+static void avx2Radix4Butterflies (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles, bool inverse)
+{
+    int rowSize = 2 * laneStride;
+    int vectorLanes = numLanes - (numLanes % 8);
+
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (int k = 0; k < m; k++)
+        {
+            float* f0 = values + ((block * 4 * m) + k) * rowSize;
+            float* f1 = f0 + m * rowSize;
+            float* f2 = f1 + m * rowSize;
+            float* f3 = f2 + m * rowSize;
+            const float* tw = twiddles + 6 * k;
+
+            __m256 tw1r = _mm256_set1_ps (tw[0]);
+            __m256 tw1i = _mm256_set1_ps (tw[1]);
+            __m256 tw2r = _mm256_set1_ps (tw[2]);
+            __m256 tw2i = _mm256_set1_ps (tw[3]);
+            __m256 tw3r = _mm256_set1_ps (tw[4]);
+            __m256 tw3i = _mm256_set1_ps (tw[5]);
+
+            for (int re = 0; re < vectorLanes; re += 8)
+            {
+                int im = re + laneStride;
+
+                __m256 f1r = _mm256_loadu_ps (f1 + re);
+                __m256 f1i = _mm256_loadu_ps (f1 + im);
+                __m256 f2r = _mm256_loadu_ps (f2 + re);
+                __m256 f2i = _mm256_loadu_ps (f2 + im);
+                __m256 f3r = _mm256_loadu_ps (f3 + re);
+                __m256 f3i = _mm256_loadu_ps (f3 + im);
+
+                __m256 s0r = _mm256_sub_ps (_mm256_mul_ps (f1r, tw1r), _mm256_mul_ps (f1i, tw1i));
+                __m256 s0i = _mm256_add_ps (_mm256_mul_ps (f1r, tw1i), _mm256_mul_ps (f1i, tw1r));
+                __m256 s1r = _mm256_sub_ps (_mm256_mul_ps (f2r, tw2r), _mm256_mul_ps (f2i, tw2i));
+                __m256 s1i = _mm256_add_ps (_mm256_mul_ps (f2r, tw2i), _mm256_mul_ps (f2i, tw2r));
+                __m256 s2r = _mm256_sub_ps (_mm256_mul_ps (f3r, tw3r), _mm256_mul_ps (f3i, tw3i));
+                __m256 s2i = _mm256_add_ps (_mm256_mul_ps (f3r, tw3i), _mm256_mul_ps (f3i, tw3r));
+
+                __m256 f0r = _mm256_loadu_ps (f0 + re);
+                __m256 f0i = _mm256_loadu_ps (f0 + im);
+                __m256 s5r = _mm256_sub_ps (f0r, s1r);
+                __m256 s5i = _mm256_sub_ps (f0i, s1i);
+                f0r = _mm256_add_ps (f0r, s1r);
+                f0i = _mm256_add_ps (f0i, s1i);
+                __m256 s3r = _mm256_add_ps (s0r, s2r);
+                __m256 s3i = _mm256_add_ps (s0i, s2i);
+                __m256 s4r = _mm256_sub_ps (s0r, s2r);
+                __m256 s4i = _mm256_sub_ps (s0i, s2i);
+
+                _mm256_storeu_ps (f2 + re, _mm256_sub_ps (f0r, s3r));
+                _mm256_storeu_ps (f2 + im, _mm256_sub_ps (f0i, s3i));
+                _mm256_storeu_ps (f0 + re, _mm256_add_ps (f0r, s3r));
+                _mm256_storeu_ps (f0 + im, _mm256_add_ps (f0i, s3i));
+
+                if (inverse)
+                {
+                    _mm256_storeu_ps (f1 + re, _mm256_sub_ps (s5r, s4i));
+                    _mm256_storeu_ps (f1 + im, _mm256_add_ps (s5i, s4r));
+                    _mm256_storeu_ps (f3 + re, _mm256_add_ps (s5r, s4i));
+                    _mm256_storeu_ps (f3 + im, _mm256_sub_ps (s5i, s4r));
+                }
+                else
+                {
+                    _mm256_storeu_ps (f1 + re, _mm256_add_ps (s5r, s4i));
+                    _mm256_storeu_ps (f1 + im, _mm256_sub_ps (s5i, s4r));
+                    _mm256_storeu_ps (f3 + re, _mm256_sub_ps (s5r, s4i));
+                    _mm256_storeu_ps (f3 + im, _mm256_add_ps (s5i, s4r));
+                }
+            }
+        }
+    }
+
+    if (vectorLanes < numLanes)
+    {
+        sse2Radix4Butterflies (values + vectorLanes, laneStride, numLanes - vectorLanes, numBlocks, m, twiddles, inverse);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////// AVX-512 Kernels /////////////////////////////////////////
+
+// gcc 12 warns that the undefined starting values inside avx512fintrin.h's own intrinsics
+// (e.g. _mm512_undefined_pd) may be used uninitialised, once they are inlined here
+#if defined (__GNUC__) && !defined (__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+//=======================================================================
+/** Load eight interleaved complex values and split them into real and imaginary parts */
+__attribute__((target("avx512f")))
+static inline void avx512LoadComplex (const double* complexSpectrum, __m512d& real, __m512d& imag)
+{
+    __m512d a = _mm512_loadu_pd (complexSpectrum);
+    __m512d b = _mm512_loadu_pd (complexSpectrum + 8);
+
+    real = _mm512_permutex2var_pd (a, _mm512_set_epi64 (14, 12, 10, 8, 6, 4, 2, 0), b);
+    imag = _mm512_permutex2var_pd (a, _mm512_set_epi64 (15, 13, 11, 9, 7, 5, 3, 1), b);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512MagnitudeSpectrum (const double* complexSpectrum, double* magnitudeSpectrum, int numBins)
+{
+    __m512d real, imag;
+    int i = 0;
+
+    for (; i + 8 <= numBins; i += 8)
+    {
+        avx512LoadComplex (complexSpectrum + 2 * i, real, imag);
+        _mm512_storeu_pd (magnitudeSpectrum + i, _mm512_sqrt_pd (_mm512_fmadd_pd (real, real, _mm512_mul_pd (imag, imag))));
+    }
+
+    scalarMagnitudeSpectrum (complexSpectrum + 2 * i, magnitudeSpectrum + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static double avx512SpectralDifference (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    __m512d sum = _mm512_setzero_pd();
+    int i = 0;
+
+    for (; i + 8 <= numBins; i += 8)
+    {
+        __m512d magnitude = _mm512_loadu_pd (magnitudeSpectrum + i);
+        __m512d diff = _mm512_sub_pd (magnitude, _mm512_loadu_pd (prevMagnitudeSpectrum + i));
+
+        sum = _mm512_fmadd_pd (_mm512_abs_pd (diff), _mm512_loadu_pd (weights + i), sum);
+    }
+
+    return _mm512_reduce_add_pd (sum) + scalarSpectralDifference (magnitudeSpectrum + i, prevMagnitudeSpectrum + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static double avx512SpectralDifferenceHWR (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins)
+{
+    __m512d sum = _mm512_setzero_pd();
+    __m512d zero = _mm512_setzero_pd();
+    int i = 0;
+
+    for (; i + 8 <= numBins; i += 8)
+    {
+        __m512d magnitude = _mm512_loadu_pd (magnitudeSpectrum + i);
+        __m512d diff = _mm512_sub_pd (magnitude, _mm512_loadu_pd (prevMagnitudeSpectrum + i));
+
+        sum = _mm512_fmadd_pd (_mm512_max_pd (diff, zero), _mm512_loadu_pd (weights + i), sum);
+    }
+
+    return _mm512_reduce_add_pd (sum) + scalarSpectralDifferenceHWR (magnitudeSpectrum + i, prevMagnitudeSpectrum + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static double avx512WeightedSum (const double* values, const double* weights, int numBins)
+{
+    __m512d sum = _mm512_setzero_pd();
+    int i = 0;
+
+    for (; i + 8 <= numBins; i += 8)
+    {
+        sum = _mm512_fmadd_pd (_mm512_loadu_pd (values + i), _mm512_loadu_pd (weights + i), sum);
+    }
+
+    return _mm512_reduce_add_pd (sum) + scalarWeightedSum (values + i, weights + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static double avx512WeightedMaximum (const double* values, const double* weights, int numValues)
+{
+    __m512d maximum = _mm512_setzero_pd();
+    int i = 0;
+
+    for (; i + 8 <= numValues; i += 8)
+    {
+        maximum = _mm512_max_pd (_mm512_mul_pd (_mm512_loadu_pd (values + i), _mm512_loadu_pd (weights + i)), maximum);
+    }
+
+    return std::max (_mm512_reduce_max_pd (maximum), scalarWeightedMaximum (values + i, weights + i, numValues - i));
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512SparseMatrixVector (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                      const double* input, double* output)
+{
+    int row = 0;
+
+    for (; row + 8 <= numRows; row += 8)
+    {
+        __m512d sum = _mm512_setzero_pd();
+
+        for (int j = 0; j < numEntriesPerRow; j++)
+        {
+            __m256i rowIndices = _mm256_loadu_si256 ((const __m256i*) (indices + j * numRows + row));
+            __m512d values = _mm512_mask_i32gather_pd (_mm512_setzero_pd(), 0xFF, rowIndices, input, 8);
+
+            sum = _mm512_fmadd_pd (_mm512_loadu_pd (coefficients + j * numRows + row), values, sum);
+        }
+
+        _mm512_storeu_pd (output + row, sum);
+    }
+
+    fmaSparseMatrixVectorRows (indices, coefficients, numRows, numEntriesPerRow, input, output, row);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512SparseMatrixMatrix (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                      const double* input, int numColumns, double* output)
+{
+    int vectorColumns = numColumns - (numColumns % 8);
+
+    // eight columns at a time, for four rows at a time, so that their sums are calculated in parallel
+    for (int column = 0; column < vectorColumns; column += 8)
+    {
+        int row = 0;
+
+        for (; row + 4 <= numRows; row += 4)
+        {
+            __m512d sum0 = _mm512_setzero_pd();
+            __m512d sum1 = _mm512_setzero_pd();
+            __m512d sum2 = _mm512_setzero_pd();
+            __m512d sum3 = _mm512_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                const int* index = indices + j * numRows + row;
+                const double* coefficient = coefficients + j * numRows + row;
+
+                sum0 = _mm512_fmadd_pd (_mm512_set1_pd (coefficient[0]), _mm512_loadu_pd (input + index[0] * numColumns + column), sum0);
+                sum1 = _mm512_fmadd_pd (_mm512_set1_pd (coefficient[1]), _mm512_loadu_pd (input + index[1] * numColumns + column), sum1);
+                sum2 = _mm512_fmadd_pd (_mm512_set1_pd (coefficient[2]), _mm512_loadu_pd (input + index[2] * numColumns + column), sum2);
+                sum3 = _mm512_fmadd_pd (_mm512_set1_pd (coefficient[3]), _mm512_loadu_pd (input + index[3] * numColumns + column), sum3);
+            }
+
+            _mm512_storeu_pd (output + row * numColumns + column, sum0);
+            _mm512_storeu_pd (output + (row + 1) * numColumns + column, sum1);
+            _mm512_storeu_pd (output + (row + 2) * numColumns + column, sum2);
+            _mm512_storeu_pd (output + (row + 3) * numColumns + column, sum3);
+        }
+
+        for (; row < numRows; row++)
+        {
+            __m512d sum = _mm512_setzero_pd();
+
+            for (int j = 0; j < numEntriesPerRow; j++)
+            {
+                const double* values = input + indices[j * numRows + row] * numColumns + column;
+
+                sum = _mm512_fmadd_pd (_mm512_set1_pd (coefficients[j * numRows + row]), _mm512_loadu_pd (values), sum);
+            }
+
+            _mm512_storeu_pd (output + row * numColumns + column, sum);
+        }
+    }
+
+    fmaSparseMatrixMatrixColumns (indices, coefficients, numRows, numEntriesPerRow, input, numColumns, output, vectorColumns);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512MaxPlusCorrelation (const double* input, const double* kernel, int kernelLength, double* output, int numOutputs)
+{
+    int i = 0;
+
+    for (; i + 8 <= numOutputs; i += 8)
+    {
+        __m512d maximum = _mm512_add_pd (_mm512_loadu_pd (input + i), _mm512_set1_pd (kernel[0]));
+
+        for (int k = 1; k < kernelLength; k++)
+        {
+            maximum = _mm512_max_pd (maximum, _mm512_add_pd (_mm512_loadu_pd (input + i + k), _mm512_set1_pd (kernel[k])));
+        }
+
+        _mm512_storeu_pd (output + i, maximum);
+    }
+
+    scalarMaxPlusCorrelation (input + i, kernel, kernelLength, output + i, numOutputs - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512AccumulateWeightedMaximum (const double* values, const double* weights, double* maxima, int numValues)
+{
+    int i = 0;
+
+    for (; i + 8 <= numValues; i += 8)
+    {
+        _mm512_storeu_pd (maxima + i, _mm512_max_pd (_mm512_mul_pd (_mm512_loadu_pd (values + i), _mm512_loadu_pd (weights + i)), _mm512_loadu_pd (maxima + i)));
+    }
+
+    scalarAccumulateWeightedMaximum (values + i, weights + i, maxima + i, numValues - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512AccumulateMaxPlus (const double* values, double offset, double* maxima, int numValues)
+{
+    __m512d offsets = _mm512_set1_pd (offset);
+    int i = 0;
+
+    for (; i + 8 <= numValues; i += 8)
+    {
+        _mm512_storeu_pd (maxima + i, _mm512_max_pd (_mm512_add_pd (_mm512_loadu_pd (values + i), offsets), _mm512_loadu_pd (maxima + i)));
+    }
+
+    scalarAccumulateMaxPlus (values + i, offset, maxima + i, numValues - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static void avx512UnitPhasors (const double* complexSpectrum, const double* magnitudeSpectrum, double* phasorReal, double* phasorImag, int numBins)
+{
+    __m512d zero = _mm512_setzero_pd();
+    __m512d one = _mm512_set1_pd (1.0);
+    __m512d real, imag;
+    int i = 0;
+
+    for (; i + 8 <= numBins; i += 8)
+    {
+        avx512LoadComplex (complexSpectrum + 2 * i, real, imag);
+        __m512d magnitude = _mm512_loadu_pd (magnitudeSpectrum + i);
+
+        // unit phasor, or phase 0 for zero bins
+        __mmask8 nonZero = _mm512_cmp_pd_mask (magnitude, zero, _CMP_GT_OQ);
+
+        _mm512_storeu_pd (phasorReal + i, _mm512_mask_div_pd (one, nonZero, real, magnitude));
+        _mm512_storeu_pd (phasorImag + i, _mm512_maskz_div_pd (nonZero, imag, magnitude));
+    }
+
+    scalarUnitPhasors (complexSpectrum + 2 * i, magnitudeSpectrum + i, phasorReal + i, phasorImag + i, numBins - i);
+}
+
+//=======================================================================
+__attribute__((target("avx512f")))
+static double avx512ComplexSpectralDifference (const double* complexSpectrum, const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum,
+                                               const double* prevPhasorReal, const double* prevPhasorImag, const double* prevPhasor2Real, const double* prevPhasor2Imag,
+                                               const double* weights, int numBins, bool halfWaveRectify)
+{
+    __m512d sum = _mm512_setzero_pd();
+    __m512d two = _mm512_set1_pd (2.0);
+    __m512d real, imag;
+    int i = 0;
+
+    for (; i + 8 <= numBins; i += 8)
+    {
+        avx512LoadComplex (complexSpectrum + 2 * i, real, imag);
+
+        __m512d pr = _mm512_loadu_pd (prevPhasorReal + i);
+        __m512d pi = _mm512_loadu_pd (prevPhasorImag + i);
+        __m512d p2r = _mm512_loadu_pd (prevPhasor2Real + i);
+        __m512d p2i = _mm512_loadu_pd (prevPhasor2Imag + i);
+        __m512d prevMagnitude = _mm512_loadu_pd (prevMagnitudeSpectrum + i);
+
+        __m512d rotationReal = _mm512_fmsub_pd (pr, pr, _mm512_mul_pd (pi, pi));
+        __m512d rotationImag = _mm512_mul_pd (two, _mm512_mul_pd (pr, pi));
+        __m512d targetReal = _mm512_mul_pd (prevMagnitude, _mm512_fmadd_pd (rotationReal, p2r, _mm512_mul_pd (rotationImag, p2i)));
+        __m512d targetImag = _mm512_mul_pd (prevMagnitude, _mm512_fmsub_pd (rotationImag, p2r, _mm512_mul_pd (rotationReal, p2i)));
+
+        __m512d diffReal = _mm512_sub_pd (real, targetReal);
+        __m512d diffImag = _mm512_sub_pd (imag, targetImag);
+        __m512d csd = _mm512_mul_pd (_mm512_sqrt_pd (_mm512_fmadd_pd (diffReal, diffReal, _mm512_mul_pd (diffImag, diffImag))), _mm512_loadu_pd (weights + i));
+
+        if (halfWaveRectify)
+        {
+            csd = _mm512_maskz_mov_pd (_mm512_cmp_pd_mask (_mm512_loadu_pd (magnitudeSpectrum + i), prevMagnitude, _CMP_GT_OQ), csd);
+        }
+
+        sum = _mm512_add_pd (sum, csd);
+    }
+
+    return _mm512_reduce_add_pd (sum) + scalarComplexSpectralDifference (complexSpectrum + 2 * i, magnitudeSpectrum + i, prevMagnitudeSpectrum + i,
+                                                                          prevPhasorReal + i, prevPhasorImag + i, prevPhasor2Real + i, prevPhasor2Imag + i,
+                                                                          weights + i, numBins - i, halfWaveRectify);
+}
+
+#if defined (__GNUC__) && !defined (__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////// Kernel Selection ////////////////////////////////////////
+
+static const SpectralKernels scalarKernels = {scalarMagnitudeSpectrum, scalarSpectralDifference, scalarSpectralDifferenceHWR,
+                                              scalarWeightedSum, scalarWeightedMaximum, scalarSparseMatrixVector, scalarMaxPlusCorrelation,
+                                              scalarAccumulateWeightedMaximum, scalarAccumulateMaxPlus,
+                                              scalarUnitPhasors, scalarComplexSpectralDifference,
+                                              scalarSparseMatrixMatrix, scalarRadix2Butterflies, scalarRadix4Butterflies, 1};
+
+#ifdef SPECTRAL_KERNELS_X86
+static const SpectralKernels sse2Kernels = {sse2MagnitudeSpectrum, sse2SpectralDifference, sse2SpectralDifferenceHWR,
+                                            sse2WeightedSum, sse2WeightedMaximum, sse2SparseMatrixVector, sse2MaxPlusCorrelation,
+                                            sse2AccumulateWeightedMaximum, sse2AccumulateMaxPlus,
+                                            sse2UnitPhasors, sse2ComplexSpectralDifference,
+                                            sse2SparseMatrixMatrix, sse2Radix2Butterflies, sse2Radix4Butterflies, 4};
+
+static const SpectralKernels avx2Kernels = {avx2MagnitudeSpectrum, avx2SpectralDifference, avx2SpectralDifferenceHWR,
+                                            avx2WeightedSum, avx2WeightedMaximum, avx2SparseMatrixVector, avx2MaxPlusCorrelation,
+                                            avx2AccumulateWeightedMaximum, avx2AccumulateMaxPlus,
+                                            avx2UnitPhasors, avx2ComplexSpectralDifference,
+                                            avx2SparseMatrixMatrix, avx2Radix2Butterflies, avx2Radix4Butterflies, 8};
+
+// AVX-512 always lets the compiler fuse multiplies and adds, so the AVX2 butterflies are used
+static const SpectralKernels avx512Kernels = {avx512MagnitudeSpectrum, avx512SpectralDifference, avx512SpectralDifferenceHWR,
+                                              avx512WeightedSum, avx512WeightedMaximum, avx512SparseMatrixVector, avx512MaxPlusCorrelation,
+                                              avx512AccumulateWeightedMaximum, avx512AccumulateMaxPlus,
+                                              avx512UnitPhasors, avx512ComplexSpectralDifference,
+                                              avx512SparseMatrixMatrix, avx2Radix2Butterflies, avx2Radix4Butterflies, 8};
+#endif
+
+//=======================================================================
+bool SpectralKernels::isSupported (int spectralKernelType)
+{
+    switch (spectralKernelType)
+    {
+        case ScalarKernels:
+            return true;
+#ifdef SPECTRAL_KERNELS_X86
+        case SSE2Kernels:
+            return __builtin_cpu_supports ("sse2");
+        case AVX2Kernels:
+            return __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+        case AVX512Kernels:
+            return __builtin_cpu_supports ("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+//=======================================================================
+int SpectralKernels::getNearestSupportedType (int spectralKernelType)
+{
+    if (spectralKernelType > AVX512Kernels)
+    {
+        spectralKernelType = AVX512Kernels;
+    }
+
+    // fall back to the fastest type below the one requested that we can run
+    while ((spectralKernelType > ScalarKernels) && !isSupported (spectralKernelType))
+    {
+        spectralKernelType--;
+    }
+
+    return spectralKernelType;
+}
+
+//=======================================================================
+int SpectralKernels::getFastestSupportedType()
+{
+    return getNearestSupportedType (AVX512Kernels);
+}
+
+//=======================================================================
+const SpectralKernels& SpectralKernels::get (int spectralKernelType)
+{
+    switch (getNearestSupportedType (spectralKernelType))
+    {
+#ifdef SPECTRAL_KERNELS_X86
+        case SSE2Kernels:
+            return sse2Kernels;
+        case AVX2Kernels:
+            return avx2Kernels;
+        case AVX512Kernels:
+            return avx512Kernels;
+#endif
+        default:
+            return scalarKernels;
+    }
+}
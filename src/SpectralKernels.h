@@ -0,0 +1,213 @@
+//=======================================================================
+/** @file SpectralKernels.h
+ *  @brief Vectorised functions for reducing spectra to onset detection function samples
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#ifndef __SPECTRALKERNELS_H
+#define __SPECTRALKERNELS_H
+
+//=======================================================================
+/** The instruction set used to reduce spectra to onset detection function samples */
+enum SpectralKernelType
+{
+    ScalarKernels,
+    SSE2Kernels,
+    AVX2Kernels,
+    AVX512Kernels
+};
+
+//=======================================================================
+/** A set of functions that reduce spectra to onset detection function samples, along with
+ * the few other reductions that the beat tracker's inner loops are built from,
+ * implemented for one instruction set. All sets other than ScalarKernels need an
+ * x86 processor and are only used if the processor we are running on supports them.
+ * Complex spectra are interleaved (real, imaginary) pairs, as produced by FFTW.
+ *
+ * The butterfly kernels perform many Kiss FFTs at once, one per lane, with the rows of every
+ * FFT side by side: row r holds the real part of row r of every lane, then, laneStride values
+ * later, the imaginary parts. They do exactly the arithmetic that Kiss FFT does for each lane,
+ * so give exactly the same results as it does, with every kernel type.
+ */
+struct SpectralKernels
+{
+    /** Calculate the magnitude of each bin of a complex spectrum
+     * @param complexSpectrum the interleaved complex spectrum
+     * @param magnitudeSpectrum the array to write the magnitudes to
+     * @param numBins the number of bins
+     */
+    void (*magnitudeSpectrum) (const double* complexSpectrum, double* magnitudeSpectrum, int numBins);
+
+    /** Calculate the weighted sum of absolute differences between two magnitude spectra
+     * @param magnitudeSpectrum the current magnitude spectrum
+     * @param prevMagnitudeSpectrum the previous magnitude spectrum
+     * @param weights the weight for each bin
+     * @param numBins the number of bins
+     * @returns the weighted sum
+     */
+    double (*spectralDifference) (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins);
+
+    /** As spectralDifference, but only positive differences contribute to the sum */
+    double (*spectralDifferenceHWR) (const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum, const double* weights, int numBins);
+
+    /** @returns the weighted sum of an array of values
+     * @param values the values to sum
+     * @param weights the weight for each value
+     * @param numBins the number of values
+     */
+    double (*weightedSum) (const double* values, const double* weights, int numBins);
+
+    /** @returns the largest product of a value and its weight, or zero if none are positive
+     * @param values the values
+     * @param weights the weight for each value
+     * @param numValues the number of values
+     */
+    double (*weightedMaximum) (const double* values, const double* weights, int numValues);
+
+    /** Multiply a vector by a sparse matrix with the same number of entries in every row. The entries
+     * are stored column by column: entry j of row r is at index (j * numRows) + r, so that neighbouring
+     * rows can be calculated together
+     * @param indices the input index of each entry
+     * @param coefficients the value of each entry
+     * @param numRows the number of rows
+     * @param numEntriesPerRow the number of entries in each row
+     * @param input the vector to multiply
+     * @param output the array to write the numRows results to
+     */
+    void (*sparseMatrixVector) (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                const double* input, double* output);
+
+    /** Calculate the largest sum of each run of input values and a kernel, i.e. a correlation
+     * with max in place of addition and addition in place of multiplication. This is the
+     * Viterbi update for a transition kernel in the log domain
+     * @param input the numOutputs + kernelLength - 1 input values
+     * @param kernel the kernel
+     * @param kernelLength the number of kernel values
+     * @param output the array to write the numOutputs results to, where output i is the
+     * largest value of input[i + k] + kernel[k]
+     * @param numOutputs the number of outputs
+     */
+    void (*maxPlusCorrelation) (const double* input, const double* kernel, int kernelLength, double* output, int numOutputs);
+
+    /** Raise each of a set of running maxima to the product of a value and its weight, if that is larger.
+     * Used to find weighted maxima across many beat trackers at once, one per element
+     * @param values the values
+     * @param weights the weight for each value
+     * @param maxima the running maxima, which are updated
+     * @param numValues the number of values
+     */
+    void (*accumulateWeightedMaximum) (const double* values, const double* weights, double* maxima, int numValues);
+
+    /** Raise each of a set of running maxima to the sum of a value and an offset, if that is larger.
+     * Used to make the Viterbi update across many beat trackers at once, one per element
+     * @param values the values
+     * @param offset the offset added to every value
+     * @param maxima the running maxima, which are updated
+     * @param numValues the number of values
+     */
+    void (*accumulateMaxPlus) (const double* values, double offset, double* maxima, int numValues);
+
+    /** Calculate the unit phasor (the complex spectrum divided by its magnitude) of each bin.
+     * Bins with zero magnitude are given the phasor (1, 0), i.e. a phase of zero
+     * @param complexSpectrum the interleaved complex spectrum
+     * @param magnitudeSpectrum the magnitude spectrum
+     * @param phasorReal the array to write the real parts of the phasors to
+     * @param phasorImag the array to write the imaginary parts of the phasors to
+     * @param numBins the number of bins
+     */
+    void (*unitPhasors) (const double* complexSpectrum, const double* magnitudeSpectrum, double* phasorReal, double* phasorImag, int numBins);
+
+    /** Calculate the complex spectral difference in the complex domain, predicting each bin from the
+     * unit phasors of the previous two spectra
+     * @param complexSpectrum the interleaved complex spectrum
+     * @param magnitudeSpectrum the magnitude spectrum
+     * @param prevMagnitudeSpectrum the previous magnitude spectrum
+     * @param prevPhasorReal the real parts of the previous unit phasors
+     * @param prevPhasorImag the imaginary parts of the previous unit phasors
+     * @param prevPhasor2Real the real parts of the second previous unit phasors
+     * @param prevPhasor2Imag the imaginary parts of the second previous unit phasors
+     * @param weights the weight for each bin
+     * @param numBins the number of bins
+     * @param halfWaveRectify if true, only bins with a rise in magnitude contribute to the sum
+     * @returns the weighted sum of the distances between each bin and its prediction
+     */
+    double (*complexSpectralDifference) (const double* complexSpectrum, const double* magnitudeSpectrum, const double* prevMagnitudeSpectrum,
+                                         const double* prevPhasorReal, const double* prevPhasorImag, const double* prevPhasor2Real, const double* prevPhasor2Imag,
+                                         const double* weights, int numBins, bool halfWaveRectify);
+
+    /** Multiply a matrix by a sparse matrix stored as for sparseMatrixVector(). The input and output
+     * are stored row by row, so that each column can be, e.g., the vector of a different beat tracker.
+     * Each column is rounded exactly as sparseMatrixVector() of the same kernel type rounds a vector
+     * @param indices the input row of each entry
+     * @param coefficients the value of each entry
+     * @param numRows the number of rows
+     * @param numEntriesPerRow the number of entries in each row
+     * @param input the matrix to multiply, where column c of row i is at (i * numColumns) + c
+     * @param numColumns the number of columns of the input and output
+     * @param output the array to write the numRows rows of numColumns results to
+     */
+    void (*sparseMatrixMatrix) (const int* indices, const double* coefficients, int numRows, int numEntriesPerRow,
+                                const double* input, int numColumns, double* output);
+
+    /** Perform one stage of radix 2 butterflies, as Kiss FFT's kf_bfly2 does, on every lane at once, in place
+     * @param values the rows of every lane, each 2 * laneStride values long
+     * @param laneStride the number of values from the real parts of a row to its imaginary parts
+     * @param numLanes the number of lanes
+     * @param numBlocks the number of blocks of 2 * m rows to transform, one after another
+     * @param m the number of butterflies in each block
+     * @param twiddles the twiddle factor of each of the m butterflies, as (real, imaginary) pairs
+     */
+    void (*radix2Butterflies) (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles);
+
+    /** Perform one stage of radix 4 butterflies, as Kiss FFT's kf_bfly4 does, on every lane at once, in place
+     * @param values the rows of every lane, each 2 * laneStride values long
+     * @param laneStride the number of values from the real parts of a row to its imaginary parts
+     * @param numLanes the number of lanes
+     * @param numBlocks the number of blocks of 4 * m rows to transform, one after another
+     * @param m the number of butterflies in each block
+     * @param twiddles the three twiddle factors of each of the m butterflies, as (real, imaginary) pairs
+     * @param inverse true if the FFT is an inverse FFT
+     */
+    void (*radix4Butterflies) (float* values, int laneStride, int numLanes, int numBlocks, int m, const float* twiddles, bool inverse);
+
+    /** The number of lanes of floats that the butterfly kernels process at once, so that batches
+     * can be padded to a multiple of it rather than leaving lanes to the scalar remainder */
+    int numFloatLanes;
+
+    //=======================================================================
+    /** @returns true if the processor we are running on supports the given kernel type
+     * @param spectralKernelType the kernel type (see SpectralKernelType)
+     */
+    static bool isSupported (int spectralKernelType);
+
+    /** @returns the given kernel type if the processor we are running on supports it,
+     * otherwise the fastest supported type below it
+     * @param spectralKernelType the kernel type (see SpectralKernelType)
+     */
+    static int getNearestSupportedType (int spectralKernelType);
+
+    /** @returns the fastest kernel type that the processor we are running on supports */
+    static int getFastestSupportedType();
+
+    /** @returns the kernels for the nearest supported type to the one given
+     * @param spectralKernelType the kernel type (see SpectralKernelType)
+     */
+    static const SpectralKernels& get (int spectralKernelType);
+};
+
+#endif
@@ -0,0 +1,144 @@
+//=======================================================================
+/** @file StageTiming.h
+ *  @brief Optional counters of the time spent in each stage of processing
+ *  @author Adam Stark
+ *  @copyright Copyright (C) 2008-2014  Queen Mary University of London
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//=======================================================================
+
+#ifndef __STAGETIMING_H
+#define __STAGETIMING_H
+
+#ifdef BTRACK_STAGE_TIMING
+#include <atomic>
+#include <chrono>
+#endif
+
+//=======================================================================
+/** The time spent in one stage of processing */
+struct StageTimingStatistics
+{
+    unsigned long long numCalls;            /**< the number of times the stage has run */
+    unsigned long long totalNanoseconds;    /**< the total time spent in the stage */
+    unsigned long long maxNanoseconds;      /**< the longest time the stage has taken */
+};
+
+//=======================================================================
+/** The time spent in each stage of beat tracking. Timing is only done when compiled
+ * with the flag -DBTRACK_STAGE_TIMING, otherwise every value is zero.
+ */
+struct TimingStatistics
+{
+    StageTimingStatistics onsetDetectionFunctionFFT;        /**< the FFT of each audio frame */
+    StageTimingStatistics onsetDetectionFunctionReduction;  /**< reducing each spectrum to detection function samples */
+    StageTimingStatistics cumulativeScore;                  /**< updateCumulativeScore() */
+    StageTimingStatistics beatPrediction;                   /**< predictBeat() */
+    StageTimingStatistics resampling;                       /**< resampleOnsetDetectionFunction() */
+
+    /** the autocorrelation function. This is calculated in two steps, the power spectrum and its
+     * inverse FFT, which are counted as separate calls */
+    StageTimingStatistics autocorrelation;
+
+    StageTimingStatistics combFilterBank;                   /**< calculateOutputOfCombFilterBank() */
+    StageTimingStatistics viterbi;                          /**< the Viterbi update of the tempo state */
+};
+
+#ifdef BTRACK_STAGE_TIMING
+
+//=======================================================================
+/** Accumulates the time spent in one stage of processing. Times are added by the thread
+ * running the stage and can be read by any other thread. The three values are read
+ * separately, so a reading made while the stage runs may be one call out of step.
+ */
+class StageTimingCounter
+{
+public:
+    StageTimingCounter()
+    {
+        reset();
+    }
+
+    /** Add one call to the counter
+     * @param nanoseconds the time the call took
+     */
+    void addCall (unsigned long long nanoseconds)
+    {
+        numCalls.fetch_add (1, std::memory_order_relaxed);
+        totalNanoseconds.fetch_add (nanoseconds, std::memory_order_relaxed);
+
+        unsigned long long currentMax = maxNanoseconds.load (std::memory_order_relaxed);
+
+        while (nanoseconds > currentMax && !maxNanoseconds.compare_exchange_weak (currentMax, nanoseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /** @returns the time spent in the stage so far */
+    StageTimingStatistics getStatistics() const
+    {
+        StageTimingStatistics statistics;
+        statistics.numCalls = numCalls.load (std::memory_order_relaxed);
+        statistics.totalNanoseconds = totalNanoseconds.load (std::memory_order_relaxed);
+        statistics.maxNanoseconds = maxNanoseconds.load (std::memory_order_relaxed);
+        return statistics;
+    }
+
+    /** Set every value back to zero */
+    void reset()
+    {
+        numCalls.store (0, std::memory_order_relaxed);
+        totalNanoseconds.store (0, std::memory_order_relaxed);
+        maxNanoseconds.store (0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<unsigned long long> numCalls;
+    std::atomic<unsigned long long> totalNanoseconds;
+    std::atomic<unsigned long long> maxNanoseconds;
+};
+
+//=======================================================================
+/** Adds the time between its creation and destruction to a StageTimingCounter */
+class ScopedStageTimer
+{
+public:
+    ScopedStageTimer (StageTimingCounter& counter_)
+     :  counter (counter_),
+        startTime (std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedStageTimer()
+    {
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - startTime;
+        counter.addCall ((unsigned long long) std::chrono::duration_cast<std::chrono::nanoseconds> (elapsed).count());
+    }
+
+private:
+    StageTimingCounter& counter;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+/** Time the rest of the enclosing scope, adding it to the given StageTimingCounter */
+#define BTRACK_TIME_STAGE(counter) ScopedStageTimer scopedStageTimer (counter)
+
+#else
+
+#define BTRACK_TIME_STAGE(counter)
+
+#endif
+
+#endif
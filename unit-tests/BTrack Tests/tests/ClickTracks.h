@@ -0,0 +1,57 @@
+#ifndef CLICK_TRACKS_H
+#define CLICK_TRACKS_H
+
+#include <vector>
+#include <cstdlib>
+
+//======================================================================
+// creates an onset detection function of clicks at the given tempo, over low level noise
+inline std::vector<double> createClickTrackODF (double tempo, int hopSize, int numSamples)
+{
+    std::vector<double> odf;
+
+    double beatPeriod = (60. / tempo) * 44100. / hopSize;
+    double nextClick = 0;
+
+    for (int i = 0;i < numSamples;i++)
+    {
+        double sample = ((double) (random() % 1000)) / 100.;
+
+        if (i >= nextClick)
+        {
+            sample += 1000;
+            nextClick += beatPeriod;
+        }
+
+        odf.push_back (sample);
+    }
+
+    return odf;
+}
+
+//======================================================================
+// creates audio of clicks at the given tempo, over low level noise, with part of a hop left over at the end
+inline std::vector<double> createClickTrackAudio (double tempo, int hopSize, int numHops)
+{
+    std::vector<double> audio;
+
+    double beatLength = (60. / tempo) * 44100.;
+    double nextClick = 0;
+
+    for (int i = 0;i < numHops * hopSize + hopSize / 3;i++)
+    {
+        double sample = 0.01 * (((double) (random() % 1000)) / 500. - 1.);
+
+        if (i >= nextClick)
+        {
+            sample += 0.9;
+            nextClick += beatLength;
+        }
+
+        audio.push_back (sample);
+    }
+
+    return audio;
+}
+
+#endif
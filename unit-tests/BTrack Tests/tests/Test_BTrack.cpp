@@ -5,7 +5,95 @@
 #include <boost/test/unit_test.hpp>
 
 #include <iostream>
+#include <cmath>
+#include <atomic>
+#include <new>
+#include <cstdlib>
 #include "../../../src/BTrack.h"
+#include "ClickTracks.h"
+
+//======================================================================
+//===================== COUNTING ALLOCATIONS ===========================
+//======================================================================
+
+// while this is true, every allocation made by the program is counted
+static std::atomic<bool> countingAllocations (false);
+static std::atomic<long> numAllocations (0);
+
+static void countAllocation()
+{
+    if (countingAllocations.load())
+    {
+        numAllocations++;
+    }
+}
+
+void* operator new (std::size_t size)
+{
+    countAllocation();
+    
+    void* p = std::malloc (size == 0 ? 1 : size);
+    
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    
+    return p;
+}
+
+void* operator new[] (std::size_t size)
+{
+    return operator new (size);
+}
+
+// gcc does not realise that operator new above is where the memory came from
+#if defined (__GNUC__) && !defined (__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete (void* p) noexcept
+{
+    std::free (p);
+}
+
+void operator delete[] (void* p) noexcept
+{
+    std::free (p);
+}
+
+#if defined (__GNUC__) && !defined (__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#if defined (__GLIBC__)
+// with glibc we can also catch the C allocations made by the FFT libraries
+extern "C"
+{
+    void* __libc_malloc (size_t size);
+    void* __libc_calloc (size_t num, size_t size);
+    void* __libc_realloc (void* p, size_t size);
+    
+    void* malloc (size_t size)
+    {
+        countAllocation();
+        return __libc_malloc (size);
+    }
+    
+    void* calloc (size_t num, size_t size)
+    {
+        countAllocation();
+        return __libc_calloc (num, size);
+    }
+    
+    void* realloc (void* p, size_t size)
+    {
+        countAllocation();
+        return __libc_realloc (p, size);
+    }
+}
+#endif
 
 //======================================================================
 //==================== CHECKING INITIALISATION =========================
@@ -87,6 +175,74 @@ BOOST_AUTO_TEST_CASE(processZeroValuedOnsetDetectionFunctionSamples)
     
 }
 
+//======================================================================
+// once the onset detection function buffer holds nothing but silence there is no evidence
+// for any tempo, so the tempo estimate should stay where it was, rather than falling back
+// to the slowest tempo
+BOOST_AUTO_TEST_CASE(zeroValuedOnsetDetectionFunctionKeepsTheInitialTempo)
+{
+    BTrack b(512);
+    
+    double initialTempo = b.getCurrentTempoEstimate();
+    
+    // fill the onset detection function buffer with silence
+    for (int i = 0;i < 1024;i++)
+    {
+        b.processOnsetDetectionFunctionSample (0.0);
+    }
+    
+    double silentTempo = b.getCurrentTempoEstimate();
+    
+    // the step from the empty buffer to silence may move the estimate by one tempo state at most
+    BOOST_CHECK_CLOSE (silentTempo, initialTempo, 3.0);
+    
+    for (int i = 0;i < 5000;i++)
+    {
+        b.processOnsetDetectionFunctionSample (0.0);
+        
+        BOOST_REQUIRE_EQUAL (b.getCurrentTempoEstimate(), silentTempo);
+    }
+}
+
+//======================================================================
+// silence part way through a signal should keep the tempo estimate, rather than falling
+// back to the slowest tempo, and tracking should pick up again once the silence ends
+BOOST_AUTO_TEST_CASE(silenceKeepsTheTempoEstimate)
+{
+    BTrack b(512);
+    
+    int beatPeriods[] = {43, 52};
+    double slowestTempo = 60. / ((512. / 44100.) * round ((60. * 44100.) / (80. * 512.)));
+    
+    for (int k = 0;k < 2;k++)
+    {
+        for (int i = 0;i < 2000;i++)
+        {
+            b.processOnsetDetectionFunctionSample ((i % beatPeriods[k] == 0) ? 1000 : 0.0);
+        }
+        
+        // within one tempo state of the clicks
+        BOOST_CHECK_CLOSE (b.getCurrentTempoEstimate(), 60. / ((512. / 44100.) * beatPeriods[k]), 3.0);
+        
+        // let the clicks leave the onset detection function buffer
+        for (int i = 0;i < 1024;i++)
+        {
+            b.processOnsetDetectionFunctionSample (0.0);
+        }
+        
+        double silentTempo = b.getCurrentTempoEstimate();
+        
+        BOOST_CHECK (silentTempo != slowestTempo);
+        
+        for (int i = 0;i < 5000;i++)
+        {
+            b.processOnsetDetectionFunctionSample (0.0);
+            
+            BOOST_REQUIRE_EQUAL (b.getCurrentTempoEstimate(), silentTempo);
+        }
+    }
+}
+
 //======================================================================
 BOOST_AUTO_TEST_CASE(processRandomOnsetDetectionFunctionSamples)
 {
@@ -243,6 +399,686 @@ BOOST_AUTO_TEST_CASE(processSeriesOfDeltaFunctions)
 }
 
 
+//======================================================================
+// the onset detection function is resampled to a fixed length for tempo estimation,
+// so check that a click track is tracked whether it is shrunk, stretched or left as it is
+BOOST_AUTO_TEST_CASE(processSeriesOfDeltaFunctionsAtDifferentHopSizes)
+{
+    int hopSizes[] = {128, 256, 441, 512, 1024};
+    
+    for (int h = 0;h < 5;h++)
+    {
+        BTrack b(hopSizes[h]);
+        
+        // 120 beats per minute, in onset detection function samples
+        double beatPeriod = (60. / 120.) * 44100. / hopSizes[h];
+        long numSamples = (long) (60 * 44100 / hopSizes[h]);
+        double nextClick = 0;
+        
+        int currentInterval = 0;
+        int numBeats = 0;
+        int correct = 0;
+        
+        for (int i = 0;i < numSamples;i++)
+        {
+            if (i >= nextClick)
+            {
+                b.processOnsetDetectionFunctionSample(1000);
+                nextClick += beatPeriod;
+            }
+            else
+            {
+                b.processOnsetDetectionFunctionSample(0.0);
+            }
+            
+            currentInterval++;
+            
+            if (b.beatDueInCurrentFrame())
+            {
+                numBeats++;
+                
+                if (fabs (currentInterval - beatPeriod) <= 1.5)
+                {
+                    correct++;
+                }
+                
+                currentInterval = 0;
+            }
+        }
+        
+        // check that there is roughly one beat per click
+        BOOST_CHECK(numBeats > 110);
+        BOOST_CHECK(numBeats < 130);
+        
+        // check that nearly all of the beats are a beat period apart
+        BOOST_CHECK(((double)correct) > (((double)numBeats)*0.95));
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(processSeriesOfDeltaFunctionsAtDifferentSampleRates)
+{
+    int sampleRates[] = {22050, 32000, 48000, 96000};
+    
+    for (int k = 0;k < 4;k++)
+    {
+        BTrack b(512, 1024, sampleRates[k]);
+        
+        BOOST_CHECK_EQUAL(b.getSampleRate(), sampleRates[k]);
+        
+        // 120 beats per minute, in onset detection function samples
+        double beatPeriod = (60. / 120.) * sampleRates[k] / 512.;
+        long numSamples = (long) (60 * sampleRates[k] / 512);
+        double nextClick = 0;
+        
+        int currentInterval = 0;
+        int numBeats = 0;
+        int correct = 0;
+        
+        for (int i = 0;i < numSamples;i++)
+        {
+            if (i >= nextClick)
+            {
+                b.processOnsetDetectionFunctionSample(1000);
+                nextClick += beatPeriod;
+            }
+            else
+            {
+                b.processOnsetDetectionFunctionSample(0.0);
+            }
+            
+            currentInterval++;
+            
+            if (b.beatDueInCurrentFrame())
+            {
+                numBeats++;
+                
+                if (fabs (currentInterval - beatPeriod) <= 1.5)
+                {
+                    correct++;
+                }
+                
+                currentInterval = 0;
+            }
+        }
+        
+        // check that there is roughly one beat per click
+        BOOST_CHECK(numBeats > 110);
+        BOOST_CHECK(numBeats < 130);
+        
+        // check that nearly all of the beats are a beat period apart
+        BOOST_CHECK(((double)correct) > (((double)numBeats)*0.95));
+        
+        // check that the tempo is in beats per minute at this sample rate
+        BOOST_CHECK(fabs(b.getCurrentTempoEstimate() - 120.) < 4.);
+    }
+    
+    BTrack b;
+    
+    BOOST_CHECK_EQUAL(b.getSampleRate(), 44100);
+    
+    b.updateSampleRate(48000);
+    
+    BOOST_CHECK_EQUAL(b.getSampleRate(), 48000);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(processSeriesOfDeltaFunctionsWithAmortisedTempoEstimation)
+{
+    int hopSizes[] = {128, 512, 1024};
+    
+    for (int h = 0;h < 3;h++)
+    {
+        BTrack allAtOnce(hopSizes[h]);
+        BTrack amortised(hopSizes[h]);
+        
+        BOOST_CHECK(!allAtOnce.isTempoEstimationAmortised());
+        
+        amortised.setAmortisedTempoEstimation(true);
+        
+        BOOST_CHECK(amortised.isTempoEstimationAmortised());
+        
+        // 120 beats per minute, in onset detection function samples
+        double beatPeriod = (60. / 120.) * 44100. / hopSizes[h];
+        long numSamples = (long) (60 * 44100 / hopSizes[h]);
+        double nextClick = 0;
+        
+        int currentInterval = 0;
+        int numBeats = 0;
+        int correct = 0;
+        
+        for (int i = 0;i < numSamples;i++)
+        {
+            double sample = 0.0;
+            
+            if (i >= nextClick)
+            {
+                sample = 1000;
+                nextClick += beatPeriod;
+            }
+            
+            allAtOnce.processOnsetDetectionFunctionSample(sample);
+            amortised.processOnsetDetectionFunctionSample(sample);
+            
+            currentInterval++;
+            
+            if (amortised.beatDueInCurrentFrame())
+            {
+                numBeats++;
+                
+                if (fabs (currentInterval - beatPeriod) <= 1.5)
+                {
+                    correct++;
+                }
+                
+                currentInterval = 0;
+            }
+        }
+        
+        // check that there is roughly one beat per click
+        BOOST_CHECK(numBeats > 110);
+        BOOST_CHECK(numBeats < 130);
+        
+        // check that nearly all of the beats are a beat period apart
+        BOOST_CHECK(((double)correct) > (((double)numBeats)*0.95));
+        
+        // check that spreading out the estimates arrives at the same tempo
+        BOOST_CHECK_EQUAL(amortised.getCurrentTempoEstimate(), allAtOnce.getCurrentTempoEstimate());
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(processSeriesOfDeltaFunctionsWithAsynchronousTempoEstimation)
+{
+    BTrack b;
+    
+    BOOST_CHECK(!b.isTempoEstimationAsynchronous());
+    
+    b.setAsynchronousTempoEstimation(true);
+    
+    BOOST_CHECK(b.isTempoEstimationAsynchronous());
+    
+    // 100 beats per minute, so that the tempo has to move away from where it starts
+    double beatPeriod = (60. / 100.) * 44100. / 512.;
+    long numSamples = (long) (60 * 44100 / 512);
+    double nextClick = 0;
+    
+    int currentInterval = 0;
+    int numBeats = 0;
+    int correct = 0;
+    
+    for (int i = 0;i < numSamples;i++)
+    {
+        if (i >= nextClick)
+        {
+            b.processOnsetDetectionFunctionSample(1000);
+            nextClick += beatPeriod;
+        }
+        else
+        {
+            b.processOnsetDetectionFunctionSample(0.0);
+        }
+        
+        currentInterval++;
+        
+        if (b.beatDueInCurrentFrame())
+        {
+            numBeats++;
+            
+            if (fabs (currentInterval - beatPeriod) <= 1.5)
+            {
+                correct++;
+            }
+            
+            currentInterval = 0;
+            
+            // let the worker finish, as it would have between beats in real time
+            b.waitForTempoWorker();
+        }
+    }
+    
+    // check that there is roughly one beat per click
+    BOOST_CHECK(numBeats > 90);
+    BOOST_CHECK(numBeats < 110);
+    
+    // check that nearly all of the beats are a beat period apart
+    BOOST_CHECK(((double)correct) > (((double)numBeats)*0.9));
+    
+    BOOST_CHECK(fabs(b.getCurrentTempoEstimate() - 100.) < 3.);
+    
+    // the worker can be stopped and restarted, including mid-estimate
+    b.setAsynchronousTempoEstimation(false);
+    BOOST_CHECK(!b.isTempoEstimationAsynchronous());
+    
+    b.setAsynchronousTempoEstimation(true);
+    b.setTempo(120);
+    b.processOnsetDetectionFunctionSample(1000);
+    b.updateHopAndFrameSize(256, 512);
+    b.processOnsetDetectionFunctionSample(1000);
+}
+
+//======================================================================
+// with time to finish each estimate, the worker should give exactly the same beats and
+// tempi as estimating the tempo on the beat, including after the tempo is set and fixed
+BOOST_AUTO_TEST_CASE(asynchronousTempoEstimationMatchesEstimatingOnTheBeat)
+{
+    BTrack onTheBeat;
+    BTrack asynchronous;
+    
+    asynchronous.setAsynchronousTempoEstimation(true);
+    
+    std::vector<double> odf = createClickTrackODF (100, 512, 6000);
+    
+    for (int i = 0;i < (int) odf.size();i++)
+    {
+        if (i == 2000)
+        {
+            onTheBeat.setTempo(130);
+            asynchronous.setTempo(130);
+        }
+        else if (i == 3000)
+        {
+            onTheBeat.fixTempo(90);
+            asynchronous.fixTempo(90);
+        }
+        else if (i == 4000)
+        {
+            onTheBeat.doNotFixTempo();
+            asynchronous.doNotFixTempo();
+        }
+        
+        onTheBeat.processOnsetDetectionFunctionSample(odf[i]);
+        asynchronous.processOnsetDetectionFunctionSample(odf[i]);
+        
+        asynchronous.waitForTempoWorker();
+        
+        BOOST_REQUIRE_EQUAL(asynchronous.beatDueInCurrentFrame(), onTheBeat.beatDueInCurrentFrame());
+        BOOST_REQUIRE_EQUAL(asynchronous.getCurrentTempoEstimate(), onTheBeat.getCurrentTempoEstimate());
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(tempoTransitionBandwidthCanBeChanged)
+{
+    BTrack b;
+    
+    BOOST_CHECK_EQUAL(b.getTempoTransitionBandwidth(), 20);
+    
+    b.setTempoTransitionBandwidth(100);
+    BOOST_CHECK_EQUAL(b.getTempoTransitionBandwidth(), 40);
+    
+    b.setTempoTransitionBandwidth(-1);
+    BOOST_CHECK_EQUAL(b.getTempoTransitionBandwidth(), 0);
+    
+    int bandwidths[] = {3, 20, 40};
+    
+    for (int k = 0;k < 3;k++)
+    {
+        BTrack b2;
+        b2.setTempoTransitionBandwidth(bandwidths[k]);
+        
+        // 120 beats per minute, in onset detection function samples
+        double beatPeriod = (60. / 120.) * 44100. / 512.;
+        double nextClick = 0;
+        
+        for (int i = 0;i < 60 * 44100 / 512;i++)
+        {
+            if (i >= nextClick)
+            {
+                b2.processOnsetDetectionFunctionSample(1000);
+                nextClick += beatPeriod;
+            }
+            else
+            {
+                b2.processOnsetDetectionFunctionSample(0.0);
+            }
+        }
+        
+        // the tempo states are 2 bpm apart
+        BOOST_CHECK(fabs(b2.getCurrentTempoEstimate() - 120.) < 3.);
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(tempoRangeAndResolutionCanBeChanged)
+{
+    BTrack defaultStates;
+    
+    BOOST_CHECK_EQUAL(defaultStates.getNumTempoStates(), 41);
+    BOOST_CHECK_EQUAL(defaultStates.getMinTempo(), 80);
+    BOOST_CHECK_EQUAL(defaultStates.getMaxTempo(), 160);
+    
+    BTrack b(512, 1024, 60, 200, 0.5);
+    
+    BOOST_CHECK_EQUAL(b.getNumTempoStates(), 281);
+    BOOST_CHECK_EQUAL(b.getTempoResolution(), 0.5);
+    
+    // 65 beats per minute, which is below the default range
+    double beatPeriod = (60. / 65.) * 44100. / 512.;
+    double nextClick = 0;
+    
+    for (int i = 0;i < 60 * 44100 / 512;i++)
+    {
+        if (i >= nextClick)
+        {
+            b.processOnsetDetectionFunctionSample(1000);
+            nextClick += beatPeriod;
+        }
+        else
+        {
+            b.processOnsetDetectionFunctionSample(0.0);
+        }
+    }
+    
+    // the estimate is limited by the beat period being a whole number of detection function samples
+    BOOST_CHECK(fabs(b.getCurrentTempoEstimate() - 65.) < 1.);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(timingStatisticsCountEachStage)
+{
+    BTrack b;
+    
+    std::vector<double> hop (512, 0.0);
+    
+    for (int i = 0;i < 2000;i++)
+    {
+        hop[0] = (i % 43 == 0) ? 1.0 : 0.0;
+        b.processAudioFrame (&hop[0]);
+    }
+    
+    TimingStatistics statistics = b.getTimingStatistics();
+    
+    const StageTimingStatistics* stages[] = {&statistics.onsetDetectionFunctionFFT, &statistics.onsetDetectionFunctionReduction,
+                                             &statistics.cumulativeScore, &statistics.beatPrediction, &statistics.resampling,
+                                             &statistics.autocorrelation, &statistics.combFilterBank, &statistics.viterbi};
+    
+#ifdef BTRACK_STAGE_TIMING
+    // the per-frame stages run once per frame, and the tempo stages at least once
+    BOOST_CHECK_EQUAL(statistics.onsetDetectionFunctionFFT.numCalls, 2000);
+    BOOST_CHECK_EQUAL(statistics.onsetDetectionFunctionReduction.numCalls, 2000);
+    BOOST_CHECK_EQUAL(statistics.cumulativeScore.numCalls, 2000);
+    BOOST_CHECK_EQUAL(statistics.autocorrelation.numCalls, 2 * statistics.combFilterBank.numCalls);
+    
+    for (int i = 0;i < 8;i++)
+    {
+        BOOST_CHECK(stages[i]->numCalls > 0);
+        BOOST_CHECK(stages[i]->maxNanoseconds <= stages[i]->totalNanoseconds);
+    }
+#else
+    // without timing compiled in, nothing is counted
+    for (int i = 0;i < 8;i++)
+    {
+        BOOST_CHECK_EQUAL(stages[i]->numCalls, 0);
+        BOOST_CHECK_EQUAL(stages[i]->totalNanoseconds, 0);
+    }
+#endif
+    
+    b.resetTimingStatistics();
+    
+    BOOST_CHECK_EQUAL(b.getTimingStatistics().cumulativeScore.numCalls, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+
+
+//======================================================================
+//================= PROCESSING WITHOUT ALLOCATING ======================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(processingWithoutAllocating)
+
+//======================================================================
+/** Process a click track at 120 bpm through a beat tracker, counting any allocations
+ * made during processing
+ * @returns the number of allocations made
+ */
+static long countAllocationsWhileProcessing (BTrack& b, int hopSize, bool useAudio)
+{
+    std::vector<double> frame (hopSize, 0.0);
+    
+    double beatPeriod = (60. / 120.) * 44100. / hopSize;
+    long numSamples = (long) (20 * 44100 / hopSize);
+    double nextClick = 0;
+    
+    numAllocations = 0;
+    countingAllocations = true;
+    
+    for (int i = 0;i < numSamples;i++)
+    {
+        double sample = 0.0;
+        
+        if (i >= nextClick)
+        {
+            sample = 1000;
+            nextClick += beatPeriod;
+        }
+        
+        if (useAudio)
+        {
+            // each call takes the next hop of audio: a click at its start, and quiet noise
+            for (int j = 0;j < hopSize;j++)
+            {
+                frame[j] = 0.01 * sin ((i * hopSize + j) * 0.1);
+            }
+            
+            frame[0] += sample / 1000.;
+            
+            b.processAudioFrame (&frame[0]);
+        }
+        else
+        {
+            b.processOnsetDetectionFunctionSample (sample);
+        }
+    }
+    
+    countingAllocations = false;
+    
+    return numAllocations;
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(processingOnsetDetectionFunctionSamplesDoesNotAllocate)
+{
+    BTrack b;
+    BTrack amortised;
+    
+    amortised.setAmortisedTempoEstimation(true);
+    
+    BOOST_CHECK_EQUAL(countAllocationsWhileProcessing (b, 512, false), 0);
+    BOOST_CHECK_EQUAL(countAllocationsWhileProcessing (amortised, 512, false), 0);
+    
+    // check that the tempo was still tracked
+    BOOST_CHECK(fabs (b.getCurrentTempoEstimate() - 120.) < 3.);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(processingAudioFramesDoesNotAllocate)
+{
+    // the second hop size gives FFT sizes with factors other than 2, 3 and 5
+    int hopSizes[] = {512, 441};
+    
+    for (int h = 0;h < 2;h++)
+    {
+        BTrack b (hopSizes[h], hopSizes[h] * 2);
+        BTrack amortised (hopSizes[h], hopSizes[h] * 2);
+        
+        amortised.setAmortisedTempoEstimation(true);
+        
+        BOOST_CHECK_EQUAL(countAllocationsWhileProcessing (b, hopSizes[h], true), 0);
+        BOOST_CHECK_EQUAL(countAllocationsWhileProcessing (amortised, hopSizes[h], true), 0);
+        
+        // check that the clicks were tracked
+        BOOST_CHECK(fabs (b.getCurrentTempoEstimate() - 120.) < 3.);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+
+//======================================================================
+//===================== TRACKING WHOLE SIGNALS =========================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(trackingWholeSignals)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(wholeAudioSignalGivesTheSameBeatsAsHopByHop)
+{
+    int hopSize = 512;
+    int numHops = 2000;
+    
+    std::vector<double> audio = createClickTrackAudio (120., hopSize, numHops);
+    std::vector<float> floatAudio (audio.begin(), audio.end());
+    
+    BTrack hopByHop (hopSize, 2 * hopSize);
+    BTrack floatHopByHop (hopSize, 2 * hopSize);
+    std::vector<long> expectedBeats;
+    std::vector<long> expectedFloatBeats;
+    std::vector<double> expectedTempi;
+    std::vector<double> expectedFloatTempi;
+    
+    for (int i = 0;i < numHops;i++)
+    {
+        std::vector<double> hop (&audio[i * hopSize], &audio[(i + 1) * hopSize]);
+        std::vector<double> floatHop (&floatAudio[i * hopSize], &floatAudio[(i + 1) * hopSize]);
+        
+        hopByHop.processAudioFrame (&hop[0]);
+        floatHopByHop.processAudioFrame (&floatHop[0]);
+        
+        if (hopByHop.beatDueInCurrentFrame())
+        {
+            expectedBeats.push_back (i);
+        }
+        
+        if (floatHopByHop.beatDueInCurrentFrame())
+        {
+            expectedFloatBeats.push_back (i);
+        }
+        
+        expectedTempi.push_back (hopByHop.getCurrentTempoEstimate());
+        expectedFloatTempi.push_back (floatHopByHop.getCurrentTempoEstimate());
+    }
+    
+    BTrack whole (hopSize, 2 * hopSize);
+    BTrack floatWhole (hopSize, 2 * hopSize);
+    std::vector<long> beats (1, -1);
+    std::vector<long> floatBeats;
+    std::vector<double> tempi;
+    std::vector<double> floatTempi;
+    
+    whole.trackBeats (&audio[0], (long) audio.size(), beats, tempi);
+    floatWhole.trackBeats (&floatAudio[0], (long) floatAudio.size(), floatBeats, floatTempi);
+    
+    BOOST_CHECK (expectedBeats.size() > 40);
+    BOOST_CHECK (beats == expectedBeats);
+    BOOST_CHECK (tempi == expectedTempi);
+    BOOST_CHECK (floatBeats == expectedFloatBeats);
+    BOOST_CHECK (floatTempi == expectedFloatTempi);
+    BOOST_CHECK (fabs (tempi.back() - 120.) < 3.);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(beatsThatDoNotFitAreCountedButNotWritten)
+{
+    int hopSize = 512;
+    int numHops = 1000;
+    
+    std::vector<double> audio = createClickTrackAudio (120., hopSize, numHops);
+    
+    BTrack all (hopSize, 2 * hopSize);
+    BTrack someOf (hopSize, 2 * hopSize);
+    std::vector<long> allBeats (numHops);
+    long someBeats[5] = {-1, -1, -1, -1, -1};
+    
+    long numBeats = all.trackBeats (&audio[0], (long) audio.size(), &allBeats[0], numHops, NULL);
+    
+    BOOST_CHECK (numBeats > 5);
+    BOOST_CHECK_EQUAL (someOf.trackBeats (&audio[0], (long) audio.size(), someBeats, 4, NULL), numBeats);
+    
+    for (int i = 0;i < 4;i++)
+    {
+        BOOST_CHECK_EQUAL (someBeats[i], allBeats[i]);
+    }
+    
+    BOOST_CHECK_EQUAL (someBeats[4], -1);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(wholeOnsetDetectionFunctionGivesTheSameBeatsAsSampleBySample)
+{
+    int numSamples = 3000;
+    std::vector<double> odf = createClickTrackODF (100., 512, numSamples);
+    
+    BTrack sampleBySample;
+    std::vector<long> expectedBeats;
+    std::vector<double> expectedTempi;
+    
+    for (int i = 0;i < numSamples;i++)
+    {
+        sampleBySample.processOnsetDetectionFunctionSample (odf[i]);
+        
+        if (sampleBySample.beatDueInCurrentFrame())
+        {
+            expectedBeats.push_back (i);
+        }
+        
+        expectedTempi.push_back (sampleBySample.getCurrentTempoEstimate());
+    }
+    
+    BTrack whole;
+    std::vector<long> beats;
+    std::vector<double> tempi;
+    
+    whole.trackBeatsInOnsetDetectionFunction (&odf[0], numSamples, beats, tempi);
+    
+    BOOST_CHECK (expectedBeats.size() > 50);
+    BOOST_CHECK (beats == expectedBeats);
+    BOOST_CHECK (tempi == expectedTempi);
+    BOOST_CHECK (fabs (tempi.back() - 100.) < 3.);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(trackingWholeSignalsDoesNotAllocate)
+{
+    int hopSize = 512;
+    int numHops = 1000;
+    
+    std::vector<double> audio = createClickTrackAudio (120., hopSize, numHops);
+    std::vector<long> beats (numHops);
+    std::vector<double> tempi (numHops);
+    
+    BTrack b (hopSize, 2 * hopSize);
+    
+    numAllocations = 0;
+    countingAllocations = true;
+    
+    long numBeats = b.trackBeats (&audio[0], (long) audio.size(), &beats[0], numHops, &tempi[0]);
+    
+    countingAllocations = false;
+    
+    BOOST_CHECK_EQUAL (numAllocations, 0);
+    BOOST_CHECK (numBeats > 0);
+    
+    // float audio is converted as it is written into the frame, rather than a hop at a time
+    std::vector<float> floatAudio (audio.begin(), audio.end());
+    
+    BTrack floatTracker (hopSize, 2 * hopSize);
+    
+    numAllocations = 0;
+    countingAllocations = true;
+    
+    numBeats = floatTracker.trackBeats (&floatAudio[0], (long) floatAudio.size(), &beats[0], numHops, &tempi[0]);
+    
+    countingAllocations = false;
+    
+    BOOST_CHECK_EQUAL (numAllocations, 0);
+    BOOST_CHECK (numBeats > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 //======================================================================
 //======================================================================
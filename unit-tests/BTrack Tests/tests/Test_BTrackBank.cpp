@@ -0,0 +1,290 @@
+#ifndef BTRACK_BANK_TESTS
+#define BTRACK_BANK_TESTS
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include "../../../src/BTrackBank.h"
+#include "ClickTracks.h"
+
+//======================================================================
+//==================== MATCHING SEPARATE TRACKERS ======================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(matchingSeparateTrackers)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(onsetDetectionFunctionSamplesGiveTheSameBeatsAsSeparateTrackers)
+{
+    int numStreams = 7;
+    int numSamples = 3000;
+
+    BTrackBank bank (numStreams, 512, 1024);
+    std::vector<BTrack*> trackers;
+    std::vector<std::vector<double> > odfs;
+
+    BOOST_CHECK_EQUAL (bank.getNumStreams(), numStreams);
+    BOOST_CHECK_EQUAL (bank.getHopSize(), 512);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        trackers.push_back (new BTrack (512, 1024));
+
+        // a different tempo for each stream, and one stream of only noise
+        odfs.push_back (createClickTrackODF (85. + 10. * s, 512, numSamples));
+    }
+
+    for (int i = 0;i < numSamples;i++)
+    {
+        odfs[numStreams - 1][i] = ((double) (random() % 1000)) / 100.;
+    }
+
+    std::vector<double> samples (numStreams);
+    int numBeats = 0;
+    int numMismatches = 0;
+
+    for (int i = 0;i < numSamples;i++)
+    {
+        for (int s = 0;s < numStreams;s++)
+        {
+            samples[s] = odfs[s][i];
+            trackers[s]->processOnsetDetectionFunctionSample (samples[s]);
+        }
+
+        bank.processOnsetDetectionFunctionSamples (&samples[0]);
+
+        for (int s = 0;s < numStreams;s++)
+        {
+            if (bank.getBeatsDueInCurrentFrame()[s] != trackers[s]->beatDueInCurrentFrame())
+            {
+                numMismatches++;
+            }
+
+            if (bank.getCurrentTempoEstimates()[s] != trackers[s]->getCurrentTempoEstimate())
+            {
+                numMismatches++;
+            }
+
+            if (bank.getBeatsDueInCurrentFrame()[s])
+            {
+                numBeats++;
+            }
+        }
+    }
+
+    BOOST_CHECK_EQUAL (numMismatches, 0);
+    BOOST_CHECK (numBeats > 100);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        delete trackers[s];
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(streamsThatChangeTempoGiveTheSameBeatsAsSeparateTrackers)
+{
+    int numStreams = 8;
+    int numSamples = 4000;
+
+    BTrackBank bank (numStreams, 512, 1024);
+    std::vector<BTrack*> trackers;
+    std::vector<std::vector<double> > odfs;
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        trackers.push_back (new BTrack (512, 1024));
+
+        // the streams start with tempi from slow to fast, and swap to fast to slow half way through
+        std::vector<double> odf = createClickTrackODF (85. + 10. * s, 512, numSamples / 2);
+        std::vector<double> secondHalf = createClickTrackODF (155. - 10. * s, 512, numSamples / 2);
+
+        odf.insert (odf.end(), secondHalf.begin(), secondHalf.end());
+        odfs.push_back (odf);
+    }
+
+    std::vector<double> samples (numStreams);
+    int numMismatches = 0;
+
+    for (int i = 0;i < numSamples;i++)
+    {
+        for (int s = 0;s < numStreams;s++)
+        {
+            samples[s] = odfs[s][i];
+            trackers[s]->processOnsetDetectionFunctionSample (samples[s]);
+        }
+
+        bank.processOnsetDetectionFunctionSamples (&samples[0]);
+
+        for (int s = 0;s < numStreams;s++)
+        {
+            if (bank.getBeatsDueInCurrentFrame()[s] != trackers[s]->beatDueInCurrentFrame())
+            {
+                numMismatches++;
+            }
+
+            if (bank.getCurrentTempoEstimates()[s] != trackers[s]->getCurrentTempoEstimate())
+            {
+                numMismatches++;
+            }
+        }
+    }
+
+    BOOST_CHECK_EQUAL (numMismatches, 0);
+
+    // the streams have really changed tempo, past each other
+    BOOST_CHECK (bank.getCurrentTempoEstimates()[0] > bank.getCurrentTempoEstimates()[numStreams - 1]);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        delete trackers[s];
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(manyStreamsOnTheSameBeatGiveTheSameBeatsAsSeparateTrackers)
+{
+    int numStreams = 24;
+    int numSynchronisedStreams = 20;
+    int numSamples = 3000;
+
+    BTrackBank bank (numStreams, 512, 1024);
+    std::vector<BTrack*> trackers;
+    std::vector<std::vector<double> > odfs;
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        trackers.push_back (new BTrack (512, 1024));
+
+        // most streams share a tempo and phase, so that their beats and tempo estimates fall on the same
+        // frames and are calculated side by side, and the rest have tempi of their own
+        if (s < numSynchronisedStreams)
+        {
+            odfs.push_back (createClickTrackODF (120., 512, numSamples));
+        }
+        else
+        {
+            odfs.push_back (createClickTrackODF (90. + 15. * (s - numSynchronisedStreams), 512, numSamples));
+        }
+
+        // with a little noise of their own, so that no two streams are the same
+        for (int i = 0;i < numSamples;i++)
+        {
+            odfs[s][i] += ((double) (random() % 1000)) / 1000.;
+        }
+    }
+
+    std::vector<double> samples (numStreams);
+    int numBeats = 0;
+    int numMismatches = 0;
+
+    for (int i = 0;i < numSamples;i++)
+    {
+        for (int s = 0;s < numStreams;s++)
+        {
+            samples[s] = odfs[s][i];
+            trackers[s]->processOnsetDetectionFunctionSample (samples[s]);
+        }
+
+        bank.processOnsetDetectionFunctionSamples (&samples[0]);
+
+        for (int s = 0;s < numStreams;s++)
+        {
+            if (bank.getBeatsDueInCurrentFrame()[s] != trackers[s]->beatDueInCurrentFrame())
+            {
+                numMismatches++;
+            }
+
+            if (bank.getCurrentTempoEstimates()[s] != trackers[s]->getCurrentTempoEstimate())
+            {
+                numMismatches++;
+            }
+
+            if (bank.getBeatsDueInCurrentFrame()[s])
+            {
+                numBeats++;
+            }
+        }
+    }
+
+    BOOST_CHECK_EQUAL (numMismatches, 0);
+    BOOST_CHECK (numBeats > 50 * numSynchronisedStreams);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        delete trackers[s];
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(audioGivesTheSameBeatsAsSeparateTrackers)
+{
+    int numStreams = 3;
+    int hopSize = 441;
+    int numHops = 2000;
+
+    BTrackBank bank (numStreams, hopSize, 2 * hopSize, 44100, 60, 180, 1);
+    std::vector<BTrack*> trackers;
+    std::vector<std::vector<double> > hops (numStreams, std::vector<double> (hopSize));
+    std::vector<double*> hopPointers;
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        trackers.push_back (new BTrack (hopSize, 2 * hopSize, 44100, 60, 180, 1));
+        hopPointers.push_back (&hops[s][0]);
+    }
+
+    int numMismatches = 0;
+
+    for (int i = 0;i < numHops;i++)
+    {
+        for (int s = 0;s < numStreams;s++)
+        {
+            // decaying noise bursts at a different tempo in each stream
+            double beatLength = 44100. * 60. / (100. + 15. * s);
+
+            for (int j = 0;j < hopSize;j++)
+            {
+                double t = fmod ((double) (i * hopSize + j), beatLength);
+                hops[s][j] = exp (-t / 500.) * (((double) (random() % 1000)) / 500. - 1.);
+            }
+        }
+
+        // the trackers are given their own copies, in case they change the hops
+        for (int s = 0;s < numStreams;s++)
+        {
+            std::vector<double> hop (hops[s]);
+            trackers[s]->processAudioFrame (&hop[0]);
+        }
+
+        bank.processAudioFrames (&hopPointers[0]);
+
+        for (int s = 0;s < numStreams;s++)
+        {
+            if (bank.getBeatsDueInCurrentFrame()[s] != trackers[s]->beatDueInCurrentFrame())
+            {
+                numMismatches++;
+            }
+
+            if (bank.getCurrentTempoEstimates()[s] != trackers[s]->getCurrentTempoEstimate())
+            {
+                numMismatches++;
+            }
+        }
+    }
+
+    BOOST_CHECK_EQUAL (numMismatches, 0);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        delete trackers[s];
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef BTRACK_SCHEDULER_TESTS
+#define BTRACK_SCHEDULER_TESTS
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include "../../../src/BTrackScheduler.h"
+
+//======================================================================
+// creates audio of decaying noise bursts at the given tempo
+static std::vector<double> createNoiseBursts (double tempo, int numSamples)
+{
+    std::vector<double> audio;
+
+    double beatLength = 44100. * 60. / tempo;
+
+    for (int i = 0;i < numSamples;i++)
+    {
+        double t = fmod ((double) i, beatLength);
+        audio.push_back (exp (-t / 500.) * (((double) (random() % 1000)) / 500. - 1.));
+    }
+
+    return audio;
+}
+
+//======================================================================
+// pushes every hop of every stream, a hop of each stream in turn, and checks that the results
+// match those of a separate beat tracker for each stream, processed in order
+static void checkSchedulerMatchesSeparateTrackers (BTrackScheduler& scheduler, int numStreams, int hopSize, int numHops)
+{
+    std::vector<std::vector<double> > audio;
+    std::vector<BTrack*> trackers;
+    std::vector<int> numPushed (numStreams, 0);
+    std::vector<int> numResults (numStreams, 0);
+    int numMismatches = 0;
+    int numBeats = 0;
+    int numFinished = 0;
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        audio.push_back (createNoiseBursts (90. + 5. * s, hopSize * numHops));
+        trackers.push_back (new BTrack (hopSize, 2 * hopSize));
+    }
+
+    // push each stream's hops for as long as its queue has room, and check its results as they arrive
+    while (numFinished < numStreams)
+    {
+        for (int s = 0;s < numStreams;s++)
+        {
+            while (numPushed[s] < numHops && scheduler.pushHop (s, &audio[s][numPushed[s] * hopSize]))
+            {
+                numPushed[s]++;
+            }
+
+            StreamResult result;
+
+            while (scheduler.popResult (s, result))
+            {
+                std::vector<double> hop (&audio[s][numResults[s] * hopSize], &audio[s][(numResults[s] + 1) * hopSize]);
+                trackers[s]->processAudioFrame (&hop[0]);
+
+                if (result.hopIndex != numResults[s] || result.beatDue != trackers[s]->beatDueInCurrentFrame() || result.tempo != trackers[s]->getCurrentTempoEstimate())
+                {
+                    numMismatches++;
+                }
+
+                numBeats += result.beatDue ? 1 : 0;
+                numResults[s]++;
+
+                if (numResults[s] == numHops)
+                {
+                    numFinished++;
+                }
+            }
+        }
+
+        std::this_thread::yield();
+    }
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        delete trackers[s];
+    }
+
+    BOOST_CHECK_EQUAL (numMismatches, 0);
+    BOOST_CHECK (numBeats > numStreams * numHops / 100);
+}
+
+//======================================================================
+//========================= PROCESSING STREAMS =========================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(processingStreams)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(streamsGiveTheSameBeatsAsSeparateTrackers)
+{
+    int numStreams = 24;
+    int hopSize = 512;
+    int numHops = 600;
+
+    BTrackScheduler scheduler (4, numStreams);
+
+    BOOST_CHECK_EQUAL (scheduler.getNumWorkers(), 4);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        // a mixture of priorities and queue lengths, as none of them should change the results
+        BOOST_CHECK_EQUAL (scheduler.addStream (hopSize, 2 * hopSize, s % NumStreamPriorities, 1 + 4 * (s % 5)), s);
+    }
+
+    BOOST_CHECK_EQUAL (scheduler.getNumStreams(), numStreams);
+    BOOST_CHECK_EQUAL (scheduler.addStream (hopSize, 2 * hopSize), -1);
+
+    checkSchedulerMatchesSeparateTrackers (scheduler, numStreams, hopSize, numHops);
+
+    unsigned long long numHopsProcessed = 0;
+
+    for (int w = 0;w < scheduler.getNumWorkers();w++)
+    {
+        WorkerStatistics statistics = scheduler.getWorkerStatistics (w);
+
+        numHopsProcessed += statistics.numHopsProcessed;
+
+        BOOST_CHECK (statistics.busyNanoseconds <= statistics.elapsedNanoseconds);
+        BOOST_CHECK (statistics.utilisation >= 0 && statistics.utilisation <= 1);
+    }
+
+    BOOST_CHECK_EQUAL (numHopsProcessed, (unsigned long long) (numStreams * numHops));
+
+    scheduler.resetWorkerStatistics();
+
+    for (int w = 0;w < scheduler.getNumWorkers();w++)
+    {
+        BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (w).numHopsProcessed, 0);
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(exclusiveStreamsAreOnlyProcessedByTheirWorker)
+{
+    int numStreams = 6;
+    int hopSize = 512;
+    int numHops = 200;
+
+    BTrackScheduler scheduler (3, numStreams);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        scheduler.addStream (hopSize, 2 * hopSize);
+
+        // every stream is kept on worker 1, leaving the others idle
+        scheduler.setStreamAffinity (s, 1, true);
+    }
+
+    scheduler.setStreamPriority (0, HighPriority);
+    BOOST_CHECK_EQUAL (scheduler.getStreamPriority (0), HighPriority);
+    BOOST_CHECK_EQUAL (scheduler.getStreamPriority (1), NormalPriority);
+
+    checkSchedulerMatchesSeparateTrackers (scheduler, numStreams, hopSize, numHops);
+
+    BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (0).numHopsProcessed, 0);
+    BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (1).numHopsProcessed, (unsigned long long) (numStreams * numHops));
+    BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (2).numHopsProcessed, 0);
+    BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (0).numStreamsStolen, 0);
+    BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (2).numStreamsStolen, 0);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(idleWorkersStealFromBusyOnes)
+{
+    int numStreams = 16;
+    int hopSize = 512;
+    int numHops = 400;
+
+    BTrackScheduler scheduler (4, numStreams);
+
+    for (int s = 0;s < numStreams;s++)
+    {
+        scheduler.addStream (hopSize, 2 * hopSize, NormalPriority, 32);
+
+        // every stream prefers worker 0, but may be stolen
+        scheduler.setStreamAffinity (s, 0, false);
+    }
+
+    checkSchedulerMatchesSeparateTrackers (scheduler, numStreams, hopSize, numHops);
+
+    unsigned long long numStolen = 0;
+
+    for (int w = 1;w < scheduler.getNumWorkers();w++)
+    {
+        numStolen += scheduler.getWorkerStatistics (w).numStreamsStolen;
+    }
+
+    // everything goes to worker 0, so the others only have work if they steal it
+    BOOST_CHECK_EQUAL (scheduler.getWorkerStatistics (0).numStreamsStolen, 0);
+    BOOST_CHECK (numStolen > 0);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(highPriorityStreamsAreProcessedFirst)
+{
+    int hopSize = 512;
+    int numHighHops = 64;
+    int numBusyHops = 1024;
+
+    BTrackScheduler scheduler (1, 3);
+
+    int lowStream = scheduler.addStream (hopSize, 2 * hopSize, LowPriority, 1);
+    int busyStream = scheduler.addStream (hopSize, 2 * hopSize, NormalPriority, numBusyHops);
+    int highStream = scheduler.addStream (hopSize, 2 * hopSize, HighPriority, numHighHops);
+
+    std::vector<double> audio = createNoiseBursts (120., hopSize * numHighHops);
+
+    // the low priority stream's first hop is processed, and its second waits for room for its result
+    scheduler.pushHop (lowStream, &audio[0]);
+
+    while (!scheduler.pushHop (lowStream, &audio[hopSize]))
+    {
+        std::this_thread::yield();
+    }
+
+    // keep the worker busy with a long backlog of normal priority hops
+    for (int i = 0;i < numBusyHops;i++)
+    {
+        scheduler.pushHop (busyStream, &audio[(i % numHighHops) * hopSize]);
+    }
+
+    // make room for the low priority stream's second result, so that it is queued before the high priority hops arrive
+    StreamResult result;
+    BOOST_CHECK (scheduler.popResult (lowStream, result));
+    BOOST_CHECK_EQUAL (result.hopIndex, 0);
+
+    for (int i = 0;i < numHighHops;i++)
+    {
+        BOOST_CHECK (scheduler.pushHop (highStream, &audio[i * hopSize]));
+    }
+
+    int numHighResults = 0;
+    StreamResult highResult;
+
+    while (!scheduler.popResult (lowStream, result))
+    {
+        while (scheduler.popResult (highStream, highResult))
+        {
+            numHighResults++;
+        }
+
+        std::this_thread::yield();
+    }
+
+    BOOST_CHECK_EQUAL (result.hopIndex, 1);
+
+    // every high priority hop was processed before the low priority one, so their results are all ready
+    while (scheduler.popResult (highStream, highResult))
+    {
+        numHighResults++;
+    }
+
+    BOOST_CHECK_EQUAL (numHighResults, numHighHops);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(streamsCanBeAddedFromManyThreads)
+{
+    int numThreads = 4;
+    int numStreamsPerThread = 8;
+
+    BTrackScheduler scheduler (2, numThreads * numStreamsPerThread);
+    std::vector<std::thread> threads;
+    std::vector<int> indices (numThreads * numStreamsPerThread, -1);
+
+    for (int t = 0;t < numThreads;t++)
+    {
+        threads.push_back (std::thread ([&scheduler, &indices, t, numStreamsPerThread] {
+            for (int i = 0;i < numStreamsPerThread;i++)
+            {
+                indices[t * numStreamsPerThread + i] = scheduler.addStream (512, 1024);
+            }
+        }));
+    }
+
+    for (int t = 0;t < numThreads;t++)
+    {
+        threads[t].join();
+    }
+
+    // every stream gets an index of its own
+    std::vector<int> sortedIndices (indices);
+    std::sort (sortedIndices.begin(), sortedIndices.end());
+
+    for (int s = 0;s < numThreads * numStreamsPerThread;s++)
+    {
+        BOOST_CHECK_EQUAL (sortedIndices[s], s);
+    }
+
+    BOOST_CHECK_EQUAL (scheduler.getNumStreams(), numThreads * numStreamsPerThread);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+#endif
@@ -0,0 +1,973 @@
+#ifndef ONSET_DETECTION_FUNCTION_TESTS
+#define ONSET_DETECTION_FUNCTION_TESTS
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <cmath>
+#include "../../../src/OnsetDetectionFunction.h"
+#include "../../../src/OnsetDetectionFunctionBank.h"
+
+//======================================================================
+// creates a test signal of decaying noise bursts over a pair of sinusoids
+static std::vector<double> createTestSignal (int numSamples)
+{
+    std::vector<double> signal;
+    
+    for (int i = 0;i < numSamples;i++)
+    {
+        double t = ((double) i) / 44100.;
+        double envelope = exp (-fmod (t, 0.5) * 20.);
+        double noise = ((double) (random() % 1000)) / 1000. - 0.5;
+        
+        signal.push_back (envelope * noise + 0.3 * sin (2 * M_PI * 440. * t) + 0.2 * sin (2 * M_PI * 1234.5 * t));
+    }
+    
+    return signal;
+}
+
+//======================================================================
+// checks that the two phase calculation methods agree to within a relative tolerance
+static void checkPhaseCalculationMethodsAgree (int onsetDetectionFunctionType, double tolerance)
+{
+    int hopSize = 512;
+    int frameSize = 1024;
+    
+    std::vector<double> signal = createTestSignal (hopSize * 200);
+    
+    OnsetDetectionFunction polar (hopSize, frameSize, onsetDetectionFunctionType, HanningWindow);
+    OnsetDetectionFunction complexDomain (hopSize, frameSize, onsetDetectionFunctionType, HanningWindow);
+    
+    complexDomain.setPhaseCalculationMethod (ComplexDomainPhase);
+    
+    for (int i = 0;i < 200;i++)
+    {
+        double expected = polar.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+        double actual = complexDomain.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+        
+        BOOST_CHECK_SMALL (actual - expected, tolerance * std::max (fabs (expected), 1.0));
+    }
+}
+
+//======================================================================
+// checks that a bank of detection functions gives the same samples as a separate detection function for each stream
+static void checkBankMatchesSeparateDetectionFunctions (int onsetDetectionFunctionType)
+{
+    int numStreams = 5;
+    int hopSize = 441;
+    int frameSize = 1024;
+    int numHops = 100;
+    
+    // each stream is the test signal, starting from a different point
+    std::vector<double> signal = createTestSignal (hopSize * (numHops + numStreams * 7));
+    
+    OnsetDetectionFunctionBank bank (numStreams, hopSize, frameSize, onsetDetectionFunctionType, HanningWindow);
+    std::vector<OnsetDetectionFunction*> odfs;
+    
+    BOOST_CHECK_EQUAL (bank.getNumStreams(), numStreams);
+    
+    for (int s = 0;s < numStreams;s++)
+    {
+        odfs.push_back (new OnsetDetectionFunction (hopSize, frameSize, onsetDetectionFunctionType, HanningWindow));
+    }
+    
+    std::vector<double*> hops (numStreams);
+    std::vector<double> odfSamples (numStreams);
+    
+    for (int i = 0;i < numHops;i++)
+    {
+        for (int s = 0;s < numStreams;s++)
+        {
+            hops[s] = &signal[(i + s * 7) * hopSize];
+        }
+        
+        bank.calculateOnsetDetectionFunctionSamples (&hops[0], &odfSamples[0]);
+        
+        for (int s = 0;s < numStreams;s++)
+        {
+            double expected = odfs[s]->calculateOnsetDetectionFunctionSample (hops[s]);
+            
+            // fftw may order the arithmetic of a batch of FFTs differently from a single FFT
+            BOOST_CHECK_SMALL (odfSamples[s] - expected, 1e-9 * std::max (fabs (expected), 1.0));
+        }
+    }
+    
+    for (int s = 0;s < numStreams;s++)
+    {
+        delete odfs[s];
+    }
+}
+
+//======================================================================
+// checks that every supported spectral kernel type gives the same output as the scalar kernels
+static void checkSpectralKernelsMatchScalar (int onsetDetectionFunctionType, int phaseCalculationMethod)
+{
+    int hopSize = 512;
+    int frameSize = 1024;
+    
+    std::vector<double> signal = createTestSignal (hopSize * 100);
+    
+    for (int type = SSE2Kernels;type <= AVX512Kernels;type++)
+    {
+        if (!SpectralKernels::isSupported (type))
+        {
+            continue;
+        }
+        
+        OnsetDetectionFunction scalar (hopSize, frameSize, onsetDetectionFunctionType, HanningWindow);
+        OnsetDetectionFunction vectorised (hopSize, frameSize, onsetDetectionFunctionType, HanningWindow);
+        
+        scalar.setSpectralKernelType (ScalarKernels);
+        scalar.setPhaseCalculationMethod (phaseCalculationMethod);
+        vectorised.setSpectralKernelType (type);
+        vectorised.setPhaseCalculationMethod (phaseCalculationMethod);
+        
+        BOOST_CHECK_EQUAL (vectorised.getSpectralKernelType(), type);
+        
+        for (int i = 0;i < 100;i++)
+        {
+            double expected = scalar.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+            double actual = vectorised.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+            
+            BOOST_CHECK_SMALL (actual - expected, 1e-9 * std::max (fabs (expected), 1.0));
+        }
+    }
+}
+
+//======================================================================
+// checks that calculating several detection functions at once gives the same output as
+// calculating each of them with its own OnsetDetectionFunction
+static void checkMultipleDetectionFunctionsMatchSingle (const std::vector<int>& onsetDetectionFunctionTypes, int phaseCalculationMethod)
+{
+    int hopSize = 512;
+    int frameSize = 1024;
+    int numTypes = (int) onsetDetectionFunctionTypes.size();
+    
+    std::vector<double> signal = createTestSignal (hopSize * 100);
+    
+    OnsetDetectionFunction multiple (hopSize, frameSize);
+    std::vector<OnsetDetectionFunction*> singles;
+    
+    multiple.setPhaseCalculationMethod (phaseCalculationMethod);
+    
+    for (int k = 0;k < numTypes;k++)
+    {
+        singles.push_back (new OnsetDetectionFunction (hopSize, frameSize, onsetDetectionFunctionTypes[k], HanningWindow));
+        singles[k]->setPhaseCalculationMethod (phaseCalculationMethod);
+    }
+    
+    std::vector<double> samples (numTypes);
+    
+    for (int i = 0;i < 100;i++)
+    {
+        multiple.calculateOnsetDetectionFunctionSamples (&signal[i * hopSize], &onsetDetectionFunctionTypes[0], numTypes, &samples[0]);
+        
+        for (int k = 0;k < numTypes;k++)
+        {
+            double expected = singles[k]->calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+            
+            BOOST_CHECK_SMALL (samples[k] - expected, 1e-9 * std::max (fabs (expected), 1.0));
+        }
+    }
+    
+    for (int k = 0;k < numTypes;k++)
+    {
+        delete singles[k];
+    }
+}
+
+//======================================================================
+// calculates a detection function sample from the full N-point DFT of the windowed frame,
+// with its two halves swapped, as the detection functions were originally written
+static double calculateReferenceSample (int onsetDetectionFunctionType, const std::vector<double>& frame, std::vector<double>& prevMagSpec, std::vector<double>& prevPhase, std::vector<double>& prevPhase2, double& prevEnergySum)
+{
+    int frameSize = (int) frame.size();
+    int fsize2 = frameSize / 2;
+    
+    double energy = 0;
+    
+    for (int n = 0;n < frameSize;n++)
+    {
+        energy += frame[n] * frame[n];
+    }
+    
+    if (onsetDetectionFunctionType == EnergyEnvelope)
+    {
+        return energy;
+    }
+    
+    if (onsetDetectionFunctionType == EnergyDifference)
+    {
+        double difference = energy - prevEnergySum;
+        prevEnergySum = energy;
+        return std::max (difference, 0.0);
+    }
+    
+    std::vector<double> in (frameSize);
+    
+    for (int n = 0;n < fsize2;n++)
+    {
+        double windowFirstHalf = 0.5 * (1 - cos (2 * M_PI * (n / (double) (frameSize - 1))));
+        double windowSecondHalf = 0.5 * (1 - cos (2 * M_PI * ((n + fsize2) / (double) (frameSize - 1))));
+        
+        in[n] = frame[n + fsize2] * windowSecondHalf;
+        in[n + fsize2] = frame[n] * windowFirstHalf;
+    }
+    
+    std::vector<double> twiddleReal (frameSize);
+    std::vector<double> twiddleImag (frameSize);
+    
+    for (int n = 0;n < frameSize;n++)
+    {
+        twiddleReal[n] = cos (-2 * M_PI * n / frameSize);
+        twiddleImag[n] = sin (-2 * M_PI * n / frameSize);
+    }
+    
+    double sum = 0;
+    
+    for (int k = 0;k < frameSize;k++)
+    {
+        double real = 0;
+        double imag = 0;
+        
+        for (int n = 0;n < frameSize;n++)
+        {
+            int t = (int) (((long) k * n) % frameSize);
+            real += in[n] * twiddleReal[t];
+            imag += in[n] * twiddleImag[t];
+        }
+        
+        double mag = sqrt (real * real + imag * imag);
+        double phase = atan2 (imag, real);
+        double magDifference = mag - prevMagSpec[k];
+        double phaseDeviation = phase - (2 * prevPhase[k]) + prevPhase2[k];
+        double csd = sqrt (std::max (mag * mag + prevMagSpec[k] * prevMagSpec[k] - 2 * mag * prevMagSpec[k] * cos (phaseDeviation), 0.0));
+        
+        switch (onsetDetectionFunctionType)
+        {
+            case SpectralDifference:
+                sum += fabs (magDifference);
+                break;
+            case SpectralDifferenceHWR:
+                sum += std::max (magDifference, 0.0);
+                break;
+            case PhaseDeviation:
+                if (mag > 0.1)
+                {
+                    // wrap into [-pi, pi] and make positive
+                    sum += fabs (remainder (phaseDeviation, 2 * M_PI));
+                }
+                break;
+            case ComplexSpectralDifference:
+                sum += csd;
+                break;
+            case ComplexSpectralDifferenceHWR:
+                if (magDifference > 0)
+                {
+                    sum += csd;
+                }
+                break;
+            case HighFrequencyContent:
+                sum += mag * (k + 1);
+                break;
+            case HighFrequencySpectralDifference:
+                sum += fabs (magDifference) * (k + 1);
+                break;
+            case HighFrequencySpectralDifferenceHWR:
+                sum += std::max (magDifference, 0.0) * (k + 1);
+                break;
+        }
+        
+        prevMagSpec[k] = mag;
+        prevPhase2[k] = prevPhase[k];
+        prevPhase[k] = phase;
+    }
+    
+    return sum;
+}
+
+//======================================================================
+// checks that a detection function calculated from the real-input FFT matches the full N-point DFT
+static void checkMatchesFullSpectrumReference (int onsetDetectionFunctionType, int phaseCalculationMethod, int hopSize, int frameSize)
+{
+    int numHops = 8;
+    
+    std::vector<double> signal = createTestSignal (hopSize * numHops);
+    
+    OnsetDetectionFunction odf (hopSize, frameSize, onsetDetectionFunctionType, HanningWindow);
+    odf.setPhaseCalculationMethod (phaseCalculationMethod);
+    
+    std::vector<double> frame (frameSize, 0.0);
+    std::vector<double> prevMagSpec (frameSize, 0.0);
+    std::vector<double> prevPhase (frameSize, 0.0);
+    std::vector<double> prevPhase2 (frameSize, 0.0);
+    double prevEnergySum = 0;
+    
+    for (int i = 0;i < numHops;i++)
+    {
+        // the frame holds the most recent frameSize samples
+        frame.erase (frame.begin(), frame.begin() + hopSize);
+        frame.insert (frame.end(), signal.begin() + i * hopSize, signal.begin() + (i + 1) * hopSize);
+        
+        double expected = calculateReferenceSample (onsetDetectionFunctionType, frame, prevMagSpec, prevPhase, prevPhase2, prevEnergySum);
+        double actual = odf.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+        
+        BOOST_CHECK_SMALL (actual - expected, 1e-6 * std::max (fabs (expected), 1.0));
+    }
+}
+
+//======================================================================
+//=================== PHASE CALCULATION METHODS ========================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(phaseCalculationMethods)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(complexDomainComplexSpectralDifferenceMatchesPolar)
+{
+    checkPhaseCalculationMethodsAgree (ComplexSpectralDifference, 1e-6);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(complexDomainComplexSpectralDifferenceHWRMatchesPolar)
+{
+    checkPhaseCalculationMethodsAgree (ComplexSpectralDifferenceHWR, 1e-6);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(complexDomainPhaseDeviationMatchesPolar)
+{
+    checkPhaseCalculationMethodsAgree (PhaseDeviation, 1e-3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+
+//======================================================================
+//====================== FULL SPECTRUM REFERENCE =======================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(fullSpectrumReference)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(everyDetectionFunctionMatchesFullSpectrumWithPolarPhase)
+{
+    for (int type = EnergyEnvelope;type <= HighFrequencySpectralDifferenceHWR;type++)
+    {
+        BOOST_TEST_CONTEXT ("onset detection function type " << type)
+        {
+            checkMatchesFullSpectrumReference (type, PolarPhase, 512, 1024);
+        }
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(everyDetectionFunctionMatchesFullSpectrumWithComplexDomainPhase)
+{
+    for (int type = EnergyEnvelope;type <= HighFrequencySpectralDifferenceHWR;type++)
+    {
+        BOOST_TEST_CONTEXT ("onset detection function type " << type)
+        {
+            checkMatchesFullSpectrumReference (type, ComplexDomainPhase, 512, 1024);
+        }
+    }
+}
+
+//======================================================================
+// half of 882 is 3 x 3 x 7 x 7, which Kiss FFT transforms with Bluestein's algorithm
+BOOST_AUTO_TEST_CASE(everyDetectionFunctionMatchesFullSpectrumWithOtherPrimeFactors)
+{
+    for (int type = EnergyEnvelope;type <= HighFrequencySpectralDifferenceHWR;type++)
+    {
+        BOOST_TEST_CONTEXT ("onset detection function type " << type)
+        {
+            checkMatchesFullSpectrumReference (type, PolarPhase, 441, 882);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+
+//======================================================================
+//======================== SPECTRAL KERNELS ============================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(spectralKernels)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(fastestSupportedTypeIsSupported)
+{
+    BOOST_CHECK (SpectralKernels::isSupported (SpectralKernels::getFastestSupportedType()));
+    
+    OnsetDetectionFunction odf (512, 1024);
+    
+    BOOST_CHECK_EQUAL (odf.getSpectralKernelType(), SpectralKernels::getFastestSupportedType());
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(vectorisedMagnitudeKernelsMatchScalar)
+{
+    checkSpectralKernelsMatchScalar (SpectralDifference, PolarPhase);
+    checkSpectralKernelsMatchScalar (SpectralDifferenceHWR, PolarPhase);
+    checkSpectralKernelsMatchScalar (HighFrequencyContent, PolarPhase);
+    checkSpectralKernelsMatchScalar (HighFrequencySpectralDifference, PolarPhase);
+    checkSpectralKernelsMatchScalar (HighFrequencySpectralDifferenceHWR, PolarPhase);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(vectorisedComplexSpectralDifferenceKernelsMatchScalar)
+{
+    checkSpectralKernelsMatchScalar (ComplexSpectralDifference, ComplexDomainPhase);
+    checkSpectralKernelsMatchScalar (ComplexSpectralDifferenceHWR, ComplexDomainPhase);
+    checkSpectralKernelsMatchScalar (PhaseDeviation, ComplexDomainPhase);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(vectorisedWeightedMaximumKernelsMatchScalar)
+{
+    std::vector<double> values = createTestSignal (203);
+    std::vector<double> weights = createTestSignal (203);
+    
+    // NaNs are skipped, as the cumulative score's maximum always has been
+    values[17] = NAN;
+    
+    const SpectralKernels& scalar = SpectralKernels::get (ScalarKernels);
+    
+    for (int type = SSE2Kernels;type <= AVX512Kernels;type++)
+    {
+        const SpectralKernels& vectorised = SpectralKernels::get (type);
+        
+        // every length, so that every combination of vector and remainder is covered
+        for (int n = 0;n <= 203;n++)
+        {
+            BOOST_CHECK_EQUAL (vectorised.weightedMaximum (&values[0], &weights[0], n), scalar.weightedMaximum (&values[0], &weights[0], n));
+        }
+    }
+    
+    // if no products are positive the maximum is zero
+    std::vector<double> negative (10, -1.0);
+    std::vector<double> ones (10, 1.0);
+    
+    for (int type = ScalarKernels;type <= AVX512Kernels;type++)
+    {
+        BOOST_CHECK_EQUAL (SpectralKernels::get (type).weightedMaximum (&negative[0], &ones[0], 10), 0.0);
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(vectorisedSparseMatrixVectorKernelsMatchScalar)
+{
+    int numEntriesPerRow = 5;
+    int maxRows = 37;
+
+    std::vector<double> input = createTestSignal (100);
+    std::vector<double> coefficients = createTestSignal (maxRows * numEntriesPerRow);
+    std::vector<int> indices (maxRows * numEntriesPerRow);
+
+    for (int i = 0;i < (int) indices.size();i++)
+    {
+        indices[i] = (i * 37) % 100;
+    }
+
+    const SpectralKernels& scalar = SpectralKernels::get (ScalarKernels);
+
+    for (int type = SSE2Kernels;type <= AVX512Kernels;type++)
+    {
+        const SpectralKernels& vectorised = SpectralKernels::get (type);
+
+        // every number of rows, so that every combination of vector and remainder is covered
+        for (int numRows = 1;numRows <= maxRows;numRows++)
+        {
+            std::vector<double> scalarOutput (numRows);
+            std::vector<double> vectorisedOutput (numRows);
+
+            scalar.sparseMatrixVector (&indices[0], &coefficients[0], numRows, numEntriesPerRow, &input[0], &scalarOutput[0]);
+            vectorised.sparseMatrixVector (&indices[0], &coefficients[0], numRows, numEntriesPerRow, &input[0], &vectorisedOutput[0]);
+
+            // fused multiply-adds round differently
+            for (int i = 0;i < numRows;i++)
+            {
+                BOOST_CHECK_SMALL (vectorisedOutput[i] - scalarOutput[i], 1e-12);
+            }
+        }
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(vectorisedMaxPlusCorrelationKernelsMatchScalar)
+{
+    int kernelLength = 7;
+    
+    std::vector<double> input = createTestSignal (60);
+    std::vector<double> kernel = createTestSignal (kernelLength);
+    
+    // impossible states, as used to pad the tempo states
+    input[0] = -INFINITY;
+    input[31] = -INFINITY;
+    
+    const SpectralKernels& scalar = SpectralKernels::get (ScalarKernels);
+    
+    for (int type = SSE2Kernels;type <= AVX512Kernels;type++)
+    {
+        const SpectralKernels& vectorised = SpectralKernels::get (type);
+        
+        // every number of outputs, so that every combination of vector and remainder is covered
+        for (int n = 1;n <= 60 - kernelLength + 1;n++)
+        {
+            std::vector<double> scalarOutput (n);
+            std::vector<double> vectorisedOutput (n);
+            
+            scalar.maxPlusCorrelation (&input[0], &kernel[0], kernelLength, &scalarOutput[0], n);
+            vectorised.maxPlusCorrelation (&input[0], &kernel[0], kernelLength, &vectorisedOutput[0], n);
+            
+            for (int i = 0;i < n;i++)
+            {
+                BOOST_CHECK_EQUAL (vectorisedOutput[i], scalarOutput[i]);
+            }
+        }
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(vectorisedAccumulatingKernelsMatchScalar)
+{
+    std::vector<double> values = createTestSignal (40);
+    std::vector<double> weights = createTestSignal (40);
+    std::vector<double> initialMaxima = createTestSignal (40);
+    
+    // the running maxima start at -infinity before a Viterbi update
+    initialMaxima[3] = -INFINITY;
+    values[5] = -INFINITY;
+    
+    for (int i = 0;i < 40;i++)
+    {
+        initialMaxima[i] *= 0.5;
+    }
+    
+    const SpectralKernels& scalar = SpectralKernels::get (ScalarKernels);
+    
+    for (int type = SSE2Kernels;type <= AVX512Kernels;type++)
+    {
+        const SpectralKernels& vectorised = SpectralKernels::get (type);
+        
+        // every number of values, so that every combination of vector and remainder is covered
+        for (int n = 1;n <= 40;n++)
+        {
+            std::vector<double> scalarMaxima (initialMaxima.begin(), initialMaxima.begin() + n);
+            std::vector<double> vectorisedMaxima (scalarMaxima);
+            
+            scalar.accumulateWeightedMaximum (&values[0], &weights[0], &scalarMaxima[0], n);
+            vectorised.accumulateWeightedMaximum (&values[0], &weights[0], &vectorisedMaxima[0], n);
+            
+            scalar.accumulateMaxPlus (&values[0], -0.25, &scalarMaxima[0], n);
+            vectorised.accumulateMaxPlus (&values[0], -0.25, &vectorisedMaxima[0], n);
+            
+            for (int i = 0;i < n;i++)
+            {
+                BOOST_CHECK_EQUAL (vectorisedMaxima[i], scalarMaxima[i]);
+            }
+        }
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(sparseMatrixMatrixKernelsMatchSparseMatrixVectorForEveryColumn)
+{
+    int numEntriesPerRow = 5;
+    int numRows = 37;
+    int maxColumns = 19;
+
+    std::vector<double> input = createTestSignal (100 * maxColumns);
+    std::vector<double> coefficients = createTestSignal (numRows * numEntriesPerRow);
+    std::vector<int> indices (numRows * numEntriesPerRow);
+
+    for (int i = 0;i < (int) indices.size();i++)
+    {
+        indices[i] = (i * 37) % 100;
+    }
+
+    for (int type = ScalarKernels;type <= AVX512Kernels;type++)
+    {
+        const SpectralKernels& kernels = SpectralKernels::get (type);
+
+        // every number of columns, so that every combination of vector and remainder is covered
+        for (int numColumns = 1;numColumns <= maxColumns;numColumns++)
+        {
+            std::vector<double> output (numRows * numColumns);
+
+            kernels.sparseMatrixMatrix (&indices[0], &coefficients[0], numRows, numEntriesPerRow, &input[0], numColumns, &output[0]);
+
+            for (int c = 0;c < numColumns;c++)
+            {
+                std::vector<double> column (100);
+                std::vector<double> expected (numRows);
+
+                for (int i = 0;i < 100;i++)
+                {
+                    column[i] = input[i * numColumns + c];
+                }
+
+                kernels.sparseMatrixVector (&indices[0], &coefficients[0], numRows, numEntriesPerRow, &column[0], &expected[0]);
+
+                for (int i = 0;i < numRows;i++)
+                {
+                    BOOST_CHECK_EQUAL (output[i * numColumns + c], expected[i]);
+                }
+            }
+        }
+    }
+}
+
+#ifdef USE_KISS_FFT
+//======================================================================
+BOOST_AUTO_TEST_CASE(interleavedFFTsMatchKissFFTForEveryLane)
+{
+    int numLaneCounts = 8;
+    int laneCounts[] = {1, 2, 3, 4, 7, 8, 9, 19};
+
+    for (int size = 2;size <= 1024;size *= 2)
+    {
+        for (int fftType = ForwardFFT;fftType <= BackwardFFT;fftType++)
+        {
+            const FFTPlan* plan = FFTCache::acquirePlan (size, fftType);
+
+            BOOST_REQUIRE (FFTCache::canInterleave (plan));
+
+            for (int type = ScalarKernels;type <= AVX512Kernels;type++)
+            {
+                for (int n = 0;n < numLaneCounts;n++)
+                {
+                    // pad the lanes, as the banks do, to check that the padding is ignored
+                    int numLanes = laneCounts[n];
+                    int laneStride = numLanes + 1;
+                    std::vector<double> signal = createTestSignal (2 * size * numLanes);
+                    std::vector<float> in (2 * size * laneStride, NAN);
+                    std::vector<float> out (2 * size * laneStride);
+
+                    for (int lane = 0;lane < numLanes;lane++)
+                    {
+                        for (int i = 0;i < size;i++)
+                        {
+                            in[i * 2 * laneStride + lane] = (float) signal[(lane * size + i) * 2];
+                            in[i * 2 * laneStride + laneStride + lane] = (float) signal[(lane * size + i) * 2 + 1];
+                        }
+                    }
+
+                    FFTCache::performInterleavedFFT (plan, SpectralKernels::get (type), &in[0], &out[0], numLanes, laneStride);
+
+                    for (int lane = 0;lane < numLanes;lane++)
+                    {
+                        std::vector<kiss_fft_cpx> laneIn (size);
+                        std::vector<kiss_fft_cpx> laneOut (size);
+
+                        for (int i = 0;i < size;i++)
+                        {
+                            laneIn[i].r = in[i * 2 * laneStride + lane];
+                            laneIn[i].i = in[i * 2 * laneStride + laneStride + lane];
+                        }
+
+                        kiss_fft (plan->cfg, &laneIn[0], &laneOut[0]);
+
+                        for (int i = 0;i < size;i++)
+                        {
+                            BOOST_CHECK_EQUAL (out[i * 2 * laneStride + lane], laneOut[i].r);
+                            BOOST_CHECK_EQUAL (out[i * 2 * laneStride + laneStride + lane], laneOut[i].i);
+                        }
+                    }
+                }
+            }
+
+            FFTCache::releasePlan (plan);
+        }
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(interleavedRealFFTsMatchRealFFTForEveryLane)
+{
+    int numLaneCounts = 5;
+    int laneCounts[] = {1, 3, 8, 9, 19};
+
+    for (int size = 4;size <= 1024;size *= 2)
+    {
+        const FFTPlan* plan = FFTCache::acquirePlan (size, RealForwardFFT);
+
+        BOOST_REQUIRE (FFTCache::canInterleave (plan));
+
+        for (int type = ScalarKernels;type <= AVX512Kernels;type++)
+        {
+            for (int n = 0;n < numLaneCounts;n++)
+            {
+                int numLanes = laneCounts[n];
+                int laneStride = numLanes + 1;
+                std::vector<double> signal = createTestSignal (size * numLanes);
+                std::vector<float> in (size * laneStride, NAN);
+                std::vector<float> out (((size / 2) + 1) * 2 * laneStride);
+
+                for (int lane = 0;lane < numLanes;lane++)
+                {
+                    for (int i = 0;i < size;i++)
+                    {
+                        in[i * laneStride + lane] = (float) signal[lane * size + i];
+                    }
+                }
+
+                FFTCache::performInterleavedRealFFT (plan, SpectralKernels::get (type), &in[0], &out[0], numLanes, laneStride);
+
+                for (int lane = 0;lane < numLanes;lane++)
+                {
+                    std::vector<kiss_fft_scalar> laneIn (size);
+                    std::vector<kiss_fft_cpx> laneOut ((size / 2) + 1);
+
+                    for (int i = 0;i < size;i++)
+                    {
+                        laneIn[i] = in[i * laneStride + lane];
+                    }
+
+                    FFTCache::performRealFFT (plan, &laneIn[0], &laneOut[0], NULL);
+
+                    for (int i = 0;i <= size / 2;i++)
+                    {
+                        BOOST_CHECK_EQUAL (out[i * 2 * laneStride + lane], laneOut[i].r);
+                        BOOST_CHECK_EQUAL (out[i * 2 * laneStride + laneStride + lane], laneOut[i].i);
+                    }
+                }
+            }
+        }
+
+        FFTCache::releasePlan (plan);
+    }
+
+    // sizes whose half has other prime factors are left to Bluestein's algorithm
+    const FFTPlan* plan = FFTCache::acquirePlan (882, RealForwardFFT);
+    BOOST_CHECK (!FFTCache::canInterleave (plan));
+    FFTCache::releasePlan (plan);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+
+//======================================================================
+//================= MULTIPLE DETECTION FUNCTIONS =======================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(multipleDetectionFunctions)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(multipleDetectionFunctionsMatchSingleWithPolarPhase)
+{
+    std::vector<int> types;
+    
+    for (int type = EnergyEnvelope;type <= HighFrequencySpectralDifferenceHWR;type++)
+    {
+        types.push_back (type);
+    }
+    
+    checkMultipleDetectionFunctionsMatchSingle (types, PolarPhase);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(multipleDetectionFunctionsMatchSingleWithComplexDomainPhase)
+{
+    std::vector<int> types;
+    
+    types.push_back (SpectralDifferenceHWR);
+    types.push_back (ComplexSpectralDifferenceHWR);
+    types.push_back (HighFrequencyContent);
+    types.push_back (PhaseDeviation);
+    types.push_back (EnergyDifference);
+    
+    checkMultipleDetectionFunctionsMatchSingle (types, ComplexDomainPhase);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+//======================================================================
+//========================== FRAME BUFFER ==============================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(frameBuffer)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(frameHoldsMostRecentSamplesWhenHopDoesNotDivideFrame)
+{
+    int hopSize = 384;
+    int frameSize = 1024;
+    
+    std::vector<double> signal = createTestSignal (hopSize * 50);
+    
+    OnsetDetectionFunction odf (hopSize, frameSize, EnergyEnvelope, RectangularWindow);
+    
+    for (int i = 0;i < 50;i++)
+    {
+        double actual = odf.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+        
+        // the energy of the last frameSize samples, treating those before the signal as zero
+        double expected = 0;
+        int end = (i + 1) * hopSize;
+        
+        for (int n = std::max (end - frameSize, 0);n < end;n++)
+        {
+            expected += signal[n] * signal[n];
+        }
+        
+        BOOST_CHECK_SMALL (actual - expected, 1e-9 * std::max (fabs (expected), 1.0));
+    }
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(runningEnergyReturnsToZeroInSilence)
+{
+    int hopSize = 128;
+    int frameSize = 2048;
+    
+    std::vector<double> signal = createTestSignal (hopSize * 100);
+    std::vector<double> silence (hopSize, 0.0);
+    
+    OnsetDetectionFunction odf (hopSize, frameSize, EnergyEnvelope, RectangularWindow);
+    
+    for (int i = 0;i < 100;i++)
+    {
+        // make the signal loud so that rounding errors in the running sum are large
+        for (int n = 0;n < hopSize;n++)
+        {
+            signal[i * hopSize + n] *= 1000.;
+        }
+        
+        odf.calculateOnsetDetectionFunctionSample (&signal[i * hopSize]);
+    }
+    
+    for (int i = 0;i < 2000;i++)
+    {
+        double energy = odf.calculateOnsetDetectionFunctionSample (&silence[0]);
+        
+        BOOST_CHECK (energy >= 0);
+        
+        if (i >= frameSize / hopSize)
+        {
+            BOOST_CHECK_SMALL (energy, 1e-3);
+        }
+    }
+    
+    // once the energy has been re-summed, no error should be left at all
+    BOOST_CHECK_EQUAL (odf.calculateOnsetDetectionFunctionSample (&silence[0]), 0.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+//======================================================================
+//=========================== MANY STREAMS =============================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(manyStreams)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(bankMatchesSeparateComplexSpectralDifferenceHWR)
+{
+    checkBankMatchesSeparateDetectionFunctions (ComplexSpectralDifferenceHWR);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(bankMatchesSeparateSpectralDifference)
+{
+    checkBankMatchesSeparateDetectionFunctions (SpectralDifference);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(bankMatchesSeparateEnergyDifference)
+{
+    checkBankMatchesSeparateDetectionFunctions (EnergyDifference);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(bankSharesOneBatchPlan)
+{
+    int numPlans = FFTCache::getNumPlans();
+    
+    {
+        // a bank holds only its batch plan, as its streams do not make single plans of their own
+        OnsetDetectionFunctionBank bank1 (3, 512, 1536);
+        OnsetDetectionFunctionBank bank2 (3, 256, 1536);
+        
+        BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans + 1);
+        
+        OnsetDetectionFunctionBank bank3 (4, 512, 1536);
+        
+        BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans + 2);
+    }
+    
+    BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+//======================================================================
+//========================= SHARED FFT CACHE ===========================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(sharedFFTCache)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(instancesOfTheSameSizeSharePlansAndWindows)
+{
+    int numPlans = FFTCache::getNumPlans();
+    int numWindows = FFTCache::getNumWindows();
+    
+    {
+        OnsetDetectionFunction odf1 (256, 1536, SpectralDifference, BlackmanWindow);
+        
+        BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans + 1);
+        BOOST_CHECK_EQUAL (FFTCache::getNumWindows(), numWindows + 1);
+        
+        OnsetDetectionFunction odf2 (512, 1536, HighFrequencyContent, BlackmanWindow);
+        OnsetDetectionFunction odf3 (512, 1536, PhaseDeviation, BlackmanWindow);
+        
+        BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans + 1);
+        BOOST_CHECK_EQUAL (FFTCache::getNumWindows(), numWindows + 1);
+        
+        // a different window type needs its own table, but not its own plan
+        odf3.initialise (512, 1536, PhaseDeviation, TukeyWindow);
+        
+        BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans + 1);
+        BOOST_CHECK_EQUAL (FFTCache::getNumWindows(), numWindows + 2);
+    }
+    
+    // everything is freed once the last instance using it has gone
+    BOOST_CHECK_EQUAL (FFTCache::getNumPlans(), numPlans);
+    BOOST_CHECK_EQUAL (FFTCache::getNumWindows(), numWindows);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(planningModeCanBeChanged)
+{
+    BOOST_CHECK_EQUAL (FFTCache::getPlanningMode(), EstimatePlanning);
+    
+    FFTCache::setPlanningMode (MeasurePlanning);
+    BOOST_CHECK_EQUAL (FFTCache::getPlanningMode(), MeasurePlanning);
+    
+    {
+        // plans are made with the new mode, and the output is unaffected
+        OnsetDetectionFunction odf (512, 1024, SpectralDifference, HanningWindow);
+        std::vector<double> signal = createTestSignal (512);
+        
+        BOOST_CHECK (odf.calculateOnsetDetectionFunctionSample (&signal[0]) > 0);
+    }
+    
+    FFTCache::setPlanningMode (EstimatePlanning);
+    
+    BOOST_CHECK (!FFTCache::importWisdom ("/nonexistent/btrack.wisdom"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+#endif
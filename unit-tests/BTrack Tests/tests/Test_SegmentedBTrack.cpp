@@ -0,0 +1,164 @@
+#ifndef SEGMENTED_BTRACK_TESTS
+#define SEGMENTED_BTRACK_TESTS
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include "../../../src/SegmentedBTrack.h"
+#include "ClickTracks.h"
+
+//======================================================================
+// checks that the beats are in order and never closer than half a beat period
+static bool beatsAreSpacedOut (const std::vector<long>& beats, const std::vector<double>& tempi, int hopSize)
+{
+    for (size_t i = 1;i < beats.size();i++)
+    {
+        double halfBeatPeriod = 0.5 * (60. / tempi[beats[i]]) * 44100. / hopSize;
+
+        if (beats[i] - beats[i - 1] < halfBeatPeriod)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//======================================================================
+//======================== TRACKING SEGMENTS ===========================
+//======================================================================
+BOOST_AUTO_TEST_SUITE(trackingSegments)
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(oneSegmentGivesTheSameBeatsAsSequentialTracking)
+{
+    int numSamples = 3000;
+    std::vector<double> odf = createClickTrackODF (110., 512, numSamples);
+
+    BTrack sequential (512, 1024);
+    std::vector<long> expectedBeats;
+    std::vector<double> expectedTempi;
+    sequential.trackBeatsInOnsetDetectionFunction (&odf[0], numSamples, expectedBeats, expectedTempi);
+
+    // the signal is shorter than two segments, so it is tracked as one
+    SegmentedBTrack segmented (512, 1024);
+    segmented.setSegmentLength (20.);
+    std::vector<long> beats;
+    std::vector<double> tempi;
+    BeatAgreement agreement = segmented.trackBeatsInOnsetDetectionFunctionAndMeasureAgreement (&odf[0], numSamples, beats, tempi);
+
+    BOOST_CHECK (beats == expectedBeats);
+    BOOST_CHECK (tempi == expectedTempi);
+    BOOST_CHECK_EQUAL (agreement.numMatchedBeats, (long) expectedBeats.size());
+    BOOST_CHECK_EQUAL (agreement.fMeasure, 1.);
+    BOOST_CHECK_EQUAL (agreement.meanTempoDifference, 0.);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(longOnsetDetectionFunctionAgreesWithSequentialTracking)
+{
+    int numSamples = 20000;
+    std::vector<double> odf = createClickTrackODF (120., 512, numSamples);
+
+    SegmentedBTrack segmented (512, 1024);
+    segmented.setNumThreads (4);
+    segmented.setSegmentLength (30.);
+    segmented.setPreRollLength (10.);
+
+    BOOST_CHECK_EQUAL (segmented.getSegmentLengthInHops(), 2584);
+    BOOST_CHECK_EQUAL (segmented.getPreRollLengthInHops(), 861);
+
+    std::vector<long> beats;
+    std::vector<double> tempi;
+    BeatAgreement agreement = segmented.trackBeatsInOnsetDetectionFunctionAndMeasureAgreement (&odf[0], numSamples, beats, tempi);
+
+    BOOST_CHECK_EQUAL ((long) tempi.size(), (long) numSamples);
+    BOOST_CHECK_EQUAL (agreement.numBeats, (long) beats.size());
+    BOOST_CHECK (beats.size() > 400);
+    BOOST_CHECK (beatsAreSpacedOut (beats, tempi, 512));
+    BOOST_CHECK (agreement.fMeasure > 0.95);
+    BOOST_CHECK (agreement.meanTempoDifference < 5.);
+
+    // the result does not depend on the number of threads
+    segmented.setNumThreads (1);
+    std::vector<long> singleThreadBeats;
+    std::vector<double> singleThreadTempi;
+    segmented.trackBeatsInOnsetDetectionFunction (&odf[0], numSamples, singleThreadBeats, singleThreadTempi);
+
+    BOOST_CHECK (singleThreadBeats == beats);
+    BOOST_CHECK (singleThreadTempi == tempi);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(audioSignalAgreesWithSequentialTracking)
+{
+    int hopSize = 512;
+    int numHops = 6000;
+    std::vector<double> audio = createClickTrackAudio (120., hopSize, numHops);
+    std::vector<float> floatAudio (audio.begin(), audio.end());
+
+    SegmentedBTrack segmented (hopSize, 2 * hopSize);
+    segmented.setSegmentLength (20.);
+    segmented.setPreRollLength (8.);
+
+    std::vector<long> beats;
+    std::vector<double> tempi;
+    BeatAgreement agreement = segmented.trackBeatsAndMeasureAgreement (&audio[0], (long) audio.size(), beats, tempi);
+
+    BOOST_CHECK_EQUAL ((long) tempi.size(), (long) numHops);
+    BOOST_CHECK (beats.size() > 100);
+    BOOST_CHECK (beatsAreSpacedOut (beats, tempi, hopSize));
+    BOOST_CHECK (agreement.fMeasure > 0.95);
+
+    std::vector<long> floatBeats;
+    std::vector<double> floatTempi;
+    segmented.trackBeats (&floatAudio[0], (long) floatAudio.size(), floatBeats, floatTempi);
+
+    BOOST_CHECK_EQUAL ((long) floatTempi.size(), (long) numHops);
+    BOOST_CHECK (SegmentedBTrack::measureAgreement (floatBeats, floatTempi, beats, tempi, 6).fMeasure > 0.95);
+}
+
+//======================================================================
+BOOST_AUTO_TEST_CASE(measuringAgreement)
+{
+    std::vector<long> beats;
+    std::vector<long> referenceBeats;
+    std::vector<double> tempi (100, 120.);
+    std::vector<double> referenceTempi (100, 118.);
+
+    // 10 and 31 match 11 and 30, 50 is too far from 45, and 80 has no reference beat
+    beats.push_back (10);
+    beats.push_back (31);
+    beats.push_back (50);
+    beats.push_back (80);
+
+    referenceBeats.push_back (11);
+    referenceBeats.push_back (30);
+    referenceBeats.push_back (45);
+
+    BeatAgreement agreement = SegmentedBTrack::measureAgreement (beats, tempi, referenceBeats, referenceTempi, 2);
+
+    BOOST_CHECK_EQUAL (agreement.numBeats, 4);
+    BOOST_CHECK_EQUAL (agreement.numReferenceBeats, 3);
+    BOOST_CHECK_EQUAL (agreement.numMatchedBeats, 2);
+    BOOST_CHECK_CLOSE (agreement.precision, 0.5, 0.0001);
+    BOOST_CHECK_CLOSE (agreement.recall, 2. / 3., 0.0001);
+    BOOST_CHECK_CLOSE (agreement.fMeasure, 4. / 7., 0.0001);
+    BOOST_CHECK_CLOSE (agreement.meanTempoDifference, 2., 0.0001);
+
+    // no beats agrees perfectly with no beats
+    std::vector<long> noBeats;
+    agreement = SegmentedBTrack::measureAgreement (noBeats, tempi, noBeats, tempi, 2);
+
+    BOOST_CHECK_EQUAL (agreement.fMeasure, 1.);
+    BOOST_CHECK_EQUAL (agreement.meanTempoDifference, 0.);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+//======================================================================
+//======================================================================
+
+#endif